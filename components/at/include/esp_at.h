@@ -46,6 +46,14 @@ bool esp_at_ota_cmd_regist(void);
 bool esp_at_fact_cmd_regist(void);
 #endif
 
+#ifdef CONFIG_AT_BENCH_COMMAND_SUPPORT
+/**
+ * @brief regist at bench command set. If not,you can not use AT+BENCH to measure the AT port throughput
+ *
+ */
+bool esp_at_bench_cmd_regist(void);
+#endif
+
 /**
  * @brief get current module name
  *
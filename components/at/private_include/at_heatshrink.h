@@ -0,0 +1,83 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AT_HEATSHRINK_WINDOW_SZ2_MIN        4
+#define AT_HEATSHRINK_WINDOW_SZ2_MAX        14      // the window is allocated, 16 KB at most
+#define AT_HEATSHRINK_LOOKAHEAD_SZ2_MIN     3
+
+/**
+ * @brief Called with the decompressed bytes, a non-zero return value stops the decoder with an error.
+ *        data points into the window of the decoder and is only valid during the call.
+ */
+typedef int (*at_heatshrink_output_cb_t)(void* arg, const uint8_t* data, size_t len);
+
+/**
+ * @brief Streaming decoder of the heatshrink LZSS bitstream.
+ *
+ *        Bits are read MSB first. A 1 bit is followed by an 8-bit literal, a 0 bit by a back-reference:
+ *        window_sz2 bits of (distance - 1), then lookahead_sz2 bits of (length - 1).
+ *        The window is the only buffer, so the memory use is 2^window_sz2 bytes whatever the input size.
+ *        The members are private.
+ */
+typedef struct {
+    uint8_t* window;
+    uint32_t mask;                          // window size - 1
+    uint32_t pos;                           // bytes decompressed so far
+    uint32_t flushed;                       // bytes given to the output callback so far
+    uint8_t window_sz2;
+    uint8_t lookahead_sz2;
+    uint8_t state;
+    uint8_t need;                           // bits the state needs
+    uint32_t bits;                          // bits read and not used yet, the lowest nbits of it
+    uint8_t nbits;
+    uint16_t index;                         // distance - 1 of the back-reference being read
+    at_heatshrink_output_cb_t output_cb;
+    void* arg;
+} at_heatshrink_decoder_t;
+
+/**
+ * @brief Allocate the window of a decoder.
+ *
+ * @return 0, or -1 if the sizes are out of range or there is not enough memory
+ */
+int at_heatshrink_decoder_init(at_heatshrink_decoder_t* decoder, uint8_t window_sz2, uint8_t lookahead_sz2,
+                               at_heatshrink_output_cb_t output_cb, void* arg);
+
+/**
+ * @brief Decompress the next compressed bytes, the input may be split anywhere.
+ *        The decompressed bytes are given to the output callback before it returns.
+ *
+ * @return 0, or -1 if the input is corrupted or the output callback failed
+ */
+int at_heatshrink_decode(at_heatshrink_decoder_t* decoder, const uint8_t* data, size_t len);
+
+/**
+ * @brief Free the window.
+ */
+void at_heatshrink_decoder_deinit(at_heatshrink_decoder_t* decoder);
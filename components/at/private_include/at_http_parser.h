@@ -0,0 +1,110 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define AT_HTTP_LINE_MAX            256     // status line, header and chunk size lines, longer header lines are truncated
+
+typedef enum {
+    AT_HTTP_STATE_STATUS_LINE = 0,
+    AT_HTTP_STATE_HEADER,
+    AT_HTTP_STATE_BODY,                     // Content-Length body
+    AT_HTTP_STATE_BODY_TO_EOF,              // neither Content-Length nor chunked, the body ends with the connection
+    AT_HTTP_STATE_CHUNK_SIZE,
+    AT_HTTP_STATE_CHUNK_DATA,
+    AT_HTTP_STATE_CHUNK_DATA_END,           // CRLF after the chunk data
+    AT_HTTP_STATE_TRAILER,
+    AT_HTTP_STATE_DONE,
+    AT_HTTP_STATE_ERROR,
+} at_http_state_t;
+
+typedef struct at_http_parser at_http_parser_t;
+
+/**
+ * @brief Parser callbacks, any of them may be NULL. A non-zero return value stops the parser with an error.
+ */
+typedef struct {
+    int (*on_header)(at_http_parser_t* parser, const char* name, const char* value);
+    int (*on_headers_complete)(at_http_parser_t* parser);
+    int (*on_body)(at_http_parser_t* parser, const uint8_t* data, size_t len);
+} at_http_parser_callbacks_t;
+
+/**
+ * @brief Incremental HTTP/1.x response parser.
+ *        The members before line are read-only for the user once the headers are complete.
+ */
+struct at_http_parser {
+    int status_code;
+    int http_minor;                         // 0 for HTTP/1.0, 1 for HTTP/1.1
+    int64_t content_length;                 // -1 if the response has no Content-Length
+    bool chunked;
+    bool keep_alive;                        // the connection can carry another request after this response
+    int64_t body_len;                       // body bytes passed to on_body so far
+    void* arg;                              // user data for the callbacks
+
+    at_http_state_t state;
+    const at_http_parser_callbacks_t* callbacks;
+    bool no_body;
+    uint64_t remain;
+    char line[AT_HTTP_LINE_MAX];
+    size_t line_len;
+};
+
+/**
+ * @brief Initialize a parser for one response.
+ *
+ * @param parser the parser
+ * @param callbacks callbacks, must stay valid while the parser is used
+ * @param head_request true if the response answers a HEAD request and has no body
+ * @param arg user data, stored in parser->arg
+ */
+void at_http_parser_init(at_http_parser_t* parser, const at_http_parser_callbacks_t* callbacks, bool head_request, void* arg);
+
+/**
+ * @brief Feed received bytes, they may be split anywhere.
+ *        Body bytes are passed to on_body in place, without being copied.
+ *
+ * @param parser the parser
+ * @param data received bytes
+ * @param len length of data
+ *
+ * @return bytes consumed, less than len if the response is complete before the end of data, -1 on error
+ */
+int at_http_parser_execute(at_http_parser_t* parser, const uint8_t* data, size_t len);
+
+/**
+ * @brief Tell the parser that the connection is closed.
+ *
+ * @return 0 if the response is complete, -1 otherwise
+ */
+int at_http_parser_finish(at_http_parser_t* parser);
+
+/**
+ * @brief Whether the whole response has been parsed.
+ */
+bool at_http_parser_is_done(const at_http_parser_t* parser);
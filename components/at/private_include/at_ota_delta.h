@@ -0,0 +1,116 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "at_heatshrink.h"
+
+#define AT_OTA_DELTA_MAGIC                  "ATDP"
+#define AT_OTA_DELTA_MAGIC_LEN              4
+#define AT_OTA_DELTA_VERSION                1
+#define AT_OTA_DELTA_HEADER_LEN             80
+#define AT_OTA_DELTA_SOURCE_BUFFER_SIZE     256
+
+/**
+ * @brief Patch header, little endian on the wire:
+ *        magic[4] "ATDP", version, window_sz2, lookahead_sz2, reserved,
+ *        source_size u32, target_size u32, source_sha256[32], target_sha256[32]
+ */
+typedef struct {
+    uint8_t version;
+    uint8_t window_sz2;                     // heatshrink parameters of the patch body
+    uint8_t lookahead_sz2;
+    uint32_t source_size;                   // the image the patch applies to
+    uint32_t target_size;                   // the image the patch produces
+    uint8_t source_sha256[32];
+    uint8_t target_sha256[32];
+} at_ota_delta_header_t;
+
+typedef struct at_ota_delta at_ota_delta_t;
+
+/**
+ * @brief Patch callbacks, a non-zero return value stops the patch with an error.
+ */
+typedef struct {
+    int (*on_header)(at_ota_delta_t* delta, const at_ota_delta_header_t* header);   // may be NULL
+    int (*read_source)(at_ota_delta_t* delta, uint32_t offset, uint8_t* data, size_t len);
+    int (*on_target)(at_ota_delta_t* delta, const uint8_t* data, size_t len);
+} at_ota_delta_callbacks_t;
+
+/**
+ * @brief Streaming applier of a binary patch.
+ *
+ *        After the header, the patch body is heatshrink compressed. Once decompressed it is a sequence of
+ *        records, each one a control block of three little endian 32-bit values (diff_len, extra_len, seek)
+ *        followed by diff_len diff bytes and extra_len extra bytes:
+ *        - diff byte i is added (mod 256) to the source byte at the source cursor + i, the cursor then
+ *          moves diff_len forward,
+ *        - extra bytes are copied to the target as they are,
+ *        - seek, signed, then moves the source cursor.
+ *        The target is produced in order, so it can be written while the patch is downloaded.
+ *        The members before the private part are read-only for the user.
+ */
+struct at_ota_delta {
+    at_ota_delta_header_t header;           // valid once on_header is called
+    uint32_t target_len;                    // target bytes produced so far
+    void* arg;
+
+    const at_ota_delta_callbacks_t* callbacks;
+    uint8_t state;
+    uint32_t len;                           // bytes of the header or control block read so far
+    uint8_t raw[AT_OTA_DELTA_HEADER_LEN];   // the header, then the control block
+    uint32_t diff_left;
+    uint32_t extra_left;
+    int32_t seek;
+    uint32_t source_pos;
+    at_heatshrink_decoder_t decoder;
+    uint8_t source[AT_OTA_DELTA_SOURCE_BUFFER_SIZE];
+};
+
+/**
+ * @brief Check the first bytes of an image.
+ *
+ * @return true if data starts with the patch magic, len must be AT_OTA_DELTA_MAGIC_LEN at least
+ */
+bool at_ota_delta_is_patch(const uint8_t* data, size_t len);
+
+void at_ota_delta_init(at_ota_delta_t* delta, const at_ota_delta_callbacks_t* callbacks, void* arg);
+
+/**
+ * @brief Apply the next bytes of the patch, the input may be split anywhere.
+ *
+ * @return 0, or -1 if the patch is corrupted, does not fit the source or a callback failed
+ */
+int at_ota_delta_execute(at_ota_delta_t* delta, const uint8_t* data, size_t len);
+
+/**
+ * @brief End the patch and free it.
+ *
+ * @return 0 if the whole target was produced, -1 otherwise
+ */
+int at_ota_delta_finish(at_ota_delta_t* delta);
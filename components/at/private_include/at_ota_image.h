@@ -0,0 +1,76 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define AT_OTA_IMAGE_COMPRESSED_MAGIC       "ATCZ"
+#define AT_OTA_IMAGE_MAGIC_LEN              4
+#define AT_OTA_IMAGE_COMPRESSED_VERSION     1
+#define AT_OTA_IMAGE_COMPRESSED_HEADER_LEN  12
+
+typedef struct at_ota_image at_ota_image_t;
+
+/**
+ * @brief Start writing an image that may come compressed into a partition, through the OTA pipeline.
+ *        The first bytes tell the image apart:
+ *        - a compressed image starts with the 12-byte header, little endian on the wire:
+ *          magic[4] "ATCZ", version, window_sz2, lookahead_sz2, reserved, image size u32,
+ *          followed by the heatshrink compressed image, see tools/esp_at_ota_compress.py,
+ *        - anything else is a plain image, written as it is.
+ *        The pipeline starts once the image size is known, a compressed image is decompressed
+ *        into it with a window of 2^window_sz2 bytes.
+ *
+ * @param partition the partition to write
+ * @param image_len size of a plain image, 0 if unknown, a compressed image tells its own
+ *
+ * @return the image, NULL if there is not enough memory
+ */
+at_ota_image_t* at_ota_image_start(const esp_partition_t* partition, uint32_t image_len);
+
+/**
+ * @brief Write the next received bytes, the input may be split anywhere.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the image does not fit the partition or its header,
+ *         ESP_ERR_NOT_SUPPORTED if the window is larger than CONFIG_AT_OTA_COMPRESS_WINDOW_SZ2_MAX,
+ *         ESP_ERR_INVALID_RESPONSE if the compressed data is corrupted, or the error of the pipeline
+ */
+esp_err_t at_ota_image_write(at_ota_image_t* image, const uint8_t* data, size_t len);
+
+/**
+ * @brief End the pipeline, then free the image.
+ *
+ * @param image the image
+ * @param complete true if every byte is received
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if a compressed image is shorter than its header tells,
+ *         or the first error of the image
+ */
+esp_err_t at_ota_image_end(at_ota_image_t* image, bool complete);
@@ -0,0 +1,99 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define AT_OTA_PIPELINE_WRITE_ALIGN         16      // flash encryption writes 16 bytes at a time
+
+/**
+ * @brief Time spent in each stage of a pipelined OTA write, in microseconds.
+ */
+typedef struct {
+    uint32_t bytes;                         // image bytes written to flash
+    uint32_t total_us;                      // from at_ota_pipeline_start to at_ota_pipeline_end
+    uint32_t recv_wait_us;                  // receive stage waiting for a free buffer, flash is the bottleneck
+    uint32_t write_idle_us;                 // flash writer waiting for data, the network is the bottleneck
+    uint32_t erase_us;                      // flash writer erasing sectors
+    uint32_t write_us;                      // flash writer writing
+} at_ota_pipeline_stats_t;
+
+/**
+ * @brief Called in the flash writer task once data is in flash. A piece never crosses a sector boundary.
+ *        A return value other than ESP_OK fails the pipeline.
+ *
+ * @param arg user data given to at_ota_pipeline_start
+ * @param data the image bytes
+ * @param len length of data, the padding of the last piece is not included
+ * @param offset offset of data in the partition
+ */
+typedef esp_err_t (*at_ota_pipeline_written_cb_t)(void* arg, const uint8_t* data, size_t len, uint32_t offset);
+
+typedef struct at_ota_pipeline at_ota_pipeline_t;
+
+/**
+ * @brief Start writing an image into a partition from a flash writer task.
+ *        The caller is the receive stage: it copies the image into a ring of buffers with
+ *        at_ota_pipeline_write, while the flash writer task drains them into the partition
+ *        and erases the sectors ahead of its write cursor whenever it has nothing to write.
+ *
+ * @param partition the partition to write, an app partition must receive an app image
+ * @param offset where the image continues in the partition, 0 for a new image. Inside a sector, the rest of
+ *        the sector must be erased, as an earlier pipeline that ended there leaves it
+ * @param image_len size of the whole image, 0 if unknown
+ * @param written_cb called after each write, may be NULL
+ * @param arg user data for written_cb
+ *
+ * @return the pipeline, NULL if there is not enough memory, or if an app partition can not be updated now:
+ *         it is the running one, or the running app has not confirmed itself since an update (rollback enabled)
+ */
+at_ota_pipeline_t* at_ota_pipeline_start(const esp_partition_t* partition, uint32_t offset, uint32_t image_len,
+                                         at_ota_pipeline_written_cb_t written_cb, void* arg);
+
+/**
+ * @brief Queue the next bytes of the image, blocks while every buffer is waiting for flash.
+ *
+ * @return ESP_OK, or the first error of the pipeline, such as ESP_ERR_OTA_VALIDATE_FAILED
+ *         if an app image does not start with the image magic
+ */
+esp_err_t at_ota_pipeline_write(at_ota_pipeline_t* pipeline, const uint8_t* data, size_t len);
+
+/**
+ * @brief Wait for the flash writer, then free the pipeline and print its stats.
+ *
+ * @param pipeline the pipeline
+ * @param complete true if the whole image is queued, the tail is then padded to the write alignment and
+ *        written, otherwise the tail shorter than the write alignment is dropped
+ * @param stats where to copy the stats, may be NULL
+ *
+ * @return ESP_OK, or the first error of the pipeline. A complete app image is verified as by esp_ota_end(),
+ *         ESP_ERR_OTA_VALIDATE_FAILED if it is not valid
+ */
+esp_err_t at_ota_pipeline_end(at_ota_pipeline_t* pipeline, bool complete, at_ota_pipeline_stats_t* stats);
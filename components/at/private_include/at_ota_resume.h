@@ -0,0 +1,119 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+
+#define AT_OTA_RESUME_ETAG_LEN_MAX          64
+
+/**
+ * @brief Download of an image into a partition that can be continued after the connection drops.
+ *
+ *        The image is written to the partition by an OTA pipeline (at_ota_pipeline.h) started at offset,
+ *        with at_ota_resume_written as its written callback, and the progress (offset, SHA-256
+ *        of the bytes written so far and ETag) is saved to NVS at sector boundaries. A later download
+ *        of the same source into the same partition checks the SHA-256 of what is in flash and
+ *        continues from the saved offset with a Range request.
+ *        The members before the private part are read-only for the user.
+ */
+typedef struct {
+    const esp_partition_t* partition;           // NULL once the download is ended or aborted
+    uint32_t offset;                            // image bytes in flash, the next request starts here
+    int32_t total_len;                          // image size, -1 if the server does not tell it
+    char etag[AT_OTA_RESUME_ETAG_LEN_MAX + 1];  // ETag of the image, empty if the server has none
+
+    uint32_t saved;                             // offset of the last saved progress
+    uint8_t source[32];                         // SHA-256 of the source, such as the URL
+    mbedtls_sha256_context sha;                 // SHA-256 of the first offset bytes
+} at_ota_resume_t;
+
+/**
+ * @brief Start or continue a download into a partition.
+ *        The saved progress is used if it is for the same partition and source and the flash
+ *        still holds the same bytes, otherwise the download starts from zero.
+ *
+ * @param resume the download
+ * @param partition the partition to write, an app partition must receive an app image
+ * @param source identifies the image, such as its URL, the progress of another source is dropped
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM
+ */
+esp_err_t at_ota_resume_begin(at_ota_resume_t* resume, const esp_partition_t* partition, const char* source);
+
+/**
+ * @brief Format the Range and If-Range request headers, each ended with CRLF.
+ *
+ * @return length of the headers, 0 if the download starts from zero
+ */
+int at_ota_resume_request_headers(const at_ota_resume_t* resume, char* buf, size_t size);
+
+/**
+ * @brief Check the response to a request, before its body is written.
+ *        A 200 response restarts the download from zero, a 206 response must continue at offset.
+ *
+ * @param resume the download
+ * @param status_code HTTP status code
+ * @param content_range Content-Range header, NULL or empty if none
+ * @param etag ETag header, NULL or empty if none
+ * @param content_length Content-Length of the response, -1 if none
+ *
+ * @return ESP_OK if the body can be written, ESP_ERR_INVALID_SIZE if the image does not fit,
+ *         ESP_ERR_INVALID_RESPONSE if the response does not continue the download (the next request
+ *         starts from zero), ESP_FAIL for other status codes
+ */
+esp_err_t at_ota_resume_response(at_ota_resume_t* resume, int status_code, const char* content_range, const char* etag, int64_t content_length);
+
+/**
+ * @brief Account for image bytes that are in flash, the written callback of the OTA pipeline.
+ *
+ * @param arg the download
+ * @param data the image bytes
+ * @param len length of data
+ * @param offset offset of data in the partition, must be the offset of the download
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if the data does not continue the download
+ */
+esp_err_t at_ota_resume_written(void* arg, const uint8_t* data, size_t len, uint32_t offset);
+
+/**
+ * @brief End a complete download, the saved progress is dropped.
+ *
+ * @param resume the download
+ * @param digest the SHA-256 of the image, may be NULL
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if the image is empty or shorter than total_len
+ */
+esp_err_t at_ota_resume_end(at_ota_resume_t* resume, uint8_t digest[32]);
+
+/**
+ * @brief Stop a download that failed, the saved progress is kept for the next one.
+ *        Does nothing if the download is already ended.
+ */
+void at_ota_resume_abort(at_ota_resume_t* resume);
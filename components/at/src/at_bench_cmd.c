@@ -0,0 +1,290 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_timer.h"
+#include "esp_at_core.h"
+#include "esp_at.h"
+
+#ifdef CONFIG_AT_BENCH_COMMAND_SUPPORT
+
+#define AT_BENCH_BUFFER_SIZE            4096
+#define AT_BENCH_LEN_MAX                (64 * 1024 * 1024)
+#define AT_BENCH_INTERVAL_MAX_MS        10000
+#define AT_BENCH_RX_TIMEOUT_MS          10000   // abort the sink when the host sends nothing for this long
+
+typedef enum {
+    AT_BENCH_SOURCE = 0,    // device -> host
+    AT_BENCH_SINK,          // host -> device
+    AT_BENCH_MAX,
+} at_bench_mode_t;
+
+typedef struct {
+    int32_t mode;
+    int32_t len;
+    int64_t time_us;
+    int32_t errors;
+} at_bench_result_t;
+
+static at_bench_result_t s_at_bench_result = {
+    .mode = -1,
+};
+static xSemaphoreHandle s_at_bench_sync_sema;
+
+// byte at offset n of the benchmark stream, a dropped or duplicated block of up to 64 KB shows up as a mismatch
+static inline uint8_t at_bench_pattern(uint32_t offset)
+{
+    return (uint8_t)(offset + (offset >> 8));
+}
+
+static void at_bench_pattern_fill(uint8_t* buf, uint32_t offset, int32_t len)
+{
+    for (int32_t loop = 0; loop < len; loop++) {
+        buf[loop] = at_bench_pattern(offset + loop);
+    }
+}
+
+static int32_t at_bench_pattern_check(const uint8_t* buf, uint32_t offset, int32_t len)
+{
+    int32_t errors = 0;
+
+    for (int32_t loop = 0; loop < len; loop++) {
+        if (buf[loop] != at_bench_pattern(offset + loop)) {
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+static void at_bench_wait_data_cb(void)
+{
+    xSemaphoreGive(s_at_bench_sync_sema);
+}
+
+static void at_bench_result_output(uint8_t* cmd_name)
+{
+    uint8_t buffer[64];
+
+    snprintf((char*)buffer, sizeof(buffer), "\r\n%s:%d,%d,%lld,%d\r\n", cmd_name, s_at_bench_result.mode,
+             s_at_bench_result.len, s_at_bench_result.time_us, s_at_bench_result.errors);
+    esp_at_port_write_data(buffer, strlen((char*)buffer));
+}
+
+// write len bytes of the pattern to the AT port, chunk bytes every interval_ms
+static uint8_t at_bench_source(int32_t len, int32_t chunk, int32_t interval_ms)
+{
+    uint8_t header[32];
+    uint8_t* buf = NULL;
+    int32_t offset = 0;
+    int32_t write_len = 0;
+    int32_t errors = 0;
+    int64_t start_us = 0;
+
+    buf = (uint8_t*)malloc(chunk);
+    if (buf == NULL) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    // the host reads exactly len raw bytes after the header
+    snprintf((char*)header, sizeof(header), "+BENCH:%d,", len);
+    esp_at_port_write_data(header, strlen((char*)header));
+
+    start_us = esp_timer_get_time();
+    while (offset < len) {
+        write_len = (len - offset > chunk) ? chunk : len - offset;
+        at_bench_pattern_fill(buf, offset, write_len);
+        if (esp_at_port_write_data(buf, write_len) != write_len) {
+            errors++;
+        }
+        offset += write_len;
+
+        if (interval_ms > 0 && offset < len) {
+            vTaskDelay(interval_ms / portTICK_PERIOD_MS);
+        }
+    }
+    esp_at_port_wait_write_complete(ESP_AT_PORT_TX_WAIT_MS_MAX);
+
+    s_at_bench_result.mode = AT_BENCH_SOURCE;
+    s_at_bench_result.len = len;
+    s_at_bench_result.time_us = esp_timer_get_time() - start_us;
+    s_at_bench_result.errors = errors;
+
+    free(buf);
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+// read len bytes from the AT port after the '>' prompt and check them against the pattern
+static uint8_t at_bench_sink(int32_t len)
+{
+    uint8_t* buf = NULL;
+    int32_t received = 0;
+    int32_t read_len = 0;
+    int32_t errors = 0;
+    int64_t start_us = 0;
+
+    buf = (uint8_t*)malloc(AT_BENCH_BUFFER_SIZE);
+    if (buf == NULL) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    s_at_bench_sync_sema = xSemaphoreCreateBinary();
+    if (s_at_bench_sync_sema == NULL) {
+        free(buf);
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    esp_at_port_enter_specific(at_bench_wait_data_cb);
+    esp_at_response_result(ESP_AT_RESULT_CODE_OK_AND_INPUT_PROMPT);
+
+    while (received < len) {
+        if (xSemaphoreTake(s_at_bench_sync_sema, AT_BENCH_RX_TIMEOUT_MS / portTICK_PERIOD_MS) != pdTRUE) {
+            break;
+        }
+
+        do {
+            read_len = (len - received > AT_BENCH_BUFFER_SIZE) ? AT_BENCH_BUFFER_SIZE : len - received;
+            read_len = esp_at_port_read_data(buf, read_len);
+            if (read_len <= 0) {
+                break;
+            }
+            if (start_us == 0) {
+                start_us = esp_timer_get_time();
+            }
+            errors += at_bench_pattern_check(buf, received, read_len);
+            received += read_len;
+        } while (received < len && esp_at_port_get_data_length() > 0);
+    }
+    esp_at_port_exit_specific();
+
+    s_at_bench_result.mode = AT_BENCH_SINK;
+    s_at_bench_result.len = received;
+    s_at_bench_result.time_us = (start_us == 0) ? 0 : esp_timer_get_time() - start_us;
+    // the missing bytes count as errors
+    s_at_bench_result.errors = errors + (len - received);
+
+    vSemaphoreDelete(s_at_bench_sync_sema);
+    s_at_bench_sync_sema = NULL;
+    free(buf);
+
+    // pass the data following the benchmark stream back to the AT core
+    read_len = esp_at_port_get_data_length();
+    if (read_len > 0) {
+        esp_at_port_recv_data_notify(read_len, portMAX_DELAY);
+    }
+
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+static uint8_t at_setup_cmd_bench(uint8_t para_num)
+{
+    int32_t cnt = 0, mode = 0, len = 0, chunk = AT_BENCH_BUFFER_SIZE, interval_ms = 0;
+    uint8_t ret = ESP_AT_RESULT_CODE_ERROR;
+
+    // mode
+    if (esp_at_get_para_as_digit(cnt++, &mode) != ESP_AT_PARA_PARSE_RESULT_OK) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+    if (mode < AT_BENCH_SOURCE || mode >= AT_BENCH_MAX) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    // length
+    if (esp_at_get_para_as_digit(cnt++, &len) != ESP_AT_PARA_PARSE_RESULT_OK) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+    if (len <= 0 || len > AT_BENCH_LEN_MAX) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    // chunk size and interval, only for the source
+    if (mode == AT_BENCH_SOURCE) {
+        if (cnt != para_num) {
+            if (esp_at_get_para_as_digit(cnt++, &chunk) == ESP_AT_PARA_PARSE_RESULT_FAIL) {
+                return ESP_AT_RESULT_CODE_ERROR;
+            }
+            if (chunk <= 0 || chunk > AT_BENCH_BUFFER_SIZE) {
+                return ESP_AT_RESULT_CODE_ERROR;
+            }
+        }
+        if (cnt != para_num) {
+            if (esp_at_get_para_as_digit(cnt++, &interval_ms) == ESP_AT_PARA_PARSE_RESULT_FAIL) {
+                return ESP_AT_RESULT_CODE_ERROR;
+            }
+            if (interval_ms < 0 || interval_ms > AT_BENCH_INTERVAL_MAX_MS) {
+                return ESP_AT_RESULT_CODE_ERROR;
+            }
+        }
+    }
+
+    // parameters are ready
+    if (cnt != para_num) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    if (mode == AT_BENCH_SOURCE) {
+        ret = at_bench_source(len, chunk, interval_ms);
+    } else {
+        ret = at_bench_sink(len);
+    }
+
+    if (ret == ESP_AT_RESULT_CODE_OK) {
+        at_bench_result_output((uint8_t*)"+BENCH");
+    }
+
+    return ret;
+}
+
+static uint8_t at_query_cmd_bench(uint8_t* cmd_name)
+{
+    if (s_at_bench_result.mode < 0) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    at_bench_result_output(cmd_name);
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+// does nothing, the host measures the command round-trip latency with it
+static uint8_t at_exe_cmd_bench(uint8_t* cmd_name)
+{
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+static esp_at_cmd_struct at_bench_cmd[] = {
+    {"+BENCH", NULL, at_query_cmd_bench, at_setup_cmd_bench, at_exe_cmd_bench},
+};
+
+bool esp_at_bench_cmd_regist(void)
+{
+    return esp_at_custom_cmd_array_regist(at_bench_cmd, sizeof(at_bench_cmd) / sizeof(at_bench_cmd[0]));
+}
+#endif
@@ -0,0 +1,181 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "at_heatshrink.h"
+
+enum {
+    AT_HEATSHRINK_STATE_TAG = 0,
+    AT_HEATSHRINK_STATE_LITERAL,
+    AT_HEATSHRINK_STATE_INDEX,
+    AT_HEATSHRINK_STATE_COUNT,
+    AT_HEATSHRINK_STATE_ERROR,
+};
+
+// Give the bytes decompressed since the last flush to the output, as at most two pieces of the window
+static int at_heatshrink_flush(at_heatshrink_decoder_t* decoder)
+{
+    uint32_t start = decoder->flushed & decoder->mask;
+    uint32_t len = decoder->pos - decoder->flushed;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (start + len > decoder->mask + 1) {
+        if (decoder->output_cb(decoder->arg, decoder->window + start, decoder->mask + 1 - start) != 0) {
+            return -1;
+        }
+        len -= decoder->mask + 1 - start;
+        start = 0;
+    }
+    if (decoder->output_cb(decoder->arg, decoder->window + start, len) != 0) {
+        return -1;
+    }
+    decoder->flushed = decoder->pos;
+
+    return 0;
+}
+
+static int at_heatshrink_put(at_heatshrink_decoder_t* decoder, uint8_t byte)
+{
+    decoder->window[decoder->pos & decoder->mask] = byte;
+    decoder->pos++;
+
+    // the window is full of bytes the output has not seen
+    if (decoder->pos - decoder->flushed > decoder->mask) {
+        return at_heatshrink_flush(decoder);
+    }
+    return 0;
+}
+
+static int at_heatshrink_step(at_heatshrink_decoder_t* decoder, uint32_t value)
+{
+    uint32_t distance = 0;
+    uint32_t count = 0;
+
+    switch (decoder->state) {
+    case AT_HEATSHRINK_STATE_TAG:
+        if (value) {
+            decoder->state = AT_HEATSHRINK_STATE_LITERAL;
+            decoder->need = 8;
+        } else {
+            decoder->state = AT_HEATSHRINK_STATE_INDEX;
+            decoder->need = decoder->window_sz2;
+        }
+        return 0;
+
+    case AT_HEATSHRINK_STATE_LITERAL:
+        decoder->state = AT_HEATSHRINK_STATE_TAG;
+        decoder->need = 1;
+        return at_heatshrink_put(decoder, (uint8_t)value);
+
+    case AT_HEATSHRINK_STATE_INDEX:
+        decoder->index = (uint16_t)value;
+        decoder->state = AT_HEATSHRINK_STATE_COUNT;
+        decoder->need = decoder->lookahead_sz2;
+        return 0;
+
+    case AT_HEATSHRINK_STATE_COUNT:
+        distance = (uint32_t)decoder->index + 1;
+        if (distance > decoder->pos) {
+            return -1;                      // before the start of the output
+        }
+        // byte by byte, a back-reference may overlap the bytes it produces
+        for (count = value + 1; count > 0; count--) {
+            if (at_heatshrink_put(decoder, decoder->window[(decoder->pos - distance) & decoder->mask]) != 0) {
+                return -1;
+            }
+        }
+        decoder->state = AT_HEATSHRINK_STATE_TAG;
+        decoder->need = 1;
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+int at_heatshrink_decoder_init(at_heatshrink_decoder_t* decoder, uint8_t window_sz2, uint8_t lookahead_sz2,
+                               at_heatshrink_output_cb_t output_cb, void* arg)
+{
+    memset(decoder, 0x0, sizeof(at_heatshrink_decoder_t));
+
+    if (window_sz2 < AT_HEATSHRINK_WINDOW_SZ2_MIN || window_sz2 > AT_HEATSHRINK_WINDOW_SZ2_MAX
+        || lookahead_sz2 < AT_HEATSHRINK_LOOKAHEAD_SZ2_MIN || lookahead_sz2 >= window_sz2 || output_cb == NULL) {
+        return -1;
+    }
+
+    decoder->window = (uint8_t*)malloc(1 << window_sz2);
+    if (decoder->window == NULL) {
+        return -1;
+    }
+    decoder->mask = (1 << window_sz2) - 1;
+    decoder->window_sz2 = window_sz2;
+    decoder->lookahead_sz2 = lookahead_sz2;
+    decoder->state = AT_HEATSHRINK_STATE_TAG;
+    decoder->need = 1;
+    decoder->output_cb = output_cb;
+    decoder->arg = arg;
+
+    return 0;
+}
+
+int at_heatshrink_decode(at_heatshrink_decoder_t* decoder, const uint8_t* data, size_t len)
+{
+    uint32_t value = 0;
+    size_t i = 0;
+
+    if (decoder->state == AT_HEATSHRINK_STATE_ERROR) {
+        return -1;
+    }
+
+    for (i = 0; i < len; i++) {
+        // at most need - 1 + 8 bits, need is 15 at most
+        decoder->bits = (decoder->bits << 8) | data[i];
+        decoder->nbits += 8;
+
+        while (decoder->nbits >= decoder->need) {
+            decoder->nbits -= decoder->need;
+            value = (decoder->bits >> decoder->nbits) & ((1 << decoder->need) - 1);
+            if (at_heatshrink_step(decoder, value) != 0) {
+                decoder->state = AT_HEATSHRINK_STATE_ERROR;
+                return -1;
+            }
+        }
+        decoder->bits &= (1 << decoder->nbits) - 1;
+    }
+
+    if (at_heatshrink_flush(decoder) != 0) {
+        decoder->state = AT_HEATSHRINK_STATE_ERROR;
+        return -1;
+    }
+    return 0;
+}
+
+void at_heatshrink_decoder_deinit(at_heatshrink_decoder_t* decoder)
+{
+    free(decoder->window);
+    decoder->window = NULL;
+}
@@ -0,0 +1,320 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "at_http_parser.h"
+
+// no real response comes close, it only keeps the chunk size arithmetic away from overflows
+#define AT_HTTP_LENGTH_MAX          (1ULL << 60)
+
+static int at_http_parse_length(const char* str, int base, uint64_t* value)
+{
+    uint64_t result = 0;
+    int digits = 0;
+
+    for (; *str; str++, digits++) {
+        int digit;
+
+        if (*str >= '0' && *str <= '9') {
+            digit = *str - '0';
+        } else if (base == 16 && *str >= 'a' && *str <= 'f') {
+            digit = *str - 'a' + 10;
+        } else if (base == 16 && *str >= 'A' && *str <= 'F') {
+            digit = *str - 'A' + 10;
+        } else {
+            break;
+        }
+
+        result = result * base + digit;
+        if (result > AT_HTTP_LENGTH_MAX) {
+            return -1;
+        }
+    }
+
+    if (digits == 0) {
+        return -1;
+    }
+
+    *value = result;
+    return (int)digits;
+}
+
+// true if the comma separated list contains token, case insensitive
+static bool at_http_list_has_token(const char* list, const char* token)
+{
+    size_t token_len = strlen(token);
+
+    while (*list) {
+        const char* end = NULL;
+        size_t len = 0;
+
+        while (*list == ' ' || *list == '\t' || *list == ',') {
+            list++;
+        }
+
+        end = strchr(list, ',');
+        len = end ? (size_t)(end - list) : strlen(list);
+        while (len > 0 && (list[len - 1] == ' ' || list[len - 1] == '\t')) {
+            len--;
+        }
+
+        if (len == token_len && strncasecmp(list, token, len) == 0) {
+            return true;
+        }
+
+        list += end ? (size_t)(end - list) : strlen(list);
+    }
+
+    return false;
+}
+
+static int at_http_parse_status_line(at_http_parser_t* parser)
+{
+    const char* line = parser->line;
+
+    // HTTP/1.x SSS reason
+    if (strncmp(line, "HTTP/1.", 7) != 0 || !isdigit((unsigned char)line[7]) || line[8] != ' ') {
+        return -1;
+    }
+
+    if (!isdigit((unsigned char)line[9]) || !isdigit((unsigned char)line[10]) || !isdigit((unsigned char)line[11])
+            || (line[12] != ' ' && line[12] != '\0')) {
+        return -1;
+    }
+
+    parser->http_minor = line[7] - '0';
+    parser->status_code = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+    parser->keep_alive = (parser->http_minor >= 1);
+    parser->state = AT_HTTP_STATE_HEADER;
+    return 0;
+}
+
+static int at_http_parse_header(at_http_parser_t* parser)
+{
+    char* name = parser->line;
+    char* value = strchr(name, ':');
+    char* end = NULL;
+    uint64_t length = 0;
+
+    // obsolete line folding and other malformed lines carry nothing this parser needs
+    if (value == NULL || value == name || name[0] == ' ' || name[0] == '\t') {
+        return 0;
+    }
+
+    *value++ = '\0';
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+    end = value + strlen(value);
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+        *--end = '\0';
+    }
+
+    if (strcasecmp(name, "Content-Length") == 0) {
+        if (at_http_parse_length(value, 10, &length) != (int)strlen(value)) {
+            return -1;
+        }
+        // repeated Content-Length headers must agree, otherwise the body can not be delimited
+        if (parser->content_length >= 0 && (uint64_t)parser->content_length != length) {
+            return -1;
+        }
+        parser->content_length = (int64_t)length;
+    } else if (strcasecmp(name, "Transfer-Encoding") == 0) {
+        // chunked is always the last transfer coding when present
+        size_t len = strlen(value);
+        parser->chunked = (len >= 7 && strcasecmp(value + len - 7, "chunked") == 0);
+    } else if (strcasecmp(name, "Connection") == 0) {
+        if (at_http_list_has_token(value, "close")) {
+            parser->keep_alive = false;
+        } else if (at_http_list_has_token(value, "keep-alive")) {
+            parser->keep_alive = true;
+        }
+    }
+
+    if (parser->callbacks && parser->callbacks->on_header) {
+        return parser->callbacks->on_header(parser, name, value);
+    }
+
+    return 0;
+}
+
+static int at_http_headers_complete(at_http_parser_t* parser)
+{
+    // an interim response such as 100 Continue is followed by the real one
+    if (parser->status_code >= 100 && parser->status_code < 200) {
+        parser->content_length = -1;
+        parser->chunked = false;
+        parser->state = AT_HTTP_STATE_STATUS_LINE;
+        return 0;
+    }
+
+    if (parser->no_body || parser->status_code == 204 || parser->status_code == 304) {
+        parser->state = AT_HTTP_STATE_DONE;
+    } else if (parser->chunked) {
+        parser->state = AT_HTTP_STATE_CHUNK_SIZE;
+    } else if (parser->content_length >= 0) {
+        parser->remain = (uint64_t)parser->content_length;
+        parser->state = (parser->remain > 0) ? AT_HTTP_STATE_BODY : AT_HTTP_STATE_DONE;
+    } else {
+        parser->keep_alive = false;
+        parser->state = AT_HTTP_STATE_BODY_TO_EOF;
+    }
+
+    if (parser->callbacks && parser->callbacks->on_headers_complete) {
+        return parser->callbacks->on_headers_complete(parser);
+    }
+
+    return 0;
+}
+
+static int at_http_parse_line(at_http_parser_t* parser)
+{
+    uint64_t size = 0;
+
+    switch (parser->state) {
+    case AT_HTTP_STATE_STATUS_LINE:
+        // tolerate empty lines before the status line
+        return (parser->line_len == 0) ? 0 : at_http_parse_status_line(parser);
+
+    case AT_HTTP_STATE_HEADER:
+        return (parser->line_len == 0) ? at_http_headers_complete(parser) : at_http_parse_header(parser);
+
+    case AT_HTTP_STATE_CHUNK_SIZE:
+        // chunk extensions after ';' are ignored
+        if (at_http_parse_length(parser->line, 16, &size) < 0) {
+            return -1;
+        }
+        if (size == 0) {
+            parser->state = AT_HTTP_STATE_TRAILER;
+        } else {
+            parser->remain = size;
+            parser->state = AT_HTTP_STATE_CHUNK_DATA;
+        }
+        return 0;
+
+    case AT_HTTP_STATE_CHUNK_DATA_END:
+        if (parser->line_len != 0) {
+            return -1;
+        }
+        parser->state = AT_HTTP_STATE_CHUNK_SIZE;
+        return 0;
+
+    case AT_HTTP_STATE_TRAILER:
+        if (parser->line_len == 0) {
+            parser->state = AT_HTTP_STATE_DONE;
+        }
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+void at_http_parser_init(at_http_parser_t* parser, const at_http_parser_callbacks_t* callbacks, bool head_request, void* arg)
+{
+    memset(parser, 0x0, sizeof(at_http_parser_t));
+    parser->content_length = -1;
+    parser->callbacks = callbacks;
+    parser->no_body = head_request;
+    parser->arg = arg;
+    parser->state = AT_HTTP_STATE_STATUS_LINE;
+}
+
+int at_http_parser_execute(at_http_parser_t* parser, const uint8_t* data, size_t len)
+{
+    size_t pos = 0;
+
+    if (parser->state == AT_HTTP_STATE_ERROR || (data == NULL && len > 0)) {
+        return -1;
+    }
+
+    while (pos < len && parser->state != AT_HTTP_STATE_DONE) {
+        if (parser->state == AT_HTTP_STATE_BODY || parser->state == AT_HTTP_STATE_CHUNK_DATA
+                || parser->state == AT_HTTP_STATE_BODY_TO_EOF) {
+            size_t body_len = len - pos;
+
+            if (parser->state != AT_HTTP_STATE_BODY_TO_EOF && body_len > parser->remain) {
+                body_len = (size_t)parser->remain;
+            }
+
+            if (parser->callbacks && parser->callbacks->on_body
+                    && parser->callbacks->on_body(parser, data + pos, body_len) != 0) {
+                parser->state = AT_HTTP_STATE_ERROR;
+                return -1;
+            }
+
+            parser->body_len += body_len;
+            pos += body_len;
+
+            if (parser->state != AT_HTTP_STATE_BODY_TO_EOF) {
+                parser->remain -= body_len;
+                if (parser->remain == 0) {
+                    parser->state = (parser->state == AT_HTTP_STATE_BODY) ? AT_HTTP_STATE_DONE : AT_HTTP_STATE_CHUNK_DATA_END;
+                }
+            }
+            continue;
+        }
+
+        // the other states are made of lines, ended by LF with an optional CR
+        uint8_t byte = data[pos++];
+
+        if (byte != '\n') {
+            if (parser->line_len < AT_HTTP_LINE_MAX - 1) {
+                parser->line[parser->line_len++] = (char)byte;
+            }
+            continue;
+        }
+
+        if (parser->line_len > 0 && parser->line[parser->line_len - 1] == '\r') {
+            parser->line_len--;
+        }
+        parser->line[parser->line_len] = '\0';
+
+        if (at_http_parse_line(parser) != 0) {
+            parser->state = AT_HTTP_STATE_ERROR;
+            return -1;
+        }
+        parser->line_len = 0;
+    }
+
+    return (int)pos;
+}
+
+int at_http_parser_finish(at_http_parser_t* parser)
+{
+    if (parser->state == AT_HTTP_STATE_BODY_TO_EOF) {
+        parser->state = AT_HTTP_STATE_DONE;
+    }
+
+    return (parser->state == AT_HTTP_STATE_DONE) ? 0 : -1;
+}
+
+bool at_http_parser_is_done(const at_http_parser_t* parser)
+{
+    return (parser->state == AT_HTTP_STATE_DONE);
+}
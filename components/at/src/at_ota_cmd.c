@@ -22,6 +22,7 @@
  *
  */
 #include <string.h>
+#include <strings.h>
 #include "malloc.h"
 #include "stdlib.h"
 
@@ -31,6 +32,7 @@
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 #include "lwip/dns.h"
+#include "freertos/task.h"
 #include "freertos/timers.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
@@ -41,6 +43,17 @@
 
 #ifdef CONFIG_AT_OTA_SUPPORT
 #include "at_ota.h"
+#include "at_http_parser.h"
+#ifdef CONFIG_AT_OTA_PIPELINE_SUPPORT
+#include "at_ota_pipeline.h"
+#endif
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+#include "at_ota_resume.h"
+#endif
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+#include "mbedtls/sha256.h"
+#include "at_ota_delta.h"
+#endif
 
 typedef enum {
     AT_UPGRADE_SYSTEM_FIRMWARE = 0,         /**< upgrade type is system firmware */
@@ -61,6 +74,7 @@ typedef enum {
 #endif
 
 #define TEXT_BUFFSIZE 1024
+#define ESP_AT_OTA_RECV_BUFFER_SIZE         CONFIG_AT_OTA_RECV_BUFFER_SIZE
 
 #define UPGRADE_FRAME  "{\"path\": \"/v1/messages/\", \"method\": \"POST\", \"meta\": {\"Authorization\": \"token %s\"},\
 \"get\":{\"action\":\"%s\"},\"body\":{\"pre_rom_version\":\"%s\",\"rom_version\":\"%s\"}}\n"
@@ -74,6 +88,12 @@ Accept-Encoding: gzip,deflate,sdch\r\n\
 Accept-Language: zh-CN,zh;q=0.8\r\n\r\n"
 
 #define ESP_AT_OTA_TIMEOUT_MS               (60*3*1000)
+#define ESP_AT_OTA_RETRY_DELAY_MS           1000
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+#define ESP_AT_OTA_RETRY_MAX                CONFIG_AT_OTA_RESUME_RETRY_MAX
+#else
+#define ESP_AT_OTA_RETRY_MAX                0       // a new download starts from zero, nothing to retry
+#endif
 
 static xTimerHandle esp_at_ota_timeout_timer = NULL;
 static bool esp_at_ota_timeout_flag = false;
@@ -85,6 +105,43 @@ static esp_at_ota_state_t s_ota_status = ESP_AT_OTA_STATE_IDLE;
 #define ESP_AT_VERSION_LEN_MAX                64
 #define ESP_AT_PARTITION_NAME_LEN_MAX         64
 #define NB_OTA_TASK_STACK_SIZE              5120  // for non-blocking ota
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+#define ESP_AT_OTA_SHA256_CHUNK_SIZE        1024
+#endif
+
+// where the body of the firmware download goes
+typedef struct {
+    at_upgrade_type_t upgrade_type;
+    esp_ota_handle_t handle;
+    const esp_partition_t* partition;       // custom partition, NULL for the system firmware
+    int total_len;                          // -1 if the server does not tell the length
+    int recv_len;
+    bool fatal;                             // the download cannot succeed, do not retry
+#ifdef CONFIG_AT_OTA_PIPELINE_SUPPORT
+    const esp_partition_t* target;          // the partition the pipeline writes
+    at_ota_pipeline_t* pipeline;            // started once the response headers are accepted
+#endif
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+    at_ota_resume_t* resume;
+    char etag[AT_OTA_RESUME_ETAG_LEN_MAX + 1];
+    char content_range[64];
+#endif
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+    const esp_partition_t* source;          // the running firmware a patch applies to
+    at_ota_delta_t* delta;                  // the body is a patch, NULL until its first bytes tell
+    at_ota_delta_header_t patch;            // header of the patch, once is_patch is set
+    bool is_patch;
+    uint8_t head[AT_OTA_DELTA_MAGIC_LEN];   // first bytes of the body, until they tell a patch from a firmware
+    uint8_t head_len;
+#endif
+} esp_at_ota_writer_t;
+
+// collects a small text body, such as the version information
+typedef struct {
+    char* text;
+    int len;
+    int size;
+} esp_at_ota_text_t;
 
 typedef struct {
     int32_t ota_mode;
@@ -114,9 +171,394 @@ static void esp_at_ota_timeout_callback( TimerHandle_t xTimer )
     }
 }
 
+// the socket is used if tls is NULL
+static int esp_at_ota_read(void* tls, uint8_t* data, int len)
+{
+#ifdef CONFIG_AT_OTA_SSL_SUPPORT
+    if (tls) {
+        return esp_tls_conn_read((esp_tls_t*)tls, data, len);
+    }
+#endif
+    return read(esp_at_ota_socket_id, data, len);
+}
+
+// Receive a whole HTTP response, the body is handed to the parser callbacks as it arrives
+static bool esp_at_ota_recv_response(void* tls, at_http_parser_t* parser, uint8_t* buffer, int size)
+{
+    int len = 0;
+
+    while (!at_http_parser_is_done(parser)) {
+        len = esp_at_ota_read(tls, buffer, size);
+        if (len < 0) {
+            ESP_AT_OTA_DEBUG("receive data error!\r\n");
+            return false;
+        }
+
+        if (len == 0) {
+            ESP_AT_OTA_DEBUG("receive all packet over!\r\n");
+            return (at_http_parser_finish(parser) == 0);
+        }
+
+        if (at_http_parser_execute(parser, buffer, len) < 0) {
+            ESP_AT_OTA_DEBUG("http response error!\r\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int esp_at_ota_text_body_cb(at_http_parser_t* parser, const uint8_t* data, size_t len)
+{
+    esp_at_ota_text_t* text = (esp_at_ota_text_t*)parser->arg;
+
+    // the version information is short, whatever does not fit is not needed
+    if (len > (size_t)(text->size - 1 - text->len)) {
+        len = text->size - 1 - text->len;
+    }
+    memcpy(text->text + text->len, data, len);
+    text->len += len;
+    text->text[text->len] = '\0';
+
+    return 0;
+}
+
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+static int esp_at_ota_header_cb(at_http_parser_t* parser, const char* name, const char* value)
+{
+    esp_at_ota_writer_t* writer = (esp_at_ota_writer_t*)parser->arg;
+
+    // a value too long to be kept is dropped, the download then cannot be continued from the middle
+    if (strcasecmp(name, "ETag") == 0) {
+        if (strlen(value) < sizeof(writer->etag)) {
+            strcpy(writer->etag, value);
+        }
+    } else if (strcasecmp(name, "Content-Range") == 0) {
+        if (strlen(value) < sizeof(writer->content_range)) {
+            strcpy(writer->content_range, value);
+        }
+    }
+
+    return 0;
+}
+
+static int esp_at_ota_headers_complete_cb(at_http_parser_t* parser)
+{
+    esp_at_ota_writer_t* writer = (esp_at_ota_writer_t*)parser->arg;
+    esp_err_t err = at_ota_resume_response(writer->resume, parser->status_code, writer->content_range, writer->etag, parser->content_length);
+
+    if (err != ESP_OK) {
+        // a range that does not fit is asked again from zero
+        writer->fatal = (err != ESP_ERR_INVALID_RESPONSE);
+        return -1;
+    }
+
+    writer->total_len = writer->resume->total_len;
+    writer->recv_len = writer->resume->offset;
+    ESP_AT_OTA_DEBUG("total_len=%d, from %d!\r\n", writer->total_len, writer->recv_len);
+
+    writer->pipeline = at_ota_pipeline_start(writer->target, writer->resume->offset, (writer->total_len > 0) ? writer->total_len : 0,
+                                             at_ota_resume_written, writer->resume);
+    if (writer->pipeline == NULL) {
+        ESP_AT_OTA_DEBUG("at_ota_pipeline_start failed!\r\n");
+        writer->fatal = true;
+        return -1;
+    }
+    return 0;
+}
+#else
+static int esp_at_ota_headers_complete_cb(at_http_parser_t* parser)
+{
+    esp_at_ota_writer_t* writer = (esp_at_ota_writer_t*)parser->arg;
+
+    if (parser->status_code != 200) {
+        ESP_AT_OTA_DEBUG("http status %d!\r\n", parser->status_code);
+        return -1;
+    }
+
+    if (writer->partition && parser->content_length > writer->partition->size) {
+        ESP_AT_OTA_DEBUG("bin size %lld is larger than the partition!\r\n", (long long)parser->content_length);
+        return -1;
+    }
+
+    writer->total_len = (parser->content_length >= 0) ? (int)parser->content_length : -1;
+    ESP_AT_OTA_DEBUG("total_len=%d!\r\n", writer->total_len);
+
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+    // the system firmware may come as a patch, the pipeline starts once the first bytes of the body tell
+    if (writer->upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) {
+        return 0;
+    }
+#endif
+#ifdef CONFIG_AT_OTA_PIPELINE_SUPPORT
+    writer->pipeline = at_ota_pipeline_start(writer->target, 0, (writer->total_len > 0) ? writer->total_len : 0, NULL, NULL);
+    if (writer->pipeline == NULL) {
+        ESP_AT_OTA_DEBUG("at_ota_pipeline_start failed!\r\n");
+        return -1;
+    }
+#endif
+    return 0;
+}
+#endif
+
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+// SHA-256 of the first len bytes of a partition
+static esp_err_t esp_at_ota_partition_sha256(const esp_partition_t* partition, uint32_t len, uint8_t* digest)
+{
+    mbedtls_sha256_context ctx;
+    uint8_t* buffer = (uint8_t*)malloc(ESP_AT_OTA_SHA256_CHUNK_SIZE);
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    esp_err_t err = ESP_OK;
+
+    if (buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    for (offset = 0; offset < len; offset += size) {
+        size = (len - offset < ESP_AT_OTA_SHA256_CHUNK_SIZE) ? (len - offset) : ESP_AT_OTA_SHA256_CHUNK_SIZE;
+        err = esp_partition_read(partition, offset, buffer, size);
+        if (err != ESP_OK) {
+            break;
+        }
+        mbedtls_sha256_update_ret(&ctx, buffer, size);
+    }
+    mbedtls_sha256_finish_ret(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+    free(buffer);
+
+    return err;
+}
+
+// The patch must be made from the running firmware, the pipeline then writes what it produces
+static int esp_at_ota_delta_header_cb(at_ota_delta_t* delta, const at_ota_delta_header_t* header)
+{
+    esp_at_ota_writer_t* writer = (esp_at_ota_writer_t*)delta->arg;
+    uint8_t digest[32];
+
+    if (header->target_size > writer->target->size || header->source_size > writer->source->size) {
+        ESP_AT_OTA_DEBUG("patch %u -> %u bytes does not fit the partitions!\r\n", header->source_size, header->target_size);
+        return -1;
+    }
+
+    if (esp_at_ota_partition_sha256(writer->source, header->source_size, digest) != ESP_OK
+        || memcmp(digest, header->source_sha256, sizeof(digest)) != 0) {
+        ESP_AT_OTA_DEBUG("patch is not made from the running firmware!\r\n");
+        return -1;
+    }
+    ESP_AT_OTA_DEBUG("patch %u -> %u bytes\r\n", header->source_size, header->target_size);
+
+    writer->pipeline = at_ota_pipeline_start(writer->target, 0, header->target_size, NULL, NULL);
+    if (writer->pipeline == NULL) {
+        ESP_AT_OTA_DEBUG("at_ota_pipeline_start failed!\r\n");
+        return -1;
+    }
+    memcpy(&writer->patch, header, sizeof(writer->patch));
+    writer->is_patch = true;
+
+    return 0;
+}
+
+static int esp_at_ota_delta_read_source_cb(at_ota_delta_t* delta, uint32_t offset, uint8_t* data, size_t len)
+{
+    esp_at_ota_writer_t* writer = (esp_at_ota_writer_t*)delta->arg;
+
+    return (esp_partition_read(writer->source, offset, data, len) == ESP_OK) ? 0 : -1;
+}
+
+static int esp_at_ota_delta_target_cb(at_ota_delta_t* delta, const uint8_t* data, size_t len)
+{
+    esp_at_ota_writer_t* writer = (esp_at_ota_writer_t*)delta->arg;
+
+    return (at_ota_pipeline_write(writer->pipeline, data, len) == ESP_OK) ? 0 : -1;
+}
+
+static const at_ota_delta_callbacks_t s_esp_at_ota_delta_callbacks = {
+    .on_header = esp_at_ota_delta_header_cb,
+    .read_source = esp_at_ota_delta_read_source_cb,
+    .on_target = esp_at_ota_delta_target_cb,
+};
+
+static int esp_at_ota_delta_route(esp_at_ota_writer_t* writer, const uint8_t* data, size_t len)
+{
+    if (writer->delta) {
+        return at_ota_delta_execute(writer->delta, data, len);
+    }
+    return (at_ota_pipeline_write(writer->pipeline, data, len) == ESP_OK) ? 0 : -1;
+}
+
+// The body of the system firmware is either the image or a patch, the first bytes tell which one
+static int esp_at_ota_delta_write(esp_at_ota_writer_t* writer, const uint8_t* data, size_t len)
+{
+    size_t head = 0;
+
+    if (writer->delta == NULL && writer->pipeline == NULL) {
+        head = AT_OTA_DELTA_MAGIC_LEN - writer->head_len;
+        head = (len < head) ? len : head;
+        memcpy(writer->head + writer->head_len, data, head);
+        writer->head_len += head;
+        data += head;
+        len -= head;
+        if (writer->head_len < AT_OTA_DELTA_MAGIC_LEN) {
+            return 0;
+        }
+
+        if (at_ota_delta_is_patch(writer->head, writer->head_len)) {
+            writer->delta = (at_ota_delta_t*)malloc(sizeof(at_ota_delta_t));
+            if (writer->delta == NULL) {
+                return -1;
+            }
+            at_ota_delta_init(writer->delta, &s_esp_at_ota_delta_callbacks, writer);
+        } else {
+            writer->pipeline = at_ota_pipeline_start(writer->target, 0, (writer->total_len > 0) ? writer->total_len : 0, NULL, NULL);
+            if (writer->pipeline == NULL) {
+                ESP_AT_OTA_DEBUG("at_ota_pipeline_start failed!\r\n");
+                return -1;
+            }
+        }
+
+        if (esp_at_ota_delta_route(writer, writer->head, writer->head_len) != 0) {
+            return -1;
+        }
+    }
+
+    return (len > 0) ? esp_at_ota_delta_route(writer, data, len) : 0;
+}
+#endif
+
+// Write the body straight from the receive buffer to flash, or to the flash writer task of the pipeline
+static int esp_at_ota_body_cb(at_http_parser_t* parser, const uint8_t* data, size_t len)
+{
+    esp_at_ota_writer_t* writer = (esp_at_ota_writer_t*)parser->arg;
+
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+    if (esp_at_ota_delta_write(writer, data, len) != 0) {
+        writer->fatal = true;
+        return -1;
+    }
+#elif defined(CONFIG_AT_OTA_PIPELINE_SUPPORT)
+    if (at_ota_pipeline_write(writer->pipeline, data, len) != ESP_OK) {
+        writer->fatal = true;
+        return -1;
+    }
+#else
+    if (writer->upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) {
+        if (writer->recv_len == 0 && data[0] != 0xE9) {
+            ESP_AT_OTA_DEBUG("OTA Write Header format Check Failed! first byte is %02x\r\n", data[0]);
+            return -1;
+        }
+
+        if (esp_ota_write(writer->handle, (const void*)data, len) != ESP_OK) {
+            ESP_AT_OTA_DEBUG("esp_ota_write failed!\r\n");
+            return -1;
+        }
+    } else {
+        if (esp_partition_write(writer->partition, writer->recv_len, data, len) != ESP_OK) {
+            ESP_AT_OTA_DEBUG("esp_partition_write failed!\r\n");
+            return -1;
+        }
+    }
+#endif
+
+    writer->recv_len += len;
+    if (writer->total_len > 0) {
+        ESP_AT_OTA_DEBUG("total_len=%d(%d), %0.1f%%!\r\n", writer->total_len, writer->recv_len, (writer->recv_len * 1.0) * 100 / writer->total_len);
+    } else {
+        ESP_AT_OTA_DEBUG("recv_len=%d!\r\n", writer->recv_len);
+    }
+
+    return 0;
+}
+
+static const at_http_parser_callbacks_t s_esp_at_ota_text_callbacks = {
+    .on_body = esp_at_ota_text_body_cb,
+};
+
+static const at_http_parser_callbacks_t s_esp_at_ota_writer_callbacks = {
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+    .on_header = esp_at_ota_header_cb,
+#endif
+    .on_headers_complete = esp_at_ota_headers_complete_cb,
+    .on_body = esp_at_ota_body_cb,
+};
+
+// Connect to the OTA server, the connection is *tls in SSL mode and esp_at_ota_socket_id otherwise
+static bool esp_at_ota_connect(esp_at_ota_mode_type ota_mode, const char* server_ip, uint16_t server_port, const struct sockaddr_in* sock_info, void** tls)
+{
+    int sockopt = 1;
+
+    *tls = NULL;
+    if (ota_mode == ESP_AT_OTA_MODE_NORMAL) {
+        esp_at_ota_socket_id = socket(AF_INET, SOCK_STREAM, 0);
+        if (esp_at_ota_socket_id < 0) {
+            return false;
+        }
+
+        setsockopt(esp_at_ota_socket_id, SOL_SOCKET, SO_REUSEADDR,&sockopt, sizeof(sockopt));
+        // connect to http server
+        if (connect(esp_at_ota_socket_id, (struct sockaddr*)sock_info, sizeof(struct sockaddr_in)) < 0) {
+            ESP_AT_OTA_DEBUG("connect to server failed!\r\n");
+            return false;
+        }
+        return true;
+    }
+#ifdef CONFIG_AT_OTA_SSL_SUPPORT
+    else if (ota_mode == ESP_AT_OTA_MODE_SSL) {
+        esp_tls_cfg_t* tls_cfg = (esp_tls_cfg_t *)calloc(1, sizeof(esp_tls_cfg_t));
+        bool ret = false;
+
+        *tls = esp_tls_init();
+        if (*tls && tls_cfg) {
+            if (esp_tls_conn_new_sync(server_ip, strlen(server_ip), server_port, tls_cfg, (esp_tls_t*)*tls) < 0) {
+                ESP_AT_OTA_DEBUG("Failed to open a new connection\r\n");
+            } else {
+                ret = true;
+            }
+        }
+        free(tls_cfg);
+        return ret;
+    }
+#endif
+
+    return false;
+}
+
+static void esp_at_ota_disconnect(void** tls)
+{
+#ifdef CONFIG_AT_OTA_SSL_SUPPORT
+    if (*tls) {
+        esp_tls_conn_delete((esp_tls_t*)*tls);
+    }
+#endif
+    *tls = NULL;
+
+    if (esp_at_ota_socket_id >= 0) {
+        close(esp_at_ota_socket_id);
+        esp_at_ota_socket_id = -1;
+    }
+}
+
+// the socket is used if tls is NULL
+static bool esp_at_ota_send(void* tls, const uint8_t* data, int len)
+{
+    int result = -1;
+
+#ifdef CONFIG_AT_OTA_SSL_SUPPORT
+    if (tls) {
+        result = esp_tls_conn_write((esp_tls_t*)tls, (const unsigned char *)data, len);
+    } else
+#endif
+    {
+        result = write(esp_at_ota_socket_id, data, len);
+    }
+
+    return (result == len);
+}
+
 bool esp_at_upgrade_process(esp_at_ota_mode_type ota_mode, uint8_t *version, const char *partition_name)
 {
-    bool pkg_body_start = false;
     struct sockaddr_in sock_info;
     ip_addr_t ip_address;
     struct hostent* hptr = NULL;
@@ -127,22 +569,26 @@ bool esp_at_upgrade_process(esp_at_ota_mode_type ota_mode, uint8_t *version, con
     esp_partition_t partition;
     const esp_partition_t* next_partition = NULL;
     esp_ota_handle_t out_handle = 0;
-    int buff_len = 0;
-    int sockopt = 1;
-    int total_len = 0;
-    int recv_len = 0;
     bool ret = false;
     int result = -1;
+    int len = 0;
+    int retry = 0;
     char* server_ip = NULL;
     uint16_t server_port = 0;
     const char* ota_key = NULL;
     uint32_t module_id = esp_at_get_module_id();
     at_upgrade_type_t upgrade_type = 0;
     const esp_partition_t *at_custom_partition = NULL;
-
-#ifdef CONFIG_AT_OTA_SSL_SUPPORT
-    esp_tls_t *tls = NULL;
-    esp_tls_cfg_t *tls_cfg = NULL;
+    void* conn_tls = NULL;
+    at_http_parser_t parser;
+    esp_at_ota_text_t text;
+    esp_at_ota_writer_t writer;
+    char latest_version[ESP_AT_VERSION_LEN_MAX + 1];
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+    at_ota_resume_t resume;
+    uint8_t digest[32];
+
+    memset(&resume, 0x0, sizeof(resume));
 #endif
 
     if (memcmp(partition_name, "ota", strlen("ota")) == 0) {
@@ -202,41 +648,15 @@ bool esp_at_upgrade_process(esp_at_ota_mode_type ota_mode, uint8_t *version, con
     if (http_request == NULL) {
         goto OTA_ERROR;
     }
-    data_buffer = (uint8_t*)malloc(TEXT_BUFFSIZE);
+    data_buffer = (uint8_t*)malloc(ESP_AT_OTA_RECV_BUFFER_SIZE);
     if (data_buffer == NULL) {
         goto OTA_ERROR;
     }
 
     if (version == NULL) {
-        if (ota_mode == ESP_AT_OTA_MODE_NORMAL) {
-            esp_at_ota_socket_id = socket(AF_INET, SOCK_STREAM, 0);
-            if (esp_at_ota_socket_id < 0) {
-                goto OTA_ERROR;
-            }
-
-            setsockopt(esp_at_ota_socket_id, SOL_SOCKET, SO_REUSEADDR,&sockopt, sizeof(sockopt));
-            // connect to http server
-            if (connect(esp_at_ota_socket_id, (struct sockaddr*)&sock_info, sizeof(sock_info)) < 0)
-            {
-                ESP_AT_OTA_DEBUG("connect to server failed!\r\n");
-                goto OTA_ERROR;
-            }
-        }
-    #ifdef CONFIG_AT_OTA_SSL_SUPPORT
-        else if (ota_mode == ESP_AT_OTA_MODE_SSL) {
-            tls = esp_tls_init();
-
-            tls_cfg = (esp_tls_cfg_t *)calloc(1, sizeof(esp_tls_cfg_t));
-            if (tls_cfg == NULL) {
-                goto OTA_ERROR;
-            }
-
-            if (esp_tls_conn_new_sync(server_ip, strlen(server_ip), server_port, tls_cfg, tls) < 0) {
-                ESP_AT_OTA_DEBUG("Failed to open a new connection\r\n");
-                goto OTA_ERROR;
-            }
+        if (!esp_at_ota_connect(ota_mode, server_ip, server_port, &sock_info, &conn_tls)) {
+            goto OTA_ERROR;
         }
-    #endif
         esp_at_set_upgrade_state(ESP_AT_OTA_STATE_CONNECTED_TO_SERVER);
         esp_at_port_write_data((uint8_t*)"+CIPUPDATE:2\r\n",strlen("+CIPUPDATE:2\r\n"));
 
@@ -246,43 +666,26 @@ bool esp_at_upgrade_process(esp_at_ota_mode_type ota_mode, uint8_t *version, con
 
         printf("http request length %d bytes\r\n",strlen((char*)http_request));
         /*send GET request to http server*/
-        result = -1;
-        if (ota_mode == ESP_AT_OTA_MODE_NORMAL) {
-            result = write(esp_at_ota_socket_id, http_request, strlen((char*)http_request));
-        }
-    #ifdef CONFIG_AT_OTA_SSL_SUPPORT
-        else if (ota_mode == ESP_AT_OTA_MODE_SSL) {
-            result = esp_tls_conn_write(tls, (const unsigned char *)http_request, strlen((char *)http_request));
-        }
-    #endif
-
-        if(result != strlen((char*)http_request))
-        {
+        if (!esp_at_ota_send(conn_tls, http_request, strlen((char*)http_request))) {
             ESP_AT_OTA_DEBUG("send GET request to server failed\r\n");
             goto OTA_ERROR;
         }
 
-        memset(data_buffer,0x0,TEXT_BUFFSIZE);
+        // the request buffer is free until the next request, collect the version information in it
+        text.text = (char*)http_request;
+        text.len = 0;
+        text.size = TEXT_BUFFSIZE;
+        text.text[0] = '\0';
+        at_http_parser_init(&parser, &s_esp_at_ota_text_callbacks, false, &text);
 
-        result = -1;
-        if (ota_mode == ESP_AT_OTA_MODE_NORMAL) {
-            result = read(esp_at_ota_socket_id, data_buffer, TEXT_BUFFSIZE);
-        }
-    #ifdef CONFIG_AT_OTA_SSL_SUPPORT
-        else if (ota_mode == ESP_AT_OTA_MODE_SSL) {
-            result = esp_tls_conn_read(tls, data_buffer, TEXT_BUFFSIZE);
-        }
-        esp_tls_conn_delete(tls);
-        tls = NULL;
-    #endif
-        close(esp_at_ota_socket_id);
-        esp_at_ota_socket_id = -1;
+        result = esp_at_ota_recv_response(conn_tls, &parser, data_buffer, ESP_AT_OTA_RECV_BUFFER_SIZE) ? 0 : -1;
+        esp_at_ota_disconnect(&conn_tls);
 
         if (result < 0) {
             ESP_AT_OTA_DEBUG("recv data from server failed!\r\n");
             goto OTA_ERROR;
         }
-        pStr = (uint8_t*)strstr((char*)data_buffer,"rom_version\": ");
+        pStr = (uint8_t*)strstr(text.text, "rom_version\": ");
         if (pStr == NULL) {
             ESP_AT_OTA_DEBUG("rom_version error!\r\n");
             goto OTA_ERROR;
@@ -291,20 +694,18 @@ bool esp_at_upgrade_process(esp_at_ota_mode_type ota_mode, uint8_t *version, con
         version = pStr;
     
         pStr = (uint8_t*)strstr((char*)version,"\",");
-        if (pStr == NULL) {
+        if (pStr == NULL || pStr - version > ESP_AT_VERSION_LEN_MAX) {
             ESP_AT_OTA_DEBUG("rom_version tail error!\r\n");
             goto OTA_ERROR;
         }
-        *pStr = '\0';
+        memcpy(latest_version, version, pStr - version);
+        latest_version[pStr - version] = '\0';
+        version = (uint8_t*)latest_version;
         esp_at_set_upgrade_state(ESP_AT_OTA_STATE_GOT_VERSION);
         esp_at_port_write_data((uint8_t*)"+CIPUPDATE:3\r\n",strlen("+CIPUPDATE:3\r\n"));
     }
     printf("version:%s\r\n",version);
 
-    snprintf((char*)http_request,TEXT_BUFFSIZE,
-        "GET /v1/device/rom/?action=download_rom&version=%s&filename=%s.bin HTTP/1.1\r\nHost: "IPSTR":%d\r\n"pheadbuffer"",
-        (char*)version, partition_name, IP2STR(&ip_address.u_addr.ip4), server_port, ota_key);
-
     // search partition
     if (upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) {  // search ota partition
         partition_ptr = (esp_partition_t*)esp_ota_get_boot_partition();
@@ -339,10 +740,12 @@ bool esp_at_upgrade_process(esp_at_ota_mode_type ota_mode, uint8_t *version, con
         }
 
         memcpy(&partition,partition_ptr,sizeof(esp_partition_t));
+#ifndef CONFIG_AT_OTA_PIPELINE_SUPPORT
         if (esp_ota_begin(&partition, OTA_SIZE_UNKNOWN, &out_handle) != ESP_OK) {
             ESP_AT_OTA_DEBUG("esp_ota_begin failed!\r\n");
             goto OTA_ERROR;
         }
+#endif
         ESP_AT_OTA_DEBUG("ready to upgrade system firmware.\r\n");
     } else {    // custom partition
         at_custom_partition = esp_at_custom_partition_find(0x0, 0x0, partition_name);
@@ -353,148 +756,141 @@ bool esp_at_upgrade_process(esp_at_ota_mode_type ota_mode, uint8_t *version, con
         ESP_AT_OTA_DEBUG("ready to upgrade partition: \"%s\" type:0x%x subtype:0x%x addr:0x%x size:0x%x encrypt:%d\r\n",
         at_custom_partition->label, at_custom_partition->type, at_custom_partition->subtype,
         at_custom_partition->address, at_custom_partition->size, at_custom_partition->encrypted);
+#ifndef CONFIG_AT_OTA_PIPELINE_SUPPORT
         if (esp_partition_erase_range(at_custom_partition, 0, at_custom_partition->size) != ESP_OK) {
             ESP_AT_OTA_DEBUG("esp_partition_erase_range failed!\r\n");
             goto OTA_ERROR;
         }
-    }
-
-    if (ota_mode == ESP_AT_OTA_MODE_NORMAL) {
-        esp_at_ota_socket_id = socket(AF_INET, SOCK_STREAM, 0);
-        if (esp_at_ota_socket_id < 0) {
-            goto OTA_ERROR;
-        }
-        setsockopt(esp_at_ota_socket_id, SOL_SOCKET, SO_REUSEADDR,&sockopt, sizeof(sockopt));
-        if (connect(esp_at_ota_socket_id, (struct sockaddr*)&sock_info, sizeof(sock_info)) < 0) {
-            ESP_AT_OTA_DEBUG("connect to server2 failed!\r\n");
-            goto OTA_ERROR;
-        }
-    }
-#ifdef CONFIG_AT_OTA_SSL_SUPPORT
-    else if (ota_mode == ESP_AT_OTA_MODE_SSL) {
-        if (tls) {
-            esp_tls_conn_delete(tls);
-        }
-        tls = esp_tls_init();
-        if (!tls_cfg) {
-            tls_cfg = (esp_tls_cfg_t *)calloc(1, sizeof(esp_tls_cfg_t));
-        } else {
-            memset(tls_cfg, 0x0, sizeof(esp_tls_cfg_t));
-        }
-        if (tls == NULL || tls_cfg == NULL) {
-            goto OTA_ERROR;
-        }
-
-        if (esp_tls_conn_new_sync(server_ip, strlen(server_ip), server_port, tls_cfg, tls) < 0) {
-            ESP_AT_OTA_DEBUG("Failed to open a new connection\r\n");
-            goto OTA_ERROR;
-        }
-    }
 #endif
-    result = -1;
-    if (ota_mode == ESP_AT_OTA_MODE_NORMAL) {
-        result = write(esp_at_ota_socket_id, http_request, strlen((char*)http_request));
     }
-#ifdef CONFIG_AT_OTA_SSL_SUPPORT
-    else if (ota_mode == ESP_AT_OTA_MODE_SSL) {
-        result = esp_tls_conn_write(tls, (const unsigned char *)http_request, strlen((char *)http_request));
-    }
-#endif
 
-    if(result != strlen((char*)http_request))
-    {
-        ESP_AT_OTA_DEBUG("send GET bin to server failed\r\n");
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+    // only the same version of the same partition from the same server continues a saved download
+    snprintf((char*)http_request, TEXT_BUFFSIZE, "%s:%d/%s/%s", server_ip, server_port, partition_name, (char*)version);
+    if (at_ota_resume_begin(&resume, (upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) ? &partition : at_custom_partition, (char*)http_request) != ESP_OK) {
         goto OTA_ERROR;
     }
-    /*deal with all receive packet*/
-    for (;;)
-    {
-        memset(data_buffer, 0x0, TEXT_BUFFSIZE);
-        
-        buff_len = -1;
-        if (ota_mode == ESP_AT_OTA_MODE_NORMAL) {
-            buff_len = read(esp_at_ota_socket_id, data_buffer, TEXT_BUFFSIZE);
-        }
-#ifdef CONFIG_AT_OTA_SSL_SUPPORT
-        else if (ota_mode == ESP_AT_OTA_MODE_SSL) {
-            buff_len = esp_tls_conn_read(tls, data_buffer, TEXT_BUFFSIZE);
-        }
 #endif
-        if (buff_len < 0) {
-            ESP_AT_OTA_DEBUG("receive data error!\r\n");
-            goto OTA_ERROR;
-        } else if (buff_len > 0 && !pkg_body_start) {
-            // search "\r\n\r\n"
-            pStr = (uint8_t*)strstr((char*)data_buffer,"Content-Length: ");
-            if (pStr == NULL) {
-                break;
-            }
-            pStr += strlen("Content-Length: ");
-            total_len = atoi((char*)pStr);
-            ESP_AT_OTA_DEBUG("total_len=%d!\r\n",total_len);
-            pStr = (uint8_t*)strstr((char*)data_buffer,"\r\n\r\n");
-            if (pStr) {
-                pkg_body_start = true;
-                pStr += 4; // skip "\r\n"
-                if (upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) {
-                    if (pStr[0] != 0xE9) {
-                        ESP_AT_OTA_DEBUG("OTA Write Header format Check Failed! first byte is %02x\r\n", pStr[0]);
-                        goto OTA_ERROR;
-                    }
-                }
-                // pStr += 2;
-                buff_len -= (pStr - data_buffer);
-
-                if (upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) {
-                    if(esp_ota_write(out_handle, (const void*)pStr, buff_len) != ESP_OK)
-                    {
-                        ESP_AT_OTA_DEBUG("esp_ota_write failed!\r\n");
-                        goto OTA_ERROR;
-                    }
-                } else {
-                    if (esp_partition_write(at_custom_partition, recv_len, pStr, buff_len) != ESP_OK) {
-                        ESP_AT_OTA_DEBUG("esp_partition_write failed!\r\n");
-                        goto OTA_ERROR;
-                    }
-                }
 
-                recv_len += buff_len;
-            }
-        } else if (buff_len > 0 && pkg_body_start) {
+    for (retry = 0; ; retry++) {
+        result = -1;
+        memset(&writer, 0x0, sizeof(writer));
+
+        if (esp_at_ota_connect(ota_mode, server_ip, server_port, &sock_info, &conn_tls)) {
+            len = snprintf((char*)http_request, TEXT_BUFFSIZE,
+                "GET /v1/device/rom/?action=download_rom&version=%s&filename=%s.bin HTTP/1.1\r\nHost: "IPSTR":%d\r\n",
+                (char*)version, partition_name, IP2STR(&ip_address.u_addr.ip4), server_port);
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+            // the server may answer with a patch made from the running firmware
             if (upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) {
-                if(esp_ota_write( out_handle, (const void*)data_buffer, buff_len) != ESP_OK) {
-                    ESP_AT_OTA_DEBUG("esp_ota_write failed!\r\n");
-                    goto OTA_ERROR;
+                const esp_app_desc_t* app_desc = esp_ota_get_app_description();
+
+                len += snprintf((char*)http_request + len, TEXT_BUFFSIZE - len, "X-ESP-AT-App-SHA256: ");
+                for (size_t i = 0; i < sizeof(app_desc->app_elf_sha256); i++) {
+                    len += snprintf((char*)http_request + len, TEXT_BUFFSIZE - len, "%02x", app_desc->app_elf_sha256[i]);
                 }
+                len += snprintf((char*)http_request + len, TEXT_BUFFSIZE - len, "\r\n");
+            }
+#endif
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+            len += at_ota_resume_request_headers(&resume, (char*)http_request + len, TEXT_BUFFSIZE - len);
+#endif
+            snprintf((char*)http_request + len, TEXT_BUFFSIZE - len, pheadbuffer, ota_key);
+
+            if (!esp_at_ota_send(conn_tls, http_request, strlen((char*)http_request))) {
+                ESP_AT_OTA_DEBUG("send GET bin to server failed\r\n");
             } else {
-                if (esp_partition_write(at_custom_partition, recv_len, data_buffer, buff_len) != ESP_OK) {
-                    ESP_AT_OTA_DEBUG("esp_partition_write failed!\r\n");
-                    goto OTA_ERROR;
+                /*deal with all receive packet*/
+                writer.upgrade_type = upgrade_type;
+                writer.handle = out_handle;
+                writer.partition = at_custom_partition;
+                writer.total_len = -1;
+#ifdef CONFIG_AT_OTA_PIPELINE_SUPPORT
+                writer.target = (upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) ? &partition : at_custom_partition;
+#endif
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+                writer.resume = &resume;
+#endif
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+                writer.source = esp_ota_get_running_partition();
+#endif
+                at_http_parser_init(&parser, &s_esp_at_ota_writer_callbacks, false, &writer);
+
+                if (esp_at_ota_recv_response(conn_tls, &parser, data_buffer, ESP_AT_OTA_RECV_BUFFER_SIZE) && writer.recv_len > 0) {
+                    result = 0;
                 }
             }
-
-            recv_len += buff_len;
-        } else if (buff_len == 0) {
-            ESP_AT_OTA_DEBUG("receive all packet over!\r\n");
-            if (recv_len != total_len) {
-                goto OTA_ERROR;
+        }
+        esp_at_ota_disconnect(&conn_tls);
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+        if (writer.delta) {
+            if (at_ota_delta_finish(writer.delta) != 0 && result == 0) {
+                ESP_AT_OTA_DEBUG("patch incomplete!\r\n");
+                result = -1;
+                writer.fatal = true;
             }
-        } else {
-            ESP_AT_OTA_DEBUG("Warning: uncontolled event!\r\n");
+            free(writer.delta);
+            writer.delta = NULL;
+        }
+        // a body shorter than the magic never started the pipeline
+        if (writer.pipeline == NULL) {
+            result = -1;
+        }
+#endif
+#ifdef CONFIG_AT_OTA_PIPELINE_SUPPORT
+        // the flash writer task finishes what is queued, a partial tail is only written when the image is complete
+        if (writer.pipeline && at_ota_pipeline_end(writer.pipeline, (result == 0), NULL) != ESP_OK) {
+            result = -1;
+            writer.fatal = true;
         }
-        ESP_AT_OTA_DEBUG("total_len=%d(%d), %0.1f%%!\r\n",total_len,recv_len,(recv_len*1.0)*100/total_len);
-        if (recv_len == total_len) {
+#endif
+
+        if (result == 0) {
             break;
         }
+        if (esp_at_ota_timeout_flag || writer.fatal || retry >= ESP_AT_OTA_RETRY_MAX) {
+            goto OTA_ERROR;
+        }
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+        ESP_AT_OTA_DEBUG("download stopped at %u, retry %d\r\n", resume.offset, retry + 1);
+#endif
+        vTaskDelay(ESP_AT_OTA_RETRY_DELAY_MS / portTICK_PERIOD_MS);
     }
 
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+    if (at_ota_resume_end(&resume, digest) != ESP_OK) {
+        goto OTA_ERROR;
+    }
+    ESP_AT_OTA_DEBUG("sha256:");
+    for (len = 0; len < (int)sizeof(digest); len++) {
+        ESP_AT_OTA_DEBUG("%02x", digest[len]);
+    }
+    ESP_AT_OTA_DEBUG("\r\n");
+#elif !defined(CONFIG_AT_OTA_PIPELINE_SUPPORT)
     if (upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) {
         if(esp_ota_end(out_handle) != ESP_OK)
         {
             ESP_AT_OTA_DEBUG("esp_ota_end failed!\r\n");
             goto OTA_ERROR;
         }
+    }
+#endif
+
+#ifdef CONFIG_AT_OTA_DELTA_SUPPORT
+    // the flash is read back, what was written must be the very image the patch was made for
+    if (writer.is_patch) {
+        uint8_t target_sha256[32];
 
+        if (esp_at_ota_partition_sha256(&partition, writer.patch.target_size, target_sha256) != ESP_OK
+            || memcmp(target_sha256, writer.patch.target_sha256, sizeof(target_sha256)) != 0) {
+            ESP_AT_OTA_DEBUG("patched firmware sha256 mismatch!\r\n");
+            goto OTA_ERROR;
+        }
+    }
+#endif
+
+    if (upgrade_type == AT_UPGRADE_SYSTEM_FIRMWARE) {
+        // the image is verified before the boot partition is changed
         if(esp_ota_set_boot_partition(&partition) != ESP_OK)
         {
             ESP_AT_OTA_DEBUG("esp_ota_set_boot_partition failed!\r\n");
@@ -512,10 +908,7 @@ OTA_ERROR:
         esp_at_ota_timeout_timer = NULL;
     }
     
-    if (esp_at_ota_socket_id >= 0) {
-        close(esp_at_ota_socket_id);
-        esp_at_ota_socket_id = -1;
-    }
+    esp_at_ota_disconnect(&conn_tls);
     
     if (http_request) {
         free(http_request);
@@ -526,14 +919,10 @@ OTA_ERROR:
         free(data_buffer);
         data_buffer = NULL;
     }
-    
-#ifdef CONFIG_AT_OTA_SSL_SUPPORT
-    if (tls_cfg) {
-        free(tls_cfg);
-    }
 
-    esp_tls_conn_delete(tls);
-    tls = NULL;
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+    // the progress saved so far is kept for the next AT+CIUPDATE
+    at_ota_resume_abort(&resume);
 #endif
     return ret;
 }
@@ -0,0 +1,236 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "at_ota_delta.h"
+
+#define AT_OTA_DELTA_CONTROL_LEN            12
+
+enum {
+    AT_OTA_DELTA_STATE_HEADER = 0,
+    AT_OTA_DELTA_STATE_CONTROL,
+    AT_OTA_DELTA_STATE_DIFF,
+    AT_OTA_DELTA_STATE_EXTRA,
+    AT_OTA_DELTA_STATE_DONE,
+    AT_OTA_DELTA_STATE_ERROR,
+};
+
+static uint32_t at_ota_delta_get_u32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static int at_ota_delta_parse_header(at_ota_delta_t* delta)
+{
+    at_ota_delta_header_t* header = &delta->header;
+    const uint8_t* raw = delta->raw;
+
+    if (memcmp(raw, AT_OTA_DELTA_MAGIC, AT_OTA_DELTA_MAGIC_LEN) != 0 || raw[4] != AT_OTA_DELTA_VERSION) {
+        return -1;
+    }
+    header->version = raw[4];
+    header->window_sz2 = raw[5];
+    header->lookahead_sz2 = raw[6];
+    header->source_size = at_ota_delta_get_u32(raw + 8);
+    header->target_size = at_ota_delta_get_u32(raw + 12);
+    memcpy(header->source_sha256, raw + 16, sizeof(header->source_sha256));
+    memcpy(header->target_sha256, raw + 48, sizeof(header->target_sha256));
+
+    if (header->target_size == 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// The end of a record: move the source cursor, then the next control block or the end of the target
+static int at_ota_delta_record_end(at_ota_delta_t* delta)
+{
+    int64_t source_pos = (int64_t)delta->source_pos + delta->seek;
+
+    if (source_pos < 0 || source_pos > delta->header.source_size) {
+        return -1;
+    }
+    delta->source_pos = (uint32_t)source_pos;
+    delta->len = 0;
+    delta->state = (delta->target_len == delta->header.target_size) ? AT_OTA_DELTA_STATE_DONE : AT_OTA_DELTA_STATE_CONTROL;
+
+    return 0;
+}
+
+static int at_ota_delta_parse_control(at_ota_delta_t* delta)
+{
+    uint32_t diff_len = at_ota_delta_get_u32(delta->raw);
+    uint32_t extra_len = at_ota_delta_get_u32(delta->raw + 4);
+
+    if ((uint64_t)delta->target_len + diff_len + extra_len > delta->header.target_size
+        || (uint64_t)delta->source_pos + diff_len > delta->header.source_size) {
+        return -1;
+    }
+    delta->diff_left = diff_len;
+    delta->extra_left = extra_len;
+    delta->seek = (int32_t)at_ota_delta_get_u32(delta->raw + 8);
+
+    if (diff_len > 0) {
+        delta->state = AT_OTA_DELTA_STATE_DIFF;
+    } else if (extra_len > 0) {
+        delta->state = AT_OTA_DELTA_STATE_EXTRA;
+    } else {
+        return at_ota_delta_record_end(delta);
+    }
+    return 0;
+}
+
+// Output of the heatshrink decoder: the records
+static int at_ota_delta_body(void* arg, const uint8_t* data, size_t len)
+{
+    at_ota_delta_t* delta = (at_ota_delta_t*)arg;
+    uint32_t size = 0;
+    uint32_t i = 0;
+
+    while (len > 0) {
+        switch (delta->state) {
+        case AT_OTA_DELTA_STATE_CONTROL:
+            size = AT_OTA_DELTA_CONTROL_LEN - delta->len;
+            if (size > len) {
+                size = len;
+            }
+            memcpy(delta->raw + delta->len, data, size);
+            delta->len += size;
+            if (delta->len == AT_OTA_DELTA_CONTROL_LEN && at_ota_delta_parse_control(delta) != 0) {
+                return -1;
+            }
+            break;
+
+        case AT_OTA_DELTA_STATE_DIFF:
+            size = (delta->diff_left < AT_OTA_DELTA_SOURCE_BUFFER_SIZE) ? delta->diff_left : AT_OTA_DELTA_SOURCE_BUFFER_SIZE;
+            if (size > len) {
+                size = len;
+            }
+            if (delta->callbacks->read_source(delta, delta->source_pos, delta->source, size) != 0) {
+                return -1;
+            }
+            for (i = 0; i < size; i++) {
+                delta->source[i] += data[i];
+            }
+            if (delta->callbacks->on_target(delta, delta->source, size) != 0) {
+                return -1;
+            }
+            delta->source_pos += size;
+            delta->target_len += size;
+            delta->diff_left -= size;
+            if (delta->diff_left == 0) {
+                if (delta->extra_left > 0) {
+                    delta->state = AT_OTA_DELTA_STATE_EXTRA;
+                } else if (at_ota_delta_record_end(delta) != 0) {
+                    return -1;
+                }
+            }
+            break;
+
+        case AT_OTA_DELTA_STATE_EXTRA:
+            size = (delta->extra_left < len) ? delta->extra_left : len;
+            if (delta->callbacks->on_target(delta, data, size) != 0) {
+                return -1;
+            }
+            delta->target_len += size;
+            delta->extra_left -= size;
+            if (delta->extra_left == 0 && at_ota_delta_record_end(delta) != 0) {
+                return -1;
+            }
+            break;
+
+        default:
+            return -1;                      // records after the end of the target
+        }
+
+        data += size;
+        len -= size;
+    }
+
+    return 0;
+}
+
+bool at_ota_delta_is_patch(const uint8_t* data, size_t len)
+{
+    return (len >= AT_OTA_DELTA_MAGIC_LEN && memcmp(data, AT_OTA_DELTA_MAGIC, AT_OTA_DELTA_MAGIC_LEN) == 0);
+}
+
+void at_ota_delta_init(at_ota_delta_t* delta, const at_ota_delta_callbacks_t* callbacks, void* arg)
+{
+    memset(delta, 0x0, sizeof(at_ota_delta_t));
+    delta->callbacks = callbacks;
+    delta->arg = arg;
+    delta->state = AT_OTA_DELTA_STATE_HEADER;
+}
+
+int at_ota_delta_execute(at_ota_delta_t* delta, const uint8_t* data, size_t len)
+{
+    uint32_t size = 0;
+
+    if (delta->state == AT_OTA_DELTA_STATE_ERROR) {
+        return -1;
+    }
+
+    if (delta->state == AT_OTA_DELTA_STATE_HEADER) {
+        size = AT_OTA_DELTA_HEADER_LEN - delta->len;
+        if (size > len) {
+            size = len;
+        }
+        memcpy(delta->raw + delta->len, data, size);
+        delta->len += size;
+        data += size;
+        len -= size;
+        if (delta->len < AT_OTA_DELTA_HEADER_LEN) {
+            return 0;
+        }
+
+        if (at_ota_delta_parse_header(delta) != 0
+            || at_heatshrink_decoder_init(&delta->decoder, delta->header.window_sz2, delta->header.lookahead_sz2,
+                                          at_ota_delta_body, delta) != 0
+            || (delta->callbacks->on_header && delta->callbacks->on_header(delta, &delta->header) != 0)) {
+            delta->state = AT_OTA_DELTA_STATE_ERROR;
+            return -1;
+        }
+        delta->len = 0;
+        delta->state = AT_OTA_DELTA_STATE_CONTROL;
+    }
+
+    if (len > 0 && at_heatshrink_decode(&delta->decoder, data, len) != 0) {
+        delta->state = AT_OTA_DELTA_STATE_ERROR;
+        return -1;
+    }
+
+    return 0;
+}
+
+int at_ota_delta_finish(at_ota_delta_t* delta)
+{
+    int ret = (delta->state == AT_OTA_DELTA_STATE_DONE) ? 0 : -1;
+
+    at_heatshrink_decoder_deinit(&delta->decoder);
+    delta->state = AT_OTA_DELTA_STATE_ERROR;
+
+    return ret;
+}
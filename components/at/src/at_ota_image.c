@@ -0,0 +1,198 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_AT_OTA_COMPRESS_SUPPORT
+#include "at_heatshrink.h"
+#include "at_ota_pipeline.h"
+#include "at_ota_image.h"
+
+#define AT_OTA_IMAGE_DEBUG  printf
+
+enum {
+    AT_OTA_IMAGE_STATE_HEADER = 0,
+    AT_OTA_IMAGE_STATE_PLAIN,
+    AT_OTA_IMAGE_STATE_COMPRESSED,
+    AT_OTA_IMAGE_STATE_ERROR,
+};
+
+struct at_ota_image {
+    const esp_partition_t* partition;
+    at_ota_pipeline_t* pipeline;            // started once the image size is known
+    uint32_t image_size;                    // 0 if unknown
+    uint32_t image_len;                     // image bytes given to the pipeline so far
+    uint32_t recv_len;                      // bytes received so far
+    esp_err_t err;                          // first error
+    uint8_t state;
+    uint8_t len;                            // bytes of the header received so far
+    uint8_t raw[AT_OTA_IMAGE_COMPRESSED_HEADER_LEN];
+    at_heatshrink_decoder_t decoder;
+};
+
+static esp_err_t at_ota_image_output(at_ota_image_t* image, const uint8_t* data, size_t len)
+{
+    if (image->image_size > 0 && (uint64_t)image->image_len + len > image->image_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (image->pipeline == NULL) {
+        image->pipeline = at_ota_pipeline_start(image->partition, 0, image->image_size, NULL, NULL);
+        if (image->pipeline == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    image->image_len += len;
+
+    return at_ota_pipeline_write(image->pipeline, data, len);
+}
+
+// Output of the heatshrink decoder
+static int at_ota_image_decoded(void* arg, const uint8_t* data, size_t len)
+{
+    at_ota_image_t* image = (at_ota_image_t*)arg;
+
+    image->err = at_ota_image_output(image, data, len);
+    return (image->err == ESP_OK) ? 0 : -1;
+}
+
+static esp_err_t at_ota_image_parse_header(at_ota_image_t* image)
+{
+    const uint8_t* raw = image->raw;
+    uint32_t image_size = (uint32_t)raw[8] | ((uint32_t)raw[9] << 8) | ((uint32_t)raw[10] << 16) | ((uint32_t)raw[11] << 24);
+
+    if (raw[4] != AT_OTA_IMAGE_COMPRESSED_VERSION) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (image_size == 0 || image_size > image->partition->size) {
+        AT_OTA_IMAGE_DEBUG("compressed image of %u bytes does not fit the partition!\r\n", image_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // the window is the heap the decoder takes
+    if (raw[5] > CONFIG_AT_OTA_COMPRESS_WINDOW_SZ2_MAX) {
+        AT_OTA_IMAGE_DEBUG("compressed image window 2^%u is too large!\r\n", raw[5]);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (at_heatshrink_decoder_init(&image->decoder, raw[5], raw[6], at_ota_image_decoded, image) != 0) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    image->image_size = image_size;
+    AT_OTA_IMAGE_DEBUG("compressed image: %u bytes, window 2^%u\r\n", image_size, raw[5]);
+    return ESP_OK;
+}
+
+at_ota_image_t* at_ota_image_start(const esp_partition_t* partition, uint32_t image_len)
+{
+    at_ota_image_t* image = (at_ota_image_t*)calloc(1, sizeof(at_ota_image_t));
+
+    if (image == NULL) {
+        return NULL;
+    }
+    image->partition = partition;
+    image->image_size = image_len;
+    image->state = AT_OTA_IMAGE_STATE_HEADER;
+
+    return image;
+}
+
+esp_err_t at_ota_image_write(at_ota_image_t* image, const uint8_t* data, size_t len)
+{
+    uint32_t size = 0;
+
+    if (image->state == AT_OTA_IMAGE_STATE_ERROR) {
+        return image->err;
+    }
+    image->recv_len += len;
+
+    // the magic first, then the rest of the header if it is a compressed image
+    while (image->state == AT_OTA_IMAGE_STATE_HEADER && len > 0) {
+        size = ((image->len < AT_OTA_IMAGE_MAGIC_LEN) ? AT_OTA_IMAGE_MAGIC_LEN : AT_OTA_IMAGE_COMPRESSED_HEADER_LEN) - image->len;
+        if (size > len) {
+            size = len;
+        }
+        memcpy(image->raw + image->len, data, size);
+        image->len += size;
+        data += size;
+        len -= size;
+
+        if (image->len == AT_OTA_IMAGE_MAGIC_LEN && memcmp(image->raw, AT_OTA_IMAGE_COMPRESSED_MAGIC, AT_OTA_IMAGE_MAGIC_LEN) != 0) {
+            image->state = AT_OTA_IMAGE_STATE_PLAIN;
+            image->err = at_ota_image_output(image, image->raw, image->len);
+        } else if (image->len == AT_OTA_IMAGE_COMPRESSED_HEADER_LEN) {
+            image->state = AT_OTA_IMAGE_STATE_COMPRESSED;
+            image->err = at_ota_image_parse_header(image);
+        }
+    }
+
+    if (image->err == ESP_OK && len > 0) {
+        if (image->state == AT_OTA_IMAGE_STATE_PLAIN) {
+            image->err = at_ota_image_output(image, data, len);
+        } else if (image->state == AT_OTA_IMAGE_STATE_COMPRESSED) {
+            if (at_heatshrink_decode(&image->decoder, data, len) != 0 && image->err == ESP_OK) {
+                image->err = ESP_ERR_INVALID_RESPONSE;
+            }
+        }
+    }
+
+    if (image->err != ESP_OK) {
+        image->state = AT_OTA_IMAGE_STATE_ERROR;
+    }
+    return image->err;
+}
+
+esp_err_t at_ota_image_end(at_ota_image_t* image, bool complete)
+{
+    esp_err_t ret = image->err;
+
+    if (complete && ret == ESP_OK) {
+        if (image->state == AT_OTA_IMAGE_STATE_HEADER || image->pipeline == NULL) {
+            ret = ESP_ERR_INVALID_SIZE;
+        } else if (image->state == AT_OTA_IMAGE_STATE_COMPRESSED && image->image_len != image->image_size) {
+            AT_OTA_IMAGE_DEBUG("compressed image ends at %u of %u bytes!\r\n", image->image_len, image->image_size);
+            ret = ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    if (image->pipeline) {
+        // a partial tail is only written when the image is complete
+        esp_err_t err = at_ota_pipeline_end(image->pipeline, complete && ret == ESP_OK, NULL);
+        if (ret == ESP_OK) {
+            ret = err;
+        }
+    }
+    if (image->state == AT_OTA_IMAGE_STATE_COMPRESSED && ret == ESP_OK) {
+        AT_OTA_IMAGE_DEBUG("compressed image: %u bytes received for %u, %u%%\r\n",
+                           image->recv_len, image->image_len, (uint32_t)((uint64_t)image->recv_len * 100 / image->image_len));
+    }
+
+    at_heatshrink_decoder_deinit(&image->decoder);
+    free(image);
+
+    return ret;
+}
+#endif
@@ -0,0 +1,387 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_AT_OTA_PIPELINE_SUPPORT
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_spi_flash.h"
+#include "esp_image_format.h"
+
+#include "at_ota_pipeline.h"
+
+#define AT_OTA_PIPELINE_BUFFER_SIZE         (CONFIG_AT_OTA_PIPELINE_BUFFER_SIZE & ~(AT_OTA_PIPELINE_WRITE_ALIGN - 1))
+#define AT_OTA_PIPELINE_BUFFER_NUM          CONFIG_AT_OTA_PIPELINE_BUFFER_NUM
+#define AT_OTA_PIPELINE_ERASE_AHEAD         (CONFIG_AT_OTA_PIPELINE_ERASE_AHEAD_SECTORS * AT_OTA_PIPELINE_SECTOR_SIZE)
+#define AT_OTA_PIPELINE_SECTOR_SIZE         SPI_FLASH_SEC_SIZE
+#define AT_OTA_PIPELINE_TASK_STACK_SIZE     4096    // the written callback may save to NVS
+
+#define AT_OTA_PIPELINE_DEBUG  printf
+
+typedef struct {
+    uint8_t* data;                          // NULL asks the flash writer to stop
+    uint32_t len;
+} at_ota_pipeline_buffer_t;
+
+struct at_ota_pipeline {
+    const esp_partition_t* partition;
+    uint32_t start;                         // offset the image continues at
+    uint32_t offset;                        // flash writer: write cursor
+    uint32_t erased;                        // flash writer: the partition is erased up to here
+    uint32_t erase_limit;                   // no need to erase beyond the image
+    at_ota_pipeline_written_cb_t written_cb;
+    void* arg;
+
+    QueueHandle_t free_queue;
+    QueueHandle_t full_queue;
+    SemaphoreHandle_t done;
+    volatile esp_err_t err;                 // first error, set by either stage
+    volatile bool complete;
+
+    at_ota_pipeline_buffer_t fill;          // receive stage: the buffer being filled, data is NULL if none
+    uint32_t queued;                        // receive stage: bytes given to at_ota_pipeline_write
+    int64_t start_us;
+    at_ota_pipeline_stats_t stats;
+    uint8_t* memory;                        // all the buffers
+};
+
+static esp_err_t at_ota_pipeline_erase_next(at_ota_pipeline_t* pipeline)
+{
+    int64_t start_us = 0;
+    esp_err_t ret = ESP_OK;
+
+    if (pipeline->erased >= pipeline->partition->size) {
+        AT_OTA_PIPELINE_DEBUG("bin is larger than the partition!\r\n");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    start_us = esp_timer_get_time();
+    ret = esp_partition_erase_range(pipeline->partition, pipeline->erased, AT_OTA_PIPELINE_SECTOR_SIZE);
+    pipeline->stats.erase_us += esp_timer_get_time() - start_us;
+    if (ret != ESP_OK) {
+        AT_OTA_PIPELINE_DEBUG("esp_partition_erase_range failed!\r\n");
+        return ret;
+    }
+    pipeline->erased += AT_OTA_PIPELINE_SECTOR_SIZE;
+
+    return ESP_OK;
+}
+
+// Write one buffer, in pieces that do not cross a sector boundary
+static esp_err_t at_ota_pipeline_flush(at_ota_pipeline_t* pipeline, uint8_t* data, uint32_t len)
+{
+    uint32_t image_len = len;
+    uint32_t size = 0;
+    uint32_t piece_len = 0;
+    uint32_t rem = len % AT_OTA_PIPELINE_WRITE_ALIGN;
+    int64_t start_us = 0;
+    esp_err_t ret = ESP_OK;
+
+    // only the last buffer can end off the alignment
+    if (rem > 0) {
+        if (pipeline->complete) {
+            memset(data + len, 0xFF, AT_OTA_PIPELINE_WRITE_ALIGN - rem);
+            len += AT_OTA_PIPELINE_WRITE_ALIGN - rem;
+        } else {
+            // dropped, an interrupted download continues from the aligned offset
+            len -= rem;
+            image_len = len;
+        }
+    }
+
+    while (len > 0) {
+        size = AT_OTA_PIPELINE_SECTOR_SIZE - (pipeline->offset % AT_OTA_PIPELINE_SECTOR_SIZE);
+        if (size > len) {
+            size = len;
+        }
+
+        while (pipeline->offset + size > pipeline->erased) {
+            ret = at_ota_pipeline_erase_next(pipeline);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+
+        start_us = esp_timer_get_time();
+        ret = esp_partition_write(pipeline->partition, pipeline->offset, data, size);
+        pipeline->stats.write_us += esp_timer_get_time() - start_us;
+        if (ret != ESP_OK) {
+            AT_OTA_PIPELINE_DEBUG("esp_partition_write failed!\r\n");
+            return ret;
+        }
+
+        piece_len = (size < image_len) ? size : image_len;
+        if (pipeline->written_cb) {
+            ret = pipeline->written_cb(pipeline->arg, data, piece_len, pipeline->offset);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+        pipeline->stats.bytes += piece_len;
+        pipeline->offset += size;
+        image_len -= piece_len;
+        data += size;
+        len -= size;
+    }
+
+    return ESP_OK;
+}
+
+static void at_ota_pipeline_task(void* arg)
+{
+    at_ota_pipeline_t* pipeline = (at_ota_pipeline_t*)arg;
+    at_ota_pipeline_buffer_t buffer;
+    int64_t start_us = 0;
+
+    for (;;) {
+        if (xQueueReceive(pipeline->full_queue, &buffer, 0) != pdTRUE) {
+            // nothing to write, erase ahead of the write cursor while waiting for the network
+            if (pipeline->err == ESP_OK && pipeline->erased < pipeline->erase_limit
+                && pipeline->erased < pipeline->offset + AT_OTA_PIPELINE_ERASE_AHEAD) {
+                esp_err_t ret = at_ota_pipeline_erase_next(pipeline);
+                if (ret != ESP_OK && pipeline->err == ESP_OK) {
+                    pipeline->err = ret;
+                }
+                continue;
+            }
+
+            start_us = esp_timer_get_time();
+            xQueueReceive(pipeline->full_queue, &buffer, portMAX_DELAY);
+            pipeline->stats.write_idle_us += esp_timer_get_time() - start_us;
+        }
+
+        if (buffer.data == NULL) {
+            break;
+        }
+
+        // after an error the buffers are only given back, so the receive stage does not block
+        if (pipeline->err == ESP_OK) {
+            esp_err_t ret = at_ota_pipeline_flush(pipeline, buffer.data, buffer.len);
+            if (ret != ESP_OK && pipeline->err == ESP_OK) {
+                pipeline->err = ret;
+            }
+        }
+        xQueueSend(pipeline->free_queue, &buffer, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(pipeline->done);
+    vTaskDelete(NULL);
+}
+
+// The checks of esp_ota_begin(), which the pipeline does not call
+static esp_err_t at_ota_pipeline_check_target(const esp_partition_t* partition)
+{
+    const esp_partition_t* running = esp_ota_get_running_partition();
+
+    if (partition->type != ESP_PARTITION_TYPE_APP) {
+        return ESP_OK;
+    }
+
+    if (running && partition->address == running->address) {
+        AT_OTA_PIPELINE_DEBUG("OTA partition is the running one!\r\n");
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    esp_ota_img_states_t state;
+    // the running app must confirm itself first, or the bootloader could roll back to the image being written
+    if (running && esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        AT_OTA_PIPELINE_DEBUG("Running app is not confirmed yet (ESP_OTA_IMG_PENDING_VERIFY)!\r\n");
+        return ESP_ERR_OTA_ROLLBACK_INVALID_STATE;
+    }
+#endif
+
+    return ESP_OK;
+}
+
+// The check of esp_ota_end(), which the pipeline does not call
+static esp_err_t at_ota_pipeline_verify(at_ota_pipeline_t* pipeline)
+{
+    esp_image_metadata_t data;
+    const esp_partition_pos_t part_pos = {
+        .offset = pipeline->partition->address,
+        .size = pipeline->partition->size,
+    };
+
+    if (pipeline->partition->type != ESP_PARTITION_TYPE_APP) {
+        return ESP_OK;
+    }
+
+    if (esp_image_verify(ESP_IMAGE_VERIFY, &part_pos, &data) != ESP_OK) {
+        AT_OTA_PIPELINE_DEBUG("OTA image verify failed!\r\n");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    return ESP_OK;
+}
+
+static void at_ota_pipeline_free(at_ota_pipeline_t* pipeline)
+{
+    if (pipeline->free_queue) {
+        vQueueDelete(pipeline->free_queue);
+    }
+    if (pipeline->full_queue) {
+        vQueueDelete(pipeline->full_queue);
+    }
+    if (pipeline->done) {
+        vSemaphoreDelete(pipeline->done);
+    }
+    free(pipeline->memory);
+    free(pipeline);
+}
+
+at_ota_pipeline_t* at_ota_pipeline_start(const esp_partition_t* partition, uint32_t offset, uint32_t image_len,
+                                         at_ota_pipeline_written_cb_t written_cb, void* arg)
+{
+    at_ota_pipeline_t* pipeline = NULL;
+    at_ota_pipeline_buffer_t buffer;
+    int i = 0;
+
+    if (at_ota_pipeline_check_target(partition) != ESP_OK) {
+        return NULL;
+    }
+
+    pipeline = (at_ota_pipeline_t*)calloc(1, sizeof(at_ota_pipeline_t));
+    if (pipeline == NULL) {
+        return NULL;
+    }
+
+    pipeline->partition = partition;
+    pipeline->start = offset;
+    pipeline->offset = offset;
+    // a sector the image continues in was erased by the pipeline that wrote its first part
+    pipeline->erased = (offset + AT_OTA_PIPELINE_SECTOR_SIZE - 1) & ~(AT_OTA_PIPELINE_SECTOR_SIZE - 1);
+    pipeline->erase_limit = partition->size;
+    if (image_len > 0 && image_len < partition->size) {
+        pipeline->erase_limit = image_len;
+    }
+    pipeline->written_cb = written_cb;
+    pipeline->arg = arg;
+
+    pipeline->memory = (uint8_t*)malloc(AT_OTA_PIPELINE_BUFFER_SIZE * AT_OTA_PIPELINE_BUFFER_NUM);
+    pipeline->free_queue = xQueueCreate(AT_OTA_PIPELINE_BUFFER_NUM, sizeof(at_ota_pipeline_buffer_t));
+    pipeline->full_queue = xQueueCreate(AT_OTA_PIPELINE_BUFFER_NUM + 1, sizeof(at_ota_pipeline_buffer_t));
+    pipeline->done = xSemaphoreCreateBinary();
+    if (!pipeline->memory || !pipeline->free_queue || !pipeline->full_queue || !pipeline->done) {
+        at_ota_pipeline_free(pipeline);
+        return NULL;
+    }
+
+    for (i = 0; i < AT_OTA_PIPELINE_BUFFER_NUM; i++) {
+        buffer.data = pipeline->memory + i * AT_OTA_PIPELINE_BUFFER_SIZE;
+        buffer.len = 0;
+        xQueueSend(pipeline->free_queue, &buffer, 0);
+    }
+
+    pipeline->start_us = esp_timer_get_time();
+    // the same priority as the receive stage, each one runs while the other waits
+    if (xTaskCreate(at_ota_pipeline_task, "ota_write", AT_OTA_PIPELINE_TASK_STACK_SIZE, pipeline,
+                    uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        at_ota_pipeline_free(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+esp_err_t at_ota_pipeline_write(at_ota_pipeline_t* pipeline, const uint8_t* data, size_t len)
+{
+    uint32_t size = 0;
+    int64_t start_us = 0;
+
+    if (pipeline->err != ESP_OK) {
+        return pipeline->err;
+    }
+
+    if (pipeline->start == 0 && pipeline->queued == 0 && len > 0 && pipeline->partition->type == ESP_PARTITION_TYPE_APP
+        && data[0] != ESP_IMAGE_HEADER_MAGIC) {
+        AT_OTA_PIPELINE_DEBUG("OTA Write Header format Check Failed! first byte is %02x\r\n", data[0]);
+        pipeline->err = ESP_ERR_OTA_VALIDATE_FAILED;
+        return pipeline->err;
+    }
+
+    while (len > 0) {
+        if (pipeline->fill.data == NULL) {
+            start_us = esp_timer_get_time();
+            xQueueReceive(pipeline->free_queue, &pipeline->fill, portMAX_DELAY);
+            pipeline->stats.recv_wait_us += esp_timer_get_time() - start_us;
+            pipeline->fill.len = 0;
+        }
+
+        size = AT_OTA_PIPELINE_BUFFER_SIZE - pipeline->fill.len;
+        if (size > len) {
+            size = len;
+        }
+        memcpy(pipeline->fill.data + pipeline->fill.len, data, size);
+        pipeline->fill.len += size;
+        pipeline->queued += size;
+        data += size;
+        len -= size;
+
+        if (pipeline->fill.len == AT_OTA_PIPELINE_BUFFER_SIZE) {
+            xQueueSend(pipeline->full_queue, &pipeline->fill, portMAX_DELAY);
+            pipeline->fill.data = NULL;
+        }
+    }
+
+    return pipeline->err;
+}
+
+esp_err_t at_ota_pipeline_end(at_ota_pipeline_t* pipeline, bool complete, at_ota_pipeline_stats_t* stats)
+{
+    at_ota_pipeline_buffer_t buffer = { NULL, 0 };
+    esp_err_t ret = ESP_OK;
+
+    pipeline->complete = complete;
+    if (pipeline->fill.data) {
+        xQueueSend(pipeline->full_queue, &pipeline->fill, portMAX_DELAY);
+        pipeline->fill.data = NULL;
+    }
+    xQueueSend(pipeline->full_queue, &buffer, portMAX_DELAY);
+    xSemaphoreTake(pipeline->done, portMAX_DELAY);
+
+    pipeline->stats.total_us = esp_timer_get_time() - pipeline->start_us;
+    AT_OTA_PIPELINE_DEBUG("ota pipeline: %u bytes in %u ms, receive wait %u ms, flash erase %u ms, flash write %u ms, writer idle %u ms\r\n",
+                          pipeline->stats.bytes, pipeline->stats.total_us / 1000, pipeline->stats.recv_wait_us / 1000,
+                          pipeline->stats.erase_us / 1000, pipeline->stats.write_us / 1000, pipeline->stats.write_idle_us / 1000);
+    if (stats) {
+        *stats = pipeline->stats;
+    }
+    ret = pipeline->err;
+    if (ret == ESP_OK && complete) {
+        ret = at_ota_pipeline_verify(pipeline);
+    }
+    at_ota_pipeline_free(pipeline);
+
+    return ret;
+}
+#endif
@@ -0,0 +1,351 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+#include "esp_spi_flash.h"
+#include "nvs.h"
+
+#include "at_ota_resume.h"
+
+#define AT_OTA_RESUME_NAMESPACE             "AT_OTA"
+#define AT_OTA_RESUME_KEY                   "resume"
+#define AT_OTA_RESUME_MAGIC                 0x4f544131      // "OTA1"
+#define AT_OTA_RESUME_SECTOR_SIZE           SPI_FLASH_SEC_SIZE
+#define AT_OTA_RESUME_SAVE_INTERVAL         (CONFIG_AT_OTA_RESUME_SAVE_SECTORS * AT_OTA_RESUME_SECTOR_SIZE)
+#define AT_OTA_RESUME_READ_BUFFER_SIZE      1024
+
+#define AT_OTA_RESUME_DEBUG  printf
+
+// the progress saved in NVS, offset is always at a sector boundary
+typedef struct {
+    uint32_t magic;
+    uint32_t partition_addr;
+    uint32_t offset;
+    int32_t total_len;
+    uint8_t source[32];
+    uint8_t digest[32];                         // SHA-256 of the first offset bytes
+    char etag[AT_OTA_RESUME_ETAG_LEN_MAX + 1];
+} at_ota_resume_record_t;
+
+static bool at_ota_resume_record_load(at_ota_resume_record_t* record)
+{
+    nvs_handle handle;
+    size_t len = sizeof(at_ota_resume_record_t);
+    esp_err_t ret;
+
+    if (nvs_open(AT_OTA_RESUME_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    ret = nvs_get_blob(handle, AT_OTA_RESUME_KEY, record, &len);
+    nvs_close(handle);
+
+    return (ret == ESP_OK && len == sizeof(at_ota_resume_record_t) && record->magic == AT_OTA_RESUME_MAGIC);
+}
+
+static void at_ota_resume_record_save(const at_ota_resume_record_t* record)
+{
+    nvs_handle handle;
+
+    if (nvs_open(AT_OTA_RESUME_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (record) {
+        nvs_set_blob(handle, AT_OTA_RESUME_KEY, record, sizeof(at_ota_resume_record_t));
+    } else {
+        nvs_erase_key(handle, AT_OTA_RESUME_KEY);
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void at_ota_resume_digest(const at_ota_resume_t* resume, uint8_t digest[32])
+{
+    mbedtls_sha256_context sha;
+
+    // the running context goes on, finish a copy of it
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_clone(&sha, &resume->sha);
+    mbedtls_sha256_finish_ret(&sha, digest);
+    mbedtls_sha256_free(&sha);
+}
+
+static void at_ota_resume_save(at_ota_resume_t* resume)
+{
+    at_ota_resume_record_t record;
+
+    memset(&record, 0x0, sizeof(record));
+    record.magic = AT_OTA_RESUME_MAGIC;
+    record.partition_addr = resume->partition->address;
+    record.offset = resume->offset;
+    record.total_len = resume->total_len;
+    memcpy(record.source, resume->source, sizeof(record.source));
+    at_ota_resume_digest(resume, record.digest);
+    memcpy(record.etag, resume->etag, sizeof(record.etag));
+
+    at_ota_resume_record_save(&record);
+    resume->saved = resume->offset;
+}
+
+static void at_ota_resume_restart(at_ota_resume_t* resume)
+{
+    mbedtls_sha256_free(&resume->sha);
+    mbedtls_sha256_init(&resume->sha);
+    mbedtls_sha256_starts_ret(&resume->sha, 0);
+
+    // flash beyond the offset is erased again before it is written
+    resume->offset = 0;
+    resume->saved = 0;
+    resume->total_len = -1;
+    resume->etag[0] = '\0';
+    at_ota_resume_record_save(NULL);
+}
+
+// Hash the first len bytes in flash, the running context then continues after them
+static bool at_ota_resume_verify(at_ota_resume_t* resume, uint32_t len, const uint8_t expected[32])
+{
+    uint8_t digest[32];
+    uint8_t* buffer = NULL;
+    uint32_t offset = 0;
+    uint32_t size = 0;
+
+    buffer = (uint8_t*)malloc(AT_OTA_RESUME_READ_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    for (offset = 0; offset < len; offset += size) {
+        size = (len - offset > AT_OTA_RESUME_READ_BUFFER_SIZE) ? AT_OTA_RESUME_READ_BUFFER_SIZE : (len - offset);
+        if (esp_partition_read(resume->partition, offset, buffer, size) != ESP_OK) {
+            break;
+        }
+        mbedtls_sha256_update_ret(&resume->sha, buffer, size);
+    }
+    free(buffer);
+
+    if (offset < len) {
+        return false;
+    }
+    at_ota_resume_digest(resume, digest);
+
+    return (memcmp(digest, expected, sizeof(digest)) == 0);
+}
+
+esp_err_t at_ota_resume_begin(at_ota_resume_t* resume, const esp_partition_t* partition, const char* source)
+{
+    at_ota_resume_record_t* record = NULL;
+
+    memset(resume, 0x0, sizeof(at_ota_resume_t));
+    resume->partition = partition;
+    resume->total_len = -1;
+    mbedtls_sha256_ret((const unsigned char*)source, strlen(source), resume->source, 0);
+    mbedtls_sha256_init(&resume->sha);
+    mbedtls_sha256_starts_ret(&resume->sha, 0);
+
+    record = (at_ota_resume_record_t*)malloc(sizeof(at_ota_resume_record_t));
+    if (record == NULL) {
+        resume->partition = NULL;
+        mbedtls_sha256_free(&resume->sha);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (!at_ota_resume_record_load(record)) {
+        free(record);
+        return ESP_OK;
+    }
+
+    if (record->partition_addr != partition->address || memcmp(record->source, resume->source, sizeof(record->source)) != 0
+        || record->offset > partition->size || (record->offset % AT_OTA_RESUME_SECTOR_SIZE) != 0) {
+        AT_OTA_RESUME_DEBUG("saved progress is for another image\r\n");
+        at_ota_resume_restart(resume);
+    } else if (!at_ota_resume_verify(resume, record->offset, record->digest)) {
+        AT_OTA_RESUME_DEBUG("flash does not match the saved progress\r\n");
+        at_ota_resume_restart(resume);
+    } else {
+        resume->offset = record->offset;
+        resume->saved = record->offset;
+        resume->total_len = record->total_len;
+        record->etag[AT_OTA_RESUME_ETAG_LEN_MAX] = '\0';
+        strcpy(resume->etag, record->etag);
+        AT_OTA_RESUME_DEBUG("resume from %u of %d\r\n", resume->offset, resume->total_len);
+    }
+    free(record);
+
+    return ESP_OK;
+}
+
+int at_ota_resume_request_headers(const at_ota_resume_t* resume, char* buf, size_t size)
+{
+    int len = 0;
+
+    if (resume->offset == 0 || size == 0) {
+        return 0;
+    }
+
+    len = snprintf(buf, size, "Range: bytes=%u-\r\n", resume->offset);
+    if (resume->etag[0] != '\0' && len >= 0 && (size_t)len < size) {
+        len += snprintf(buf + len, size - len, "If-Range: %s\r\n", resume->etag);
+    }
+
+    return (len >= 0 && (size_t)len < size) ? len : 0;
+}
+
+// "bytes <first>-<last>/<complete length or *>"
+static bool at_ota_resume_parse_range(const char* content_range, uint32_t* first, int32_t* total_len)
+{
+    char* end = NULL;
+    unsigned long value = 0;
+
+    if (strncasecmp(content_range, "bytes ", strlen("bytes ")) != 0) {
+        return false;
+    }
+    content_range += strlen("bytes ");
+
+    value = strtoul(content_range, &end, 10);
+    if (end == content_range || *end != '-') {
+        return false;
+    }
+    *first = value;
+
+    content_range = strchr(end, '/');
+    if (content_range == NULL) {
+        return false;
+    }
+    content_range++;
+
+    if (*content_range == '*') {
+        *total_len = -1;
+        return true;
+    }
+    value = strtoul(content_range, &end, 10);
+    if (end == content_range || value > INT32_MAX) {
+        return false;
+    }
+    *total_len = value;
+
+    return true;
+}
+
+esp_err_t at_ota_resume_response(at_ota_resume_t* resume, int status_code, const char* content_range, const char* etag, int64_t content_length)
+{
+    uint32_t first = 0;
+    int32_t total_len = -1;
+
+    if (status_code == 206) {
+        if (content_range == NULL || !at_ota_resume_parse_range(content_range, &first, &total_len)
+            || first != resume->offset || (resume->total_len >= 0 && total_len >= 0 && total_len != resume->total_len)) {
+            AT_OTA_RESUME_DEBUG("range %s does not continue at %u, start again\r\n", content_range ? content_range : "", resume->offset);
+            at_ota_resume_restart(resume);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (total_len < 0) {
+            total_len = resume->total_len;
+        }
+    } else if (status_code == 200) {
+        // no range support, or the image changed since its ETag was saved
+        if (resume->offset > 0) {
+            AT_OTA_RESUME_DEBUG("server sent the whole image, start again\r\n");
+            at_ota_resume_restart(resume);
+        }
+        total_len = (content_length >= 0 && content_length <= INT32_MAX) ? (int32_t)content_length : -1;
+    } else if (status_code == 416 && resume->offset > 0) {
+        // nothing left after the offset, the image is not the one the progress was saved for
+        AT_OTA_RESUME_DEBUG("range not satisfiable at %u, start again\r\n", resume->offset);
+        at_ota_resume_restart(resume);
+        return ESP_ERR_INVALID_RESPONSE;
+    } else {
+        AT_OTA_RESUME_DEBUG("http status %d!\r\n", status_code);
+        return ESP_FAIL;
+    }
+
+    if (total_len >= 0 && (uint32_t)total_len > resume->partition->size) {
+        AT_OTA_RESUME_DEBUG("bin size %d is larger than the partition!\r\n", total_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    resume->total_len = total_len;
+
+    // an ETag too long to be saved is dropped, the next request then goes without If-Range
+    if (etag && etag[0] != '\0') {
+        if (strlen(etag) <= AT_OTA_RESUME_ETAG_LEN_MAX) {
+            strcpy(resume->etag, etag);
+        } else {
+            resume->etag[0] = '\0';
+        }
+    } else if (status_code == 200) {
+        resume->etag[0] = '\0';
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t at_ota_resume_written(void* arg, const uint8_t* data, size_t len, uint32_t offset)
+{
+    at_ota_resume_t* resume = (at_ota_resume_t*)arg;
+
+    if (offset != resume->offset) {
+        AT_OTA_RESUME_DEBUG("write at %u does not continue at %u!\r\n", offset, resume->offset);
+        return ESP_ERR_INVALID_STATE;
+    }
+    mbedtls_sha256_update_ret(&resume->sha, data, len);
+    resume->offset += len;
+
+    // the pipeline never writes across a sector boundary, so the progress is saved at one
+    if ((resume->offset % AT_OTA_RESUME_SECTOR_SIZE) == 0 && resume->offset - resume->saved >= AT_OTA_RESUME_SAVE_INTERVAL) {
+        at_ota_resume_save(resume);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t at_ota_resume_end(at_ota_resume_t* resume, uint8_t digest[32])
+{
+    if (resume->offset == 0 || (resume->total_len >= 0 && resume->offset != (uint32_t)resume->total_len)) {
+        AT_OTA_RESUME_DEBUG("bin length %u, expected %d!\r\n", resume->offset, resume->total_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (digest) {
+        mbedtls_sha256_finish_ret(&resume->sha, digest);
+    }
+    mbedtls_sha256_free(&resume->sha);
+    resume->partition = NULL;
+    at_ota_resume_record_save(NULL);
+
+    return ESP_OK;
+}
+
+void at_ota_resume_abort(at_ota_resume_t* resume)
+{
+    if (resume->partition == NULL) {
+        return;
+    }
+    mbedtls_sha256_free(&resume->sha);
+    resume->partition = NULL;
+}
+#endif
@@ -25,6 +25,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <strings.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -32,13 +33,24 @@
 
 #include "esp_http_client.h"
 #include "esp_https_ota.h"
+#include "esp_ota_ops.h"
 #include "esp_at_core.h"
 #include "esp_at.h"
 
 #ifdef CONFIG_AT_USER_COMMAND_SUPPORT
 
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+#include "at_ota_pipeline.h"
+#include "at_ota_resume.h"
+#elif defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+#include "at_ota_image.h"
+#endif
+
 #define AT_USERRAM_READ_BUFFER_SIZE     1024
 #define AT_USEROTA_URL_LEN_MAX          (8 * 1024)
+#define AT_USEROTA_BUFFER_SIZE          2048
+#define AT_USEROTA_REDIRECT_MAX         5
+#define AT_USEROTA_RETRY_DELAY_MS       1000
 
 typedef enum {
     AT_USERRAM_FREE = 0,
@@ -54,6 +66,14 @@ static uint32_t s_user_ram_size = 0;
 static int32_t s_user_ota_total_size = 0;
 static int32_t s_user_ota_recv_size = 0;
 static bool s_user_ota_is_chunked = true;
+
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+// headers of the response the resumed download needs, filled in by the event handler
+typedef struct {
+    char etag[AT_OTA_RESUME_ETAG_LEN_MAX + 1];
+    char content_range[64];
+} at_user_ota_headers_t;
+#endif
 static xSemaphoreHandle s_at_user_sync_sema;
 
 static void at_user_wait_data_cb(void)
@@ -236,6 +256,18 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
             s_user_ota_is_chunked = false;
         }
 
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+        if (evt->user_data) {
+            at_user_ota_headers_t *headers = (at_user_ota_headers_t *)evt->user_data;
+
+            if (strcasecmp(evt->header_key, "ETag") == 0 && strlen(evt->header_value) < sizeof(headers->etag)) {
+                strcpy(headers->etag, evt->header_value);
+            } else if (strcasecmp(evt->header_key, "Content-Range") == 0 && strlen(evt->header_value) < sizeof(headers->content_range)) {
+                strcpy(headers->content_range, evt->header_value);
+            }
+        }
+#endif
+
         break;
     case HTTP_EVENT_ON_DATA:
         s_user_ota_recv_size += evt->data_len;
@@ -259,6 +291,259 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
+#if defined(CONFIG_AT_OTA_RESUME_SUPPORT) || defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+// Send the request and fetch the response headers, following redirects as esp_https_ota does.
+// headers, filled in by the event handler, are cleared before each response, it may be NULL.
+static esp_err_t at_user_ota_open(esp_http_client_handle_t client, uint8_t *buffer, void *headers, size_t headers_size, int *content_length)
+{
+    int redirect = 0;
+    int status_code = 0;
+    esp_err_t ret = ESP_OK;
+
+    for (redirect = 0; ; redirect++) {
+        if (headers) {
+            memset(headers, 0x0, headers_size);
+        }
+        ret = esp_http_client_open(client, 0);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        *content_length = esp_http_client_fetch_headers(client);
+        status_code = esp_http_client_get_status_code(client);
+        if ((status_code != 301 && status_code != 302 && status_code != 307 && status_code != 308) || redirect >= AT_USEROTA_REDIRECT_MAX) {
+            return ESP_OK;
+        }
+
+        while (esp_http_client_read(client, (char *)buffer, AT_USEROTA_BUFFER_SIZE) > 0);
+        esp_http_client_close(client);
+        esp_http_client_set_redirection(client);
+    }
+}
+#endif
+
+#ifdef CONFIG_AT_OTA_RESUME_SUPPORT
+// One request of a resumed download, from the offset reached so far to the end of the image.
+// *fatal is set if the download cannot succeed and should not be retried.
+static esp_err_t at_user_ota_get(at_ota_resume_t *resume, const char *url, uint8_t *buffer, bool *fatal)
+{
+    at_user_ota_headers_t headers;
+    at_ota_pipeline_t *pipeline = NULL;
+    char range[32];
+    int status_code = 0;
+    int content_length = 0;
+    int len = 0;
+    esp_err_t ret = ESP_OK;
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .event_handler = _http_event_handler,
+        .buffer_size = AT_USEROTA_BUFFER_SIZE,
+        .user_data = &headers,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (resume->offset > 0) {
+        snprintf(range, sizeof(range), "bytes=%u-", resume->offset);
+        esp_http_client_set_header(client, "Range", range);
+        if (resume->etag[0] != '\0') {
+            esp_http_client_set_header(client, "If-Range", resume->etag);
+        }
+    }
+
+    ret = at_user_ota_open(client, buffer, &headers, sizeof(headers), &content_length);
+    if (ret == ESP_OK) {
+        status_code = esp_http_client_get_status_code(client);
+        if (content_length < 0) {
+            ret = ESP_FAIL;
+        } else {
+            ret = at_ota_resume_response(resume, status_code, headers.content_range, headers.etag,
+                                         esp_http_client_is_chunked_response(client) ? -1 : content_length);
+            // a range that does not fit is asked again from zero
+            *fatal = (ret != ESP_OK && ret != ESP_ERR_INVALID_RESPONSE);
+        }
+    }
+
+    if (ret == ESP_OK) {
+        s_user_ota_total_size = resume->total_len;
+        s_user_ota_recv_size = resume->offset;
+        s_user_ota_is_chunked = (resume->total_len < 0);
+
+        // the flash writer task writes while the next data is received
+        pipeline = at_ota_pipeline_start(resume->partition, resume->offset, (resume->total_len > 0) ? resume->total_len : 0,
+                                         at_ota_resume_written, resume);
+        if (pipeline == NULL) {
+            ret = ESP_ERR_NO_MEM;
+            *fatal = true;
+        }
+    }
+
+    while (ret == ESP_OK) {
+        len = esp_http_client_read(client, (char *)buffer, AT_USEROTA_BUFFER_SIZE);
+        if (len < 0) {
+            ret = ESP_FAIL;
+        } else if (len == 0) {
+            if (!esp_http_client_is_complete_data_received(client)) {
+                ret = ESP_FAIL;
+            }
+            break;
+        } else {
+            ret = at_ota_pipeline_write(pipeline, buffer, len);
+            *fatal = (ret != ESP_OK);
+        }
+    }
+
+    if (pipeline) {
+        // a partial tail is only written when the image is complete
+        esp_err_t err = at_ota_pipeline_end(pipeline, (ret == ESP_OK), NULL);
+        if (err != ESP_OK) {
+            ret = err;
+            *fatal = true;
+        }
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return ret;
+}
+
+// AT+USEROTA with the download continued after a dropped connection, here or by the next AT+USEROTA
+static esp_err_t at_user_ota_resumable(const char *url)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    at_ota_resume_t resume;
+    uint8_t *buffer = NULL;
+    int retry = 0;
+    int i = 0;
+    bool fatal = false;
+    uint8_t digest[32];
+    esp_err_t ret = ESP_OK;
+
+    if (partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    buffer = (uint8_t *)malloc(AT_USEROTA_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = at_ota_resume_begin(&resume, partition, url);
+    if (ret != ESP_OK) {
+        free(buffer);
+        return ret;
+    }
+
+    for (retry = 0; ; retry++) {
+        ret = at_user_ota_get(&resume, url, buffer, &fatal);
+        if (ret == ESP_OK || fatal || retry >= CONFIG_AT_OTA_RESUME_RETRY_MAX) {
+            break;
+        }
+        printf("download stopped at %u, retry %d\r\n", resume.offset, retry + 1);
+        vTaskDelay(AT_USEROTA_RETRY_DELAY_MS / portTICK_PERIOD_MS);
+    }
+    free(buffer);
+
+    if (ret == ESP_OK) {
+        ret = at_ota_resume_end(&resume, digest);
+    }
+    if (ret != ESP_OK) {
+        at_ota_resume_abort(&resume);
+        return ret;
+    }
+
+    printf("sha256:");
+    for (i = 0; i < sizeof(digest); i++) {
+        printf("%02x", digest[i]);
+    }
+    printf("\r\n");
+
+    // the image is verified before the boot partition is changed
+    return esp_ota_set_boot_partition(partition);
+}
+#elif defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+// AT+USEROTA that takes a compressed image as well as a plain one, esp_https_ota only writes what it receives
+static esp_err_t at_user_ota_download(const char *url)
+{
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    at_ota_image_t *image = NULL;
+    uint8_t *buffer = NULL;
+    int content_length = 0;
+    int len = 0;
+    esp_err_t ret = ESP_OK;
+
+    esp_http_client_config_t config = {
+        .url = url,
+        .event_handler = _http_event_handler,
+        .keep_alive_enable = true,
+        .buffer_size = AT_USEROTA_BUFFER_SIZE,
+    };
+
+    if (partition == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    buffer = (uint8_t *)malloc(AT_USEROTA_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        free(buffer);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = at_user_ota_open(client, buffer, NULL, 0, &content_length);
+    if (ret == ESP_OK && esp_http_client_get_status_code(client) != 200) {
+        printf("http status %d\r\n", esp_http_client_get_status_code(client));
+        ret = ESP_FAIL;
+    }
+
+    if (ret == ESP_OK) {
+        s_user_ota_is_chunked = esp_http_client_is_chunked_response(client);
+        image = at_ota_image_start(partition, (!s_user_ota_is_chunked && content_length > 0) ? content_length : 0);
+        if (image == NULL) {
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
+
+    while (ret == ESP_OK) {
+        len = esp_http_client_read(client, (char *)buffer, AT_USEROTA_BUFFER_SIZE);
+        if (len < 0) {
+            ret = ESP_FAIL;
+        } else if (len == 0) {
+            if (!esp_http_client_is_complete_data_received(client)) {
+                ret = ESP_FAIL;
+            }
+            break;
+        } else {
+            ret = at_ota_image_write(image, buffer, len);
+        }
+    }
+
+    if (image) {
+        esp_err_t err = at_ota_image_end(image, (ret == ESP_OK));
+        if (ret == ESP_OK) {
+            ret = err;
+        }
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    free(buffer);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    // the image is verified before the boot partition is changed
+    return esp_ota_set_boot_partition(partition);
+}
+#endif
+
 static uint8_t at_setup_cmd_userota(uint8_t para_num)
 {
 #define TEMP_BUFFER_SIZE    32
@@ -324,14 +609,20 @@ static uint8_t at_setup_cmd_userota(uint8_t para_num)
     s_user_ota_recv_size = 0;
     s_user_ota_is_chunked = true;
 
+#if defined(CONFIG_AT_OTA_RESUME_SUPPORT)
+    esp_err_t ret = at_user_ota_resumable((const char*)url);
+#elif defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+    esp_err_t ret = at_user_ota_download((const char*)url);
+#else
     esp_http_client_config_t config = {
         .url = (const char*)url,
         .event_handler = _http_event_handler,
         .keep_alive_enable = true,
-        .buffer_size = 2048,
+        .buffer_size = AT_USEROTA_BUFFER_SIZE,
     };
 
     esp_err_t ret = esp_https_ota(&config);
+#endif
 
     free(url);
 
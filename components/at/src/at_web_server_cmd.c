@@ -64,6 +64,12 @@
 #include "at_web_dns_server.h"
 static char *s_at_web_redirect_url = NULL;
 #endif
+#ifdef CONFIG_AT_OTA_PIPELINE_SUPPORT
+#include "at_ota_pipeline.h"
+#endif
+#ifdef CONFIG_AT_OTA_COMPRESS_SUPPORT
+#include "at_ota_image.h"
+#endif
 
 #define ESP_AT_WEB_SERVER_CHECK(a, str, goto_tag, ...)                                              \
     do                                                                                 \
@@ -1492,7 +1498,13 @@ static esp_err_t ota_data_post_handler(httpd_req_t *req)
     int remaining_len = req->content_len;
     int received_len = 0;
     esp_err_t err = ESP_FAIL;
+#if defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+    at_ota_image_t *image = NULL;
+#elif defined(CONFIG_AT_OTA_PIPELINE_SUPPORT)
+    at_ota_pipeline_t *pipeline = NULL;
+#else
     esp_ota_handle_t update_handle = 0;
+#endif
     const esp_partition_t *update_partition = at_web_get_ota_update_partition();
     // check post data size
     if (update_partition->size < total_len) {
@@ -1504,11 +1516,27 @@ static esp_err_t ota_data_post_handler(httpd_req_t *req)
     // Send a message to MCU.
     esp_at_port_write_data((uint8_t*)s_ota_start_response, strlen(s_ota_start_response));
     // start ota
+#if defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+    // a compressed image is decompressed into the pipeline, a plain one goes as it is
+    image = at_ota_image_start(update_partition, total_len);
+    if (image == NULL) {
+        ESP_LOGE(TAG, "ota image start failed");
+        goto err_handler;
+    }
+#elif defined(CONFIG_AT_OTA_PIPELINE_SUPPORT)
+    // the small scratch pieces are gathered into large flash writes by the flash writer task
+    pipeline = at_ota_pipeline_start(update_partition, 0, total_len, NULL, NULL);
+    if (pipeline == NULL) {
+        ESP_LOGE(TAG, "ota pipeline start failed");
+        goto err_handler;
+    }
+#else
     err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "ota begin failed (%s)", esp_err_to_name(err));
         goto err_handler;
     }
+#endif
     // receive ota data
     while (remaining_len > 0) {
         received_len = httpd_req_recv(req, buf, MIN(remaining_len, ESP_AT_WEB_SCRATCH_BUFSIZE)); // Receive the file part by part into a buffer
@@ -1518,22 +1546,58 @@ static esp_err_t ota_data_post_handler(httpd_req_t *req)
                 continue;
             }
             ESP_LOGE(TAG, "Failed to receive post ota data, err = %d", received_len);
+#if defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+            at_ota_image_end(image, false);
+#elif defined(CONFIG_AT_OTA_PIPELINE_SUPPORT)
+            at_ota_pipeline_end(pipeline, false, NULL);
+#else
             esp_ota_end(update_handle);
+#endif
             goto err_handler;
         }else { // received successfully
+#if defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+            err = at_ota_image_write(image, (const uint8_t*)buf, received_len);
+#elif defined(CONFIG_AT_OTA_PIPELINE_SUPPORT)
+            err = at_ota_pipeline_write(pipeline, (const uint8_t*)buf, received_len);
+#else
             err = esp_ota_write(update_handle, buf, received_len);
+#endif
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "ota write failed (%s)", esp_err_to_name(err));
+#if defined(CONFIG_AT_OTA_COMPRESS_SUPPORT)
+                at_ota_image_end(image, false);
+#elif defined(CONFIG_AT_OTA_PIPELINE_SUPPORT)
+                at_ota_pipeline_end(pipeline, false, NULL);
+#else
                 esp_ota_end(update_handle);
+#endif
                 goto err_handler;
             }
             remaining_len -= received_len;
         }
     }
+#ifdef CONFIG_AT_OTA_PIPELINE_SUPPORT
+#ifdef CONFIG_AT_OTA_COMPRESS_SUPPORT
+    err = at_ota_image_end(image, true);
+#else
+    err = at_ota_pipeline_end(pipeline, true, NULL);
+#endif
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ota write failed (%s)", esp_err_to_name(err));
+        goto err_handler;
+    }
+    // the image is validated before the boot partition is changed
+    err = esp_ota_set_boot_partition(update_partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed (%s)!", esp_err_to_name(err));
+        goto err_handler;
+    }
+#else
     err = at_web_ota_end(update_handle, update_partition);
     if (err != ESP_OK) {
         goto err_handler;
     }
+#endif
     at_web_response_ok(req);
     esp_at_port_write_data((uint8_t*)s_ota_receive_success_response, strlen(s_ota_receive_success_response));
     ESP_LOGI(TAG, "ota end successfully, please restart");
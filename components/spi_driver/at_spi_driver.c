@@ -57,6 +57,11 @@ typedef enum {
     SPI_WRITE_DATA
 } spi_state_t;
 
+typedef struct {
+    uint8_t* buffer;
+    uint32_t len;
+} spi_slave_rx_slot_t;
+
 typedef struct {
     int id;
     spi_slave_interface_config_t cfg;
@@ -66,11 +71,26 @@ typedef struct {
     lldesc_t* dmadesc_rx;
     uint32_t flags;
     int max_transfer_sz;
-    QueueHandle_t recv_queue;
-    QueueHandle_t send_queue;
+    bool frame_mode;                // SPI_SLAVE_FRAME_MODE, burst DMA and frames up to max_transfer_sz
+    uint32_t max_frame_len;         // largest transfer in one handshake
+    uint32_t rx_len;                // length of the frame the master is writing
+    portMUX_TYPE lock;              // protects the ring indexes and cur_state against at_spi_intr
+    QueueHandle_t recv_queue;       // index of the RX slots written by the master, in order
+    QueueHandle_t result_queue;     // finished TX transactions
+    SemaphoreHandle_t tx_free_sema; // free entries of tx_ring
     spi_state_t cur_state;
-    void* rx_buffer;
-    void* tx_buffer;
+    spi_slave_rx_slot_t* rx_slots;
+    int rx_num;
+    int rx_write;                   // next slot to load for the master
+    int rx_read;                    // next slot to release by at_spi_slave_free_receive_buffer
+    int rx_count;                   // slots written by the master and not released yet
+    spi_slave_transaction_t** tx_ring;
+    int tx_num;
+    int tx_head;
+    int tx_count;
+    spi_slave_transaction_t* tx_cur; // transaction whose length is published in RD_STA
+    spi_slave_transaction_t send_trans;
+    bool send_pending;
     int dma_chan;
 #ifdef CONFIG_PM_ENABLE
     esp_pm_lock_handle_t pm_lock;
@@ -86,6 +106,30 @@ static inline bool bus_is_iomux(spi_slave_t* host)
     return host->flags & SPICOMMON_BUSFLAG_NATIVE_PINS;
 }
 
+static void at_spi_slave_free_queues(spi_slave_t* host)
+{
+    if (host->rx_slots) {
+        for (int i = 0; i < host->rx_num; i++) {
+            free(host->rx_slots[i].buffer);
+        }
+        free(host->rx_slots);
+    }
+
+    free(host->tx_ring);
+
+    if (host->recv_queue) {
+        vQueueDelete(host->recv_queue);
+    }
+
+    if (host->result_queue) {
+        vQueueDelete(host->result_queue);
+    }
+
+    if (host->tx_free_sema) {
+        vSemaphoreDelete(host->tx_free_sema);
+    }
+}
+
 esp_err_t at_spi_slave_initialize(spi_host_device_t host, const spi_bus_config_t* bus_config, const spi_slave_interface_config_t* slave_config, int dma_chan)
 {
     bool spi_chan_claimed, dma_chan_claimed;
@@ -159,20 +203,34 @@ esp_err_t at_spi_slave_initialize(spi_host_device_t host, const spi_bus_config_t
     esp_pm_lock_acquire(spihost[host]->pm_lock);
 #endif //CONFIG_PM_ENABLE
 
-    spihost[host]->recv_queue = xSemaphoreCreateBinary();
-    spihost[host]->send_queue = xSemaphoreCreateBinary();
-
-    if (!spihost[host]->recv_queue || !spihost[host]->send_queue) {
+    // every slot of the queue keeps its own receive buffer, so the master can write the next packet
+    // while the previous ones are still being processed
+    spihost[host]->rx_num = (slave_config->queue_size > 0) ? slave_config->queue_size : 1;
+    spihost[host]->frame_mode = (slave_config->flags & SPI_SLAVE_FRAME_MODE) ? true : false;
+    spihost[host]->max_frame_len = spihost[host]->frame_mode ? spihost[host]->max_transfer_sz : MAX_SPI_RECEIVE_SIZE;
+    spihost[host]->tx_num = spihost[host]->rx_num;
+    spinlock_initialize(&spihost[host]->lock);
+
+    spihost[host]->recv_queue = xQueueCreate(spihost[host]->rx_num, sizeof(int));
+    spihost[host]->result_queue = xQueueCreate(spihost[host]->tx_num, sizeof(spi_slave_transaction_t*));
+    spihost[host]->tx_free_sema = xSemaphoreCreateCounting(spihost[host]->tx_num, spihost[host]->tx_num);
+    spihost[host]->tx_ring = calloc(spihost[host]->tx_num, sizeof(spi_slave_transaction_t*));
+    spihost[host]->rx_slots = calloc(spihost[host]->rx_num, sizeof(spi_slave_rx_slot_t));
+
+    if (!spihost[host]->recv_queue || !spihost[host]->result_queue || !spihost[host]->tx_free_sema
+            || !spihost[host]->tx_ring || !spihost[host]->rx_slots) {
         ret = ESP_ERR_NO_MEM;
         goto cleanup;
     }
 
     // memory will always be used
-    spihost[host]->rx_buffer = (uint8_t*) heap_caps_malloc(MAX_SPI_RECEIVE_SIZE, MALLOC_CAP_DMA);
+    for (int i = 0; i < spihost[host]->rx_num; i++) {
+        spihost[host]->rx_slots[i].buffer = (uint8_t*) heap_caps_malloc(spihost[host]->max_frame_len, MALLOC_CAP_DMA);
 
-    if (!spihost[host]->rx_buffer) {
-        ret = ESP_ERR_NO_MEM;
-        goto cleanup;
+        if (!spihost[host]->rx_slots[i].buffer) {
+            ret = ESP_ERR_NO_MEM;
+            goto cleanup;
+        }
     }
 
     int flags = bus_config->intr_flags | ESP_INTR_FLAG_INTRDISABLED;
@@ -287,10 +345,7 @@ cleanup:
             esp_pm_lock_delete(spihost[host]->pm_lock);
         }
 #endif
-    }
-
-    if (spihost[host]->rx_buffer) {
-        free(spihost[host]->rx_buffer);
+        at_spi_slave_free_queues(spihost[host]);
     }
 
     free(spihost[host]);
@@ -309,10 +364,7 @@ esp_err_t at_spi_slave_free(spi_host_device_t host)
         spicommon_dma_chan_free(spihost[host]->dma_chan);
     }
 
-    if (spihost[host]->rx_buffer) {
-        free(spihost[host]->rx_buffer);
-    }
-
+    at_spi_slave_free_queues(spihost[host]);
     free(spihost[host]->dmadesc_tx);
     free(spihost[host]->dmadesc_rx);
     esp_intr_free(spihost[host]->intr);
@@ -334,9 +386,10 @@ static void IRAM_ATTR spi_load_trans_buffer(spi_slave_t* host, uint8_t* trans_da
     host->hw->dma_out_link.start = 0;
     host->hw->dma_in_link.start = 0;
     host->hw->dma_conf.val &= ~(SPI_OUT_RST | SPI_IN_RST | SPI_AHBM_RST | SPI_AHBM_FIFO_RST);
-    host->hw->dma_conf.out_data_burst_en = 0;
-    host->hw->dma_conf.indscr_burst_en = 0;
-    host->hw->dma_conf.outdscr_burst_en = 0;
+    // the descriptors are always word aligned, the outgoing data only when both its address and length are
+    host->hw->dma_conf.out_data_burst_en = host->frame_mode && !isrx && ((int)trans_data & 0x3) == 0 && (trans_len & 0x3) == 0;
+    host->hw->dma_conf.indscr_burst_en = host->frame_mode;
+    host->hw->dma_conf.outdscr_burst_en = host->frame_mode;
 
     host->hw->slv_wrbuf_dlen.bit_len = trans_len * 8 - 1;
     host->hw->slv_rdbuf_dlen.bit_len = trans_len * 8 - 1;
@@ -346,7 +399,7 @@ static void IRAM_ATTR spi_load_trans_buffer(spi_slave_t* host, uint8_t* trans_da
     //Fill DMA descriptors
     if (isrx) {
         host->hw->user.usr_miso_highpart = 0;
-        lldesc_setup_link(host->dmadesc_rx, host->rx_buffer, trans_len, true);
+        lldesc_setup_link(host->dmadesc_rx, trans_data, trans_len, true);
         host->hw->dma_in_link.addr = (int)(&host->dmadesc_rx[0]) & 0xFFFFF;
 
         host->hw->dma_in_link.start = 1;
@@ -361,93 +414,238 @@ static void IRAM_ATTR spi_load_trans_buffer(spi_slave_t* host, uint8_t* trans_da
     host->hw->slave.sync_reset = 0;
 }
 
+// Frames longer than a single DMA buffer carry SPI_SLAVE_FRAME_MAGIC in the status register, shorter ones keep
+// the plain length so a master without frame support can still talk to a slave in frame mode.
+static inline uint32_t IRAM_ATTR at_spi_frame_status(spi_slave_t* host, uint32_t len)
+{
+    if (host->frame_mode && len > MAX_SPI_RECEIVE_SIZE) {
+        return SPI_SLAVE_FRAME_HEADER(len);
+    }
+
+    return len;
+}
+
+static inline uint32_t IRAM_ATTR at_spi_frame_len(spi_slave_t* host, uint32_t status)
+{
+    if (host->frame_mode && (status >> 24) == SPI_SLAVE_FRAME_MAGIC) {
+        return status & SPI_SLAVE_FRAME_LEN_MASK;
+    }
+
+    // a plain length, anything longer than one DMA buffer is rejected as 0
+    return (status > MAX_SPI_RECEIVE_SIZE) ? 0 : status;
+}
+
+// Publish the oldest queued transaction in RD_STA, must be called with host->lock held.
+// Return true if the handshake line was toggled.
+static bool IRAM_ATTR at_spi_tx_publish(spi_slave_t* host)
+{
+    if (host->tx_cur != NULL || host->cur_state != SPI_STATE_IDLE || host->tx_count == 0) {
+        return false;
+    }
+
+    host->tx_cur = host->tx_ring[host->tx_head];
+    host->tx_head = (host->tx_head + 1) % host->tx_num;
+    host->tx_count--;
+
+    // a rising edge on the handshake line tells the master to read RD_STA
+    if (host->cfg.post_trans_cb) {
+        host->cfg.post_trans_cb(NULL);
+    }
+
+    host->hw->rd_status.status = at_spi_frame_status(host, (host->tx_cur->length + 7) / 8);
+
+    if (host->cfg.post_setup_cb) {
+        host->cfg.post_setup_cb(NULL);
+    }
+
+    return true;
+}
+
 esp_err_t IRAM_ATTR at_spi_slave_receive(spi_host_device_t host, uint8_t** recv_data, uint32_t* recv_len, TickType_t ticks_to_wait)
 {
-    BaseType_t r;
+    int index = 0;
     SPI_CHECK(VALID_HOST(host), "invalid host", ESP_ERR_INVALID_ARG);
     SPI_CHECK(spihost[host], "host not slave", ESP_ERR_INVALID_ARG);
 
-    // wait MCU send length
-    r = xSemaphoreTake(spihost[host]->recv_queue, ticks_to_wait);
-
-    if (!r) {
+    // wait MCU send data
+    if (xQueueReceive(spihost[host]->recv_queue, &index, ticks_to_wait) != pdTRUE) {
         return ESP_ERR_TIMEOUT;
     }
 
-    if (spihost[host]->cur_state != SPI_WRITE_DATA) {
-        ESP_LOGE(TAG, "Line: %d, Status error, %d\r\n", __LINE__, spihost[host]->cur_state);
-        return ESP_FAIL;
-    }
-
-    *recv_len = spihost[host]->hw->slv_wr_status;
-    *recv_data = spihost[host]->rx_buffer;
+    *recv_len = spihost[host]->rx_slots[index].len;
+    *recv_data = spihost[host]->rx_slots[index].buffer;
 
     return ESP_OK;
 }
 
 esp_err_t IRAM_ATTR at_spi_slave_free_receive_buffer(spi_host_device_t host)
 {
-    SPI_CHECK(spihost[host]->cur_state == SPI_WRITE_DATA, "SPI status error", ESP_ERR_INVALID_STATE);
-    spihost[host]->hw->slv_wr_status = 0;
+    spi_slave_t* slave = NULL;
+    SPI_CHECK(VALID_HOST(host), "invalid host", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(spihost[host], "host not slave", ESP_ERR_INVALID_ARG);
+    slave = spihost[host];
 
-    memset(spihost[host]->rx_buffer, 0x0, MAX_SPI_RECEIVE_SIZE);
-    spihost[host]->cur_state = SPI_STATE_IDLE;
+    portENTER_CRITICAL(&slave->lock);
+    if (slave->rx_count == 0) {
+        portEXIT_CRITICAL(&slave->lock);
+        ESP_LOGE(TAG, "no receive buffer to free");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    slave->rx_read = (slave->rx_read + 1) % slave->rx_num;
+    slave->rx_count--;
+
+    // all the slots were full, the master has been waiting for one of them
+    if (slave->cur_state == SPI_WRITE_DATA) {
+        slave->cur_state = SPI_STATE_IDLE;
 
-    // notify MASTER can send again
-    if (spihost[host]->cfg.post_setup_cb) {
-        spihost[host]->cfg.post_setup_cb(NULL);
+        // notify MASTER can send again
+        if (!at_spi_tx_publish(slave) && slave->cfg.post_setup_cb) {
+            slave->cfg.post_setup_cb(NULL);
+        }
     }
+    portEXIT_CRITICAL(&slave->lock);
 
     return ESP_OK;
 }
 
-esp_err_t IRAM_ATTR at_spi_slave_send(spi_host_device_t host, void* send_data, uint32_t send_len, TickType_t ticks_to_wait)
+esp_err_t IRAM_ATTR at_spi_slave_queue_trans(spi_host_device_t host, const spi_slave_transaction_t* trans_desc, TickType_t ticks_to_wait)
 {
-    BaseType_t r;
-    SPI_CHECK(send_data == NULL || esp_ptr_dma_capable(send_data),
+    spi_slave_t* slave = NULL;
+    SPI_CHECK(VALID_HOST(host), "invalid host", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(spihost[host], "host not slave", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(trans_desc->tx_buffer != NULL && esp_ptr_dma_capable(trans_desc->tx_buffer),
               "txdata not in DMA-capable memory", ESP_ERR_INVALID_ARG);
-    SPI_CHECK(send_len > 0 && send_len < 4096, "Send length error", ESP_ERR_INVALID_ARG);
+    slave = spihost[host];
+    SPI_CHECK(trans_desc->length > 0 && (trans_desc->length + 7) / 8 <= slave->max_frame_len, "Send length error", ESP_ERR_INVALID_ARG);
 
-    //SPI_CHECK(spihost[host]->cur_state == SPI_STATE_IDLE, "SPI status error", ESP_ERR_INVALID_STATE);
-    if (spihost[host]->cur_state != SPI_STATE_IDLE) {
-        printf("send status error %d\r\n", spihost[host]->cur_state);
+    if (xSemaphoreTake(slave->tx_free_sema, ticks_to_wait) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
     }
 
-    if (spihost[host]->cfg.post_trans_cb) {
-        spihost[host]->cfg.post_trans_cb(NULL);
+    portENTER_CRITICAL(&slave->lock);
+    slave->tx_ring[(slave->tx_head + slave->tx_count) % slave->tx_num] = (spi_slave_transaction_t*)trans_desc;
+    slave->tx_count++;
+    at_spi_tx_publish(slave);
+    portEXIT_CRITICAL(&slave->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR at_spi_slave_get_trans_result(spi_host_device_t host, spi_slave_transaction_t** trans_desc, TickType_t ticks_to_wait)
+{
+    SPI_CHECK(VALID_HOST(host), "invalid host", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(spihost[host], "host not slave", ESP_ERR_INVALID_ARG);
+
+    if (xQueueReceive(spihost[host]->result_queue, trans_desc, ticks_to_wait) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
     }
 
-    spihost[host]->hw->rd_status.status = send_len;
-    spihost[host]->tx_buffer = send_data;
+    // the descriptor is back to the application, its queue entry can be reused
+    xSemaphoreGive(spihost[host]->tx_free_sema);
+
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR at_spi_slave_transmit(spi_host_device_t host, spi_slave_transaction_t* trans_desc, TickType_t ticks_to_wait)
+{
+    esp_err_t ret;
+    spi_slave_transaction_t* ret_trans = NULL;
 
-    // notify MASTER can receive
-    if (spihost[host]->cfg.post_setup_cb) {
-        spihost[host]->cfg.post_setup_cb(NULL);
+    ret = at_spi_slave_queue_trans(host, trans_desc, ticks_to_wait);
+    if (ret != ESP_OK) {
+        return ret;
     }
 
-    r = xSemaphoreTake(spihost[host]->send_queue, ticks_to_wait);
+    ret = at_spi_slave_get_trans_result(host, &ret_trans, ticks_to_wait);
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-    if (!r) {
-        return ESP_ERR_TIMEOUT;
+    assert(ret_trans == trans_desc);
+    return ESP_OK;
+}
+
+// Take back the pending send transaction if the master has not started to read it.
+static bool IRAM_ATTR at_spi_slave_withdraw_send(spi_slave_t* slave)
+{
+    bool withdrawn = false;
+
+    portENTER_CRITICAL(&slave->lock);
+    if (slave->tx_cur == &slave->send_trans && slave->cur_state != SPI_READ_STATUS) {
+        slave->tx_cur = NULL;
+        slave->hw->rd_status.status = 0;
+        withdrawn = true;
+    } else if (slave->tx_count > 0
+               && slave->tx_ring[(slave->tx_head + slave->tx_count - 1) % slave->tx_num] == &slave->send_trans) {
+        slave->tx_count--;
+        withdrawn = true;
     }
+    portEXIT_CRITICAL(&slave->lock);
 
-    spihost[host]->hw->rd_status.status = 0;
-    spihost[host]->cur_state = SPI_STATE_IDLE;
+    if (withdrawn) {
+        xSemaphoreGive(slave->tx_free_sema);
+        slave->send_pending = false;
+    }
+
+    return withdrawn;
+}
+
+esp_err_t IRAM_ATTR at_spi_slave_send(spi_host_device_t host, void* send_data, uint32_t send_len, TickType_t ticks_to_wait)
+{
+    esp_err_t ret;
+    spi_slave_t* slave = NULL;
+    spi_slave_transaction_t* ret_trans = NULL;
+    SPI_CHECK(VALID_HOST(host), "invalid host", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(spihost[host], "host not slave", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(send_data == NULL || esp_ptr_dma_capable(send_data),
+              "txdata not in DMA-capable memory", ESP_ERR_INVALID_ARG);
+    slave = spihost[host];
+    SPI_CHECK(send_len > 0 && send_len <= slave->max_frame_len, "Send length error", ESP_ERR_INVALID_ARG);
+
+    // the previous send timed out while the master was reading it, wait for it to finish first
+    if (slave->send_pending) {
+        if (at_spi_slave_get_trans_result(host, &ret_trans, ticks_to_wait) != ESP_OK) {
+            return ESP_ERR_TIMEOUT;
+        }
+        slave->send_pending = false;
+    }
+
+    slave->send_trans.length = send_len * 8;
+    slave->send_trans.tx_buffer = send_data;
+    ret = at_spi_slave_queue_trans(host, &slave->send_trans, ticks_to_wait);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    slave->send_pending = true;
+
+    if (at_spi_slave_get_trans_result(host, &ret_trans, ticks_to_wait) != ESP_OK) {
+        // the master may still be reading it, then it is collected by the next call
+        if (!at_spi_slave_withdraw_send(slave)) {
+            ESP_LOGD(TAG, "send in progress");
+        }
+        return ESP_ERR_TIMEOUT;
+    }
+    slave->send_pending = false;
 
     return ESP_OK;
 }
 
-//This is run in interrupt context and apart from initialization and destruction, this is the only code
-//touching the host (=spihost[x]) variable. The rest of the data arrives in queues. That is why there are
-//no muxes in this code.
+//This is run in interrupt context and apart from initialization and destruction, this and the functions above
+//under host->lock are the only code touching the host (=spihost[x]) state. Received slots and finished
+//transactions are passed to the tasks through queues, after the lock is released.
 static void IRAM_ATTR at_spi_intr(void* arg)
 {
     BaseType_t do_yield = pdFALSE;
     spi_slave_t* host = (spi_slave_t*)arg;
     uint32_t trans_len = 0;
     uint32_t cnt = 0;
+    int recv_index = -1;
+    spi_slave_transaction_t* done_trans = NULL;
     ESP_EARLY_LOGV(TAG, "intr: %x", host->hw->slave);
 
+    portENTER_CRITICAL_ISR(&host->lock);
+
     if (host->hw->slave.wr_sta_done) {
         if (host->cfg.post_trans_cb) {
             host->cfg.post_trans_cb(NULL);
@@ -455,20 +653,21 @@ static void IRAM_ATTR at_spi_intr(void* arg)
 
         host->hw->slave.wr_sta_done = 0;
 
-        if (host->cur_state != SPI_STATE_IDLE) {
+        if (host->cur_state != SPI_STATE_IDLE || host->rx_count >= host->rx_num) {
             ESP_EARLY_LOGE(TAG, "WR_STA error status %d", host->cur_state);
-            return;
+            goto exit;
         }
 
         ESP_EARLY_LOGD(TAG, "WR_DONE, len: %d", host->hw->slv_wr_status);
-        trans_len = host->hw->slv_wr_status;
+        trans_len = at_spi_frame_len(host, host->hw->slv_wr_status);
 
-        if (trans_len > MAX_SPI_RECEIVE_SIZE || trans_len == 0) {
+        if (trans_len > host->max_frame_len || trans_len == 0) {
             ets_printf("recv length error: %d\r\n", trans_len);
-            return;
+            goto exit;
         }
 
-        spi_load_trans_buffer(host, host->rx_buffer, trans_len, true);
+        spi_load_trans_buffer(host, host->rx_slots[host->rx_write].buffer, trans_len, true);
+        host->rx_len = trans_len;
         host->cur_state = SPI_WRITE_STATUS;
     }
 
@@ -481,15 +680,15 @@ static void IRAM_ATTR at_spi_intr(void* arg)
 
         if (host->cur_state != SPI_STATE_IDLE) {
             ESP_EARLY_LOGE(TAG, "RD_STA error status %d", host->cur_state);
-            return;
+            goto exit;
         }
 
-        if (host->hw->rd_status.status == 0) {
+        if (host->hw->rd_status.status == 0 || host->tx_cur == NULL) {
             ESP_EARLY_LOGE(TAG, "RD_STA len error");
-            return;
+            goto exit;
         }
 
-        spi_load_trans_buffer(host, host->tx_buffer, host->hw->rd_status.status, false);
+        spi_load_trans_buffer(host, (uint8_t*)host->tx_cur->tx_buffer, (host->tx_cur->length + 7) / 8, false);
         ESP_EARLY_LOGD(TAG, "RD_DONE, len: %d", host->hw->rd_status.status);
         host->cur_state = SPI_READ_STATUS;
     }
@@ -499,10 +698,9 @@ static void IRAM_ATTR at_spi_intr(void* arg)
 
         if (host->cur_state != SPI_WRITE_STATUS) {
             ESP_EARLY_LOGE(TAG, "WR_BUF error status %d\r\n", host->cur_state);
-            return;
+            goto exit;
         }
 
-        host->cur_state = SPI_WRITE_DATA;
         ESP_EARLY_LOGD(TAG, "WR_BUF_DONE");
 
         // tell muc need wait
@@ -510,22 +708,42 @@ static void IRAM_ATTR at_spi_intr(void* arg)
             host->cfg.post_trans_cb(NULL);
         }
 
-        //Okay, transaction is done.
-        //Return transaction descriptor.
-        xSemaphoreGiveFromISR(host->recv_queue, &do_yield);
+        host->rx_slots[host->rx_write].len = host->rx_len;
+        host->hw->slv_wr_status = 0;
+        recv_index = host->rx_write;
+        host->rx_write = (host->rx_write + 1) % host->rx_num;
+        host->rx_count++;
+
+        if (host->rx_count < host->rx_num) {
+            // another slot is free, the master can send again without waiting for this one to be consumed
+            host->cur_state = SPI_STATE_IDLE;
+
+            if (!at_spi_tx_publish(host) && host->cfg.post_setup_cb) {
+                host->cfg.post_setup_cb(NULL);
+            }
+        } else {
+            // keep the handshake line low until at_spi_slave_free_receive_buffer releases a slot
+            host->cur_state = SPI_WRITE_DATA;
+        }
     }
 
     if (host->hw->slave.rd_buf_done) {
         if (host->cur_state != SPI_READ_STATUS) {
             ESP_EARLY_LOGE(TAG, "RD_BUF error status %d", host->cur_state);
-            return;
+            goto exit;
         }
 
         host->hw->slave.rd_buf_done = 0;
-        host->cur_state = SPI_READ_DATA;
         ESP_EARLY_LOGD(TAG, "RD_BUF_DONE");
 
-        xSemaphoreGiveFromISR(host->send_queue, &do_yield);
+        done_trans = host->tx_cur;
+        done_trans->trans_len = done_trans->length;
+        host->tx_cur = NULL;
+        host->hw->rd_status.status = 0;
+        host->cur_state = SPI_STATE_IDLE;
+
+        // the next queued transaction is announced right away
+        at_spi_tx_publish(host);
     }
 
     // After the software cleanup interrupt, the hardware may still be uncleaned, at which point you need to wait
@@ -548,8 +766,21 @@ static void IRAM_ATTR at_spi_intr(void* arg)
 
     host->hw->cmd.usr = 1;
 
+exit:
+    portEXIT_CRITICAL_ISR(&host->lock);
+
+    //Okay, transaction is done.
+    //Return the received slot and the transaction descriptor.
+    if (recv_index >= 0) {
+        xQueueSendFromISR(host->recv_queue, &recv_index, &do_yield);
+    }
+
+    if (done_trans) {
+        xQueueSendFromISR(host->result_queue, &done_trans, &do_yield);
+    }
+
     if (do_yield) {
         portYIELD_FROM_ISR();
     }
 }
-#endif
\ No newline at end of file
+#endif
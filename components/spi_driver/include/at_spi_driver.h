@@ -31,6 +31,15 @@ extern "C"
 #define SPI_SLAVE_TXBIT_LSBFIRST          (1<<0)  ///< Transmit command/address/data LSB first instead of the default MSB first
 #define SPI_SLAVE_RXBIT_LSBFIRST          (1<<1)  ///< Receive data LSB first instead of the default MSB first
 #define SPI_SLAVE_BIT_LSBFIRST            (SPI_SLAVE_TXBIT_LSBFIRST|SPI_SLAVE_RXBIT_LSBFIRST) ///< Transmit and receive LSB first
+#define SPI_SLAVE_FRAME_MODE              (1<<2)  ///< Burst DMA, and transfers up to ``max_transfer_sz`` in one handshake announced with SPI_SLAVE_FRAME_HEADER. The master must support it.
+
+/**
+ * In frame mode, a transfer longer than 4092 bytes is announced in WR_STA/RD_STA with this header instead of the plain length.
+ * A plain length (top byte 0) is still accepted, so a master without frame support keeps working as long as it sends short packets.
+ */
+#define SPI_SLAVE_FRAME_MAGIC             0xA5
+#define SPI_SLAVE_FRAME_LEN_MASK          0xFFFFFF
+#define SPI_SLAVE_FRAME_HEADER(len)       (((uint32_t)SPI_SLAVE_FRAME_MAGIC << 24) | ((len) & SPI_SLAVE_FRAME_LEN_MASK))
 
 
 typedef struct spi_slave_transaction_t spi_slave_transaction_t;
@@ -42,7 +51,7 @@ typedef void(*slave_transaction_cb_t)(spi_slave_transaction_t *trans);
 typedef struct {
     int spics_io_num;               ///< CS GPIO pin for this device
     uint32_t flags;                 ///< Bitwise OR of SPI_SLAVE_* flags
-    int queue_size;                 ///< Transaction queue size. This sets how many transactions can be 'in the air' (queued using spi_slave_queue_trans but not yet finished using spi_slave_get_trans_result) at the same time
+    int queue_size;                 ///< Transaction queue size. This sets how many transactions can be 'in the air' (queued using at_spi_slave_queue_trans but not yet finished using at_spi_slave_get_trans_result) at the same time, and how many receive buffers (4092 bytes, max_transfer_sz in frame mode) the master can fill before the application frees them
     uint8_t mode;                   ///< SPI mode (0-3)
     slave_transaction_cb_t post_setup_cb;  /**< Callback called after the SPI registers are loaded with new data.
                                              *
@@ -125,10 +134,14 @@ esp_err_t at_spi_slave_free(spi_host_device_t host);
  * @param host SPI peripheral that is acting as a slave
  * @param trans_desc Description of transaction to execute. Not const because we may want to write status back
  *                   into the transaction description.
+ * The length of the oldest queued transaction is published in RD_STA and the handshake line is toggled,
+ * the next one is published as soon as the master has read the previous one.
+ *
  * @param ticks_to_wait Ticks to wait until there's room in the queue; use portMAX_DELAY to
  *                      never time out.
  * @return 
  *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_TIMEOUT       if the queue stays full
  *         - ESP_OK                on success
  */
 esp_err_t at_spi_slave_queue_trans(spi_host_device_t host, const spi_slave_transaction_t *trans_desc, TickType_t ticks_to_wait);
@@ -150,6 +163,7 @@ esp_err_t at_spi_slave_queue_trans(spi_host_device_t host, const spi_slave_trans
  *                      out.
  * @return 
  *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_TIMEOUT       if wait timeout
  *         - ESP_OK                on success
  */
 esp_err_t at_spi_slave_get_trans_result(spi_host_device_t host, spi_slave_transaction_t **trans_desc, TickType_t ticks_to_wait);
@@ -181,6 +195,7 @@ esp_err_t at_spi_slave_transmit(spi_host_device_t host, spi_slave_transaction_t
  * re-use the buffers.
  *
  * It is mandatory to eventually use this function for any transaction queued by ``at_spi_slave_free_receive_buffer``.
+ * The buffers are returned in the order the master wrote them, up to ``queue_size`` of them can be held at the same time.
  *
  * @param host SPI peripheral to that is acting as a slave
  * @param[out] read_data Pointer to variable able to contain a pointer to the data 
@@ -199,10 +214,12 @@ esp_err_t at_spi_slave_receive(spi_host_device_t host, uint8_t **read_data, uint
  * @brief Free the readed data
  *
  * It is mandatory to eventually use this function for any transaction queued by ``at_spi_slave_receive``.
+ * The oldest received buffer is released, if all the buffers were full the master is notified it can send again.
  *
  * @param host SPI peripheral to that is acting as a slave
  * @return 
  *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_INVALID_STATE if no buffer is held
  *         - ESP_OK                on success
  */
 esp_err_t at_spi_slave_free_receive_buffer(spi_host_device_t host);
@@ -210,6 +227,9 @@ esp_err_t at_spi_slave_free_receive_buffer(spi_host_device_t host);
 /**
  * @brief SPI Slave send data
  *
+ * Queue the data and wait until the master has read it. Do not mix it with ``at_spi_slave_queue_trans``.
+ * On timeout, the data is withdrawn if the master has not started to read it yet.
+ *
  * @param host SPI peripheral to that is acting as a slave
  * @param send_data  Pointer to the send data
  * @param send_len   Send data length
@@ -217,6 +237,7 @@ esp_err_t at_spi_slave_free_receive_buffer(spi_host_device_t host);
  *                      out.
  * @return 
  *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_TIMEOUT       if wait timeout
  *         - ESP_OK                on success
  */
 esp_err_t at_spi_slave_send(spi_host_device_t host, void *send_data, uint32_t send_len, TickType_t ticks_to_wait);
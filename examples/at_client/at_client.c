@@ -0,0 +1,417 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "at_client.h"
+
+#define AT_IPD_PREFIX           "+IPD,"
+#define AT_IPD_PREFIX_LEN       (sizeof(AT_IPD_PREFIX) - 1)
+
+enum {
+    AT_STATE_IDLE = 0,
+    AT_STATE_WAIT_RESULT,       // command written, waiting for OK/ERROR/FAIL
+    AT_STATE_WAIT_PROMPT,       // OK received, waiting for ">" to write the data
+    AT_STATE_WAIT_SEND,         // data written, waiting for SEND OK/SEND FAIL
+    AT_STATE_ABORTING,
+};
+
+static uint32_t at_client_now(at_client_t* client)
+{
+    return client->transport.now_ms ? client->transport.now_ms(client->transport.ctx) : 0;
+}
+
+static bool at_client_line_is(const char* line, size_t len, const char* str)
+{
+    return len == strlen(str) && memcmp(line, str, len) == 0;
+}
+
+// pop the running command and report its result, the next one is started by the caller
+static void at_client_finish(at_client_t* client, at_client_result_t result)
+{
+    at_client_entry_t* entry = &client->queue[client->head];
+    at_client_done_cb_t on_done = entry->on_done;
+    void* arg = entry->arg;
+
+    client->head = (client->head + 1) % AT_CLIENT_QUEUE_LEN;
+    client->count--;
+    if (client->state != AT_STATE_ABORTING) {
+        client->state = AT_STATE_IDLE;
+    }
+
+    if (on_done) {
+        on_done(arg, result);
+    }
+}
+
+static void at_client_kick(at_client_t* client)
+{
+    while (client->state == AT_STATE_IDLE && client->count > 0) {
+        at_client_entry_t* entry = &client->queue[client->head];
+
+        client->state = AT_STATE_WAIT_RESULT;
+        client->start_ms = at_client_now(client);
+        if (client->transport.write(client->transport.ctx, (const uint8_t*)entry->cmd, entry->cmd_len) != 0) {
+            at_client_finish(client, AT_RESULT_IO_ERROR);
+        }
+    }
+}
+
+static void at_client_prompt(at_client_t* client)
+{
+    at_client_entry_t* entry = &client->queue[client->head];
+
+    client->state = AT_STATE_WAIT_SEND;
+    if (client->transport.write(client->transport.ctx, entry->data, entry->data_len) != 0) {
+        at_client_finish(client, AT_RESULT_IO_ERROR);
+        at_client_kick(client);
+    }
+}
+
+static bool at_client_urc_match(const char* pattern, const char* line, size_t len)
+{
+    size_t pattern_len = 0;
+
+    if (pattern[0] == '*') {
+        pattern++;
+        pattern_len = strlen(pattern);
+        return len >= pattern_len && memcmp(line + len - pattern_len, pattern, pattern_len) == 0;
+    }
+
+    pattern_len = strlen(pattern);
+    return len >= pattern_len && memcmp(line, pattern, pattern_len) == 0;
+}
+
+static void at_client_dispatch_line(at_client_t* client, const char* line, size_t len)
+{
+    at_client_entry_t* entry = &client->queue[client->head];
+
+    for (uint32_t loop = 0; loop < client->urc_num; loop++) {
+        if (at_client_urc_match(client->urc[loop].pattern, line, len)) {
+            client->urc[loop].cb(client->urc[loop].arg, line, len);
+            return;
+        }
+    }
+
+    if (client->state == AT_STATE_IDLE) {
+        if (client->unsolicited_cb) {
+            client->unsolicited_cb(client->unsolicited_arg, line, len);
+        }
+        return;
+    }
+
+    if (client->state == AT_STATE_WAIT_RESULT && at_client_line_is(line, len, "OK")) {
+        if (entry->data) {
+            client->state = AT_STATE_WAIT_PROMPT;
+            return;
+        }
+        at_client_finish(client, AT_RESULT_OK);
+    } else if (at_client_line_is(line, len, "ERROR")) {
+        at_client_finish(client, AT_RESULT_ERROR);
+    } else if (at_client_line_is(line, len, "FAIL")) {
+        at_client_finish(client, AT_RESULT_FAIL);
+    } else if (client->state == AT_STATE_WAIT_SEND && at_client_line_is(line, len, "SEND OK")) {
+        at_client_finish(client, AT_RESULT_OK);
+    } else if (client->state == AT_STATE_WAIT_SEND && at_client_line_is(line, len, "SEND FAIL")) {
+        at_client_finish(client, AT_RESULT_SEND_FAIL);
+    } else {
+        if (entry->on_line) {
+            entry->on_line(entry->arg, line, len);
+        }
+        return;
+    }
+
+    at_client_kick(client);
+}
+
+static bool at_client_parse_uint(const char* str, size_t len, uint32_t max, uint32_t* value)
+{
+    uint32_t result = 0;
+
+    if (len == 0 || len > 9) {
+        return false;
+    }
+
+    for (size_t loop = 0; loop < len; loop++) {
+        if (str[loop] < '0' || str[loop] > '9') {
+            return false;
+        }
+        result = result * 10 + (str[loop] - '0');
+    }
+
+    if (result > max) {
+        return false;
+    }
+    *value = result;
+    return true;
+}
+
+static bool at_client_parse_ip(const char* str, size_t len, char* ip)
+{
+    bool has_separator = false;
+
+    if (len >= 2 && str[0] == '"' && str[len - 1] == '"') {
+        str++;
+        len -= 2;
+    }
+
+    if (len == 0 || len >= sizeof(((at_client_ipd_t*)0)->remote_ip)) {
+        return false;
+    }
+
+    for (size_t loop = 0; loop < len; loop++) {
+        char c = str[loop];
+        if (c == '.' || c == ':') {
+            has_separator = true;
+        } else if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) {
+            return false;
+        }
+    }
+
+    memcpy(ip, str, len);
+    ip[len] = '\0';
+    return has_separator;
+}
+
+// parse "+IPD,[<link ID>,]<len>[,<remote IP>,<remote port>]", the IP may be quoted and may be IPv6
+static bool at_client_parse_ipd(const char* header, size_t header_len, at_client_ipd_t* ipd)
+{
+    const char* field[4];
+    size_t field_len[4];
+    uint32_t num = 0;
+    uint32_t index = 0;
+    uint32_t value = 0;
+    bool quoted = false;
+    const char* end = header + header_len;
+
+    if (header_len <= AT_IPD_PREFIX_LEN || memcmp(header, AT_IPD_PREFIX, AT_IPD_PREFIX_LEN) != 0) {
+        return false;
+    }
+
+    field[0] = header + AT_IPD_PREFIX_LEN;
+    for (const char* p = field[0]; p < end; p++) {
+        if (*p == '"') {
+            quoted = !quoted;
+        } else if (*p == ',' && !quoted) {
+            field_len[num] = p - field[num];
+            if (++num == 4) {
+                return false;
+            }
+            field[num] = p + 1;
+        }
+    }
+    if (quoted) {
+        return false;
+    }
+    field_len[num] = end - field[num];
+    num++;
+
+    memset(ipd, 0x0, sizeof(at_client_ipd_t));
+    ipd->link_id = -1;
+
+    // 1: len, 2: link, len, 3: len, ip, port, 4: link, len, ip, port
+    if (num == 2 || num == 4) {
+        if (!at_client_parse_uint(field[0], field_len[0], 0xff, &value)) {
+            return false;
+        }
+        ipd->link_id = value;
+        index = 1;
+    }
+
+    if (!at_client_parse_uint(field[index], field_len[index], 0x7fffffff, &value) || value == 0) {
+        return false;
+    }
+    ipd->length = value;
+
+    if (num >= 3) {
+        if (!at_client_parse_ip(field[index + 1], field_len[index + 1], ipd->remote_ip)
+                || !at_client_parse_uint(field[index + 2], field_len[index + 2], 0xffff, &value)) {
+            return false;
+        }
+        ipd->remote_port = value;
+    }
+
+    return true;
+}
+
+static void at_client_line_end(at_client_t* client)
+{
+    at_client_ipd_t ipd;
+    size_t len = client->line_len;
+
+    client->line_len = 0;
+    client->line_truncated = false;
+
+    if (len > 0 && client->line[len - 1] == '\r') {
+        len--;
+    }
+    if (len == 0) {
+        return;
+    }
+    client->line[len] = '\0';
+
+    // passive receive mode, +IPD only announces the length
+    if (at_client_parse_ipd(client->line, len, &ipd)) {
+        if (client->ipd_cb) {
+            client->ipd_cb(client->ipd_arg, &ipd, 0, NULL, 0);
+        }
+        return;
+    }
+
+    at_client_dispatch_line(client, client->line, len);
+}
+
+static void at_client_input_byte(at_client_t* client, uint8_t c)
+{
+    at_client_ipd_t ipd;
+
+    if (c == '\n') {
+        at_client_line_end(client);
+        return;
+    }
+
+    if (client->line_len < AT_CLIENT_LINE_MAX - 1) {
+        client->line[client->line_len++] = c;
+    } else {
+        client->line_truncated = true;
+        return;
+    }
+
+    if (c == ':' && !client->line_truncated
+            && at_client_parse_ipd(client->line, client->line_len - 1, &ipd)) {
+        // the data follows the header without a line end
+        client->line_len = 0;
+        client->ipd = ipd;
+        client->ipd_offset = 0;
+    } else if (c == '>' && client->line_len == 1
+            && (client->state == AT_STATE_WAIT_PROMPT
+                || (client->state == AT_STATE_WAIT_RESULT && client->queue[client->head].data))) {
+        // the prompt is not followed by a line end
+        client->line_len = 0;
+        at_client_prompt(client);
+    }
+}
+
+at_client_err_t at_client_init(at_client_t* client, const at_client_transport_t* transport)
+{
+    if (client == NULL || transport == NULL || transport->write == NULL) {
+        return AT_CLIENT_ERR_INVALID_ARG;
+    }
+
+    memset(client, 0x0, sizeof(at_client_t));
+    client->transport = *transport;
+    return AT_CLIENT_OK;
+}
+
+at_client_err_t at_client_submit(at_client_t* client, const at_client_cmd_t* cmd)
+{
+    at_client_entry_t* entry = NULL;
+    size_t len = 0;
+
+    if (client == NULL || cmd == NULL || cmd->cmd == NULL) {
+        return AT_CLIENT_ERR_INVALID_ARG;
+    }
+
+    len = strlen(cmd->cmd);
+    if (len + 2 > AT_CLIENT_CMD_MAX) {
+        return AT_CLIENT_ERR_TOO_LONG;
+    }
+
+    if (client->count == AT_CLIENT_QUEUE_LEN) {
+        return AT_CLIENT_ERR_QUEUE_FULL;
+    }
+
+    entry = &client->queue[(client->head + client->count) % AT_CLIENT_QUEUE_LEN];
+    memcpy(entry->cmd, cmd->cmd, len);
+    memcpy(entry->cmd + len, "\r\n", 2);
+    entry->cmd_len = len + 2;
+    entry->data = cmd->data;
+    entry->data_len = cmd->data_len;
+    entry->timeout_ms = cmd->timeout_ms ? cmd->timeout_ms : AT_CLIENT_DEFAULT_TIMEOUT_MS;
+    entry->on_line = cmd->on_line;
+    entry->on_done = cmd->on_done;
+    entry->arg = cmd->arg;
+    client->count++;
+
+    at_client_kick(client);
+    return AT_CLIENT_OK;
+}
+
+void at_client_input(at_client_t* client, const uint8_t* data, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        if (client->ipd_offset < client->ipd.length) {
+            // +IPD data, handed over in place
+            size_t chunk = client->ipd.length - client->ipd_offset;
+            size_t offset = client->ipd_offset;
+
+            chunk = chunk < len - pos ? chunk : len - pos;
+            client->ipd_offset += chunk;
+            if (client->ipd_cb) {
+                client->ipd_cb(client->ipd_arg, &client->ipd, offset, data + pos, chunk);
+            }
+            pos += chunk;
+            continue;
+        }
+
+        at_client_input_byte(client, data[pos++]);
+    }
+}
+
+void at_client_poll(at_client_t* client)
+{
+    if (client->transport.now_ms == NULL || client->state == AT_STATE_IDLE) {
+        return;
+    }
+
+    if (at_client_now(client) - client->start_ms >= client->queue[client->head].timeout_ms) {
+        at_client_finish(client, AT_RESULT_TIMEOUT);
+        at_client_kick(client);
+    }
+}
+
+void at_client_abort(at_client_t* client)
+{
+    uint32_t num = client->count;
+
+    client->state = AT_STATE_ABORTING;
+    while (num-- > 0) {
+        at_client_finish(client, AT_RESULT_ABORTED);
+    }
+    client->state = AT_STATE_IDLE;
+    at_client_kick(client);
+}
+
+at_client_err_t at_client_register_urc(at_client_t* client, const char* pattern, at_client_line_cb_t cb, void* arg)
+{
+    if (client == NULL || pattern == NULL || cb == NULL) {
+        return AT_CLIENT_ERR_INVALID_ARG;
+    }
+
+    if (client->urc_num == AT_CLIENT_URC_MAX) {
+        return AT_CLIENT_ERR_QUEUE_FULL;
+    }
+
+    client->urc[client->urc_num].pattern = pattern;
+    client->urc[client->urc_num].cb = cb;
+    client->urc[client->urc_num].arg = arg;
+    client->urc_num++;
+    return AT_CLIENT_OK;
+}
+
+void at_client_set_unsolicited_cb(at_client_t* client, at_client_line_cb_t cb, void* arg)
+{
+    client->unsolicited_cb = cb;
+    client->unsolicited_arg = arg;
+}
+
+void at_client_set_ipd_cb(at_client_t* client, at_client_ipd_cb_t cb, void* arg)
+{
+    client->ipd_cb = cb;
+    client->ipd_arg = arg;
+}
+
+bool at_client_idle(const at_client_t* client)
+{
+    return client->count == 0;
+}
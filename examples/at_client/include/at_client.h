@@ -0,0 +1,242 @@
+#ifndef AT_CLIENT_H_
+#define AT_CLIENT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef AT_CLIENT_LINE_MAX
+#define AT_CLIENT_LINE_MAX          256     ///< Longest response line kept, longer lines are truncated
+#endif
+
+#ifndef AT_CLIENT_CMD_MAX
+#define AT_CLIENT_CMD_MAX           256     ///< Longest command, including the "\r\n" added by the client
+#endif
+
+#ifndef AT_CLIENT_QUEUE_LEN
+#define AT_CLIENT_QUEUE_LEN         8       ///< Commands queued and not finished yet
+#endif
+
+#ifndef AT_CLIENT_URC_MAX
+#define AT_CLIENT_URC_MAX           16      ///< Registered URC handlers
+#endif
+
+#define AT_CLIENT_DEFAULT_TIMEOUT_MS    10000
+
+typedef enum {
+    AT_CLIENT_OK                =  0,
+    AT_CLIENT_ERR_INVALID_ARG   = -1,
+    AT_CLIENT_ERR_QUEUE_FULL    = -2,
+    AT_CLIENT_ERR_TOO_LONG      = -3,
+} at_client_err_t;
+
+/**
+ * Final result of a command, passed to ``at_client_done_cb_t``
+ */
+typedef enum {
+    AT_RESULT_OK = 0,           ///< "OK", or "SEND OK" for a command with data
+    AT_RESULT_ERROR,            ///< "ERROR"
+    AT_RESULT_FAIL,             ///< "FAIL"
+    AT_RESULT_SEND_FAIL,        ///< "SEND FAIL"
+    AT_RESULT_TIMEOUT,          ///< No final result in time, see ``at_client_poll``
+    AT_RESULT_IO_ERROR,         ///< The transport failed to write the command or its data
+    AT_RESULT_ABORTED,          ///< Dropped by ``at_client_abort``
+} at_client_result_t;
+
+/**
+ * Bytes to the slave, and the time for command timeouts
+ */
+typedef struct {
+    int (*write)(void* ctx, const uint8_t* data, size_t len);   ///< Write all of data, return 0 on success
+    uint32_t (*now_ms)(void* ctx);                              ///< Monotonic time in ms, NULL to disable timeouts
+    void* ctx;
+} at_client_transport_t;
+
+/**
+ * One +IPD, ``link_id`` is -1 in single connection mode, ``remote_ip`` is empty unless AT+CIPDINFO=1
+ */
+typedef struct {
+    int link_id;
+    size_t length;
+    char remote_ip[40];
+    uint16_t remote_port;
+} at_client_ipd_t;
+
+typedef void (*at_client_line_cb_t)(void* arg, const char* line, size_t len);
+typedef void (*at_client_done_cb_t)(void* arg, at_client_result_t result);
+
+/**
+ * Called for each slice of +IPD data, with ``data`` pointing into the buffer given to ``at_client_input``
+ *
+ * A payload split over several ``at_client_input`` calls is delivered in several slices, ``offset`` is the
+ * position of the slice in the payload. In passive receive mode (AT+CIPRECVMODE=1) the slave only announces
+ * the length, the callback is called once with ``data`` NULL and ``len`` 0.
+ */
+typedef void (*at_client_ipd_cb_t)(void* arg, const at_client_ipd_t* ipd, size_t offset, const uint8_t* data, size_t len);
+
+/**
+ * A command to queue, see ``at_client_submit``
+ */
+typedef struct {
+    const char* cmd;                ///< Command without "\r\n", copied by ``at_client_submit``
+    const uint8_t* data;            ///< Sent after the ">" prompt (AT+CIPSEND and alike), NULL if none. Must stay valid until on_done
+    size_t data_len;
+    uint32_t timeout_ms;            ///< 0 for AT_CLIENT_DEFAULT_TIMEOUT_MS
+    at_client_line_cb_t on_line;    ///< Response lines before the final result, may be NULL
+    at_client_done_cb_t on_done;    ///< Final result, may be NULL
+    void* arg;
+} at_client_cmd_t;
+
+typedef struct {
+    char cmd[AT_CLIENT_CMD_MAX];
+    size_t cmd_len;
+    const uint8_t* data;
+    size_t data_len;
+    uint32_t timeout_ms;
+    at_client_line_cb_t on_line;
+    at_client_done_cb_t on_done;
+    void* arg;
+} at_client_entry_t;
+
+typedef struct {
+    const char* pattern;
+    at_client_line_cb_t cb;
+    void* arg;
+} at_client_urc_t;
+
+/**
+ * Client state, the members are private. Allocate it statically or on the heap, then call ``at_client_init``
+ */
+typedef struct {
+    at_client_transport_t transport;
+    at_client_entry_t queue[AT_CLIENT_QUEUE_LEN];
+    uint32_t head;
+    uint32_t count;
+    int state;
+    uint32_t start_ms;
+    at_client_urc_t urc[AT_CLIENT_URC_MAX];
+    uint32_t urc_num;
+    at_client_line_cb_t unsolicited_cb;
+    void* unsolicited_arg;
+    at_client_ipd_cb_t ipd_cb;
+    void* ipd_arg;
+    at_client_ipd_t ipd;
+    size_t ipd_offset;
+    char line[AT_CLIENT_LINE_MAX];
+    size_t line_len;
+    bool line_truncated;
+} at_client_t;
+
+/**
+ * Init a client on a transport
+ *
+ * The client is not thread safe. Call all the at_client functions from one task, usually the one reading
+ * the transport, or serialize them with a recursive mutex. Callbacks run inside ``at_client_input`` and
+ * ``at_client_poll`` and may submit new commands.
+ *
+ * @param client client to init
+ * @param transport write function and clock, copied
+ *
+ * @return
+ *      - AT_CLIENT_OK on success
+ *      - AT_CLIENT_ERR_INVALID_ARG if transport has no write function
+ */
+at_client_err_t at_client_init(at_client_t* client, const at_client_transport_t* transport);
+
+/**
+ * Queue a command
+ *
+ * The slave runs one command at a time, so the client writes a command as soon as the previous one gets its
+ * final result, without a round trip through the application. The command is written at once if the client
+ * is idle.
+ *
+ * @param client client
+ * @param cmd command and callbacks, the command string is copied
+ *
+ * @return
+ *      - AT_CLIENT_OK on success
+ *      - AT_CLIENT_ERR_INVALID_ARG if cmd or its string is NULL
+ *      - AT_CLIENT_ERR_TOO_LONG if the command does not fit AT_CLIENT_CMD_MAX
+ *      - AT_CLIENT_ERR_QUEUE_FULL if AT_CLIENT_QUEUE_LEN commands are pending
+ */
+at_client_err_t at_client_submit(at_client_t* client, const at_client_cmd_t* cmd);
+
+/**
+ * Feed bytes received from the slave
+ *
+ * The bytes are parsed incrementally, they may be split anywhere. Response lines go to the running command,
+ * URCs to their handlers and +IPD data to the IPD callback without being copied.
+ *
+ * @param client client
+ * @param data received bytes
+ * @param len length of data
+ */
+void at_client_input(at_client_t* client, const uint8_t* data, size_t len);
+
+/**
+ * Finish the running command with AT_RESULT_TIMEOUT if its timeout has passed, and start the next one
+ *
+ * Call it periodically, for example when the transport read times out. Does nothing if the transport has
+ * no clock.
+ *
+ * @param client client
+ */
+void at_client_poll(at_client_t* client);
+
+/**
+ * Finish the running and queued commands with AT_RESULT_ABORTED, for example after the slave restarts
+ *
+ * @param client client
+ */
+void at_client_abort(at_client_t* client);
+
+/**
+ * Route lines matching a pattern to a handler, whether a command is running or not
+ *
+ * A pattern matches lines starting with it, or, if it starts with '*', lines ending with the rest of it,
+ * e.g. "WIFI " or "*,CLOSED". Handlers are tried in the order they are registered.
+ *
+ * @param client client
+ * @param pattern pattern, must stay valid while the client is used
+ * @param cb handler
+ * @param arg argument of cb
+ *
+ * @return
+ *      - AT_CLIENT_OK on success
+ *      - AT_CLIENT_ERR_INVALID_ARG if pattern or cb is NULL
+ *      - AT_CLIENT_ERR_QUEUE_FULL if AT_CLIENT_URC_MAX handlers are registered
+ */
+at_client_err_t at_client_register_urc(at_client_t* client, const char* pattern, at_client_line_cb_t cb, void* arg);
+
+/**
+ * Set the handler of lines that no command or URC handler takes
+ *
+ * @param client client
+ * @param cb handler, NULL to drop these lines
+ * @param arg argument of cb
+ */
+void at_client_set_unsolicited_cb(at_client_t* client, at_client_line_cb_t cb, void* arg);
+
+/**
+ * Set the handler of +IPD data
+ *
+ * @param client client
+ * @param cb handler, NULL to drop the data
+ * @param arg argument of cb
+ */
+void at_client_set_ipd_cb(at_client_t* client, at_client_ipd_cb_t cb, void* arg);
+
+/**
+ * @return true if no command is running or queued
+ */
+bool at_client_idle(const at_client_t* client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AT_CLIENT_H_ */
@@ -5,6 +5,11 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void* platform_os_sem_t;
+
 /**
  * Delay some times
  *
@@ -15,6 +20,54 @@ extern "C" {
  */
 void platform_os_delay(uint32_t milliseconds);
 
+/**
+ * Get the time elapsed since the scheduler started
+ *
+ * @return time in milliseconds
+ */
+uint32_t platform_os_get_time_ms(void);
+
+/**
+ * Create a binary semaphore, it is created empty
+ *
+ * @return
+ *      - semaphore handle on success
+ *      - NULL on fail
+ */
+platform_os_sem_t platform_os_sem_create(void);
+
+/**
+ * Take a semaphore
+ *
+ * @param sem semaphore created by platform_os_sem_create
+ * @param milliseconds time to wait for the semaphore
+ * @return
+ *      - true if the semaphore was taken
+ *      - false on timeout
+ */
+bool platform_os_sem_take(platform_os_sem_t sem, uint32_t milliseconds);
+
+/**
+ * Give a semaphore, it can be called from task context only
+ *
+ * @param sem semaphore created by platform_os_sem_create
+ */
+void platform_os_sem_give(platform_os_sem_t sem);
+
+/**
+ * Create a task
+ *
+ * @param task_func task entry
+ * @param name task name
+ * @param stack_size stack size in bytes
+ * @param arg argument passed to task_func
+ * @param priority task priority
+ * @return
+ *      - true on success
+ *      - false on fail
+ */
+bool platform_os_task_create(void (*task_func)(void*), const char* name, uint32_t stack_size, void* arg, uint32_t priority);
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,6 +16,26 @@ extern "C" {
  */
 sdio_err_t sdio_driver_init(void);
 
+/**
+ * Set the CMD53 block size used by sdio_driver_write_blocks and sdio_driver_read_blocks
+ *
+ * The transport writes the same size to the function block size registers of the slave.
+ *
+ * @param block_size  block size in bytes, a power of 2 within 4~512
+ * @return
+ *      - SUCCESS on success
+ *      - ERR_INVALID_ARG if the host driver does not support this block size
+ */
+sdio_err_t sdio_driver_set_block_size(uint32_t block_size);
+
+/**
+ * Get the bus configuration in use
+ *
+ * @param[out] bus_width  1 or 4
+ * @param[out] clock_khz  bus clock in kHz
+ */
+void sdio_driver_get_bus(uint32_t* bus_width, uint32_t* clock_khz);
+
 /**
  * Write blocks of data to an SDIO card using CMD53
  *
@@ -1,7 +1,35 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "platform_os.h"
 
 void platform_os_delay(uint32_t milliseconds)
 {
     vTaskDelay(milliseconds);
-}
\ No newline at end of file
+}
+
+uint32_t platform_os_get_time_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+platform_os_sem_t platform_os_sem_create(void)
+{
+    return (platform_os_sem_t)xSemaphoreCreateBinary();
+}
+
+bool platform_os_sem_take(platform_os_sem_t sem, uint32_t milliseconds)
+{
+    return xSemaphoreTake((SemaphoreHandle_t)sem, milliseconds / portTICK_PERIOD_MS) == pdTRUE;
+}
+
+void platform_os_sem_give(platform_os_sem_t sem)
+{
+    xSemaphoreGive((SemaphoreHandle_t)sem);
+}
+
+bool platform_os_task_create(void (*task_func)(void*), const char* name, uint32_t stack_size, void* arg, uint32_t priority)
+{
+    return xTaskCreate(task_func, name, stack_size, arg, priority, NULL) == pdPASS;
+}
@@ -40,12 +40,19 @@ sdio_err_t sdio_driver_init(void)
 {
     /* Probe */
     sdmmc_host_t config = SDMMC_HOST_DEFAULT();
+    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
+#if CONFIG_SDIO_HOST_4BIT
     config.flags = SDMMC_HOST_FLAG_4BIT;
+    slot_config.width = 4;
+#else
+    config.flags = SDMMC_HOST_FLAG_1BIT;
+    slot_config.width = 1;
+#endif
+#if CONFIG_SDIO_HOST_HIGHSPEED
+    config.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+#else
     config.max_freq_khz = SDMMC_FREQ_DEFAULT;
-    //config.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
-    //config.max_freq_khz = SDMMC_FREQ_PROBING;
-
-    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
+#endif
 
     printf("SDIO clock: %d, bit: %d\r\n", config.max_freq_khz, config.flags);
     sdmmc_host_init();
@@ -66,6 +73,18 @@ sdio_err_t sdio_driver_init(void)
     return SUCCESS;
 }
 
+sdio_err_t sdio_driver_set_block_size(uint32_t block_size)
+{
+    // sdmmc_io_rw_extended() always uses 512 byte blocks
+    return block_size == 512 ? SUCCESS : ERR_INVALID_ARG;
+}
+
+void sdio_driver_get_bus(uint32_t* bus_width, uint32_t* clock_khz)
+{
+    *bus_width = card ? (1 << card->log_bus_width) : 0;
+    *clock_khz = card ? card->max_freq_khz : 0;
+}
+
 sdio_err_t sdio_driver_write_blocks(uint32_t function, uint32_t addr, void* buffer, uint32_t len)
 {
     esp_err_t err;
@@ -134,7 +153,7 @@ sdio_err_t sdio_driver_write_byte(uint32_t function, uint32_t reg, uint8_t in_by
 
 sdio_err_t sdio_driver_wait_int(uint32_t timeout)
 {
-    esp_err_t err = sdmmc_io_wait_int(card, timeout);
+    esp_err_t err = sdmmc_io_wait_int(card, timeout / portTICK_PERIOD_MS);
     if(err == ESP_ERR_TIMEOUT) {
         return ERR_TIMEOUT;
     } else if (err != ESP_OK) {
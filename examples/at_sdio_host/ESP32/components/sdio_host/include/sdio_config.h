@@ -9,4 +9,19 @@
 #define TARGET_ESP32  0
 #endif
 
+// CMD53 block size requested from the slave, a power of 2 within 4~512.
+// The ESP-IDF v4.2 SDMMC host driver only supports 512 byte blocks, other sizes fall back to 512.
+#define SDIO_HOST_BLOCK_SIZE    512
+
+#if CONFIG_SDIO_HOST_BENCH
+#define SDIO_HOST_BENCH         1
+#define SDIO_HOST_BENCH_LEN     CONFIG_SDIO_HOST_BENCH_LEN
+#define SDIO_HOST_BENCH_SERVER_IP       CONFIG_SDIO_HOST_BENCH_SERVER_IP
+#define SDIO_HOST_BENCH_SERVER_PORT     CONFIG_SDIO_HOST_BENCH_SERVER_PORT
+#else
+#define SDIO_HOST_BENCH         0
+#define SDIO_HOST_BENCH_SERVER_IP       ""
+#define SDIO_HOST_BENCH_SERVER_PORT     0
+#endif
+
 #endif /* SDIO_CONFIG_H_ */
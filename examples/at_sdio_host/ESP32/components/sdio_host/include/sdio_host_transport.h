@@ -5,11 +5,30 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stddef.h>
+
 #include "sdio_host_error.h"
 
 #define HOST_SLC0_RX_NEW_PACKET_INT_ST  (BIT(23))
 #define HOST_SLC0_TOHOST_BIT0_INT_ST  (BIT(0))
 
+typedef struct {
+    uint32_t bus_width;         ///< 1 or 4
+    uint32_t clock_khz;         ///< Bus clock
+    uint32_t block_size;        ///< CMD53 block size agreed with the slave
+    uint32_t slave_buf_size;    ///< Size of one slave receive buffer
+    uint32_t slave_buf_num;     ///< Number of slave receive buffers, 0 if the slave does not publish it
+} sdio_host_link_info_t;
+
+/**
+ * One segment of a scatter-gather send, see ``sdio_host_send_packetv``
+ */
+typedef struct {
+    const void* base;   ///< Start address of the segment
+    size_t len;         ///< Length of the segment, may be 0
+} sdio_host_iovec_t;
+
 /**
  * Init SDIO host and slave
  *
@@ -19,6 +38,32 @@ extern "C" {
  */
 sdio_err_t sdio_init(void);
 
+/**
+ * Get the bus and transfer sizes agreed with the slave by ``sdio_init``
+ *
+ * The block size comes from SDIO_HOST_BLOCK_SIZE in sdio_config.h, it falls back to 512 if the host driver
+ * or the slave does not support it. A whole packet of up to slave_buf_num receive buffers is sent with one
+ * multi-block CMD53, larger packets are split.
+ *
+ * @param[out] info output of the link information
+ */
+void sdio_host_get_link_info(sdio_host_link_info_t* info);
+
+/**
+ * Start dispatching slave interrupts
+ *
+ * A task is created to wait for the D1 interrupt line, read and clear the slave interrupt bits,
+ * and wake up ``sdio_host_get_packet`` on HOST_SLC0_RX_NEW_PACKET_INT_ST and ``sdio_host_send_packet``
+ * on HOST_SLC0_TOHOST_BIT0_INT_ST. Call it after ``sdio_init`` (and after the ESP8266 firmware download)
+ * and before sending or receiving packets. Once it is started, the application must not call
+ * ``sdio_host_wait_int`` or clear the interrupt bits itself.
+ *
+ * @return
+ *      - SUCCESS on success
+ *      - ERR_NO_MEMORY if the semaphores or the task can not be created
+ */
+sdio_err_t sdio_host_start_intr(void);
+
 /**
  * Block until an SDIO interrupt is received
  *
@@ -59,10 +104,12 @@ sdio_err_t sdio_host_clear_intr(uint32_t intr_mask);
  * @param[out] out_data Data output address
  * @param size The size of the output buffer, if the buffer is smaller than the size of data to receive from slave, the driver returns ``ESP_ERR_NOT_FINISHED``
  * @param[out] out_length Output of length the data actually received from slave.
- * @param wait_ms Time to wait before timeout, in ms.
+ * @param wait_ms Time to wait before timeout, in ms. The caller sleeps until the slave raises a new packet interrupt.
  *
  * @return
  *      - SUCCESS on success
+ *      - ERR_NOT_FINISHED if more data is left in the slave, call it again to read the rest
+ *      - ERR_TIMEOUT if no data arrived within wait_ms
  *      - FAILURE on fail
  */
 sdio_err_t sdio_host_get_packet(void* out_data, size_t size, size_t *out_length, uint32_t wait_ms);
@@ -72,12 +119,35 @@ sdio_err_t sdio_host_get_packet(void* out_data, size_t size, size_t *out_length,
  * @param start Start address of the packet to send
  * @param length Length of data to send, if the packet is over-size, the it will be divided into blocks and hold into different buffers automatically.
  *
+ * The free slave buffers are cached locally, the token register is only read when they run short.
+ * The caller then sleeps until the slave signals HOST_SLC0_TOHOST_BIT0_INT_ST after loading new receive
+ * buffers, the token register is also rechecked every 10 ms for slaves which do not raise it.
+ *
  * @return
  *      - SUCCESS on success
+ *      - ERR_TIMEOUT if the slave has no free buffer in 10 s
  *      - FAILURE on fail
  */
 sdio_err_t sdio_host_send_packet(const void* start, size_t length);
 
+/** Send the concatenation of several segments to the SDIO slave as one packet stream.
+ *
+ * @param iov Array of segments, e.g. a header, the payload and a trailer
+ * @param iovcnt Number of segments in iov
+ *
+ * The segments are packed into block aligned CMD53 transfers like ``sdio_host_send_packet`` sends one buffer,
+ * without copying them into a contiguous buffer first. Word aligned data is sent in place, only the bytes
+ * at a misaligned segment border go through a small internal bounce buffer. Like ``sdio_host_send_packet``,
+ * the 1~3 bytes after the end of the last segment may be read to pad the last transfer.
+ *
+ * @return
+ *      - SUCCESS on success
+ *      - ERR_INVALID_ARG if iov is NULL, iovcnt is negative, or a non-empty segment has no base address
+ *      - ERR_TIMEOUT if the slave has no free buffer in 10 s
+ *      - FAILURE on fail
+ */
+sdio_err_t sdio_host_send_packetv(const sdio_host_iovec_t* iov, int iovcnt);
+
 /** Send a interrupt signal to the SDIO slave. 
  *
  * @param intr_no interrupt number, now only support 0.
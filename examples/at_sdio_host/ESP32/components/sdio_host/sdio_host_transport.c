@@ -13,8 +13,57 @@ static const char TAG[] = "sdio_transport";
 
 static uint32_t tx_sent_buffers = 0;    ///< Counter hold the amount of buffers already sent to sdio slave. Should be set to 0 when initialization.
 static uint32_t rx_got_bytes   = 0;       ///< Counter hold the amount of bytes already received from sdio slave. Should be set to 0 when initialization.
+static uint32_t tx_credit      = 0;       ///< Slave receive buffers known to be free, the token register is only read again when this runs short.
+static uint32_t block_size     = ESP_SDIO_DEFAULT_BUF_SIZE;    ///< CMD53 block size agreed with the slave
+static uint32_t slave_buf_size = ESP_SDIO_DEFAULT_BUF_SIZE;    ///< Size of one slave receive buffer, the unit of the send tokens
+static uint32_t slave_buf_num  = 0;       ///< Number of slave receive buffers, 0 if the slave does not publish it
+
+#define SDIO_INTR_WAIT_MS       1000    // interrupt task wakes up at least this often to catch a missed D1 edge
+#define SDIO_INTR_TASK_STACK    2048
+#define SDIO_INTR_TASK_PRIO     5
+#define TX_TOKEN_POLL_MS        10      // recheck the token register while waiting, for slaves which never raise TOHOST_BIT0
+#define TX_TOKEN_WAIT_MS        10000
+
+static platform_os_sem_t rx_sem;       ///< Given by the interrupt task on HOST_SLC0_RX_NEW_PACKET_INT_ST
+static platform_os_sem_t tx_sem;       ///< Given by the interrupt task on HOST_SLC0_TOHOST_BIT0_INT_ST, slave has loaded receive buffers
+static uint32_t tx_bounce_buf[128];     ///< Word aligned, gathers the bytes of a scatter-gather send which can not go to the slave in place
 
 /******************  Init SDIO slave *********************/
+// Write the block size of function 0~2 and read function 1 back, the slave keeps its old size if it can not handle the new one
+static sdio_err_t esp_slave_set_block_size(uint32_t size, uint32_t* actual)
+{
+    sdio_err_t err;
+    uint8_t bsl = 0, bsh = 0;
+
+    for (uint32_t func = 0; func <= 2; func++) {
+        err = sdio_driver_write_byte(0, SD_IO_FBR_BLKSIZEL(func), size & 0xFF, NULL);
+
+        if (err != SUCCESS) {
+            return err;
+        }
+
+        err = sdio_driver_write_byte(0, SD_IO_FBR_BLKSIZEH(func), (size >> 8) & 0xFF, NULL);
+
+        if (err != SUCCESS) {
+            return err;
+        }
+    }
+
+    err = sdio_driver_read_byte(0, SD_IO_FBR_BLKSIZEL(1), &bsl);
+
+    if (err == SUCCESS) {
+        err = sdio_driver_read_byte(0, SD_IO_FBR_BLKSIZEH(1), &bsh);
+    }
+
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    *actual = (bsh << 8) | bsl;
+    SDIO_LOGD(TAG, "Function 1 block size: %d", *actual);
+    return SUCCESS;
+}
+
 static sdio_err_t esp_slave_init_io(void)
 {
     sdio_err_t err;
@@ -76,65 +125,100 @@ static sdio_err_t esp_slave_init_io(void)
 
     SDIO_LOGD(TAG, "IE: 0x%02x", ie);
 
-    uint8_t bsl, bsh;
+    uint32_t actual;
+    return esp_slave_set_block_size(ESP_SDIO_DEFAULT_BUF_SIZE, &actual);
+}
 
-    bsl = 0;
-    err = sdio_driver_write_byte(0, SD_IO_CCCR_BLKSIZEL, bsl, &bsl);
+// Agree on the CMD53 block size with the host driver and the slave, and read the slave receive buffer layout
+static sdio_err_t esp_slave_negotiate(void)
+{
+    sdio_err_t err;
+    uint32_t size = SDIO_HOST_BLOCK_SIZE;
+    uint32_t actual = 0;
 
-    if (err != SUCCESS) {
-        return err;
-    }
+    if (size != ESP_SDIO_DEFAULT_BUF_SIZE) {
+        err = sdio_driver_set_block_size(size);
 
-    SDIO_LOGD(TAG, "Function 0 BSL: 0x%02x", bsl);
+        if (err == SUCCESS) {
+            err = esp_slave_set_block_size(size, &actual);
 
-    bsh = 2;
-    err = sdio_driver_write_byte(0, SD_IO_CCCR_BLKSIZEH, bsh, &bsh);
+            if (err != SUCCESS) {
+                return err;
+            }
+        }
 
-    if (err != SUCCESS) {
-        return err;
-    }
+        if (actual != size) {
+            SDIO_LOGW(TAG, "block size %d is not supported, use %d", size, ESP_SDIO_DEFAULT_BUF_SIZE);
+            size = ESP_SDIO_DEFAULT_BUF_SIZE;
+            sdio_driver_set_block_size(size);
+            err = esp_slave_set_block_size(size, &actual);
 
-    SDIO_LOGD(TAG, "Function 0 BSH: 0x%02x", bsh);
+            if (err != SUCCESS) {
+                return err;
+            }
+        }
+    }
 
-    uint8_t func1_bsl, func1_bsh;
+    block_size = size;
 
-    func1_bsl = 0;
-    err = sdio_driver_write_byte(0, 0x110, func1_bsl, &func1_bsl);
+#if TARGET_ESP32
+    uint8_t conf[4];
+    err = sdio_driver_read_bytes(1, ESP_SDIO_SLAVE_CONF_W0, conf, 4);
 
     if (err != SUCCESS) {
         return err;
     }
 
-    SDIO_LOGD(TAG, "Function 1 BSL: 0x%02x", func1_bsl);
- 
-    func1_bsh = 2;         // Set block size 512 (0x200)  
-    err = sdio_driver_write_byte(0, 0x111, func1_bsh, &func1_bsh);
-    if (err != SUCCESS) {
-        return err;
+    uint32_t buf_size = conf[0] | (conf[1] << 8);
+
+    // older slaves leave the registers 0, keep the 512 byte buffers they always used
+    if (conf[3] == ESP_SDIO_SLAVE_CONF_MAGIC && buf_size != 0 && (buf_size & 3) == 0) {
+        slave_buf_size = buf_size;
+        slave_buf_num = conf[2];
     }
+#endif
 
-    SDIO_LOGD(TAG, "Function 1 BSH: 0x%02x", func1_bsh);
+    SDIO_LOGI(TAG, "block size: %d, slave buffer size: %d, slave buffer num: %d", block_size, slave_buf_size, slave_buf_num);
+    return SUCCESS;
+}
 
-    uint8_t func2_bsl, func2_bsh;
+// Dispatch slave interrupts to the waiting receive and send paths, the slave raises D1 until the bits are cleared
+static void sdio_host_intr_task(void* arg)
+{
+    uint32_t intr_raw;
 
-    func2_bsl = 0;
-    err = sdio_driver_write_byte(0, 0x210, func2_bsl, &func2_bsl);
-    if (err != SUCCESS) {
-        return err;
-    }
+    for (;;) {
+        sdio_err_t ret = sdio_driver_wait_int(SDIO_INTR_WAIT_MS);
 
-    SDIO_LOGD(TAG, "Function 2 BSL: 0x%02x", func2_bsl);
+        if (ret == ERR_TIMEOUT) {
+            continue;
+        } else if (ret != SUCCESS) {
+            platform_os_delay(1);
+            continue;
+        }
 
-    func2_bsh = 2;
-    err = sdio_driver_write_byte(0, 0x210, func2_bsh, &func2_bsh);
+        ret = sdio_host_get_intr(&intr_raw, NULL);
 
-    if (err != SUCCESS) {
-        return err;
-    }
+        if (ret != SUCCESS || intr_raw == 0) {
+            continue;
+        }
 
-    SDIO_LOGD(TAG, "Function 2 BSH: 0x%02x", func2_bsh);
+        ret = sdio_host_clear_intr(intr_raw);
 
-    return SUCCESS;
+        if (ret != SUCCESS) {
+            SDIO_LOGE(TAG, "clear intr error, err: %d", ret);
+        }
+
+        SDIO_LOGD(TAG, "intr raw: %x", intr_raw);
+
+        if (intr_raw & HOST_SLC0_RX_NEW_PACKET_INT_ST) {
+            platform_os_sem_give(rx_sem);
+        }
+
+        if (intr_raw & HOST_SLC0_TOHOST_BIT0_INT_ST) {
+            platform_os_sem_give(tx_sem);
+        }
+    }
 }
 
 //host use this to initialize the slave as well as SDIO registers
@@ -155,9 +239,42 @@ sdio_err_t sdio_init(void)
         return ret;
     }
 
+    ret = esp_slave_negotiate();
+
+    if (ret != SUCCESS) {
+        SDIO_LOGE(TAG, "esp slave negotiate error, err: %d", ret);
+        return ret;
+    }
+
     return SUCCESS;
 }
 
+sdio_err_t sdio_host_start_intr(void)
+{
+    rx_sem = platform_os_sem_create();
+    tx_sem = platform_os_sem_create();
+
+    if (rx_sem == NULL || tx_sem == NULL) {
+        SDIO_LOGE(TAG, "create semaphore error");
+        return ERR_NO_MEMORY;
+    }
+
+    if (!platform_os_task_create(sdio_host_intr_task, "sdioIntrTask", SDIO_INTR_TASK_STACK, NULL, SDIO_INTR_TASK_PRIO)) {
+        SDIO_LOGE(TAG, "create interrupt task error");
+        return ERR_NO_MEMORY;
+    }
+
+    return SUCCESS;
+}
+
+void sdio_host_get_link_info(sdio_host_link_info_t* info)
+{
+    sdio_driver_get_bus(&info->bus_width, &info->clock_khz);
+    info->block_size = block_size;
+    info->slave_buf_size = slave_buf_size;
+    info->slave_buf_num = slave_buf_num;
+}
+
 /************************* RECEIVE ****************************/
 // HOST receive data
 static sdio_err_t esp_sdio_slave_get_rx_data_size(uint32_t* rx_size)
@@ -178,7 +295,7 @@ sdio_err_t sdio_host_get_packet(void* out_data, size_t size, size_t* out_length,
 {
     sdio_err_t err = SUCCESS;
     uint32_t len = 0;
-    uint32_t wait_time = 0;
+    uint32_t start_ms = platform_os_get_time_ms();
 
     if (size <= 0) {
         SDIO_LOGE(TAG, "Invalid size:%d", size);
@@ -196,15 +313,12 @@ sdio_err_t sdio_host_get_packet(void* out_data, size_t size, size_t* out_length,
             return err;
         }
 
-        //not error and no data, retry ``timeout_cnt`` times.
-        wait_time++;
+        // no data, sleep until the slave raises a new packet interrupt
+        uint32_t elapsed_ms = platform_os_get_time_ms() - start_ms;
 
-        if (wait_time >= wait_ms) {
+        if (elapsed_ms >= wait_ms || !platform_os_sem_take(rx_sem, wait_ms - elapsed_ms)) {
             return ERR_TIMEOUT;
         }
-
-        //vTaskDelay(1);
-        platform_os_delay(1);
     }
 
     SDIO_LOGD(TAG, "get_packet: slave len=%d, max read size=%d", len, size);
@@ -218,11 +332,15 @@ sdio_err_t sdio_host_get_packet(void* out_data, size_t size, size_t* out_length,
     uint8_t* start_ptr = (uint8_t*)out_data;
 
     do {
-        const int block_size = 512; //currently our driver don't support block size other than 512
         int len_to_send;
 
+        // the block aligned part in a single multi-block CMD53
         int block_n = len_remain / block_size;
 
+        if (block_n > SDIO_CMD53_MAX_BLOCKS) {
+            block_n = SDIO_CMD53_MAX_BLOCKS;
+        }
+
         if (block_n != 0) {
             len_to_send = block_n * block_size;
             err = sdio_driver_read_blocks(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, start_ptr, len_to_send);
@@ -286,8 +404,6 @@ sdio_err_t sdio_host_wait_int(uint32_t wait)
     return sdio_driver_wait_int(wait);
 }
 
-uint32_t test_count = 0;
-
 /*********************** SEND ***************************/
 
 static uint32_t esp_sdio_host_get_buffer_size(void)
@@ -299,7 +415,6 @@ static uint32_t esp_sdio_host_get_buffer_size(void)
         SDIO_LOGE(TAG, "Read length error, ret=%d\r\n", ret);
         return 0;
     }
-    test_count = len;
     SDIO_LOGD(TAG, " Read ESP32 len: %d\r\n", len);
     len = (len >> ESP_SDIO_SEND_OFFSET) & TX_BUFFER_MASK;
     len = (len + TX_BUFFER_MAX - tx_sent_buffers) % TX_BUFFER_MAX;
@@ -321,70 +436,186 @@ sdio_err_t sdio_host_send_intr(uint8_t intr_no)
     return ret;
 }
 
-sdio_err_t sdio_host_send_packet(const void* start, size_t length)
+// Position in a segment list, empty segments are skipped
+typedef struct {
+    const sdio_host_iovec_t* iov;
+    int iovcnt;
+    int index;
+    size_t offset;
+} esp_sdio_iov_cursor_t;
+
+// Return the unsent part of the current segment, NULL with *seg_len 0 when the list is used up
+static const uint8_t* esp_sdio_iov_peek(esp_sdio_iov_cursor_t* cursor, size_t* seg_len)
+{
+    while (cursor->index < cursor->iovcnt && cursor->offset == cursor->iov[cursor->index].len) {
+        cursor->index++;
+        cursor->offset = 0;
+    }
+
+    if (cursor->index >= cursor->iovcnt) {
+        *seg_len = 0;
+        return NULL;
+    }
+
+    *seg_len = cursor->iov[cursor->index].len - cursor->offset;
+    return (const uint8_t*)cursor->iov[cursor->index].base + cursor->offset;
+}
+
+/* Send one packet taken from the segment list.
+ *
+ * Word aligned data goes to the slave in place, the block aligned part in a single multi-block CMD53 and
+ * the rest in byte mode. Only the bytes which do not fit the 4-byte granularity of CMD53 (a misaligned
+ * segment, or the 1~3 bytes at a segment border) are gathered in a bounce buffer. Every CMD53 except the
+ * last one of the packet carries a multiple of 4 bytes, the length is determined by the SDIO address, and
+ * the padding of the last one will be discarded by the slave hardware.
+ */
+static sdio_err_t esp_sdio_host_write_packet(esp_sdio_iov_cursor_t* cursor, uint32_t length)
 {
     sdio_err_t err;
-    uint8_t* start_ptr = (uint8_t*)start;
-    uint32_t len_remain = length;
-    uint32_t block_size = 512;
-    int buffer_used = (length + block_size - 1) / block_size;
+    uint32_t len_remain = length;       // bytes of the packet not sent yet, the next CMD53 address is END_ADDR - len_remain
+    uint32_t bounce_len = 0;
+    uint8_t* bounce = (uint8_t*)tx_bounce_buf;
+
+    while (len_remain) {
+        uint32_t avail = len_remain - bounce_len;
+        size_t seg_len = 0;
+        const uint8_t* ptr = NULL;
+        uint32_t len_to_send = 0;
+
+        if (avail) {
+            ptr = esp_sdio_iov_peek(cursor, &seg_len);
+            if (ptr == NULL) {
+                // the segments hold less than the packet length
+                return ERR_INVALID_ARG;
+            }
+            seg_len = seg_len > avail ? avail : seg_len;
+        }
+
+        if (bounce_len && (avail == 0 || bounce_len == sizeof(tx_bounce_buf) || ((bounce_len & 3) == 0 && ((uintptr_t)ptr & 3) == 0))) {
+            // flush the gathered bytes, only the last CMD53 of the packet may be padded
+            err = sdio_driver_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, bounce, (bounce_len + 3) & (~3));
 
-    uint32_t delay_time = 1;
+            if (err != SUCCESS) {
+                return err;
+            }
+
+            len_remain -= bounce_len;
+            bounce_len = 0;
+            continue;
+        }
 
-    uint32_t cnt = 10000;               // Test 300 times, fail will return TIMEOUT
+        if (bounce_len == 0 && ((uintptr_t)ptr & 3) == 0 && (seg_len >= 4 || seg_len == avail)) {
+            uint32_t block_n = seg_len / block_size;
 
-    while (1) {
-        uint32_t num = esp_sdio_host_get_buffer_size();
-        SDIO_LOGD(TAG, "Buffer size %d can be send", num);
+            if (block_n > SDIO_CMD53_MAX_BLOCKS) {
+                block_n = SDIO_CMD53_MAX_BLOCKS;
+            }
 
-        if (num * block_size < length) {
-            if (!--cnt) {
-                SDIO_LOGI(TAG, "buffer is not enough: %d, %d required.", num, buffer_used);
-                return ERR_TIMEOUT;
+            if (block_n) {
+                len_to_send = block_n * block_size;
+                err = sdio_driver_write_blocks(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, (void*)ptr, len_to_send);
             } else {
-                SDIO_LOGD(TAG, "buffer is not enough: %d, %d required. Retry...", num, buffer_used);
+                len_to_send = (seg_len == avail) ? seg_len : (seg_len & (~3));
+                err = sdio_driver_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, (void*)ptr, (len_to_send + 3) & (~3));
             }
-            if(cnt%1000 == 0) {
-                SDIO_LOGI(TAG, "Get buffer too many times, num:%d, test_count: %d, tx_sent_buffers: %d", num, test_count, tx_sent_buffers);
+
+            if (err != SUCCESS) {
+                return err;
             }
 
-            platform_os_delay(1);
-            //ets_delay_us(delay_time);
-            delay_time *= 2;
-        }  else {
+            len_remain -= len_to_send;
+        } else {
+            // fill the bounce buffer up to a word, or further if the segment stays misaligned after that
+            uint32_t need = (4 - (bounce_len & 3)) & 3;
+
+            if (need == 0 || (((uintptr_t)ptr + need) & 3) != 0) {
+                need = sizeof(tx_bounce_buf) - bounce_len;
+            }
+
+            len_to_send = seg_len > need ? need : seg_len;
+            memcpy(bounce + bounce_len, ptr, len_to_send);
+            bounce_len += len_to_send;
+        }
+
+        cursor->offset += len_to_send;
+    }
+
+    return SUCCESS;
+}
+
+// Wait until the slave has loaded buffer_used receive buffers
+static sdio_err_t esp_sdio_host_wait_buffer(uint32_t buffer_used)
+{
+    uint32_t start_ms = platform_os_get_time_ms();
+
+    while (tx_credit < buffer_used) {
+        tx_credit = esp_sdio_host_get_buffer_size();
+        SDIO_LOGD(TAG, "Buffer size %d can be send", tx_credit);
+
+        if (tx_credit >= buffer_used) {
             break;
         }
+
+        if (platform_os_get_time_ms() - start_ms >= TX_TOKEN_WAIT_MS) {
+            SDIO_LOGI(TAG, "buffer is not enough: %d, %d required.", tx_credit, buffer_used);
+            return ERR_TIMEOUT;
+        }
+
+        SDIO_LOGD(TAG, "buffer is not enough: %d, %d required. Wait...", tx_credit, buffer_used);
+        platform_os_sem_take(tx_sem, TX_TOKEN_POLL_MS);
     }
 
-    do {
-        /* Though the driver supports to split packet of unaligned size into
-         * length of 4x and 1~3, we still send aligned size of data to get
-         * higher effeciency. The length is determined by the SDIO address, and
-         * the remainning will be discard by the slave hardware.
-         */
-        int block_n = len_remain / block_size;
-        int len_to_send;
+    return SUCCESS;
+}
 
-        if (block_n) {
-            len_to_send = block_n * block_size;
-            err = sdio_driver_write_blocks(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, start_ptr, len_to_send);
-        } else {
-            len_to_send = len_remain;
-            err = sdio_driver_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, start_ptr, (len_to_send + 3) & (~3));
+sdio_err_t sdio_host_send_packetv(const sdio_host_iovec_t* iov, int iovcnt)
+{
+    sdio_err_t err;
+    esp_sdio_iov_cursor_t cursor = { iov, iovcnt, 0, 0 };
+    size_t len_remain = 0;
+
+    if (iov == NULL || iovcnt < 0) {
+        return ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].len && iov[i].base == NULL) {
+            return ERR_INVALID_ARG;
         }
 
+        len_remain += iov[i].len;
+    }
+
+    // a packet larger than all the slave receive buffers never gets enough tokens, split it
+    uint32_t packet_max = slave_buf_num ? slave_buf_num * slave_buf_size : len_remain;
+
+    while (len_remain) {
+        uint32_t packet_len = len_remain > packet_max ? packet_max : len_remain;
+        uint32_t buffer_used = (packet_len + slave_buf_size - 1) / slave_buf_size;
+
+        err = esp_sdio_host_wait_buffer(buffer_used);
+
         if (err != SUCCESS) {
             return err;
         }
 
-        start_ptr += len_to_send;
-        len_remain -= len_to_send;
-    } while (len_remain);
+        err = esp_sdio_host_write_packet(&cursor, packet_len);
 
-    if (tx_sent_buffers >= TX_BUFFER_MAX) {
-        tx_sent_buffers -= TX_BUFFER_MAX;
+        if (err != SUCCESS) {
+            return err;
+        }
+
+        tx_credit -= buffer_used;
+        tx_sent_buffers = (tx_sent_buffers + buffer_used) % TX_BUFFER_MAX;
+        len_remain -= packet_len;
     }
 
-    tx_sent_buffers += buffer_used;
     return SUCCESS;
 }
+
+sdio_err_t sdio_host_send_packet(const void* start, size_t length)
+{
+    sdio_host_iovec_t iov = { start, length };
+
+    return sdio_host_send_packetv(&iov, 1);
+}
@@ -18,6 +18,7 @@
 
 #include "sdio_host_log.h"
 #include "sdio_host_transport.h"
+#include "sdio_host_bench.h"
 #include "sdio_config.h"
 
 #include "driver/uart.h"
@@ -66,55 +67,26 @@ static void slave_power_on()
 
 static void sdio_recv_task(void* pvParameters)
 {
+    const int wait_ms = 1000;
+
     while (1) {
-        esp_err_t ret = sdio_host_wait_int(1000 / portTICK_RATE_MS);
+        size_t size_read = READ_BUFFER_LEN;
+        // sleeps until the transport interrupt task reports a new packet
+        sdio_err_t ret = sdio_host_get_packet(rcv_buffer, READ_BUFFER_LEN, &size_read, wait_ms);
 
-        if (ret != SUCCESS) {
+        if (ret == ERR_TIMEOUT) {
             continue;
-        }
-
-        uint32_t intr_raw, intr_st;
-        ret = sdio_host_get_intr(&intr_raw, &intr_st);
-        SDIO_ERROR_CHECK(ret);
-
-        if (intr_raw == 0) {
-            //SDIO_LOGW(TAG, "No intr\r\n");
+        } else if (ret != SUCCESS && ret != ERR_NOT_FINISHED) {
+            SDIO_LOGE(TAG, "rx packet error: %08X", ret);
             continue;
         }
 
-        ret = sdio_host_clear_intr(intr_raw);
-        SDIO_ERROR_CHECK(ret);
-        SDIO_LOGD(TAG, "intr raw: %x, intr_st: %x", intr_raw, intr_st);
-
-        const int wait_ms = 50;
-
-        if (intr_raw & HOST_SLC0_RX_NEW_PACKET_INT_ST) {
-            SDIO_LOGD(TAG, "new packet coming");
-
-            while (1) {
-                size_t size_read = READ_BUFFER_LEN;
-                ret = sdio_host_get_packet(rcv_buffer, READ_BUFFER_LEN, &size_read, wait_ms);
-
-                if (ret == ERR_NOT_FOUND) {
-                    SDIO_LOGE(TAG, "interrupt but no data can be read");
-                    break;
-                } else if (ret != SUCCESS && ret != ERR_NOT_FINISHED) {
-                    SDIO_LOGE(TAG, "rx packet error: %08X", ret);
-                    break;
-                }
-
-                {
-                    printf("%s", rcv_buffer);
-                    fflush(stdout);
-                }
-
-                memset(rcv_buffer, 0x0, sizeof(rcv_buffer));
-
-                if (ret == SUCCESS) {
-                    break;
-                }
-            }
+        {
+            printf("%s", rcv_buffer);
+            fflush(stdout);
         }
+
+        memset(rcv_buffer, 0x0, sizeof(rcv_buffer));
     }
 
     vTaskDelete(NULL);
@@ -167,6 +139,15 @@ static void sdio_task(void* pvParameters)
     SDIO_ERROR_CHECK(err);
 #endif
 
+    err = sdio_host_start_intr();
+    assert(err == SUCCESS);
+
+#if SDIO_HOST_BENCH
+    err = sdio_host_bench(SDIO_HOST_BENCH_LEN);
+    SDIO_ERROR_CHECK(err);
+    vTaskDelete(NULL);
+#endif
+
     //Create the semaphore.
     rdySem = xSemaphoreCreateBinary();
 
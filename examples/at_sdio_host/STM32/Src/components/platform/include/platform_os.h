@@ -5,6 +5,8 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 /**
  * Delay some times
  *
@@ -15,6 +17,13 @@ extern "C" {
  */
 void platform_os_delay(uint32_t milliseconds);
 
+/**
+ * Get the time elapsed since the scheduler started
+ *
+ * @return time in milliseconds
+ */
+uint32_t platform_os_get_time_ms(void);
+
 #ifdef __cplusplus
 }
 #endif
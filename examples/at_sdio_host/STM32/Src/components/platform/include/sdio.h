@@ -38,6 +38,8 @@ typedef struct {
 void STM32SdioInit(sdio_init_t sdio_init);
 	 
 uint8_t STM32WaitIntr(uint32_t timeout);
+int STM32SetBlockSize(uint32_t size);
+uint32_t STM32GetClock(void);
 
 uint8_t STM32ReadReg(uint8_t func, uint32_t addr);
 
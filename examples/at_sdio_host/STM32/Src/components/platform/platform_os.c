@@ -1,7 +1,14 @@
 #include "FreeRTOS.h"
 #include "task.h"
 
+#include "platform_os.h"
+
 void platform_os_delay(uint32_t milliseconds)
 {
     vTaskDelay(milliseconds);
-}
\ No newline at end of file
+}
+
+uint32_t platform_os_get_time_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
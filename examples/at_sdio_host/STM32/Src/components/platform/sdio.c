@@ -50,9 +50,13 @@ static const char TAG[] = "STM32_sdio";
 #define SD_IO_CCCR_BUS_WIDTH        0x07
 #define CCCR_BUS_WIDTH_4           (2<<0)
 
-#define SDIO_BLOCK_SIZE 512
+#define SDIO_BLOCK_SIZE_MAX 512
+#define SDIO_CLOCK_MAX 24000000
 
 static SDIO_CmdInitTypeDef sdio_cmd;
+static uint32_t sdio_block_size = 512;
+static uint32_t sdio_block_size_code = SDIO_DATABLOCK_SIZE_512B;
+static uint32_t sdio_clock;
 static SDIO_DataInitTypeDef sdio_data;
 extern SemaphoreHandle_t sdio_recv_SemHandle;
 static SemaphoreHandle_t semahandle;
@@ -65,6 +69,8 @@ static uint8_t CalcClockDivider(uint32_t freq, uint32_t *preal)
   sdioclk = HAL_RCC_GetHCLKFreq();
   if (freq == 0)
     freq = 1;
+  else if (freq > SDIO_CLOCK_MAX)
+    freq = SDIO_CLOCK_MAX;
   
   divider = sdioclk / freq - 2;
   if (sdioclk % freq != 0)
@@ -300,8 +306,10 @@ sdio_err_t SdioDriverInit(SD_InitTypeDef init_para)
   WaitForResponse(__FUNCTION__);
   SDIO_LOGD(TAG, "Card selected! RESP1_%08x\n", SDIO_GetResponse(SDIO, SDIO_RESP1));
 
-	// resume SDIO CLK
-	status = SDIO_Init(SDIO, init_para);
+	// resume SDIO CLK, keep 1-bit until the card has switched its bus width
+	Init = init_para;
+	Init.BusWide = SDIO_BUS_WIDE_1B;
+	status = SDIO_Init(SDIO, Init);
 	if (status != HAL_OK)
 	{
 			return FAILURE;
@@ -321,6 +329,14 @@ sdio_err_t SdioDriverInit(SD_InitTypeDef init_para)
 	}
 	STM32WriteReg(0, SD_IO_CCCR_BUS_WIDTH, bus_width);
 
+	if(init_para.BusWide == SDIO_BUS_WIDE_4B){
+		status = SDIO_Init(SDIO, init_para);
+		if (status != HAL_OK)
+		{
+				return FAILURE;
+		}
+	}
+
 	return SDIO_SUCCESS;
 }
 
@@ -351,13 +367,13 @@ static uint16_t GetBlockNum(uint8_t func, uint32_t *psize, uint8_t flag)
   
 	if(*psize == 4){
 		sdio_data.DataBlockSize = SDIO_DATABLOCK_SIZE_4B;
-	} else if (*psize >= SDIO_BLOCK_SIZE || flag) {
-    sdio_data.DataBlockSize = SDIO_DATABLOCK_SIZE_512B;
+	} else if (*psize >= sdio_block_size || flag) {
+    sdio_data.DataBlockSize = sdio_block_size_code;
     
-    block_num = *psize / SDIO_BLOCK_SIZE;
-    if (*psize % SDIO_BLOCK_SIZE != 0)
+    block_num = *psize / sdio_block_size;
+    if (*psize % sdio_block_size != 0)
     block_num++;
-    *psize = block_num * SDIO_BLOCK_SIZE;
+    *psize = block_num * sdio_block_size;
   } else {
 		sdio_data.DataBlockSize = SDIO_DATABLOCK_SIZE_1B;
     *psize = (*psize + 3) & ~3;
@@ -592,6 +608,7 @@ void STM32SdioInit(sdio_init_t sdio_init)
 	}
   Init.HardwareFlowControl = SDIO_HARDWARE_FLOW_CONTROL_DISABLE;
   Init.ClockDiv = CalcClockDivider(sdio_init.clock, &freq);
+	sdio_clock = freq;
 	sdio_data.DataTimeOut = freq ;    // Data timeout is 1s
   if (SdioDriverInit(Init) != SDIO_SUCCESS)
   {
@@ -600,6 +617,29 @@ void STM32SdioInit(sdio_init_t sdio_init)
   }	
 }
 
+/* Block size of CMD53 block mode, a power of 2 up to 512 */
+int STM32SetBlockSize(uint32_t size)
+{
+  uint32_t order = 0;
+
+  if (size < 4 || size > SDIO_BLOCK_SIZE_MAX || (size & (size - 1)) != 0)
+    return -2;
+
+  while ((1UL << order) != size)
+    order++;
+
+  xSemaphoreTake(semahandle, portMAX_DELAY);
+  sdio_block_size = size;
+  sdio_block_size_code = order << SDIO_DCTRL_DBLOCKSIZE_Pos;
+  xSemaphoreGive(semahandle);
+  return 0;
+}
+
+uint32_t STM32GetClock(void)
+{
+  return sdio_clock;
+}
+
 uint8_t STM32WaitIntr(uint32_t timeout)
 {
 	__SDIO_DISABLE_IT(SDIO, SDIO_FLAG_SDIOIT);    //disable GPIO intrrupt
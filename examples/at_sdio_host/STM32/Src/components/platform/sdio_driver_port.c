@@ -24,6 +24,7 @@
 #include "sdio.h"
 #include "gpio.h"
 #include "platform_os.h"
+#include "sdio_config.h"
 
 static const char TAG[] = "sdio_driver";
 
@@ -32,14 +33,28 @@ SemaphoreHandle_t sdio_recv_SemHandle;
 sdio_err_t sdio_driver_init(void)
 {
 	  sdio_init_t sdio_init = {
-			.width = WIDTH_1,
-			.clock = 400000    // 12M clock
+			.width = (SDIO_HOST_BUS_WIDTH == 4) ? WIDTH_4 : WIDTH_1,
+			.clock = SDIO_HOST_CLOCK
 		};
     sdio_recv_SemHandle = xSemaphoreCreateBinary();
 	  STM32SdioInit(sdio_init);
     return SDIO_SUCCESS;
 }
 
+sdio_err_t sdio_driver_set_block_size(uint32_t block_size)
+{
+    if (STM32SetBlockSize(block_size) < 0) {
+        return ERR_INVALID_ARG;
+    }
+    return SDIO_SUCCESS;
+}
+
+void sdio_driver_get_bus(uint32_t* bus_width, uint32_t* clock_khz)
+{
+    *bus_width = (SDIO_HOST_BUS_WIDTH == 4) ? 4 : 1;
+    *clock_khz = STM32GetClock() / 1000;
+}
+
 sdio_err_t sdio_driver_read_bytes(uint32_t function, uint32_t addr, void* buffer, uint32_t len)
 {
     int ret = STM32ReadData(function, addr, buffer, len);
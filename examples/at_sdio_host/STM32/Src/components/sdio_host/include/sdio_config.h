@@ -3,4 +3,21 @@
 
 #define TARGET_ESP32  1
 
+// CMD53 block size requested from the slave, a power of 2 within 4~512
+#define SDIO_HOST_BLOCK_SIZE    512
+
+// bus width (1 or 4) and clock in Hz, SDIO_CK is HCLK / (divider + 2) and at most 24 MHz on STM32F103,
+// the 4-bit bus needs DAT2 and DAT3 connected
+#define SDIO_HOST_BUS_WIDTH     1
+#define SDIO_HOST_CLOCK         400000
+
+// 1: run the AT+BENCH throughput test instead of the UART bridge, the slave needs CONFIG_AT_BENCH_COMMAND_SUPPORT
+#define SDIO_HOST_BENCH         0
+#define SDIO_HOST_BENCH_LEN     (64 * 1024)
+
+// TCP server for the transparent transmission run of the benchmark, "" to skip it.
+// The slave must be connected to an AP already, the server receives SDIO_HOST_BENCH_LEN bytes.
+#define SDIO_HOST_BENCH_SERVER_IP       ""
+#define SDIO_HOST_BENCH_SERVER_PORT     8080
+
 #endif /* SDIO_CONFIG_H_ */
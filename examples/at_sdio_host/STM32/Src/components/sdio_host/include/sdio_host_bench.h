@@ -0,0 +1,35 @@
+#ifndef SDIO_HOST_BENCH_H_
+#define SDIO_HOST_BENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "sdio_host_error.h"
+
+/**
+ * Measure the throughput of both directions with the AT+BENCH command of the slave
+ *
+ * The bus width, clock, block size and slave buffers in use are printed first, followed by
+ * bytes per second and pattern errors of host -> slave and slave -> host. Nothing else may
+ * send or receive packets during the test. The slave needs CONFIG_AT_BENCH_COMMAND_SUPPORT.
+ *
+ * If SDIO_HOST_BENCH_SERVER_IP is set, the same bytes are then sent to that TCP server in
+ * transparent transmission and the host -> slave rate of this run is printed too.
+ *
+ * @param length bytes to transfer in each direction
+ *
+ * @return
+ *      - SDIO_SUCCESS on success
+ *      - ERR_TIMEOUT if the slave stops answering
+ *      - FAILURE on fail
+ */
+sdio_err_t sdio_host_bench(uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDIO_HOST_BENCH_H_ */
@@ -13,11 +13,18 @@
 #define SD_IO_CCCR_BLKSIZEL         0x10
 #define SD_IO_CCCR_BLKSIZEH         0x11
 
+#define SD_IO_FBR_BLKSIZEL(func)    ((func) * 0x100 + 0x10)
+#define SD_IO_FBR_BLKSIZEH(func)    ((func) * 0x100 + 0x11)
+
+#define SDIO_CMD53_MAX_BLOCKS       511         // 9 bit block count of CMD53
+
 #define TX_BUFFER_MAX   0x1000
 #define TX_BUFFER_MASK  0xFFF
 
 #define ESP_SLAVE_CMD53_END_ADDR    0x1f800
 
+#define ESP_SDIO_DEFAULT_BUF_SIZE   512         // slave receive buffer size if the slave does not publish it
+
 #if TARGET_ESP32
 
 #define ESP32_SLCHOST_BASE          0x3ff55000
@@ -31,6 +38,10 @@
 #define ESP_SDIO_CONF               (ESP32_SLCHOST_BASE + 0x8c)&0x3FF
 #define ESP_SDIO_CONF_OFFSET        0
 
+// shared registers 0~3 written by the AT slave: receive buffer size (little endian), buffer number, magic
+#define ESP_SDIO_SLAVE_CONF_W0      (ESP32_SLCHOST_BASE + 0x6C)&0x3FF
+#define ESP_SDIO_SLAVE_CONF_MAGIC   0xA5
+
 #define RX_BYTE_MAX                 0x100000
 #define RX_BYTE_MASK                0xFFFFF
 
@@ -5,6 +5,9 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stddef.h>
+
 #include "sdio_host_error.h"
 
 #define BIT(n)   (1UL << (n))
@@ -12,6 +15,22 @@ extern "C" {
 #define HOST_SLC0_RX_NEW_PACKET_INT_ST  (BIT(23))
 #define HOST_SLC0_TOHOST_BIT0_INT_ST  (BIT(0))
 
+typedef struct {
+    uint32_t bus_width;         ///< 1 or 4
+    uint32_t clock_khz;         ///< Bus clock
+    uint32_t block_size;        ///< CMD53 block size agreed with the slave
+    uint32_t slave_buf_size;    ///< Size of one slave receive buffer
+    uint32_t slave_buf_num;     ///< Number of slave receive buffers, 0 if the slave does not publish it
+} sdio_host_link_info_t;
+
+/**
+ * One segment of a scatter-gather send, see ``sdio_host_send_packetv``
+ */
+typedef struct {
+    const void* base;   ///< Start address of the segment
+    size_t len;         ///< Length of the segment, may be 0
+} sdio_host_iovec_t;
+
 /**
  * Init SDIO host and slave
  *
@@ -21,6 +40,17 @@ extern "C" {
  */
 sdio_err_t sdio_host_init(void);
 
+/**
+ * Get the bus and transfer sizes agreed with the slave by ``sdio_host_init``
+ *
+ * The block size comes from SDIO_HOST_BLOCK_SIZE in sdio_config.h, it falls back to 512 if the host driver
+ * or the slave does not support it. A whole packet of up to slave_buf_num receive buffers is sent with one
+ * multi-block CMD53, larger packets are split.
+ *
+ * @param[out] info output of the link information
+ */
+void sdio_host_get_link_info(sdio_host_link_info_t* info);
+
 /**
  * Block until an SDIO interrupt is received
  *
@@ -80,6 +110,24 @@ sdio_err_t sdio_host_get_packet(void* out_data, size_t size, size_t *out_length,
  */
 sdio_err_t sdio_host_send_packet(const void* start, size_t length);
 
+/** Send the concatenation of several segments to the SDIO slave as one packet stream.
+ *
+ * @param iov Array of segments, e.g. a header, the payload and a trailer
+ * @param iovcnt Number of segments in iov
+ *
+ * The segments are packed into block aligned CMD53 transfers like ``sdio_host_send_packet`` sends one buffer,
+ * without copying them into a contiguous buffer first. Word aligned data is sent in place (and by DMA),
+ * only the bytes at a misaligned segment border go through a small internal bounce buffer. Like
+ * ``sdio_host_send_packet``, the 1~3 bytes after the end of the last segment may be read to pad the last transfer.
+ *
+ * @return
+ *      - SUCCESS on success
+ *      - ERR_INVALID_ARG if iov is NULL, iovcnt is negative, or a non-empty segment has no base address
+ *      - ERR_TIMEOUT if the slave has no free buffer
+ *      - FAILURE on fail
+ */
+sdio_err_t sdio_host_send_packetv(const sdio_host_iovec_t* iov, int iovcnt);
+
 /** Send a interrupt signal to the SDIO slave. 
  *
  * @param intr_no interrupt number, now only support 0.
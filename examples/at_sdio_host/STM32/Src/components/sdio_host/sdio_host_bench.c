@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform_os.h"
+#include "sdio_config.h"
+#include "sdio_host_log.h"
+#include "sdio_host_transport.h"
+#include "sdio_host_bench.h"
+
+static const char TAG[] = "sdio_bench";
+
+#define BENCH_CHUNK_LEN         4096
+#define BENCH_WAIT_MS           5000
+#define BENCH_MODE_SOURCE       0       // slave -> host
+#define BENCH_MODE_SINK         1       // host -> slave
+#define BENCH_GUARD_MS          1000    // silence before and after "+++", so the slave takes it as the end of transparent transmission
+
+// word aligned, the STM32 SDIO DMA can not handle other buffers
+static uint32_t bench_tx_buf[BENCH_CHUNK_LEN / 4];
+static uint32_t bench_rx_buf[BENCH_CHUNK_LEN / 4];
+static uint32_t bench_rx_pos;
+static uint32_t bench_rx_len;
+
+// same stream as AT+BENCH on the slave
+static uint8_t bench_pattern(uint32_t offset)
+{
+    return (uint8_t)(offset + (offset >> 8));
+}
+
+static sdio_err_t bench_get_byte(uint8_t* byte)
+{
+    if (bench_rx_pos == bench_rx_len) {
+        size_t size_read = 0;
+        sdio_err_t err = sdio_host_get_packet(bench_rx_buf, sizeof(bench_rx_buf), &size_read, BENCH_WAIT_MS);
+
+        if (err != SDIO_SUCCESS && err != ERR_NOT_FINISHED) {
+            return err;
+        }
+
+        bench_rx_pos = 0;
+        bench_rx_len = size_read;
+    }
+
+    *byte = ((uint8_t*)bench_rx_buf)[bench_rx_pos++];
+    return SDIO_SUCCESS;
+}
+
+// Skip the slave output up to and including expect, fail on an ERROR response
+static sdio_err_t bench_wait_for(const char* expect)
+{
+    const char* error = "ERROR\r\n";
+    uint32_t expect_pos = 0, error_pos = 0;
+    uint8_t byte;
+
+    while (expect[expect_pos] != '\0') {
+        sdio_err_t err = bench_get_byte(&byte);
+
+        if (err != SDIO_SUCCESS) {
+            return err;
+        }
+
+        expect_pos = (byte == expect[expect_pos]) ? expect_pos + 1 : (byte == expect[0]);
+        error_pos = (byte == error[error_pos]) ? error_pos + 1 : (byte == error[0]);
+
+        if (error[error_pos] == '\0') {
+            return FAILURE;
+        }
+    }
+
+    return SDIO_SUCCESS;
+}
+
+// Parse a decimal number ended by terminator
+static sdio_err_t bench_read_uint(uint32_t* value, char terminator)
+{
+    uint8_t byte;
+    *value = 0;
+
+    for (;;) {
+        sdio_err_t err = bench_get_byte(&byte);
+
+        if (err != SDIO_SUCCESS) {
+            return err;
+        }
+
+        if (byte == terminator) {
+            return SDIO_SUCCESS;
+        } else if (byte < '0' || byte > '9') {
+            return FAILURE;
+        }
+
+        *value = *value * 10 + (byte - '0');
+    }
+}
+
+// "+BENCH:<mode>,<length>,<us>,<errors>" printed by the slave at the end of a run
+static sdio_err_t bench_read_result(uint32_t* length, uint32_t* errors)
+{
+    uint32_t mode, us;
+    sdio_err_t err = bench_wait_for("+BENCH:");
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_read_uint(&mode, ',');
+    }
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_read_uint(length, ',');
+    }
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_read_uint(&us, ',');
+    }
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_read_uint(errors, '\r');
+    }
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_wait_for("OK\r\n");
+    }
+
+    return err;
+}
+
+static sdio_err_t bench_send_cmd(uint32_t mode, uint32_t length)
+{
+    int len = snprintf((char*)bench_tx_buf, sizeof(bench_tx_buf), "AT+BENCH=%u,%u\r\n", (unsigned)mode, (unsigned)length);
+    return sdio_host_send_packet(bench_tx_buf, len);
+}
+
+// Send a command and skip its output up to expect
+static sdio_err_t bench_command(const char* cmd, const char* expect)
+{
+    int len = snprintf((char*)bench_tx_buf, sizeof(bench_tx_buf), "%s\r\n", cmd);
+    sdio_err_t err = sdio_host_send_packet(bench_tx_buf, len);
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_wait_for(expect);
+    }
+
+    return err;
+}
+
+static void bench_report(const char* name, uint32_t length, uint32_t elapsed_ms, uint32_t errors)
+{
+    uint32_t rate = elapsed_ms ? (uint32_t)((uint64_t)length * 1000 / elapsed_ms) : 0;
+    SDIO_LOGI(TAG, "%s: %u bytes in %u ms, %u bytes/s, errors: %u", name, (unsigned)length, (unsigned)elapsed_ms, (unsigned)rate, (unsigned)errors);
+}
+
+// host -> slave: AT+BENCH=1,<length>, then the pattern after the '>' prompt
+static sdio_err_t bench_sink(uint32_t length)
+{
+    uint32_t offset = 0, received = 0, errors = 0;
+    uint32_t start_ms;
+    sdio_err_t err = bench_send_cmd(BENCH_MODE_SINK, length);
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_wait_for(">");
+    }
+
+    if (err != SDIO_SUCCESS) {
+        return err;
+    }
+
+    start_ms = platform_os_get_time_ms();
+
+    while (offset < length) {
+        uint32_t chunk = (length - offset > BENCH_CHUNK_LEN) ? BENCH_CHUNK_LEN : length - offset;
+
+        for (uint32_t loop = 0; loop < chunk; loop++) {
+            ((uint8_t*)bench_tx_buf)[loop] = bench_pattern(offset + loop);
+        }
+
+        err = sdio_host_send_packet(bench_tx_buf, chunk);
+
+        if (err != SDIO_SUCCESS) {
+            return err;
+        }
+
+        offset += chunk;
+    }
+
+    err = bench_read_result(&received, &errors);
+
+    if (err != SDIO_SUCCESS) {
+        return err;
+    }
+
+    bench_report("host -> slave", length, platform_os_get_time_ms() - start_ms, errors + (length - received));
+    return SDIO_SUCCESS;
+}
+
+// slave -> host: AT+BENCH=0,<length> answers "+BENCH:<length>," followed by the pattern
+static sdio_err_t bench_source(uint32_t length)
+{
+    uint32_t offset = 0, header_len = 0, result_len = 0, errors = 0, slave_errors = 0;
+    uint32_t start_ms = platform_os_get_time_ms();
+    uint8_t byte;
+    sdio_err_t err = bench_send_cmd(BENCH_MODE_SOURCE, length);
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_wait_for("+BENCH:");
+    }
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_read_uint(&header_len, ',');
+    }
+
+    if (err != SDIO_SUCCESS || header_len != length) {
+        return FAILURE;
+    }
+
+    for (offset = 0; offset < length; offset++) {
+        err = bench_get_byte(&byte);
+
+        if (err != SDIO_SUCCESS) {
+            return err;
+        }
+
+        errors += (byte != bench_pattern(offset));
+    }
+
+    uint32_t elapsed_ms = platform_os_get_time_ms() - start_ms;
+    err = bench_read_result(&result_len, &slave_errors);
+
+    if (err != SDIO_SUCCESS) {
+        return err;
+    }
+
+    bench_report("slave -> host", length, elapsed_ms, errors + slave_errors);
+    return SDIO_SUCCESS;
+}
+
+// host -> slave -> TCP server in transparent transmission, the slave must be connected to an AP already
+static sdio_err_t bench_passthrough(const char* ip, uint32_t port, uint32_t length)
+{
+    char cmd[64];
+    uint32_t offset = 0;
+    uint32_t start_ms, elapsed_ms;
+    sdio_err_t err = bench_command("AT+CIPMODE=1", "OK\r\n");
+
+    if (err == SDIO_SUCCESS) {
+        snprintf(cmd, sizeof(cmd), "AT+CIPSTART=\"TCP\",\"%s\",%u", ip, (unsigned)port);
+        err = bench_command(cmd, "OK\r\n");
+    }
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_command("AT+CIPSEND", ">");
+    }
+
+    if (err != SDIO_SUCCESS) {
+        return err;
+    }
+
+    start_ms = platform_os_get_time_ms();
+
+    while (offset < length) {
+        uint32_t chunk = (length - offset > BENCH_CHUNK_LEN) ? BENCH_CHUNK_LEN : length - offset;
+
+        for (uint32_t loop = 0; loop < chunk; loop++) {
+            ((uint8_t*)bench_tx_buf)[loop] = bench_pattern(offset + loop);
+        }
+
+        err = sdio_host_send_packet(bench_tx_buf, chunk);
+
+        if (err != SDIO_SUCCESS) {
+            return err;
+        }
+
+        offset += chunk;
+    }
+
+    elapsed_ms = platform_os_get_time_ms() - start_ms;
+
+    platform_os_delay(BENCH_GUARD_MS);
+    memcpy(bench_tx_buf, "+++", 3);
+    err = sdio_host_send_packet(bench_tx_buf, 3);
+    platform_os_delay(BENCH_GUARD_MS);
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_command("AT+CIPCLOSE", "OK\r\n");
+    }
+
+    if (err == SDIO_SUCCESS) {
+        err = bench_command("AT+CIPMODE=0", "OK\r\n");
+    }
+
+    if (err != SDIO_SUCCESS) {
+        return err;
+    }
+
+    // the server checks the pattern, the slave logs how many notifications the data took
+    bench_report("passthrough host -> slave", length, elapsed_ms, 0);
+    return SDIO_SUCCESS;
+}
+
+sdio_err_t sdio_host_bench(uint32_t length)
+{
+    sdio_host_link_info_t info;
+    sdio_err_t err;
+
+    sdio_host_get_link_info(&info);
+    SDIO_LOGI(TAG, "%u-bit bus, %u kHz, block size %u, slave buffer %u x %u", (unsigned)info.bus_width, (unsigned)info.clock_khz,
+              (unsigned)info.block_size, (unsigned)info.slave_buf_size, (unsigned)info.slave_buf_num);
+
+    bench_rx_pos = 0;
+    bench_rx_len = 0;
+
+    err = bench_sink(length);
+
+    if (err != SDIO_SUCCESS) {
+        SDIO_LOGE(TAG, "host -> slave failed, err: %d", err);
+        return err;
+    }
+
+    err = bench_source(length);
+
+    if (err != SDIO_SUCCESS) {
+        SDIO_LOGE(TAG, "slave -> host failed, err: %d", err);
+        return err;
+    }
+
+    if (SDIO_HOST_BENCH_SERVER_IP[0] != '\0') {
+        err = bench_passthrough(SDIO_HOST_BENCH_SERVER_IP, SDIO_HOST_BENCH_SERVER_PORT, length);
+
+        if (err != SDIO_SUCCESS) {
+            SDIO_LOGE(TAG, "passthrough host -> slave failed, err: %d", err);
+            return err;
+        }
+    }
+
+    return SDIO_SUCCESS;
+}
@@ -12,8 +12,47 @@ static const char TAG[] = "sdio_transport";
 
 static uint32_t tx_sent_buffers = 0;    ///< Counter hold the amount of buffers already sent to sdio slave. Should be set to 0 when initialization.
 static uint32_t rx_got_bytes   = 0;       ///< Counter hold the amount of bytes already received from sdio slave. Should be set to 0 when initialization.
+static uint32_t block_size     = ESP_SDIO_DEFAULT_BUF_SIZE;    ///< CMD53 block size agreed with the slave
+static uint32_t slave_buf_size = ESP_SDIO_DEFAULT_BUF_SIZE;    ///< Size of one slave receive buffer, the unit of the send tokens
+static uint32_t slave_buf_num  = 0;       ///< Number of slave receive buffers, 0 if the slave does not publish it
+static uint32_t tx_bounce_buf[128];       ///< Word aligned, gathers the bytes of a scatter-gather send which can not go to the slave in place
 
 /******************  Init SDIO slave *********************/
+// Write the block size of function 0~2 and read function 1 back, the slave keeps its old size if it can not handle the new one
+static sdio_err_t esp_slave_set_block_size(uint32_t size, uint32_t* actual)
+{
+    sdio_err_t err;
+    uint8_t bsl = 0, bsh = 0;
+
+    for (uint32_t func = 0; func <= 2; func++) {
+        err = sdio_driver_write_byte(0, SD_IO_FBR_BLKSIZEL(func), size & 0xFF, NULL);
+
+        if (err != SDIO_SUCCESS) {
+            return err;
+        }
+
+        err = sdio_driver_write_byte(0, SD_IO_FBR_BLKSIZEH(func), (size >> 8) & 0xFF, NULL);
+
+        if (err != SDIO_SUCCESS) {
+            return err;
+        }
+    }
+
+    err = sdio_driver_read_byte(0, SD_IO_FBR_BLKSIZEL(1), &bsl);
+
+    if (err == SDIO_SUCCESS) {
+        err = sdio_driver_read_byte(0, SD_IO_FBR_BLKSIZEH(1), &bsh);
+    }
+
+    if (err != SDIO_SUCCESS) {
+        return err;
+    }
+
+    *actual = (bsh << 8) | bsl;
+    SDIO_LOGD(TAG, "Function 1 block size: %d", *actual);
+    return SDIO_SUCCESS;
+}
+
 static sdio_err_t esp_slave_init_io(void)
 {
     sdio_err_t err;
@@ -75,64 +114,60 @@ printf("esp_slave_init_io\r\n");
 
     SDIO_LOGD(TAG, "IE: 0x%02x", ie);
 
-    uint8_t bsl, bsh;
-
-    bsl = 0;
-    err = sdio_driver_write_byte(0, SD_IO_CCCR_BLKSIZEL, bsl, &bsl);
-
-    if (err != SDIO_SUCCESS) {
-        return err;
-    }
-
-    SDIO_LOGD(TAG, "Function 0 BSL: 0x%02x", bsl);
-
-    bsh = 2;
-    err = sdio_driver_write_byte(0, SD_IO_CCCR_BLKSIZEH, bsh, &bsh);
+    uint32_t actual;
+    return esp_slave_set_block_size(ESP_SDIO_DEFAULT_BUF_SIZE, &actual);
+}
 
-    if (err != SDIO_SUCCESS) {
-        return err;
-    }
+// Agree on the CMD53 block size with the host driver and the slave, and read the slave receive buffer layout
+static sdio_err_t esp_slave_negotiate(void)
+{
+    sdio_err_t err;
+    uint32_t size = SDIO_HOST_BLOCK_SIZE;
+    uint32_t actual = 0;
 
-    SDIO_LOGD(TAG, "Function 0 BSH: 0x%02x", bsh);
+    if (size != ESP_SDIO_DEFAULT_BUF_SIZE) {
+        err = sdio_driver_set_block_size(size);
 
-    uint8_t func1_bsl, func1_bsh;
+        if (err == SDIO_SUCCESS) {
+            err = esp_slave_set_block_size(size, &actual);
 
-    func1_bsl = 0;
-    err = sdio_driver_write_byte(0, 0x110, func1_bsl, &func1_bsl);
+            if (err != SDIO_SUCCESS) {
+                return err;
+            }
+        }
 
-    if (err != SDIO_SUCCESS) {
-        return err;
-    }
+        if (actual != size) {
+            SDIO_LOGW(TAG, "block size %d is not supported, use %d", size, ESP_SDIO_DEFAULT_BUF_SIZE);
+            size = ESP_SDIO_DEFAULT_BUF_SIZE;
+            sdio_driver_set_block_size(size);
+            err = esp_slave_set_block_size(size, &actual);
 
-    SDIO_LOGD(TAG, "Function 1 BSL: 0x%02x", func1_bsl);
- 
-    func1_bsh = 2;         // Set block size 512 (0x200)  
-    err = sdio_driver_write_byte(0, 0x111, func1_bsh, &func1_bsh);
-    if (err != SDIO_SUCCESS) {
-        return err;
+            if (err != SDIO_SUCCESS) {
+                return err;
+            }
+        }
     }
 
-    SDIO_LOGD(TAG, "Function 1 BSH: 0x%02x", func1_bsh);
+    block_size = size;
 
-    uint8_t func2_bsl, func2_bsh;
+#if TARGET_ESP32
+    uint8_t conf[4];
+    err = sdio_driver_read_bytes(1, ESP_SDIO_SLAVE_CONF_W0, conf, 4);
 
-    func2_bsl = 0;
-    err = sdio_driver_write_byte(0, 0x210, func2_bsl, &func2_bsl);
     if (err != SDIO_SUCCESS) {
         return err;
     }
 
-    SDIO_LOGD(TAG, "Function 2 BSL: 0x%02x", func2_bsl);
+    uint32_t buf_size = conf[0] | (conf[1] << 8);
 
-    func2_bsh = 2;
-    err = sdio_driver_write_byte(0, 0x210, func2_bsh, &func2_bsh);
-
-    if (err != SDIO_SUCCESS) {
-        return err;
+    // older slaves leave the registers 0, keep the 512 byte buffers they always used
+    if (conf[3] == ESP_SDIO_SLAVE_CONF_MAGIC && buf_size != 0 && (buf_size & 3) == 0) {
+        slave_buf_size = buf_size;
+        slave_buf_num = conf[2];
     }
+#endif
 
-    SDIO_LOGD(TAG, "Function 2 BSH: 0x%02x", func2_bsh);
-
+    SDIO_LOGI(TAG, "block size: %d, slave buffer size: %d, slave buffer num: %d", block_size, slave_buf_size, slave_buf_num);
     return SDIO_SUCCESS;
 }
 
@@ -154,9 +189,24 @@ sdio_err_t sdio_host_init(void)
         return ret;
     }
 
+    ret = esp_slave_negotiate();
+
+    if (ret != SDIO_SUCCESS) {
+        SDIO_LOGE(TAG, "esp slave negotiate error, err: %d", ret);
+        return ret;
+    }
+
     return SDIO_SUCCESS;
 }
 
+void sdio_host_get_link_info(sdio_host_link_info_t* info)
+{
+    sdio_driver_get_bus(&info->bus_width, &info->clock_khz);
+    info->block_size = block_size;
+    info->slave_buf_size = slave_buf_size;
+    info->slave_buf_num = slave_buf_num;
+}
+
 /************************* RECEIVE ****************************/
 // HOST receive data
 static sdio_err_t esp_sdio_slave_get_rx_data_size(uint32_t* rx_size)
@@ -222,11 +272,15 @@ sdio_err_t sdio_host_get_packet(void* out_data, size_t size, size_t* out_length,
     uint8_t* start_ptr = (uint8_t*)out_data;
 
     do {
-        const int block_size = 512; //currently our driver don't support block size other than 512
         int len_to_send;
 
+        // the block aligned part in a single multi-block CMD53
         int block_n = len_remain / block_size;
 
+        if (block_n > SDIO_CMD53_MAX_BLOCKS) {
+            block_n = SDIO_CMD53_MAX_BLOCKS;
+        }
+
         if (block_n != 0) {
             len_to_send = block_n * block_size;
             err = sdio_driver_read_blocks(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, start_ptr, len_to_send);
@@ -322,21 +376,123 @@ sdio_err_t sdio_host_send_intr(uint8_t intr_no)
     return ret;
 }
 
-sdio_err_t sdio_host_send_packet(const void* start, size_t length)
+// Position in a segment list, empty segments are skipped
+typedef struct {
+    const sdio_host_iovec_t* iov;
+    int iovcnt;
+    int index;
+    size_t offset;
+} esp_sdio_iov_cursor_t;
+
+// Return the unsent part of the current segment, NULL with *seg_len 0 when the list is used up
+static const uint8_t* esp_sdio_iov_peek(esp_sdio_iov_cursor_t* cursor, size_t* seg_len)
+{
+    while (cursor->index < cursor->iovcnt && cursor->offset == cursor->iov[cursor->index].len) {
+        cursor->index++;
+        cursor->offset = 0;
+    }
+
+    if (cursor->index >= cursor->iovcnt) {
+        *seg_len = 0;
+        return NULL;
+    }
+
+    *seg_len = cursor->iov[cursor->index].len - cursor->offset;
+    return (const uint8_t*)cursor->iov[cursor->index].base + cursor->offset;
+}
+
+/* Send one packet taken from the segment list.
+ *
+ * Word aligned data goes to the slave in place, the block aligned part in a single multi-block CMD53 and
+ * the rest in byte mode. Only the bytes which do not fit the 4-byte granularity of CMD53 (a misaligned
+ * segment, or the 1~3 bytes at a segment border) are gathered in a bounce buffer. Every CMD53 except the
+ * last one of the packet carries a multiple of 4 bytes, the length is determined by the SDIO address, and
+ * the padding of the last one will be discarded by the slave hardware.
+ */
+static sdio_err_t esp_sdio_host_write_packet(esp_sdio_iov_cursor_t* cursor, uint32_t length)
 {
     sdio_err_t err;
-    uint8_t* start_ptr = (uint8_t*)start;
-    uint32_t len_remain = length;
-    uint32_t block_size = 512;
-    int buffer_used = (length + block_size - 1) / block_size;
+    uint32_t len_remain = length;       // bytes of the packet not sent yet, the next CMD53 address is END_ADDR - len_remain
+    uint32_t bounce_len = 0;
+    uint8_t* bounce = (uint8_t*)tx_bounce_buf;
+
+    while (len_remain) {
+        uint32_t avail = len_remain - bounce_len;
+        size_t seg_len = 0;
+        const uint8_t* ptr = NULL;
+        uint32_t len_to_send = 0;
+
+        if (avail) {
+            ptr = esp_sdio_iov_peek(cursor, &seg_len);
+            if (ptr == NULL) {
+                // the segments hold less than the packet length
+                return ERR_INVALID_ARG;
+            }
+            seg_len = seg_len > avail ? avail : seg_len;
+        }
+
+        if (bounce_len && (avail == 0 || bounce_len == sizeof(tx_bounce_buf) || ((bounce_len & 3) == 0 && ((uintptr_t)ptr & 3) == 0))) {
+            // flush the gathered bytes, only the last CMD53 of the packet may be padded
+            err = sdio_driver_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, bounce, (bounce_len + 3) & (~3));
+
+            if (err != SDIO_SUCCESS) {
+                return err;
+            }
+
+            len_remain -= bounce_len;
+            bounce_len = 0;
+            continue;
+        }
+
+        if (bounce_len == 0 && ((uintptr_t)ptr & 3) == 0 && (seg_len >= 4 || seg_len == avail)) {
+            uint32_t block_n = seg_len / block_size;
+
+            if (block_n > SDIO_CMD53_MAX_BLOCKS) {
+                block_n = SDIO_CMD53_MAX_BLOCKS;
+            }
+
+            if (block_n) {
+                len_to_send = block_n * block_size;
+                err = sdio_driver_write_blocks(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, (void*)ptr, len_to_send);
+            } else {
+                len_to_send = (seg_len == avail) ? seg_len : (seg_len & (~3));
+                err = sdio_driver_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, (void*)ptr, (len_to_send + 3) & (~3));
+            }
+
+            if (err != SDIO_SUCCESS) {
+                return err;
+            }
+
+            len_remain -= len_to_send;
+        } else {
+            // fill the bounce buffer up to a word, or further if the segment stays misaligned after that
+            uint32_t need = (4 - (bounce_len & 3)) & 3;
+
+            if (need == 0 || (((uintptr_t)ptr + need) & 3) != 0) {
+                need = sizeof(tx_bounce_buf) - bounce_len;
+            }
 
+            len_to_send = seg_len > need ? need : seg_len;
+            memcpy(bounce + bounce_len, ptr, len_to_send);
+            bounce_len += len_to_send;
+        }
+
+        cursor->offset += len_to_send;
+    }
+
+    return SDIO_SUCCESS;
+}
+
+// Wait until the slave has loaded buffer_used receive buffers
+static sdio_err_t esp_sdio_host_wait_buffer(uint32_t buffer_used)
+{
     uint32_t cnt = 0xffff;               // Test 0xffff times, fail will return TIMEOUT
 
     while (1) {
         uint32_t num = esp_sdio_host_get_buffer_size();
         SDIO_LOGD(TAG, "Buffer size %d can be send", num);
 
-        if (num * block_size < length) {
+        if (num < buffer_used) {
             if (!--cnt) {
                 SDIO_LOGI(TAG, "buffer is not enough: %d, %d required.", num, buffer_used);
                 return ERR_TIMEOUT;
@@ -345,41 +501,61 @@ sdio_err_t sdio_host_send_packet(const void* start, size_t length)
             }
 
             platform_os_delay(1);
-						
         }  else {
             break;
         }
     }
 
-    do {
-        /* Though the driver supports to split packet of unaligned size into
-         * length of 4x and 1~3, we still send aligned size of data to get
-         * higher effeciency. The length is determined by the SDIO address, and
-         * the remainning will be discard by the slave hardware.
-         */
-        int block_n = len_remain / block_size;
-        int len_to_send;
+    return SDIO_SUCCESS;
+}
 
-        if (block_n) {
-            len_to_send = block_n * block_size;
-            err = sdio_driver_write_blocks(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, start_ptr, len_to_send);
-        } else {
-            len_to_send = len_remain;
-            err = sdio_driver_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, start_ptr, (len_to_send + 3) & (~3));
+sdio_err_t sdio_host_send_packetv(const sdio_host_iovec_t* iov, int iovcnt)
+{
+    sdio_err_t err;
+    esp_sdio_iov_cursor_t cursor = { iov, iovcnt, 0, 0 };
+    size_t len_remain = 0;
+
+    if (iov == NULL || iovcnt < 0) {
+        return ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].len && iov[i].base == NULL) {
+            return ERR_INVALID_ARG;
         }
 
+        len_remain += iov[i].len;
+    }
+
+    // a packet larger than all the slave receive buffers never gets enough tokens, split it
+    uint32_t packet_max = slave_buf_num ? slave_buf_num * slave_buf_size : len_remain;
+
+    while (len_remain) {
+        uint32_t packet_len = len_remain > packet_max ? packet_max : len_remain;
+        uint32_t buffer_used = (packet_len + slave_buf_size - 1) / slave_buf_size;
+
+        err = esp_sdio_host_wait_buffer(buffer_used);
+
         if (err != SDIO_SUCCESS) {
             return err;
         }
 
-        start_ptr += len_to_send;
-        len_remain -= len_to_send;
-    } while (len_remain);
+        err = esp_sdio_host_write_packet(&cursor, packet_len);
 
-    if (tx_sent_buffers >= TX_BUFFER_MAX) {
-        tx_sent_buffers -= TX_BUFFER_MAX;
+        if (err != SDIO_SUCCESS) {
+            return err;
+        }
+
+        tx_sent_buffers = (tx_sent_buffers + buffer_used) % TX_BUFFER_MAX;
+        len_remain -= packet_len;
     }
 
-    tx_sent_buffers += buffer_used;
     return SDIO_SUCCESS;
-}
\ No newline at end of file
+}
+
+sdio_err_t sdio_host_send_packet(const void* start, size_t length)
+{
+    sdio_host_iovec_t iov = { start, length };
+
+    return sdio_host_send_packetv(&iov, 1);
+}
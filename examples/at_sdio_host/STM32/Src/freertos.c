@@ -35,6 +35,7 @@
 #include "gpio.h"
 #include "sdio_host_log.h"
 #include "sdio_host_transport.h"
+#include "sdio_host_bench.h"
 #include "sdio_config.h"
 
 #include "time.h"
@@ -91,6 +92,7 @@ osThreadId defaultTaskHandle;
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN FunctionPrototypes */
 void sdio_recv_task(void* pvParameters);
+void sdio_bench_task(void* pvParameters);
 /* USER CODE END FunctionPrototypes */
 
 void StartDefaultTask(void const * argument);
@@ -175,6 +177,10 @@ void StartDefaultTask(void const * argument)
     SDIO_LOGI(TAG, "********** Guide ESP8266 BOOT ***********");
     err = esp_download_fw();
     SDIO_ERROR_CHECK(err);
+#endif
+#if SDIO_HOST_BENCH
+    xTaskCreate(sdio_bench_task, "sdioBenchTask", 512, NULL, 5, NULL);
+    vTaskDelete(NULL);
 #endif
 	  xTaskCreate(sdio_recv_task, "sdioRecvTask", 128, NULL, 5, NULL);
 
@@ -265,6 +271,15 @@ void sdio_recv_task(void* pvParameters)
     vTaskDelete(NULL);
 }
 
+#if SDIO_HOST_BENCH
+void sdio_bench_task(void* pvParameters)
+{
+    sdio_err_t err = sdio_host_bench(SDIO_HOST_BENCH_LEN);
+    SDIO_ERROR_CHECK(err);
+    vTaskDelete(NULL);
+}
+#endif
+
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
   /* NOTE: This function Should not be modified, when the callback is needed,
@@ -44,6 +44,7 @@ typedef int32_t esp_err_t;
 #define ESP_ERR_NOT_SUPPORTED   0x106
 #define ESP_ERR_TIMEOUT         0x107
 #define ESP_ERR_INVALID_RESPONSE    0x108
+#define ESP_ERR_INVALID_CRC     0x109
 
 #define at_debugLevel 2
 
@@ -92,6 +93,29 @@ void at_do_delay(uint32_t wait_ms);
  */
 esp_err_t at_spi_transmit(void* tx_buff, void* rx_buff, uint32_t len);
 
+/**
+ * @brief Start a DMA SPI transaction and return at once, so that the CPU can work while the data is on the bus.
+ *        ``at_spi_transmit_wait`` must be called before the next transaction.
+ * 
+ * @param tx_buff Pointer to transmit buffer
+ * @param rx_buff Pointer to receive buffer, must not overlap tx_buff unless they are the same
+ * @param len     Total data length, in bytes
+ * 
+ * @return 
+ *   - ESP_OK if success
+ *   - ESP_FAIL if the transaction can not be started
+ */
+esp_err_t at_spi_transmit_start(const void* tx_buff, void* rx_buff, uint32_t len);
+
+/**
+ * @brief Wait for the transaction started by ``at_spi_transmit_start`` to complete.
+ * 
+ * @return 
+ *   - ESP_OK if success
+ *   - ESP_FAIL if the SPI or DMA reported an error
+ */
+esp_err_t at_spi_transmit_wait(void);
+
 /**
  * @brief Initialize peripherals, include SPI and GPIO.
  * 
@@ -27,6 +27,8 @@
 #include <stddef.h>
 #include <string.h>
 
+#include "sdspi_token.h"
+
 typedef int32_t esp_err_t;
 typedef enum {false = 0,true = 1} bool;
 
@@ -84,16 +86,6 @@ typedef struct {
 #define SDSPI_CMD_FLAG_NORSP    BIT(8)  //!< Don't expect response (used when sending CMD0 first time).
 #define SDSPI_CMD_FLAG_MULTI_BLK BIT(9)  //!< This indicates the start token should be a multiblock one
 
-/* SPI mode R1 response type bits */
-#define SD_SPI_R1_IDLE_STATE            (1<<0)
-#define SD_SPI_R1_ERASE_RST             (1<<1)
-#define SD_SPI_R1_ILLEGAL_CMD           (1<<2)
-#define SD_SPI_R1_CMD_CRC_ERR           (1<<3)
-#define SD_SPI_R1_ERASE_SEQ_ERR         (1<<4)
-#define SD_SPI_R1_ADDR_ERR              (1<<5)
-#define SD_SPI_R1_PARAM_ERR             (1<<6)
-#define SD_SPI_R1_NO_RESPONSE           (1<<7)
-
 #define SDSPI_MAX_DATA_LEN      512     //!< Max size of single block transfer
 
 #define SCF_CMD(flags)   ((flags) & 0x00f0)
@@ -115,12 +107,12 @@ typedef struct {
 
 #define SDSPI_MOSI_IDLE_VAL     0xff    //!< Data value which causes MOSI to stay high
 
-/// Token sent before single/multi block reads and single block writes
-#define TOKEN_BLOCK_START                   0xFE
-/// Token sent before multi block writes
-#define TOKEN_BLOCK_START_WRITE_MULTI       0xFC
-/// Token used to stop multi block write (for reads, CMD12 is used instead)
-#define TOKEN_BLOCK_STOP_WRITE_MULTI        0
+#define SDSPI_TOKEN_POLL_SIZE   16      //!< Bytes read by one DMA transfer while waiting for the start token of read data
+#define SDSPI_BUSY_POLL_SIZE    8       //!< Bytes read by one DMA transfer while the card is busy after a written block
+
+/// Set to 1 to send CMD59 at init, then send and check the CRC16 of every data block.
+/// The CRC of a block is calculated while the DMA of the same (write) or next (read) block is running.
+#define SDSPI_DATA_CRC          0
 
 #define ESP_SLAVE_CMD53_END_ADDR    0x1f800
 
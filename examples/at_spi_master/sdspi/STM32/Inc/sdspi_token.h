@@ -0,0 +1,146 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2019 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Token and response parsing of the SD SPI protocol.
+ *
+ * Nothing here touches the SPI peripheral, the functions only look at bytes already clocked in by
+ * ``at_spi_transmit``, so they can be built and checked on any host.
+ */
+#ifndef SDSPI_TOKEN_H_
+#define SDSPI_TOKEN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* SPI mode R1 response type bits */
+#define SD_SPI_R1_IDLE_STATE            (1<<0)
+#define SD_SPI_R1_ERASE_RST             (1<<1)
+#define SD_SPI_R1_ILLEGAL_CMD           (1<<2)
+#define SD_SPI_R1_CMD_CRC_ERR           (1<<3)
+#define SD_SPI_R1_ERASE_SEQ_ERR         (1<<4)
+#define SD_SPI_R1_ADDR_ERR              (1<<5)
+#define SD_SPI_R1_PARAM_ERR             (1<<6)
+#define SD_SPI_R1_NO_RESPONSE           (1<<7)
+
+/// Token sent before single/multi block reads and single block writes
+#define TOKEN_BLOCK_START                   0xFE
+/// Token sent before multi block writes
+#define TOKEN_BLOCK_START_WRITE_MULTI       0xFC
+/// Token used to stop multi block write (for reads, CMD12 is used instead)
+#define TOKEN_BLOCK_STOP_WRITE_MULTI        0
+
+/// Data response token sent by the card after each written block, format xxx0sss1
+#define TOKEN_RSP_MASK        0x1F
+#define TOKEN_RSP_OK          0x05
+#define TOKEN_RSP_CRC_ERR     0x0B
+#define TOKEN_RSP_WRITE_ERR   0x0D
+
+typedef enum {
+    SDSPI_TOKEN_NOT_FOUND = 0,  ///< Only idle bytes, keep polling
+    SDSPI_TOKEN_FOUND,          ///< Token found, ``pos`` holds its offset
+    SDSPI_TOKEN_ERROR,          ///< Unexpected byte, ``pos`` holds its offset
+} sdspi_token_result_t;
+
+typedef enum {
+    SDSPI_DATA_RSP_NONE = 0,    ///< No data response token in the bytes
+    SDSPI_DATA_RSP_OK,
+    SDSPI_DATA_RSP_CRC_ERR,
+    SDSPI_DATA_RSP_WRITE_ERR,
+} sdspi_data_rsp_t;
+
+/**
+ * @brief Find the R1 response after a command, it comes 1-8 bytes after the command and has the MSB cleared.
+ *
+ * @param buf Bytes received after the command
+ * @param len Length of buf
+ *
+ * @return offset of the R1 response, -1 if not found
+ */
+int sdspi_token_find_r1(const uint8_t* buf, size_t len);
+
+/**
+ * @brief Find the start block token in the bytes following a command response.
+ *
+ * These bytes may still carry the rest of an R5 response, so anything other than the token is skipped.
+ *
+ * @param buf Bytes to search
+ * @param len Length of buf
+ *
+ * @return offset of the token, -1 if not found
+ */
+int sdspi_token_find_start(const uint8_t* buf, size_t len);
+
+/**
+ * @brief Search a chunk polled while waiting for read data for the start block token.
+ *
+ * The card holds MISO high (0xFF, 0x00 is also accepted) until the token, any other byte is a data error token.
+ *
+ * @param buf Polled bytes
+ * @param len Length of buf
+ * @param[out] pos Offset of the token or of the unexpected byte
+ *
+ * @return see ``sdspi_token_result_t``
+ */
+sdspi_token_result_t sdspi_token_poll_start(const uint8_t* buf, size_t len, size_t* pos);
+
+/**
+ * @brief Find the end of the busy signal after a written block, the card holds MISO low until it is ready.
+ *
+ * @param buf Polled bytes
+ * @param len Length of buf
+ *
+ * @return offset of the first 0xFF byte, -1 if the card is still busy
+ */
+int sdspi_token_find_not_busy(const uint8_t* buf, size_t len);
+
+/**
+ * @brief Parse the data response token received after the CRC of a written block.
+ *
+ * @param buf Bytes received after the CRC
+ * @param len Length of buf
+ *
+ * @return the first data response found in buf
+ */
+sdspi_data_rsp_t sdspi_token_parse_data_rsp(const uint8_t* buf, size_t len);
+
+/**
+ * @brief CRC7 of a command, the 5 bytes of the command index and argument.
+ *
+ * @return CRC7 value, not shifted
+ */
+uint8_t sdspi_crc7(const uint8_t* data, size_t len);
+
+/**
+ * @brief CRC16 (CCITT, x^16 + x^12 + x^5 + 1) of a data block, sent MSB first after the block.
+ *
+ * @param crc Initial value, 0 for a new block, or the result of the previous part of the same block
+ * @param data Data
+ * @param len Length of data
+ *
+ * @return CRC16 value
+ */
+uint16_t sdspi_crc16(uint16_t crc, const uint8_t* data, size_t len);
+
+#endif /* SDSPI_TOKEN_H_ */
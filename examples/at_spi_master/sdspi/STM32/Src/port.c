@@ -33,6 +33,11 @@
 #include "port.h"
 
 SemaphoreHandle_t DataBinarySem01Handle;
+static SemaphoreHandle_t SpiDmaSemHandle;       // given when the SPI DMA transaction completes
+static uint32_t spi_dma_len;
+
+// Shorter transactions end before a task switch would, spin on the SPI state for them
+#define AT_SPI_DMA_SLEEP_LEN    64
 
 /// Set CS high
 void at_cs_high(void)
@@ -46,12 +51,59 @@ void at_cs_low(void)
     CS_low();
 }
 
+esp_err_t at_spi_transmit_start(const void* tx_buff, void* rx_buff, uint32_t len)
+{
+    spi_dma_len = len;
+
+    if (HAL_SPI_TransmitReceive_DMA(&hspi1, (uint8_t*)tx_buff, rx_buff, len) != HAL_OK) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t at_spi_transmit_wait(void)
+{
+    if (spi_dma_len >= AT_SPI_DMA_SLEEP_LEN) {
+        xSemaphoreTake(SpiDmaSemHandle, portMAX_DELAY);
+    } else {
+        while(HAL_SPI_STATE_READY != HAL_SPI_GetState(&hspi1));
+        // the completion callback has run by now, drop its semaphore
+        xSemaphoreTake(SpiDmaSemHandle, 0);
+    }
+
+    return (hspi1.ErrorCode == HAL_SPI_ERROR_NONE) ? ESP_OK : ESP_FAIL;
+}
+
 esp_err_t at_spi_transmit(void* tx_buff, void* rx_buff, uint32_t len)
 {
-	  HAL_SPI_TransmitReceive_DMA(&hspi1, tx_buff, rx_buff, len);
-	  while(HAL_SPI_STATE_READY != HAL_SPI_GetState(&hspi1));
-	  //HAL_SPI_TransmitReceive(&hspi1, tx_buff, rx_buff, len, 100);
-	  return ESP_OK;
+    esp_err_t ret = at_spi_transmit_start(tx_buff, rx_buff, len);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    return at_spi_transmit_wait();
+}
+
+static void at_spi_dma_done(SPI_HandleTypeDef *hspi)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (hspi == &hspi1) {
+        xSemaphoreGiveFromISR(SpiDmaSemHandle, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    }
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    at_spi_dma_done(hspi);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+    at_spi_dma_done(hspi);
 }
 
 /*we have inited SPI in spi.c*/
@@ -59,6 +111,8 @@ esp_err_t at_spi_slot_init(void)
 {
 	  DataBinarySem01Handle = xSemaphoreCreateBinary();
 	  assert(DataBinarySem01Handle != NULL);
+	  SpiDmaSemHandle = xSemaphoreCreateBinary();
+	  assert(SpiDmaSemHandle != NULL);
 	  at_cs_high();
 	  xSemaphoreTake(DataBinarySem01Handle, 0);
 
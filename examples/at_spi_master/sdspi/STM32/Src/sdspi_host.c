@@ -28,6 +28,7 @@
 #include <string.h>
 
 #include"sdspi_host.h"
+#include"sdspi_token.h"
 #include"port.h"
 
 //#define FOUR_BYTE_ALIGNMENT
@@ -36,10 +37,11 @@ static const char* TAG = "sdspi_transaction";
 
 //#define FOUR_BYTE_ALIGNMENT
 
-uint8_t flag_2 = 0;
-
 AT_MUTEX_T spi_lock = NULL;
 
+static uint8_t sdspi_idle_buf[SDSPI_BLOCK_BUF_SIZE];    // all SDSPI_MOSI_IDLE_VAL, sent while receiving by DMA
+static uint8_t sdspi_discard_buf[SDSPI_MAX_DATA_LEN];   // receives the bytes clocked in while a block is written
+
 static inline uint32_t bswap32(uint32_t val32)
 {
     val32 = ((val32 << 8) & 0xFF00FF00) | ((val32 >> 8) & 0x00FF00FF);
@@ -61,7 +63,8 @@ void make_hw_cmd(uint32_t opcode, uint32_t arg, sdspi_hw_cmd_t* hw_cmd)
     uint32_t arg_s = bswap32(arg);         // reverse bytes
     //printf("After swap: %x\n",arg_s);
     memcpy(hw_cmd->arguments, &arg_s, sizeof(arg_s));
-    hw_cmd->crc7 = 0x0;
+    // checked by the card only after CMD59 enables CRC
+    hw_cmd->crc7 = sdspi_crc7((const uint8_t*)hw_cmd, 1 + sizeof(arg_s));
 }
 
 /// Clock out 80 cycles (10 bytes) before GO_IDLE command
@@ -148,31 +151,25 @@ static esp_err_t start_command_default(int flags, sdspi_hw_cmd_t* cmd)
     return ESP_OK;
 }
 
-// Wait until MISO goes high
+// Wait until MISO goes high, reading SDSPI_BUSY_POLL_SIZE bytes by DMA at a time
 static esp_err_t poll_busy()
 {
     esp_err_t ret;
-    uint8_t t_rx, t_tx;
+    uint8_t t_rx[SDSPI_BUSY_POLL_SIZE];
     uint32_t nonzero_count = 0;
 
     do {
-        t_tx = SDSPI_MOSI_IDLE_VAL;
-        t_rx = 0;
-        ret = at_spi_transmit(&t_tx, &t_rx, 1);
+        ret = at_spi_transmit(sdspi_idle_buf, t_rx, sizeof(t_rx));
 
         if (ret != ESP_OK) {
             return ret;
         }
 
-        if (t_rx == 0XFF) {
+        if (sdspi_token_find_not_busy(t_rx, sizeof(t_rx)) >= 0) {
             return ESP_OK;
         }
-
-        flag_2 = 9;
-				//at_do_delay(1);
     } while (++nonzero_count < 100);
 
-    flag_2 = 10;
     ESP_AT_LOGE(TAG, "%s: timeout error", __func__);
 
     return ESP_OK;
@@ -218,12 +215,21 @@ static esp_err_t start_command_write_blocks(sdspi_hw_cmd_t* cmd,
             return ret;
         }
 
-        // Prepare data to be sent
+        // Write data by DMA, the bytes clocked in meanwhile are dropped
         size_t will_send = MIN(tx_length, SDSPI_MAX_DATA_LEN);
-        uint8_t *tmp_send = (uint8_t*)malloc(will_send);
-        // Write data
-        ret = at_spi_transmit(data, tmp_send, will_send);
-				free(tmp_send);
+        ret = at_spi_transmit_start(data, sdspi_discard_buf, will_send);
+
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        // The CRC is calculated while the block is on the bus
+#if SDSPI_DATA_CRC
+        uint16_t crc = sdspi_crc16(0, data, will_send);
+#else
+        uint16_t crc = 0xffff;
+#endif
+        ret = at_spi_transmit_wait();
 
         if (ret != ESP_OK) {
             return ret;
@@ -233,6 +239,8 @@ static esp_err_t start_command_write_blocks(sdspi_hw_cmd_t* cmd,
         uint8_t crc_rx[4];
 
         memset(crc_tx, 0xff, 4);
+        crc_tx[0] = crc >> 8;
+        crc_tx[1] = crc & 0xff;
 
         ret = at_spi_transmit(crc_tx, crc_rx, 3);
 
@@ -241,7 +249,15 @@ static esp_err_t start_command_write_blocks(sdspi_hw_cmd_t* cmd,
         }
 
         ESP_AT_LOGV(TAG, "crc_rx1[2] = %x\n", crc_rx[2]);
-        // assert((crc_rx[2] & 0xf) == 5);
+        sdspi_data_rsp_t data_rsp = sdspi_token_parse_data_rsp(&crc_rx[2], 1);
+
+        if (data_rsp == SDSPI_DATA_RSP_CRC_ERR) {
+            ESP_AT_LOGE(TAG, "%s: data CRC error", __func__);
+            return ESP_ERR_INVALID_CRC;
+        } else if (data_rsp == SDSPI_DATA_RSP_WRITE_ERR) {
+            ESP_AT_LOGE(TAG, "%s: data write error", __func__);
+            return ESP_FAIL;
+        }
 
         // Wait for the card to finish writing data
         ret = poll_busy();
@@ -258,53 +274,64 @@ static esp_err_t start_command_write_blocks(sdspi_hw_cmd_t* cmd,
     return ESP_OK;
 }
 
-// Wait for data token, reading 8 bytes at a time.
-// If the token is found, write all subsequent bytes to extra_ptr,
-// and store the number of bytes written to extra_size.
-static esp_err_t poll_data_token(uint8_t* extra_ptr, size_t* extra_size)
+// Wait for data token, reading up to ``size`` bytes by DMA at a time.
+// If the token is found, the bytes following it are left in buf,
+// extra_ptr and extra_size are set to point to them.
+static esp_err_t poll_data_token(uint8_t* buf, size_t size, const uint8_t** extra_ptr, size_t* extra_size)
 {
-    uint8_t t_rx[8];
     esp_err_t ret;
     uint32_t count_time = 0;
+    size_t pos = 0;
 
     do {
-        memset(t_rx, SDSPI_MOSI_IDLE_VAL, sizeof(t_rx));
-        ret = at_spi_transmit(t_rx, t_rx, sizeof(t_rx));
+        ret = at_spi_transmit(sdspi_idle_buf, buf, size);
 
         if (ret != ESP_OK) {
             ESP_AT_LOGE(TAG, "SPI trans error %d", ret);
             return ret;
         }
 
-        bool found = false;
-
-        for (int byte_idx = 0; byte_idx < sizeof(t_rx); byte_idx++) {
-            uint8_t rd_data = t_rx[byte_idx];
+        sdspi_token_result_t result = sdspi_token_poll_start(buf, size, &pos);
 
-            if (rd_data == TOKEN_BLOCK_START) {
-                found = true;
-                memcpy(extra_ptr, t_rx + byte_idx + 1, sizeof(t_rx) - byte_idx - 1);
-                *extra_size = sizeof(t_rx) - byte_idx - 1;
-                break;
-            }
-
-            if ((rd_data != 0xff) && (rd_data != 0)) {
-                ESP_AT_LOGE(TAG, "%s: received 0x%02x while waiting for data",
-                            __func__, rd_data);
-                return ESP_ERR_INVALID_RESPONSE;
-            }
-        }
-
-        if (found) {
+        if (result == SDSPI_TOKEN_FOUND) {
+            *extra_ptr = buf + pos + 1;
+            *extra_size = size - pos - 1;
             return ESP_OK;
         }
 
+        if (result == SDSPI_TOKEN_ERROR) {
+            ESP_AT_LOGE(TAG, "%s: received 0x%02x while waiting for data",
+                        __func__, buf[pos]);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
     } while (++count_time < 10000);
 
     ESP_AT_LOGE(TAG, "%s: timeout", __func__);
     return ESP_ERR_TIMEOUT;
 }
 
+typedef struct {
+    const uint8_t* data;        ///< Block whose CRC is not checked yet, NULL if none
+    size_t len;
+    uint16_t crc;               ///< CRC received after the block
+} sdspi_crc_pending_t;
+
+// Check the CRC of the previous block, called while the DMA of the next block is running
+static esp_err_t check_block_crc(sdspi_crc_pending_t* pending)
+{
+    esp_err_t ret = ESP_OK;
+#if SDSPI_DATA_CRC
+
+    if (pending->data != NULL && sdspi_crc16(0, pending->data, pending->len) != pending->crc) {
+        ESP_AT_LOGE(TAG, "data CRC error, received 0x%04x", pending->crc);
+        ret = ESP_ERR_INVALID_CRC;
+    }
+
+#endif
+    pending->data = NULL;
+    return ret;
+}
+
 /**
  * Receiving one or more blocks of data happens as follows:
  * 1. send command + receive r1 response (SDSPI_CMD_R1_SIZE bytes total)
@@ -314,44 +341,34 @@ static esp_err_t poll_data_token(uint8_t* extra_ptr, size_t* extra_size)
  * 4. receive 2 bytes of CRC
  * 5. for multi block transfers, go to step 2
  *
- * These steps can be done separately, but that leads to a less than optimal
- * performance on large transfers because of delays between each step.
- * For example, if steps 3 and 4 are separate SPI transactions queued one after
- * another, there will be ~16 microseconds of dead time between end of step 3
- * and the beginning of step 4. A delay between two blocking SPI transactions
- * in step 2 is even higher (~60 microseconds).
- *
- * To improve read performance the following sequence is adopted:
- * 1. Do the first transfer: command + r1 response + 8 extra bytes.
- *    Set pre_scan_data_ptr to point to the 8 extra bytes, and set
- *    pre_scan_data_size to 8.
- * 2. Search pre_scan_data_size bytes for TOKEN_BLOCK_START.
- *    If found, the rest of the bytes contain part of the actual data.
- *    Store pointer to and size of that extra data as extra_data_{ptr,size}.
- *    If not found, fall back to polling for TOKEN_BLOCK_START, 8 bytes at a
- *    time (in poll_data_token function). Deal with extra data in the same way,
- *    by setting extra_data_{ptr,size}.
- * 3. Receive the remaining 512 - extra_data_size bytes, plus 4 extra bytes
- *    (i.e. 516 - extra_data_size). Of the 4 extra bytes, first two will capture
- *    the CRC value, and the other two will capture 0xff 0xfe sequence
- *    indicating the start of the next block. Actual scanning is done by
- *    setting pre_scan_data_ptr to point to these last 2 bytes, and setting
- *    pre_scan_data_size = 2, then going to step 2 to receive the next block.
- *    When the final block is being received, the number of extra bytes is 2
- *    (only for CRC), because we don't need to wait for start token of the
- *    next block, and some cards are getting confused by these two extra bytes.
+ * Every gap between two SPI transactions is dead time on the bus, so the
+ * steps are merged as follows:
+ * 1. Do the first transfer: command + r1 response + 8 extra bytes, and search
+ *    the extra bytes for TOKEN_BLOCK_START.
+ * 2. If it is not there, poll for it with DMA transfers of up to
+ *    SDSPI_TOKEN_POLL_SIZE bytes (never more than the rest of the block and
+ *    its CRC). The bytes after the token already belong to the block.
+ * 3. Receive the rest of the block by DMA straight into the destination
+ *    buffer, plus 4 extra bytes: 2 bytes of CRC and 2 bytes to scan for the
+ *    start token of the next block. The extra bytes land on the part of the
+ *    buffer of the next block, which is not written yet, and are copied out
+ *    first. For the final block only the 2 CRC bytes are received, in a
+ *    separate transfer, because some cards are getting confused by the two
+ *    extra bytes.
+ * 4. With SDSPI_DATA_CRC, the CRC of a block is calculated while the DMA of
+ *    the next block is running.
  *
- * With this approach the delay between blocks of a multi-block transfer is
- * ~95 microseconds, out of which 35 microseconds are spend doing the CRC check.
- * Further speedup is possible by pipelining transfers and CRC checks, at an
- * expense of one extra temporary buffer.
+ * The token search is done by sdspi_token.c.
  */
 static esp_err_t start_command_read_blocks(sdspi_hw_cmd_t* cmd,
         uint8_t* data, uint32_t rx_length)
 {
     esp_err_t ret;
-    uint8_t *rx_data;
-	  bool need_stop_command = (rx_length > SDSPI_MAX_DATA_LEN) ? true : false;
+    bool need_stop_command = (rx_length > SDSPI_MAX_DATA_LEN) ? true : false;
+    uint8_t poll_buf[SDSPI_TOKEN_POLL_SIZE];
+    uint8_t tail[4];        // CRC of the block, then the bytes to scan for the next start token
+    size_t tail_size;
+    sdspi_crc_pending_t pending = { NULL, 0, 0 };
 
     ret = at_spi_transmit(cmd, cmd, (SDSPI_CMD_R1_SIZE + SDSPI_RESPONSE_MAX_DELAY));
 
@@ -360,94 +377,111 @@ static esp_err_t start_command_read_blocks(sdspi_hw_cmd_t* cmd,
         return ret;
     }
 
-    uint8_t* cmd_u8 = (uint8_t*) cmd;
-    size_t pre_scan_data_size = SDSPI_RESPONSE_MAX_DELAY;
-    uint8_t* pre_scan_data_ptr = cmd_u8 + SDSPI_CMD_R1_SIZE;
-
     /* R1 response is delayed by 1-8 bytes from the request.
-     * This loop searches for the response and writes it to cmd->r1.
+     * Search for the response and write it to cmd->r1.
      */
-    while ((cmd->r1 & SD_SPI_R1_NO_RESPONSE) != 0 && pre_scan_data_size > 0) {
-        cmd->r1 = *pre_scan_data_ptr;
-        ++pre_scan_data_ptr;
-        --pre_scan_data_size;
-    }
+    int r1_pos = sdspi_token_find_r1(&cmd->r1, 1 + SDSPI_RESPONSE_MAX_DELAY);
 
-    if (cmd->r1 & SD_SPI_R1_NO_RESPONSE) {
+    if (r1_pos < 0) {
         ESP_AT_LOGE(TAG, "no response token found");
         return ESP_ERR_TIMEOUT;
     }
 
+    cmd->r1 = (&cmd->r1)[r1_pos];
+    const uint8_t* pre_scan_data_ptr = &cmd->r1 + r1_pos + 1;
+    size_t pre_scan_data_size = SDSPI_RESPONSE_MAX_DELAY - r1_pos;
+
     while (rx_length > 0) {
+        size_t block_len = MIN(rx_length, SDSPI_MAX_DATA_LEN);
+        // the bytes after the CRC are received into the next block's part of data
+        bool tail_in_place = (rx_length >= SDSPI_MAX_DATA_LEN + sizeof(tail)) ? true : false;
         size_t extra_data_size = 0;
         const uint8_t* extra_data_ptr = NULL;
-        bool need_poll = true;
-
-        for (int i = 0; i < pre_scan_data_size; ++i) {
-            if (pre_scan_data_ptr[i] == TOKEN_BLOCK_START) {
-                extra_data_size = pre_scan_data_size - i - 1;
-                extra_data_ptr = pre_scan_data_ptr + i + 1;
-                need_poll = false;
-                break;
-            }
-        }
+        int token_pos = sdspi_token_find_start(pre_scan_data_ptr, pre_scan_data_size);
 
-        if (need_poll) {
+        if (token_pos >= 0) {
+            extra_data_size = pre_scan_data_size - token_pos - 1;
+            extra_data_ptr = pre_scan_data_ptr + token_pos + 1;
+        } else {
             // Wait for data to be ready
-            ret = poll_data_token(cmd_u8 + SDSPI_CMD_R1_SIZE, &extra_data_size);
+            ret = poll_data_token(poll_buf, MIN(sizeof(poll_buf), block_len + 3), &extra_data_ptr, &extra_data_size);
 
-            //release_transaction(slot);
             if (ret != ESP_OK) {
                 ESP_AT_LOGE(TAG, "poll_data_token return %d", ret);
                 return ret;
             }
+        }
+
+        // Bytes after the token are the block, then its CRC
+        size_t got = MIN(extra_data_size, block_len);
+        memcpy(data, extra_data_ptr, got);
+        tail_size = MIN(extra_data_size - got, sizeof(tail));
+        memmove(tail, extra_data_ptr + got, tail_size);
+
+        if (got < block_len) {
+            size_t will_receive = block_len - got;
+
+            ret = at_spi_transmit_start(sdspi_idle_buf, data + got, will_receive + (tail_in_place ? sizeof(tail) : 0));
+
+            if (ret != ESP_OK) {
+                ESP_AT_LOGE(TAG, "SPI transmit error");
+                return ret;
+            }
+
+            esp_err_t crc_ret = check_block_crc(&pending);
+            ret = at_spi_transmit_wait();
+
+            if (ret != ESP_OK) {
+                ESP_AT_LOGE(TAG, "SPI transmit error");
+                return ret;
+            }
 
-            if (extra_data_size) {
-                extra_data_ptr = cmd_u8 + SDSPI_CMD_R1_SIZE;
+            if (crc_ret != ESP_OK) {
+                return crc_ret;
+            }
+
+            if (tail_in_place) {
+                memcpy(tail, data + block_len, sizeof(tail));
+                tail_size = sizeof(tail);
+            } else {
+                tail_size = 0;
             }
         }
 
-        // Arrange RX buffer
-        size_t will_receive = MIN(rx_length, SDSPI_MAX_DATA_LEN) - extra_data_size;
+        // CRC bytes need to be received even if CRC is not enabled
+        if (tail_size < sizeof(uint16_t)) {
+            ret = at_spi_transmit(sdspi_idle_buf, tail + tail_size, sizeof(uint16_t) - tail_size);
 
-        // receive actual data
-        const size_t receive_extra_bytes = (rx_length > SDSPI_MAX_DATA_LEN) ? 4 : 2;
-				rx_data = (uint8_t *)malloc(SDSPI_BLOCK_BUF_SIZE * sizeof(uint8_t));
-				if(rx_data == NULL) {
-					ESP_AT_LOGE(TAG, "malloc error");
-					return ESP_ERR_NO_MEM;
-				}
-        memset(rx_data, 0xff, will_receive + receive_extra_bytes);
+            if (ret != ESP_OK) {
+                ESP_AT_LOGE(TAG, "SPI transmit error");
+                return ret;
+            }
+
+            tail_size = sizeof(uint16_t);
+        }
 
-        ret = at_spi_transmit(rx_data, rx_data, (will_receive + receive_extra_bytes));
+        ret = check_block_crc(&pending);
 
         if (ret != ESP_OK) {
-            ESP_AT_LOGE(TAG, "SPI transmit error");
-					  free(rx_data);
             return ret;
         }
 
-        // CRC bytes need to be received even if CRC is not enabled
-        uint16_t crc = UINT16_MAX;
-        memcpy(&crc, rx_data + will_receive, sizeof(crc));
+        pending.data = data;
+        pending.len = block_len;
+        pending.crc = (tail[0] << 8) | tail[1];
 
         // Bytes to scan for the start token
-        pre_scan_data_size = receive_extra_bytes - sizeof(crc);
-        pre_scan_data_ptr = rx_data + will_receive + sizeof(crc);
+        pre_scan_data_ptr = tail + sizeof(uint16_t);
+        pre_scan_data_size = tail_size - sizeof(uint16_t);
 
-        // Copy data to the destination buffer
-        memcpy(data + extra_data_size, rx_data, will_receive);
+        data += block_len;
+        rx_length -= block_len;
+    }
 
-        if (extra_data_size) {
-            memcpy(data, extra_data_ptr, extra_data_size);
-        }
+    ret = check_block_crc(&pending);
 
-        data += will_receive + extra_data_size;
-        rx_length -= will_receive + extra_data_size;
-        extra_data_size = 0;
-        extra_data_ptr = NULL;
-				free(rx_data);
-				rx_data = NULL;
+    if (ret != ESP_OK) {
+        return ret;
     }
 
     if (need_stop_command) {
@@ -608,6 +642,17 @@ esp_err_t at_spi_init_io()
     return err;
 }
 
+esp_err_t at_spi_cmd_init_spi_crc(bool crc_enable)
+{
+    spi_command_t cmd = {
+        .opcode = SD_CRC_ON_OFF,
+        .arg = crc_enable ? 1 : 0,
+        .flags = SCF_CMD_AC | SCF_RSP_R1
+    };
+
+    return spi_send_cmd(&cmd);
+}
+
 esp_err_t at_spi_cmd_go_idle_state()
 {
     go_idle_clockout();
@@ -954,6 +999,10 @@ esp_err_t at_sdspi_get_packet(spi_context_t* context, void* out_data, size_t siz
 
         int block_n = len_remain / block_size;
 
+        if (block_n > SD_ARG_CMD53_LENGTH_MASK) {
+            block_n = SD_ARG_CMD53_LENGTH_MASK;
+        }
+
         if (block_n != 0) {
             len_to_send = block_n * block_size;
             err = sdmmc_io_read_blocks(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, start, len_to_send);
@@ -1041,7 +1090,7 @@ esp_err_t at_sdspi_send_packet(spi_context_t* context, const void* start, size_t
         int len_to_send;
 
         if (len_remain > block_size) {
-            int block_n = len_remain / block_size;
+            int block_n = MIN(len_remain / block_size, SD_ARG_CMD53_LENGTH_MASK);
             len_to_send = block_n * block_size;
             err = sdmmc_io_write_blocks(1, ESP_SLAVE_CMD53_END_ADDR - len_remain, start_ptr, len_to_send);
         } else {
@@ -1091,8 +1140,16 @@ esp_err_t sdspi_cmd_init()
         return err;
     }
 
+#if SDSPI_DATA_CRC
     /* Enable CRC16 checks for data transfers in SPI mode */
-    //at_spi_cmd_init_spi_crc(false);
+    err = at_spi_cmd_init_spi_crc(true);
+
+    if (err != ESP_OK) {
+        ESP_AT_LOGE(TAG, "Send CMD59 error, error code:%d", err);
+        return err;
+    }
+
+#endif
 
     // enable function 1
     ioe |= BIT(1);
@@ -1158,6 +1215,8 @@ esp_err_t sdspi_cmd_init()
 //host use this to initialize the slave card as well as SPI mode
 esp_err_t at_sdspi_init(void)
 {
+    memset(sdspi_idle_buf, SDSPI_MOSI_IDLE_VAL, sizeof(sdspi_idle_buf));
+
     esp_err_t err = at_spi_slot_init();
     assert(err == ESP_OK);
 
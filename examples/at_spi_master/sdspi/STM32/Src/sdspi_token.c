@@ -0,0 +1,138 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2019 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdspi_token.h"
+
+int sdspi_token_find_r1(const uint8_t* buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if ((buf[i] & SD_SPI_R1_NO_RESPONSE) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int sdspi_token_find_start(const uint8_t* buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == TOKEN_BLOCK_START) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+sdspi_token_result_t sdspi_token_poll_start(const uint8_t* buf, size_t len, size_t* pos)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == TOKEN_BLOCK_START) {
+            *pos = i;
+            return SDSPI_TOKEN_FOUND;
+        }
+
+        if ((buf[i] != 0xff) && (buf[i] != 0)) {
+            *pos = i;
+            return SDSPI_TOKEN_ERROR;
+        }
+    }
+
+    return SDSPI_TOKEN_NOT_FOUND;
+}
+
+int sdspi_token_find_not_busy(const uint8_t* buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == 0xff) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+sdspi_data_rsp_t sdspi_token_parse_data_rsp(const uint8_t* buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        // xxx0sss1, 0xFF is the idle level
+        if ((buf[i] & 0x11) != 0x01) {
+            continue;
+        }
+
+        switch (buf[i] & TOKEN_RSP_MASK) {
+        case TOKEN_RSP_OK:
+            return SDSPI_DATA_RSP_OK;
+
+        case TOKEN_RSP_CRC_ERR:
+            return SDSPI_DATA_RSP_CRC_ERR;
+
+        case TOKEN_RSP_WRITE_ERR:
+            return SDSPI_DATA_RSP_WRITE_ERR;
+
+        default:
+            break;      // status not defined by the spec, keep looking
+        }
+    }
+
+    return SDSPI_DATA_RSP_NONE;
+}
+
+uint8_t sdspi_crc7(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc <<= 1;
+
+            if ((byte ^ crc) & 0x80) {
+                crc ^= 0x09;
+            }
+
+            byte <<= 1;
+        }
+    }
+
+    return crc & 0x7f;
+}
+
+uint16_t sdspi_crc16(uint16_t crc, const uint8_t* data, size_t len)
+{
+    // byte-wise form of the bit-serial CRC, no table needed
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc >> 8) | (crc << 8));
+        crc ^= data[i];
+        crc ^= (crc & 0xff) >> 4;
+        crc ^= (uint16_t)(crc << 12);
+        crc ^= (uint16_t)((crc & 0xff) << 5);
+    }
+
+    return crc;
+}
@@ -58,7 +58,19 @@ static QueueHandle_t esp_at_uart_queue = NULL;
 static RingbufHandle_t at_spi_master_receive_ring_buf = NULL;
 static RingbufHandle_t at_spi_master_send_ring_buf = NULL;
 
+/* Set to 1 if the slave is built with SPI_FRAME_MODE, frames up to AT_SPI_FRAME_MAX_LEN then take one handshake */
+#define AT_SPI_FRAME_MODE       0
+#define AT_SPI_FRAME_MAX_LEN    16368    // same as the slave SPI_FRAME_MAX_LEN
+
+/* Frame header in the status registers, for frames longer than 4092 bytes */
+#define AT_SPI_FRAME_MAGIC      0xA5
+#define AT_SPI_FRAME_LEN_MASK   0xFFFFFF
+
+#if AT_SPI_FRAME_MODE
+#define RING_BUFFER_SIZE  (AT_SPI_FRAME_MAX_LEN * 2)
+#else
 #define RING_BUFFER_SIZE  1024 * 6
+#endif
 
 volatile uint32_t ring_buffer_filled_byte = 0;
 
@@ -70,7 +82,12 @@ volatile uint32_t ring_buffer_filled_byte = 0;
 #define SPI_MASTER_WRITE_STATUS_TO_SLAVE_CMD   1
 #define SPI_MASTER_READ_STATUS_FROM_SLAVE_CMD  4
 
-#define MAX_SEND_SIZE 4092    // ESP32 DMA max size is 4096 - 4
+#define MAX_DMA_SIZE 4092     // ESP32 DMA max size is 4096 - 4
+#if AT_SPI_FRAME_MODE
+#define MAX_SEND_SIZE AT_SPI_FRAME_MAX_LEN
+#else
+#define MAX_SEND_SIZE MAX_DMA_SIZE
+#endif
 
 typedef enum {
     SPI_NULL = 0,
@@ -152,12 +169,23 @@ static int IRAM_ATTR at_spi_master_get_trans_len()
     };
     spi_device_transmit(handle, (spi_transaction_t*)&trans);
 
+#if AT_SPI_FRAME_MODE
+    if ((len >> 24) == AT_SPI_FRAME_MAGIC) {
+        len &= AT_SPI_FRAME_LEN_MASK;
+    }
+#endif
     return len;
 }
 
 // SPI status transmit function(Master sendto slave data length) , address length is 0 bit(no address)
 static void IRAM_ATTR at_spi_master_set_trans_len(uint32_t len)
 {
+#if AT_SPI_FRAME_MODE
+    if (len > MAX_DMA_SIZE) {
+        len = ((uint32_t)AT_SPI_FRAME_MAGIC << 24) | len;
+    }
+#endif
+
     spi_transaction_ext_t trans = (spi_transaction_ext_t) {
         .base = {
             .flags = SPI_TRANS_VARIABLE_ADDR,
@@ -238,7 +266,8 @@ void init_driver(void)
         .miso_io_num = GPIO_MISO,
         .sclk_io_num = GPIO_SCLK,
         .quadwp_io_num = -1,
-        .quadhd_io_num = -1
+        .quadhd_io_num = -1,
+        .max_transfer_sz = MAX_SEND_SIZE + 4
     };
 
     //Configuration for the SPI device on the other side of the bus
@@ -301,7 +330,7 @@ static void IRAM_ATTR spi_master_transmit(void* arg)
             if (ring_buffer_filled_byte != 0) {
                 trans_mode = SPI_WRITE;
 
-                // 4092 is the max send length, ESP32 SPI DMA only receive 4096 - 4 bytes
+                // 4092 is the max send length, ESP32 SPI DMA only receive 4096 - 4 bytes, unless both sides use frame mode
                 if (ring_buffer_filled_byte > MAX_SEND_SIZE) {
                     transmit_len = MAX_SEND_SIZE;
                 } else {
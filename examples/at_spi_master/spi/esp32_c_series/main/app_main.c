@@ -29,6 +29,7 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_intr_alloc.h"
+#include "esp_heap_caps.h"
 
 #include "driver/gpio.h"
 #include "driver/uart.h"
@@ -60,6 +61,16 @@ Pins in use. The SPI Master can use the GPIO mux, so feel free to change these i
 #define WRBUF_START_ADDR      0x0
 #define RDBUF_START_ADDR      0x4
 #define STREAM_BUFFER_SIZE    1024 * 8
+#define SPI_STATUS_POLL_MS    10        // the status is also polled, so a lost handshake edge only delays the transfer
+
+#ifdef CONFIG_SPI_WINDOW_MODE
+#define SPI_WINDOW_MAGIC      0xC5
+#define SPI_SEGMENT_MAGIC     0xFD
+#define SPI_SEGMENT_HEADER_LEN sizeof(spi_send_opt_t)
+#define SPI_SEGMENT_MAX_LEN   (ESP_SPI_DMA_MAX_LEN - SPI_SEGMENT_HEADER_LEN)
+#define SPI_WINDOW_MAX        4         // the slave loads at most 4 RX segments
+#define SPI_RESEND_TIMEOUT_MS 100
+#endif
 
 typedef enum {
     SPI_NULL = 0,
@@ -83,6 +94,48 @@ typedef struct {
     uint32_t     transmit_len : 16;
 } spi_recv_opt_t;
 
+#ifdef CONFIG_SPI_WINDOW_MODE
+// published by the slave at RDBUF address 0x8
+typedef struct {
+    uint32_t     ack_seq    : 8;    // last segment the slave accepted in order
+    uint32_t     nack_count : 8;    // bumped by the slave on a missing or corrupt segment
+    uint32_t     recv_count : 8;    // segments the slave has received
+    uint32_t     load_count : 8;    // segments the slave has had room for, since it started
+} spi_window_opt_t;
+
+// published by the slave at RDBUF address 0xC
+typedef struct {
+    uint32_t     magic    : 8;      // 0xC5
+    uint32_t     window   : 8;
+    uint32_t     reserved : 16;
+} spi_window_info_t;
+
+// segments not yet acknowledged by the slave, kept to be resent
+typedef struct {
+    uint8_t*     buf[SPI_WINDOW_MAX];   // segment header followed by the payload
+    uint16_t     len[SPI_WINDOW_MAX];   // payload length
+    uint32_t     head;                  // slot of the oldest unacknowledged segment
+    uint32_t     count;                 // segments filled and not acknowledged
+    uint32_t     next;                  // next segment to write, counted from head
+    uint32_t     inflight;              // segments written at least once, counted from head
+    uint8_t      base_seq;              // sequence number of the segment at head
+    uint8_t      written;               // segments written, compared with recv_count and load_count
+    uint8_t      recv_count;
+    uint8_t      nack_count;
+    bool         synced;
+    TickType_t   progress_tick;         // last time a write completed on the slave
+} spi_tx_window_t;
+#endif
+
+// status words read from RDBUF address 0x4 in one transaction
+typedef struct {
+    spi_recv_opt_t     recv_opt;
+#ifdef CONFIG_SPI_WINDOW_MODE
+    spi_window_opt_t   window;
+    spi_window_info_t  info;
+#endif
+} spi_slave_status_t;
+
 typedef struct {
     spi_mode_t direct;
 } spi_msg_t;
@@ -98,6 +151,9 @@ static uint32_t plan_send_len = 0; // master plan to send data len
 
 static uint8_t current_send_seq = 0;
 static uint8_t current_recv_seq = 0;
+#ifdef CONFIG_SPI_WINDOW_MODE
+static spi_tx_window_t tx_window;
+#endif
 
 static void spi_mutex_lock(void)
 {
@@ -185,17 +241,17 @@ static void at_spi_wrdma_done(void)
 
 // when spi slave ready to send/recv data from the spi master, the spi slave will a trigger GPIO interrupt,
 // then spi master should query whether the slave will perform read or write operation.
-static spi_recv_opt_t query_slave_data_trans_info()
+static spi_slave_status_t query_slave_data_trans_info()
 {
-    spi_recv_opt_t recv_opt;
+    spi_slave_status_t status;
     spi_transaction_t trans = {
         .cmd = CMD_HD_RDBUF_REG,
         .addr = RDBUF_START_ADDR,
-        .rxlength = 4 * 8,
-        .rx_buffer = &recv_opt,
+        .rxlength = sizeof(spi_slave_status_t) * 8,
+        .rx_buffer = &status,
     };
     spi_device_polling_transmit(handle, (spi_transaction_t*)&trans);
-    return recv_opt;
+    return status;
 }
 
 // before spi master write to slave, the master should write WRBUF_REG register to notify slave, 
@@ -244,9 +300,127 @@ static int32_t write_data_to_spi_task_tx_ring_buf(const void* data, size_t size)
     return length;
 }
 
+#ifdef CONFIG_SPI_WINDOW_MODE
+static esp_err_t spi_window_init(spi_tx_window_t* win)
+{
+    memset(win, 0x0, sizeof(spi_tx_window_t));
+    for (int loop = 0; loop < SPI_WINDOW_MAX; loop++) {
+        win->buf[loop] = (uint8_t*)heap_caps_malloc(ESP_SPI_DMA_MAX_LEN, MALLOC_CAP_DMA);
+        if (win->buf[loop] == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+// move the next payload out of spi_master_tx_ring_buf into a free slot
+static bool spi_window_fill(spi_tx_window_t* win)
+{
+    uint32_t slot = (win->head + win->count) % SPI_WINDOW_MAX;
+    size_t len = xStreamBufferReceive(spi_master_tx_ring_buf, win->buf[slot] + SPI_SEGMENT_HEADER_LEN, SPI_SEGMENT_MAX_LEN, 0);
+
+    if (len == 0) {
+        return false;
+    }
+    win->len[slot] = len;
+    win->count++;
+    return true;
+}
+
+// apply the window published by the slave, return false if the slave does not support window mode
+static bool spi_window_update(spi_tx_window_t* win, const spi_slave_status_t* status)
+{
+    spi_window_opt_t opt = status->window;
+    uint8_t acked = opt.ack_seq - (uint8_t)(win->base_seq - 1);
+    TickType_t now = xTaskGetTickCount();
+
+    if (status->info.magic != SPI_WINDOW_MAGIC) {
+        if (win->synced) {
+            ESP_LOGE(TAG, "Slave is not in window mode, magic: %x", status->info.magic);
+            win->synced = false;
+        }
+        return false;
+    }
+
+    // the slave can only acknowledge what has been written, and never has more room than its window
+    if (!win->synced || acked > win->inflight || (uint8_t)(opt.load_count - win->written) > SPI_WINDOW_MAX) {
+        if (win->synced) {
+            ESP_LOGE(TAG, "SPI window out of sync, ack %d, base %d, maybe SLAVE restart", opt.ack_seq, win->base_seq);
+        } else {
+            ESP_LOGI(TAG, "SPI window: %d segments, ack %d", status->info.window, opt.ack_seq);
+        }
+        // number the pending segments after what the slave has accepted
+        win->base_seq = opt.ack_seq + 1;
+        win->written = opt.recv_count;
+        win->recv_count = opt.recv_count;
+        win->nack_count = opt.nack_count;
+        win->next = 0;
+        win->inflight = 0;
+        win->progress_tick = now;
+        win->synced = true;
+        return true;
+    }
+
+    if (acked > 0) {
+        win->head = (win->head + acked) % SPI_WINDOW_MAX;
+        win->count -= acked;
+        win->inflight -= acked;
+        win->next = win->next > acked ? win->next - acked : 0;
+        win->base_seq += acked;
+    }
+
+    if (opt.nack_count != win->nack_count) {
+        ESP_LOGW(TAG, "Slave missed segment %d, resend", win->base_seq);
+        win->nack_count = opt.nack_count;
+        win->next = 0;
+    }
+
+    if (opt.recv_count != win->recv_count || opt.recv_count == win->written) {
+        win->recv_count = opt.recv_count;
+        win->progress_tick = now;
+    } else if (now - win->progress_tick > pdMS_TO_TICKS(SPI_RESEND_TIMEOUT_MS)) {
+        // some writes never completed on the slave, take their credits back and resend
+        ESP_LOGW(TAG, "SPI write lost at segment %d, resend", win->base_seq);
+        win->written = opt.recv_count;
+        win->next = 0;
+        win->progress_tick = now;
+    }
+    return true;
+}
+
+// write segments while the slave has room, resent ones first, then new ones from spi_master_tx_ring_buf
+static void spi_window_send(spi_tx_window_t* win, uint8_t load_count)
+{
+    while (win->written != load_count) {
+        if (win->next == win->count && (win->count == SPI_WINDOW_MAX || !spi_window_fill(win))) {
+            break;
+        }
+
+        uint32_t slot = (win->head + win->next) % SPI_WINDOW_MAX;
+        spi_send_opt_t* header = (spi_send_opt_t*)win->buf[slot];
+        header->magic = SPI_SEGMENT_MAGIC;
+        header->send_seq = win->base_seq + win->next;
+        header->send_len = win->len[slot];
+        spi_write_data(win->buf[slot], SPI_SEGMENT_HEADER_LEN + win->len[slot]);
+
+        win->written++;
+        win->next++;
+        win->inflight = win->next > win->inflight ? win->next : win->inflight;
+        win->progress_tick = xTaskGetTickCount();
+    }
+}
+#endif
+
 // notify slave to recv data 
 static void notify_slave_to_recv(void)
 {
+#ifdef CONFIG_SPI_WINDOW_MODE
+    // segments are written on the credits of the slave, only wake up the control task
+    spi_master_msg_t spi_msg = {
+        .slave_notify_flag = false,
+    };
+    xQueueSend(msg_queue, (void*)&spi_msg, 0);
+#else
     if (initiative_send_flag == 0) {
         spi_mutex_lock();
         uint32_t tmp_send_len = xStreamBufferBytesAvailable(spi_master_tx_ring_buf);
@@ -257,90 +431,108 @@ static void notify_slave_to_recv(void)
         }
         spi_mutex_unlock();
     }
+#endif
 }
 
-static void IRAM_ATTR spi_trans_control_task(void* arg)
+#ifndef CONFIG_SPI_WINDOW_MODE
+// the slave grants the pending write request
+static void spi_master_write_granted(spi_recv_opt_t recv_opt, uint8_t* trans_data)
 {
-    esp_err_t ret;
-    spi_master_msg_t trans_msg = {0};
     uint32_t send_len = 0;
 
-    uint8_t* trans_data = (uint8_t*)malloc(ESP_SPI_DMA_MAX_LEN * sizeof(uint8_t));
-    if (trans_data == NULL) {
-        ESP_LOGE(TAG, "malloc fail");
+    if (initiative_send_flag == 0 || recv_opt.seq_num == (uint8_t)(current_send_seq - 1)) {
+        // the grant of a segment already sent, seen again by polling
         return;
     }
 
-    while (1) {
-        xQueueReceive(msg_queue, (void*)&trans_msg, (portTickType)portMAX_DELAY);
-        spi_mutex_lock();
-        spi_recv_opt_t recv_opt = query_slave_data_trans_info();
+    if (recv_opt.seq_num != current_send_seq) {
+        ESP_LOGE(TAG, "SPI send seq error, %x, %x, maybe SLAVE restart", recv_opt.seq_num, current_send_seq);
+        current_send_seq = recv_opt.seq_num;
+    }
 
-        if (recv_opt.direct == SPI_WRITE) {
-            if (plan_send_len == 0) {
-                ESP_LOGE(TAG, "master want send data but length is 0");
-                continue;
-            }
+    send_len = xStreamBufferReceive(spi_master_tx_ring_buf, (void*) trans_data, plan_send_len, 0);
+    if (send_len != plan_send_len) {
+        ESP_LOGE(TAG, "Read len expect %d, but actual read %d", plan_send_len, send_len);
+    }
 
-            if (recv_opt.seq_num != current_send_seq) {
-                ESP_LOGE(TAG, "SPI send seq error, %x, %x", recv_opt.seq_num, current_send_seq);
-                if (recv_opt.seq_num == 1) {
-                    ESP_LOGE(TAG, "Maybe SLAVE restart, ignore");
-                    current_send_seq = recv_opt.seq_num;
-                } else {
-                    break;
-                }
-            }
+    if (send_len > 0) {
+        spi_write_data(trans_data, send_len);
+    }
 
-            //initiative_send_flag = 0;
-            send_len = xStreamBufferReceive(spi_master_tx_ring_buf, (void*) trans_data, plan_send_len, 0);
+    // maybe streambuffer filled some data when SPI transimit, just consider it after send done, because send flag has already in SLAVE queue
+    uint32_t tmp_send_len = xStreamBufferBytesAvailable(spi_master_tx_ring_buf);
+    if (tmp_send_len > 0) {
+        plan_send_len = tmp_send_len > ESP_SPI_DMA_MAX_LEN ? ESP_SPI_DMA_MAX_LEN : tmp_send_len;
+        spi_master_request_to_write(current_send_seq + 1, plan_send_len);
+    } else {
+        initiative_send_flag = 0;
+    }
+}
+#endif
 
-            if (send_len != plan_send_len) {
-                ESP_LOGE(TAG, "Read len expect %d, but actual read %d", plan_send_len, send_len);
-                break;
-            }
+// the slave has a segment for the master
+static void spi_master_read_segment(spi_recv_opt_t recv_opt, uint8_t* trans_data)
+{
+    if (recv_opt.seq_num == current_recv_seq) {
+        // already read, seen again by polling
+        return;
+    }
 
-            ret = spi_write_data(trans_data, plan_send_len);
-            if (ret < 0) {
-                ESP_LOGE(TAG, "Load data error");
-                return;
-            }
+    // the slave publishes a segment only after the previous one is read, so a gap means it restarted
+    if (recv_opt.seq_num != (uint8_t)(current_recv_seq + 1)) {
+        ESP_LOGE(TAG, "SPI recv seq error, %x, %x, maybe SLAVE restart", recv_opt.seq_num, (uint8_t)(current_recv_seq + 1));
+    }
+    current_recv_seq = recv_opt.seq_num;
 
-            // maybe streambuffer filled some data when SPI transimit, just consider it after send done, because send flag has already in SLAVE queue
-            uint32_t tmp_send_len = xStreamBufferBytesAvailable(spi_master_tx_ring_buf);
-            if (tmp_send_len > 0) {
-                plan_send_len = tmp_send_len > ESP_SPI_DMA_MAX_LEN ? ESP_SPI_DMA_MAX_LEN : tmp_send_len;
-                spi_master_request_to_write(current_send_seq + 1, plan_send_len);
-            } else {
-                initiative_send_flag = 0;
-            }
+    if (recv_opt.transmit_len > ESP_SPI_DMA_MAX_LEN || recv_opt.transmit_len == 0) {
+        ESP_LOGE(TAG, "SPI read len error, %x", recv_opt.transmit_len);
+        return;
+    }
 
-        } else if (recv_opt.direct == SPI_READ) {
-            if (recv_opt.seq_num != ((current_recv_seq + 1) & 0xFF)) {
-                ESP_LOGE(TAG, "SPI recv seq error, %x, %x", recv_opt.seq_num, (current_recv_seq + 1));
-                if (recv_opt.seq_num == 1) {
-                    ESP_LOGE(TAG, "Maybe SLAVE restart, ignore");
-                } else {
-                    break;
-                }
-            }
+    at_spi_master_recv_data(trans_data, recv_opt.transmit_len);
+    at_spi_rddma_done();
+    trans_data[recv_opt.transmit_len] = '\0';
+    printf("%s", trans_data);
+    fflush(stdout);    //Force to print even if have not '\n'
+}
 
-            if (recv_opt.transmit_len > STREAM_BUFFER_SIZE || recv_opt.transmit_len == 0) {
-                ESP_LOGE(TAG, "SPI read len error, %x", recv_opt.transmit_len);
-                break;
-            }
+static void IRAM_ATTR spi_trans_control_task(void* arg)
+{
+    spi_master_msg_t trans_msg = {0};
+    spi_slave_status_t status;
 
-            current_recv_seq = recv_opt.seq_num;
-            memset(trans_data, 0x0, recv_opt.transmit_len);
-            at_spi_master_recv_data(trans_data, recv_opt.transmit_len);
-            at_spi_rddma_done();
-            trans_data[recv_opt.transmit_len] = '\0';
-            printf("%s", trans_data);
-            fflush(stdout);    //Force to print even if have not '\n'
-        } else {
-            ESP_LOGD(TAG, "Unknow direct: %d", recv_opt.direct);
-            spi_mutex_unlock();
-            continue;
+    uint8_t* trans_data = (uint8_t*)malloc((ESP_SPI_DMA_MAX_LEN + 1) * sizeof(uint8_t));
+    if (trans_data == NULL) {
+        ESP_LOGE(TAG, "malloc fail");
+        return;
+    }
+
+#ifdef CONFIG_SPI_WINDOW_MODE
+    if (spi_window_init(&tx_window) != ESP_OK) {
+        ESP_LOGE(TAG, "malloc fail");
+        return;
+    }
+#endif
+
+    while (1) {
+        xQueueReceive(msg_queue, (void*)&trans_msg, pdMS_TO_TICKS(SPI_STATUS_POLL_MS));
+        spi_mutex_lock();
+        status = query_slave_data_trans_info();
+
+#ifdef CONFIG_SPI_WINDOW_MODE
+        if (spi_window_update(&tx_window, &status)) {
+            spi_window_send(&tx_window, status.window.load_count);
+        }
+#else
+        if (status.recv_opt.direct == SPI_WRITE) {
+            spi_master_write_granted(status.recv_opt, trans_data);
+        }
+#endif
+
+        if (status.recv_opt.direct == SPI_READ) {
+            spi_master_read_segment(status.recv_opt, trans_data);
+        } else if (status.recv_opt.direct > SPI_WRITE) {
+            ESP_LOGD(TAG, "Unknow direct: %d", status.recv_opt.direct);
         }
 
         spi_mutex_unlock();
@@ -274,6 +274,12 @@ void app_main(void)
     }
 #endif
 
+#ifdef CONFIG_AT_BENCH_COMMAND_SUPPORT
+    if (esp_at_bench_cmd_regist() == false) {
+        printf("regist bench cmd fail\r\n");
+    }
+#endif
+
 #ifdef CONFIG_AT_WEB_SERVER_SUPPORT
     if (esp_at_web_server_cmd_regist() == false) {
         printf("regist web conf wifi cmd fail\r\n");
@@ -25,8 +25,62 @@
 #ifndef __AT_INTERFACE_H__
 #define __AT_INTERFACE_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+
 void at_interface_init (void);
 
 void at_custom_init(void);
 
+#ifdef CONFIG_AT_BASE_ON_SDIO
+
+/**
+ * @brief Borrow the unread part of the oldest SDIO receive buffer, without copying it.
+ *        Only available when AT is based on SDIO, and there must be a single reader.
+ *
+ * @param data pointer to the first unread byte inside the DMA buffer, NULL if nothing pending
+ *
+ * @return length of the data pointed by data, 0 if nothing pending, -1 on error
+ */
+int32_t at_sdio_recv_borrow(uint8_t** data);
+
+/**
+ * @brief Give back the bytes consumed from the buffer returned by at_sdio_recv_borrow().
+ *        The DMA buffer is loaded back to the SDIO slave once it is fully consumed.
+ *
+ * @param consumed number of bytes consumed, no more than the borrowed length
+ *
+ * @return consumed on success, -1 on error
+ */
+int32_t at_sdio_recv_return(uint32_t consumed);
+
+typedef struct {
+    uint32_t sent_packets;      /**< packets queued to the SDIO slave since boot */
+    uint32_t pool_exhausted;    /**< times the writer had to wait for a free send buffer */
+    uint32_t in_flight;         /**< send buffers currently owned by the SDIO slave */
+} at_sdio_send_stats_t;
+
+/**
+ * @brief Get the statistics of the SDIO send buffer pool.
+ *
+ * @param stats pointer to the statistics to fill
+ */
+void at_sdio_get_send_stats(at_sdio_send_stats_t* stats);
+
+typedef struct {
+    uint32_t recv_buffers;      /**< receive buffers filled by the host since boot */
+    uint32_t recv_bytes;        /**< bytes received from the host since boot */
+    uint32_t notifies;          /**< length notifications sent to the AT core, one per chain of buffers */
+} at_sdio_recv_stats_t;
+
+/**
+ * @brief Get the statistics of the SDIO receive buffers.
+ *
+ * @param stats pointer to the statistics to fill
+ */
+void at_sdio_get_recv_stats(at_sdio_recv_stats_t* stats);
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,162 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AT_TRANSPORT_MUX_H__
+#define __AT_TRANSPORT_MUX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_at.h"
+
+/**
+ * Transport multiplexer for AT.
+ *
+ * Several transports (UART next to SDIO, HSPI or socket) feed one AT core. Every transport
+ * notifies the data it receives, the AT core reads from a transport that has data pending, and
+ * the responses go back to the transport the input came from. In transparent transmission the
+ * primary transport, the fastest one unless changed by AT+TRANSPORT, carries the data and the
+ * input of the other transports is held back until the AT core is back to normal mode.
+ *
+ * The selection logic does no I/O, takes no lock and uses nothing from esp_at.h but the ops
+ * structure types, so it builds on a Linux host, see test/host/transport_mux.
+ * It is not thread safe: the caller serializes the access and calls the transport ops.
+ */
+
+#define AT_TRANSPORT_MAX_NUM            4
+
+// transport ranks, the highest ranked transport is the primary one by default
+#define AT_TRANSPORT_RANK_UART          1
+#define AT_TRANSPORT_RANK_SOCKET        2
+#define AT_TRANSPORT_RANK_HSPI          3
+#define AT_TRANSPORT_RANK_SDIO          4
+
+typedef struct {
+    const char* name;
+    esp_at_device_ops_struct device_ops;
+    esp_at_custom_ops_struct custom_ops;
+    uint32_t rank;
+    uint32_t pending;           /**< bytes notified and not read by the AT core yet */
+    uint32_t rx_bytes;          /**< bytes read by the AT core */
+    uint32_t tx_bytes;          /**< bytes written by the AT core */
+} at_transport_t;
+
+typedef struct {
+    at_transport_t transports[AT_TRANSPORT_MAX_NUM];
+    int num;
+    int primary;                /**< transport carrying transparent transmission, -1 if none */
+    int active;                 /**< transport the AT core reads from and answers to, -1 if none */
+    bool transmit;              /**< the AT core is in transparent transmission */
+    uint32_t switches;          /**< times the active transport changed */
+} at_transport_mux_t;
+
+void at_transport_mux_init(at_transport_mux_t* mux);
+
+/**
+ * @brief Add a transport. The highest ranked transport becomes the primary one.
+ *
+ * @param custom_ops callbacks of the transport, NULL if it has none
+ *
+ * @return index of the transport, -1 if there is no room or a parameter is invalid
+ */
+int at_transport_mux_add(at_transport_mux_t* mux, const char* name, const esp_at_device_ops_struct* device_ops,
+                         const esp_at_custom_ops_struct* custom_ops, uint32_t rank);
+
+/**
+ * @return index of the transport with this name, -1 if not found
+ */
+int at_transport_mux_find(at_transport_mux_t* mux, const char* name);
+
+/**
+ * @brief Change the primary transport. It also becomes the active one in transparent transmission,
+ *        otherwise the active transport changes with the next input.
+ */
+bool at_transport_mux_set_primary(at_transport_mux_t* mux, int index);
+
+/**
+ * @brief Follow the AT core status, transparent transmission pins the active transport to the primary one.
+ */
+void at_transport_mux_set_transmit(at_transport_mux_t* mux, bool transmit);
+
+/**
+ * @brief Record data received by a transport.
+ *
+ * @return true if the AT core should be notified now, false if the input is held back
+ */
+bool at_transport_mux_notify(at_transport_mux_t* mux, int index, int32_t len);
+
+/**
+ * @brief Choose the transport the AT core reads from, the active one as long as it has data pending.
+ *
+ * @return index of the transport, -1 if no input can be read now
+ */
+int at_transport_mux_select_input(at_transport_mux_t* mux);
+
+/**
+ * @brief Account the result of a read from a transport, a result <= 0 means nothing is pending any more.
+ */
+void at_transport_mux_consume(at_transport_mux_t* mux, int index, int32_t len);
+
+/**
+ * @return index of the transport the AT core writes to, -1 if there is none
+ */
+int at_transport_mux_select_output(at_transport_mux_t* mux);
+
+/**
+ * @brief Register a transport with the AT multiplexer, called by the transports from their init.
+ *        Only available with CONFIG_AT_TRANSPORT_MUX_SUPPORT.
+ *
+ * @return index of the transport to pass to at_transport_recv_data_notify(), -1 on error
+ */
+int at_transport_register(const char* name, const esp_at_device_ops_struct* device_ops,
+                          const esp_at_custom_ops_struct* custom_ops, uint32_t rank);
+
+/**
+ * @brief Replaces esp_at_port_recv_data_notify() in the transports registered with the multiplexer.
+ */
+bool at_transport_recv_data_notify(int index, int32_t len, uint32_t msec);
+
+/**
+ * @brief Register the UART transport and the multiplexer with the AT core, called from at_interface_init()
+ *        of the selected transport after it has registered itself.
+ */
+void at_transport_interface_init(void);
+
+/**
+ * @brief Register the commands of the UART transport and AT+TRANSPORT, called from at_custom_init()
+ *        of the selected transport.
+ */
+void at_transport_custom_init(void);
+
+/**
+ * @brief Init the UART transport and register it with the multiplexer, implemented in at_uart_task.c.
+ */
+void at_uart_transport_init(void);
+
+/**
+ * @brief Register the UART commands, implemented in at_uart_task.c.
+ */
+void at_uart_transport_custom_init(void);
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AT_TX_COALESCE_H__
+#define __AT_TX_COALESCE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+
+typedef int32_t (*at_tx_bus_write_t)(uint8_t* data, int32_t len);
+
+typedef struct {
+    uint32_t write_calls;       /**< write_data calls from the AT core */
+    uint32_t bus_writes;        /**< transactions actually issued on the bus */
+    uint32_t deadline_flushes;  /**< flushes triggered by the deadline timer */
+    uint32_t high_water_flushes;/**< flushes triggered by the high-water mark */
+    uint32_t explicit_flushes;  /**< flushes triggered by wait_write_complete */
+} at_tx_coalesce_stats_t;
+
+typedef struct {
+    const char* name;
+    at_tx_bus_write_t bus_write;
+    uint8_t* buf;
+    uint32_t high_water;
+    uint32_t len;
+    uint32_t deadline_us;
+    bool timer_armed;
+    bool error;                 /**< a deferred flush failed, reported by the next write or flush */
+    esp_timer_handle_t timer;
+    TaskHandle_t task;          /**< does the deadline flushes, woken by the timer */
+    SemaphoreHandle_t mutex;
+    at_tx_coalesce_stats_t stats;
+} at_tx_coalesce_t;
+
+/**
+ * @brief Initialize a TX aggregation stage in front of a bus write function.
+ *
+ * @param ctx the context to initialize, must stay valid while it is used
+ * @param name transport name, printed by AT+TX_STAT
+ * @param bus_write the transport write function that the aggregated data is flushed to
+ * @param high_water flush as soon as this many bytes are buffered; also the buffer size
+ * @param deadline_us flush buffered data at the latest this many microseconds after the first byte
+ *
+ * @return
+ *      - ESP_OK: succeed
+ *      - ESP_ERR_INVALID_ARG: invalid parameters
+ *      - ESP_ERR_NO_MEM: out of memory
+ */
+esp_err_t at_tx_coalesce_init(at_tx_coalesce_t* ctx, const char* name, at_tx_bus_write_t bus_write, uint32_t high_water, uint32_t deadline_us);
+
+/**
+ * @brief Buffer data for the bus, or write it through when it does not fit.
+ *
+ * @return len on success, -1 on error, including a failed deadline flush of the data written before
+ */
+int32_t at_tx_coalesce_write(at_tx_coalesce_t* ctx, uint8_t* data, int32_t len);
+
+/**
+ * @brief Write all buffered data to the bus now.
+ *
+ * @param timeout_msec how long to wait for a deadline flush in progress, negative to wait forever
+ *
+ * @return true if all buffered data has been written, false on timeout or if a deadline flush failed
+ */
+bool at_tx_coalesce_flush(at_tx_coalesce_t* ctx, int32_t timeout_msec);
+
+/**
+ * @brief Get the number of bytes buffered and not flushed yet.
+ */
+uint32_t at_tx_coalesce_pending(at_tx_coalesce_t* ctx);
+
+/**
+ * @brief Register AT+TX_STAT, which reports and clears the statistics of the registered stages.
+ *
+ * Must be called after esp_at_module_init(), from at_custom_init() of the transport.
+ */
+void at_tx_coalesce_custom_init(void);
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <string.h>
+
+#include "at_transport_mux.h"
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+
+void at_transport_mux_init(at_transport_mux_t* mux)
+{
+    memset(mux, 0x0, sizeof(at_transport_mux_t));
+    mux->primary = -1;
+    mux->active = -1;
+}
+
+int at_transport_mux_add(at_transport_mux_t* mux, const char* name, const esp_at_device_ops_struct* device_ops,
+                         const esp_at_custom_ops_struct* custom_ops, uint32_t rank)
+{
+    at_transport_t* transport = NULL;
+    int index = mux->num;
+
+    if (name == NULL || device_ops == NULL || device_ops->read_data == NULL || device_ops->write_data == NULL) {
+        return -1;
+    }
+
+    if (index >= AT_TRANSPORT_MAX_NUM || at_transport_mux_find(mux, name) >= 0) {
+        return -1;
+    }
+
+    transport = &mux->transports[index];
+    memset(transport, 0x0, sizeof(at_transport_t));
+    transport->name = name;
+    transport->device_ops = *device_ops;
+    if (custom_ops) {
+        transport->custom_ops = *custom_ops;
+    }
+    transport->rank = rank;
+    mux->num++;
+
+    if (mux->primary < 0 || rank > mux->transports[mux->primary].rank) {
+        mux->primary = index;
+        if (mux->transmit) {
+            mux->active = index;
+        }
+    }
+
+    return index;
+}
+
+int at_transport_mux_find(at_transport_mux_t* mux, const char* name)
+{
+    for (int loop = 0; loop < mux->num; loop++) {
+        if (strcmp(mux->transports[loop].name, name) == 0) {
+            return loop;
+        }
+    }
+
+    return -1;
+}
+
+bool at_transport_mux_set_primary(at_transport_mux_t* mux, int index)
+{
+    if (index < 0 || index >= mux->num) {
+        return false;
+    }
+
+    mux->primary = index;
+    if (mux->transmit && mux->active != index) {
+        mux->active = index;
+        mux->switches++;
+    }
+
+    return true;
+}
+
+void at_transport_mux_set_transmit(at_transport_mux_t* mux, bool transmit)
+{
+    mux->transmit = transmit;
+    if (transmit && mux->active != mux->primary) {
+        mux->active = mux->primary;
+        mux->switches++;
+    }
+}
+
+bool at_transport_mux_notify(at_transport_mux_t* mux, int index, int32_t len)
+{
+    if (index < 0 || index >= mux->num || len <= 0) {
+        return false;
+    }
+
+    mux->transports[index].pending += len;
+
+    // in transparent transmission only the primary transport feeds the AT core
+    return (!mux->transmit || index == mux->primary);
+}
+
+int at_transport_mux_select_input(at_transport_mux_t* mux)
+{
+    int index = 0;
+
+    if (mux->transmit) {
+        if (mux->primary >= 0 && mux->transports[mux->primary].pending > 0) {
+            return mux->primary;
+        }
+        return -1;
+    }
+
+    // stay on the active transport until it is drained, so a command is not interleaved with another
+    if (mux->active >= 0 && mux->transports[mux->active].pending > 0) {
+        return mux->active;
+    }
+
+    for (int loop = 1; loop <= mux->num; loop++) {
+        index = (mux->active + loop) % mux->num;
+        if (mux->transports[index].pending > 0) {
+            if (mux->active != index) {
+                mux->active = index;
+                mux->switches++;
+            }
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+void at_transport_mux_consume(at_transport_mux_t* mux, int index, int32_t len)
+{
+    at_transport_t* transport = NULL;
+
+    if (index < 0 || index >= mux->num) {
+        return;
+    }
+
+    transport = &mux->transports[index];
+    if (len <= 0) {
+        transport->pending = 0;
+        return;
+    }
+
+    transport->rx_bytes += len;
+    transport->pending = (len >= transport->pending) ? 0 : transport->pending - len;
+}
+
+int at_transport_mux_select_output(at_transport_mux_t* mux)
+{
+    if (mux->active >= 0) {
+        return mux->active;
+    }
+
+    return mux->primary;
+}
+#endif
@@ -0,0 +1,306 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_at.h"
+
+#include "at_interface.h"
+#include "at_transport_mux.h"
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+static const char* TAG = "at-transport";
+static at_transport_mux_t s_transport_mux;
+static SemaphoreHandle_t s_transport_mux_lock = NULL;
+
+static int32_t at_transport_read_data(uint8_t* buf, int32_t len)
+{
+    int32_t ret = 0;
+    int index = -1;
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    index = at_transport_mux_select_input(&s_transport_mux);
+    xSemaphoreGive(s_transport_mux_lock);
+
+    if (index < 0) {
+        return 0;
+    }
+
+    ret = s_transport_mux.transports[index].device_ops.read_data(buf, len);
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    at_transport_mux_consume(&s_transport_mux, index, ret);
+    xSemaphoreGive(s_transport_mux_lock);
+
+    return ret;
+}
+
+static int32_t at_transport_write_data(uint8_t* buf, int32_t len)
+{
+    int32_t ret = 0;
+    int index = -1;
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    index = at_transport_mux_select_output(&s_transport_mux);
+    xSemaphoreGive(s_transport_mux_lock);
+
+    if (index < 0) {
+        return -1;
+    }
+
+    ret = s_transport_mux.transports[index].device_ops.write_data(buf, len);
+    if (ret > 0) {
+        xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+        s_transport_mux.transports[index].tx_bytes += ret;
+        xSemaphoreGive(s_transport_mux_lock);
+    }
+
+    return ret;
+}
+
+static int32_t at_transport_get_data_length(void)
+{
+    at_transport_t* transport = NULL;
+    uint32_t pending = 0;
+    int index = -1;
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    index = at_transport_mux_select_input(&s_transport_mux);
+    if (index >= 0) {
+        pending = s_transport_mux.transports[index].pending;
+    }
+    xSemaphoreGive(s_transport_mux_lock);
+
+    if (index < 0) {
+        return 0;
+    }
+
+    transport = &s_transport_mux.transports[index];
+    if (transport->device_ops.get_data_length) {
+        return transport->device_ops.get_data_length();
+    }
+
+    return pending;
+}
+
+static bool at_transport_wait_write_complete(int32_t timeout_msec)
+{
+    at_transport_t* transport = NULL;
+    int index = -1;
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    index = at_transport_mux_select_output(&s_transport_mux);
+    xSemaphoreGive(s_transport_mux_lock);
+
+    if (index < 0) {
+        return true;
+    }
+
+    transport = &s_transport_mux.transports[index];
+    if (transport->device_ops.wait_write_complete) {
+        return transport->device_ops.wait_write_complete(timeout_msec);
+    }
+
+    return true;
+}
+
+static void at_transport_status_callback(esp_at_status_type status)
+{
+    uint32_t pending = 0;
+    int active = -1;
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    at_transport_mux_set_transmit(&s_transport_mux, (status == ESP_AT_STATUS_TRANSMIT));
+    active = s_transport_mux.active;
+    xSemaphoreGive(s_transport_mux_lock);
+
+    // only the transport carrying the transmission enters it, so "+++" on another one can not end it
+    for (int loop = 0; loop < s_transport_mux.num; loop++) {
+        if (s_transport_mux.transports[loop].custom_ops.status_callback) {
+            s_transport_mux.transports[loop].custom_ops.status_callback((status == ESP_AT_STATUS_TRANSMIT && loop != active) ? ESP_AT_STATUS_NORMAL : status);
+        }
+    }
+
+    if (status != ESP_AT_STATUS_NORMAL) {
+        return;
+    }
+
+    // the input held back during transparent transmission can be read now
+    for (int loop = 0; loop < s_transport_mux.num; loop++) {
+        xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+        pending = (loop != s_transport_mux.primary) ? s_transport_mux.transports[loop].pending : 0;
+        xSemaphoreGive(s_transport_mux_lock);
+
+        if (pending > 0) {
+            esp_at_port_recv_data_notify(pending, 0);
+        }
+    }
+}
+
+static void at_transport_pre_deepsleep_callback(void)
+{
+    for (int loop = 0; loop < s_transport_mux.num; loop++) {
+        if (s_transport_mux.transports[loop].custom_ops.pre_deepsleep_callback) {
+            s_transport_mux.transports[loop].custom_ops.pre_deepsleep_callback();
+        }
+    }
+}
+
+static void at_transport_pre_restart_callback(void)
+{
+    for (int loop = 0; loop < s_transport_mux.num; loop++) {
+        if (s_transport_mux.transports[loop].custom_ops.pre_restart_callback) {
+            s_transport_mux.transports[loop].custom_ops.pre_restart_callback();
+        }
+    }
+}
+
+int at_transport_register(const char* name, const esp_at_device_ops_struct* device_ops,
+                          const esp_at_custom_ops_struct* custom_ops, uint32_t rank)
+{
+    int index = -1;
+
+    // the transports register from at_interface_init, before any of their tasks runs
+    if (s_transport_mux_lock == NULL) {
+        s_transport_mux_lock = xSemaphoreCreateMutex();
+        if (s_transport_mux_lock == NULL) {
+            ESP_LOGE(TAG, "Cannot create mutex");
+            return -1;
+        }
+        at_transport_mux_init(&s_transport_mux);
+    }
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    index = at_transport_mux_add(&s_transport_mux, name, device_ops, custom_ops, rank);
+    xSemaphoreGive(s_transport_mux_lock);
+
+    if (index < 0) {
+        ESP_LOGE(TAG, "Cannot register transport %s", name ? name : "");
+    }
+
+    return index;
+}
+
+bool at_transport_recv_data_notify(int index, int32_t len, uint32_t msec)
+{
+    bool notify = false;
+
+    if (s_transport_mux_lock == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    notify = at_transport_mux_notify(&s_transport_mux, index, len);
+    xSemaphoreGive(s_transport_mux_lock);
+
+    if (!notify) {
+        return false;
+    }
+
+    return esp_at_port_recv_data_notify(len, msec);
+}
+
+void at_transport_interface_init(void)
+{
+    esp_at_device_ops_struct esp_at_device_ops = {
+        .read_data = at_transport_read_data,
+        .write_data = at_transport_write_data,
+        .get_data_length = at_transport_get_data_length,
+        .wait_write_complete = at_transport_wait_write_complete,
+    };
+
+    esp_at_custom_ops_struct esp_at_custom_ops = {
+        .status_callback = at_transport_status_callback,
+        .pre_deepsleep_callback = at_transport_pre_deepsleep_callback,
+        .pre_restart_callback = at_transport_pre_restart_callback,
+    };
+
+    at_uart_transport_init();
+
+    if (s_transport_mux_lock == NULL) {
+        ESP_LOGE(TAG, "No transport registered");
+        return;
+    }
+
+    esp_at_device_ops_regist(&esp_at_device_ops);
+    esp_at_custom_ops_regist(&esp_at_custom_ops);
+}
+
+static uint8_t at_queryCmdTransport(uint8_t* cmd_name)
+{
+    at_transport_t transport;
+    bool primary = false;
+    bool active = false;
+    uint8_t buffer[96];
+
+    for (int loop = 0; loop < s_transport_mux.num; loop++) {
+        xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+        transport = s_transport_mux.transports[loop];
+        primary = (loop == s_transport_mux.primary);
+        active = (loop == s_transport_mux.active);
+        xSemaphoreGive(s_transport_mux_lock);
+
+        snprintf((char*)buffer, sizeof(buffer) - 1, "%s:\"%s\",%d,%d,%u,%u\r\n", cmd_name, transport.name,
+                 primary, active, transport.rx_bytes, transport.tx_bytes);
+        esp_at_port_write_data(buffer, strlen((char*)buffer));
+    }
+
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+static uint8_t at_setupCmdTransport(uint8_t para_num)
+{
+    uint8_t* name = NULL;
+    bool ret = false;
+
+    if (para_num != 1) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    if (esp_at_get_para_as_str(0, &name) != ESP_AT_PARA_PARSE_RESULT_OK) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    xSemaphoreTake(s_transport_mux_lock, portMAX_DELAY);
+    ret = at_transport_mux_set_primary(&s_transport_mux, at_transport_mux_find(&s_transport_mux, (char*)name));
+    xSemaphoreGive(s_transport_mux_lock);
+
+    return ret ? ESP_AT_RESULT_CODE_OK : ESP_AT_RESULT_CODE_ERROR;
+}
+
+static esp_at_cmd_struct at_transport_cmd[] = {
+    {"+TRANSPORT", NULL, at_queryCmdTransport, at_setupCmdTransport, NULL},
+};
+
+void at_transport_custom_init(void)
+{
+    at_uart_transport_custom_init();
+    esp_at_custom_cmd_array_regist(at_transport_cmd, sizeof(at_transport_cmd) / sizeof(at_transport_cmd[0]));
+}
+#endif
@@ -0,0 +1,321 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_at.h"
+
+#include "at_tx_coalesce.h"
+
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+#define AT_TX_COALESCE_MAX_NUM      4
+#define AT_TX_COALESCE_TASK_STACK   3072
+#define AT_TX_COALESCE_TASK_PRIO    10      // same as the transport tasks
+
+static const char* TAG = "at-tx-coalesce";
+static at_tx_coalesce_t* s_coalesce_list[AT_TX_COALESCE_MAX_NUM];
+
+// must be called with ctx->mutex held, a failed bus write is latched in ctx->error
+static bool at_tx_coalesce_flush_locked(at_tx_coalesce_t* ctx)
+{
+    int32_t ret = 0;
+    uint32_t len = ctx->len;
+
+    if (ctx->timer_armed) {
+        esp_timer_stop(ctx->timer);
+        ctx->timer_armed = false;
+    }
+
+    if (ctx->len == 0) {
+        return true;
+    }
+
+    ret = ctx->bus_write(ctx->buf, len);
+    ctx->stats.bus_writes++;
+    ctx->len = 0;
+
+    if (ret != (int32_t)len) {
+        ESP_LOGE(TAG, "%s bus write %d of %d bytes", ctx->name, ret, (int)len);
+        ctx->error = true;
+        return false;
+    }
+    return true;
+}
+
+// Report the latched error once, must be called with ctx->mutex held
+static bool at_tx_coalesce_take_error(at_tx_coalesce_t* ctx)
+{
+    bool error = ctx->error;
+
+    ctx->error = false;
+    return error;
+}
+
+// The bus writes may block until the host reads, so the esp_timer task only wakes the flush task
+static void at_tx_coalesce_timer_cb(void* arg)
+{
+    at_tx_coalesce_t* ctx = (at_tx_coalesce_t*)arg;
+
+    xTaskNotifyGive(ctx->task);
+}
+
+static void at_tx_coalesce_task(void* arg)
+{
+    at_tx_coalesce_t* ctx = (at_tx_coalesce_t*)arg;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        xSemaphoreTake(ctx->mutex, portMAX_DELAY);
+        // a writer may have flushed since the timer fired
+        if (ctx->timer_armed) {
+            ctx->timer_armed = false;
+            if (ctx->len > 0) {
+                ctx->stats.deadline_flushes++;
+            }
+            at_tx_coalesce_flush_locked(ctx);
+        }
+        xSemaphoreGive(ctx->mutex);
+    }
+}
+
+esp_err_t at_tx_coalesce_init(at_tx_coalesce_t* ctx, const char* name, at_tx_bus_write_t bus_write, uint32_t high_water, uint32_t deadline_us)
+{
+    int loop = 0;
+
+    if (ctx == NULL || name == NULL || bus_write == NULL || high_water == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(ctx, 0x0, sizeof(at_tx_coalesce_t));
+    ctx->name = name;
+    ctx->bus_write = bus_write;
+    ctx->high_water = high_water;
+    ctx->deadline_us = deadline_us;
+
+    ctx->buf = (uint8_t*)malloc(high_water);
+    ctx->mutex = xSemaphoreCreateMutex();
+    if (ctx->buf == NULL || ctx->mutex == NULL) {
+        goto err;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = at_tx_coalesce_timer_cb,
+        .arg = ctx,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "at_tx_coalesce",
+    };
+    if (esp_timer_create(&timer_args, &ctx->timer) != ESP_OK) {
+        goto err;
+    }
+    if (xTaskCreate(at_tx_coalesce_task, "at_tx_coalesce", AT_TX_COALESCE_TASK_STACK, ctx, AT_TX_COALESCE_TASK_PRIO, &ctx->task) != pdPASS) {
+        esp_timer_delete(ctx->timer);
+        ctx->timer = NULL;
+        goto err;
+    }
+
+    for (loop = 0; loop < AT_TX_COALESCE_MAX_NUM; loop++) {
+        if (s_coalesce_list[loop] == NULL) {
+            s_coalesce_list[loop] = ctx;
+            break;
+        }
+    }
+    if (loop == AT_TX_COALESCE_MAX_NUM) {
+        ESP_LOGW(TAG, "no room for %s statistics", name);
+    }
+
+    return ESP_OK;
+
+err:
+    ESP_LOGE(TAG, "init %s fail", name);
+    if (ctx->mutex) {
+        vSemaphoreDelete(ctx->mutex);
+        ctx->mutex = NULL;
+    }
+    free(ctx->buf);
+    ctx->buf = NULL;
+    return ESP_ERR_NO_MEM;
+}
+
+int32_t at_tx_coalesce_write(at_tx_coalesce_t* ctx, uint8_t* data, int32_t len)
+{
+    int32_t ret = len;
+
+    if (data == NULL || len < 0) {
+        return -1;
+    }
+
+    if (len == 0) {
+        return 0;
+    }
+
+    xSemaphoreTake(ctx->mutex, portMAX_DELAY);
+    ctx->stats.write_calls++;
+
+    // a deferred flush failed after the earlier write was reported as written
+    if (at_tx_coalesce_take_error(ctx)) {
+        xSemaphoreGive(ctx->mutex);
+        return -1;
+    }
+
+    if (ctx->len + len > ctx->high_water) {
+        // keep the byte order: what is buffered goes first
+        ctx->stats.high_water_flushes++;
+        if (!at_tx_coalesce_flush_locked(ctx)) {
+            at_tx_coalesce_take_error(ctx);
+            xSemaphoreGive(ctx->mutex);
+            return -1;
+        }
+    }
+
+    if (len >= ctx->high_water) {
+        // too large to be worth buffering, write it through
+        ret = ctx->bus_write(data, len);
+        ctx->stats.bus_writes++;
+        xSemaphoreGive(ctx->mutex);
+        return ret;
+    }
+
+    memcpy(ctx->buf + ctx->len, data, len);
+    ctx->len += len;
+
+    if (ctx->len == ctx->high_water) {
+        ctx->stats.high_water_flushes++;
+        if (!at_tx_coalesce_flush_locked(ctx)) {
+            ret = -1;
+        }
+    } else if (!ctx->timer_armed) {
+        if (ctx->deadline_us == 0 || esp_timer_start_once(ctx->timer, ctx->deadline_us) != ESP_OK) {
+            if (!at_tx_coalesce_flush_locked(ctx)) {
+                ret = -1;
+            }
+        } else {
+            ctx->timer_armed = true;
+        }
+    }
+    if (ret < 0) {
+        at_tx_coalesce_take_error(ctx);
+    }
+    xSemaphoreGive(ctx->mutex);
+
+    return ret;
+}
+
+bool at_tx_coalesce_flush(at_tx_coalesce_t* ctx, int32_t timeout_msec)
+{
+    bool ret = false;
+
+    if (xSemaphoreTake(ctx->mutex, (timeout_msec < 0) ? portMAX_DELAY : (TickType_t)(timeout_msec / portTICK_PERIOD_MS)) != pdTRUE) {
+        return false;
+    }
+    if (ctx->len > 0) {
+        ctx->stats.explicit_flushes++;
+    }
+    at_tx_coalesce_flush_locked(ctx);
+    ret = !at_tx_coalesce_take_error(ctx);
+    xSemaphoreGive(ctx->mutex);
+
+    return ret;
+}
+
+uint32_t at_tx_coalesce_pending(at_tx_coalesce_t* ctx)
+{
+    uint32_t len = 0;
+
+    xSemaphoreTake(ctx->mutex, portMAX_DELAY);
+    len = ctx->len;
+    xSemaphoreGive(ctx->mutex);
+
+    return len;
+}
+
+static uint8_t at_queryCmdTxStat(uint8_t* cmd_name)
+{
+    at_tx_coalesce_stats_t stats;
+    uint8_t buffer[128];
+
+    for (int loop = 0; loop < AT_TX_COALESCE_MAX_NUM; loop++) {
+        at_tx_coalesce_t* ctx = s_coalesce_list[loop];
+        if (ctx == NULL) {
+            continue;
+        }
+        xSemaphoreTake(ctx->mutex, portMAX_DELAY);
+        stats = ctx->stats;
+        xSemaphoreGive(ctx->mutex);
+
+        // write calls that did not cost a bus transaction of their own
+        snprintf((char*)buffer, sizeof(buffer) - 1, "%s:\"%s\",%u,%u,%d,%u,%u,%u\r\n", cmd_name, ctx->name,
+                 stats.write_calls, stats.bus_writes, (int)(stats.write_calls - stats.bus_writes),
+                 stats.deadline_flushes, stats.high_water_flushes, stats.explicit_flushes);
+        esp_at_port_write_data(buffer, strlen((char*)buffer));
+    }
+
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+// AT+TX_STAT=0 clears the counters
+static uint8_t at_setupCmdTxStat(uint8_t para_num)
+{
+    int32_t value = 0;
+
+    if (para_num != 1) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    if (esp_at_get_para_as_digit(0, &value) != ESP_AT_PARA_PARSE_RESULT_OK) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+    if (value != 0) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    for (int loop = 0; loop < AT_TX_COALESCE_MAX_NUM; loop++) {
+        at_tx_coalesce_t* ctx = s_coalesce_list[loop];
+        if (ctx == NULL) {
+            continue;
+        }
+        xSemaphoreTake(ctx->mutex, portMAX_DELAY);
+        memset(&ctx->stats, 0x0, sizeof(at_tx_coalesce_stats_t));
+        xSemaphoreGive(ctx->mutex);
+    }
+
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+static esp_at_cmd_struct at_tx_coalesce_cmd[] = {
+    {"+TX_STAT", NULL, at_queryCmdTxStat, at_setupCmdTxStat, NULL},
+};
+
+void at_tx_coalesce_custom_init(void)
+{
+    esp_at_custom_cmd_array_regist(at_tx_coalesce_cmd, sizeof(at_tx_coalesce_cmd) / sizeof(at_tx_coalesce_cmd[0]));
+}
+#endif
@@ -30,6 +30,8 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/stream_buffer.h"
 
 #include "esp_system.h"
 #include "esp_log.h"
@@ -37,6 +39,8 @@
 #ifdef CONFIG_AT_BASE_ON_HSPI
 #include "driver/gpio.h"
 #include "at_spi_driver.h"
+#include "at_tx_coalesce.h"
+#include "at_transport_mux.h"
 
 #if CONFIG_SPI_NUM == 1
 #define AT_SPI_HOST HSPI_HOST
@@ -45,8 +49,9 @@
 #endif
 
 static const char* TAG = "HSPI-AT";
-static uint8_t *recv_data;
-static uint32_t notify_len = 0;
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+static int spi_transport_id = -1;
+#endif
 
 //#define LOG_LOCAL_LEVEL 4     //debug mode, it will print debug log
 
@@ -58,19 +63,44 @@ static uint32_t notify_len = 0;
 
 #define SPI_SLAVE_HANDSHARK_SEL      (1ULL<<CONFIG_SPI_HANDSHAKE_PIN)
 #define AT_READ_STREAM_BUFFER_SIZE      CONFIG_RX_STREAM_BUFFER_SIZE
+#ifdef CONFIG_SPI_FRAME_MODE
+// room for a whole frame besides the configured buffering, otherwise frames never grow past the stream size
+#define AT_WRITE_STREAM_BUFFER_SIZE      (CONFIG_TX_STREAM_BUFFER_SIZE + CONFIG_SPI_FRAME_MAX_LEN)
+#else
 #define AT_WRITE_STREAM_BUFFER_SIZE      CONFIG_TX_STREAM_BUFFER_SIZE
+#endif
 
-static xSemaphoreHandle spi_pxMutex;
-
-void spi_mutex_lock(void)
-{
-    xSemaphoreTake(spi_pxMutex, portMAX_DELAY);
-}
+#ifdef CONFIG_SPI_FRAME_MODE
+#define SPI_DMA_MAX_LEN             CONFIG_SPI_FRAME_MAX_LEN
+#define SPI_SLAVE_FLAGS             SPI_SLAVE_FRAME_MODE
+#else
+#define SPI_DMA_MAX_LEN             4092
+#define SPI_SLAVE_FLAGS             0
+#endif
+// the driver TX queue is as deep as its RX ring (queue_size), never keep more bounce buffers in flight
+#if CONFIG_SPI_TX_SEGMENT_NUM < CONFIG_SPI_RX_SEGMENT_NUM
+#define SPI_TX_POOL_NUM             CONFIG_SPI_TX_SEGMENT_NUM
+#else
+#define SPI_TX_POOL_NUM             CONFIG_SPI_RX_SEGMENT_NUM
+#endif
 
-void spi_mutex_unlock(void)
-{
-    xSemaphoreGive(spi_pxMutex);
-}
+#define SPI_TX_DRAINED_BIT          BIT0
+
+static StreamBufferHandle_t spi_tx_stream_buf = NULL;
+static xSemaphoreHandle spi_tx_write_mutex;     // serializes the writers of spi_tx_stream_buf
+static xSemaphoreHandle spi_rx_consumed;        // the AT core has read the whole received buffer
+static xSemaphoreHandle spi_tx_pool_free;       // counts the bounce buffers not held by the driver
+static EventGroupHandle_t spi_tx_event;         // SPI_TX_DRAINED_BIT: spi_tx_pending_len dropped to 0
+static uint8_t* spi_tx_pool[SPI_TX_POOL_NUM];
+static spi_slave_transaction_t spi_tx_trans[SPI_TX_POOL_NUM];
+static portMUX_TYPE spi_tx_pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t spi_tx_pending_len = 0;         // written by the AT core and not read by the master yet
+
+// the received buffer handed to the AT core, the three of them change together under spi_rx_lock
+static portMUX_TYPE spi_rx_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t* recv_data = NULL;
+static uint32_t notify_len = 0;
+static uint32_t recv_offset = 0;
 
 //Called notify master can send data. We use this to set the handshake line high.
 void pull_high_cb(spi_slave_transaction_t *trans) {
@@ -85,6 +115,8 @@ void pull_low_cb(spi_slave_transaction_t *trans) {
 /* Called when spi receive a normal AT command, make sure you have added \r\n in your spi data */
 static int32_t at_spi_read_data(uint8_t* data, int32_t len)
 {
+    const uint8_t* src = NULL;
+    bool read_out = false;
 
     if (data == NULL || len < 0) {
         return -1;
@@ -95,20 +127,39 @@ static int32_t at_spi_read_data(uint8_t* data, int32_t len)
         return 0;
     }
 
-    memcpy(data, recv_data, len);
+    // take the bytes under the lock, the copy itself is safe outside of it: at_spi_slave_task does not
+    // replace recv_data before spi_rx_consumed is given below
+    portENTER_CRITICAL(&spi_rx_lock);
+    // nothing unread: the buffer was read out already, or none has been notified yet
+    if (recv_data == NULL || recv_offset >= notify_len) {
+        portEXIT_CRITICAL(&spi_rx_lock);
+        return 0;
+    }
+
+    if (len > notify_len - recv_offset) {
+        len = notify_len - recv_offset;
+    }
+
+    src = recv_data + recv_offset;
+    recv_offset += len;
+    read_out = (recv_offset == notify_len);
+    portEXIT_CRITICAL(&spi_rx_lock);
+
+    memcpy(data, src, len);
     ESP_LOGD(TAG, "read len: %d", len);
 
-    at_spi_slave_free_receive_buffer(AT_SPI_HOST);
-    spi_mutex_unlock();
+    // give the buffer back to the driver once it has been read out
+    if (read_out) {
+        at_spi_slave_free_receive_buffer(AT_SPI_HOST);
+        xSemaphoreGive(spi_rx_consumed);
+    }
     return len;
 }
 
 /* Result of AT command, auto call when read_data get data */
 static int32_t at_spi_write_data(uint8_t* buf, int32_t len)
 {
-    esp_err_t ret;
-    uint8_t wait_time = 10;
-    uint8_t* sendbuf = NULL;
+    int32_t length = 0;
     if (len < 0 || buf == NULL) {
         ESP_LOGE(TAG, "Cannot get write data.");
         return -1;
@@ -118,40 +169,133 @@ static int32_t at_spi_write_data(uint8_t* buf, int32_t len)
         ESP_LOGE(TAG, "Empty write data.");
         return 0;
     }
-    spi_mutex_lock();
     ESP_LOGD(TAG, "Write data len: %d", len);
-    sendbuf = heap_caps_malloc(len, MALLOC_CAP_DMA);
-    if (sendbuf == NULL) {
-        ESP_LOGE(TAG , "Malloc send buffer fail!");
-        spi_mutex_unlock();
-        return 0;
+
+    // only waits for room in the stream buffer, at_spi_tx_task deals with the bus
+    xSemaphoreTake(spi_tx_write_mutex, portMAX_DELAY);
+    portENTER_CRITICAL(&spi_tx_pending_lock);
+    spi_tx_pending_len += len;
+    portEXIT_CRITICAL(&spi_tx_pending_lock);
+    while (length < len) {
+        length += xStreamBufferSend(spi_tx_stream_buf, buf + length, len - length, portMAX_DELAY);
     }
-    memcpy(sendbuf, buf, len);
+    xSemaphoreGive(spi_tx_write_mutex);
+
+    return len;
+}
+
+static bool at_spi_tx_pending(void)
+{
+    uint32_t pending_len = 0;
+
+    portENTER_CRITICAL(&spi_tx_pending_lock);
+    pending_len = spi_tx_pending_len;
+    portEXIT_CRITICAL(&spi_tx_pending_lock);
+
+    return (pending_len > 0);
+}
+
+static bool at_spi_wait_write_complete(int32_t timeout_msec)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = (timeout_msec < 0) ? portMAX_DELAY : (timeout_msec / portTICK_PERIOD_MS);
+    TickType_t elapsed = 0;
+
+    while (at_spi_tx_pending()) {
+        elapsed = xTaskGetTickCount() - start;
+        if (timeout != portMAX_DELAY && elapsed >= timeout) {
+            return false;
+        }
 
-    while (wait_time--) {
-        ret = at_spi_slave_send(AT_SPI_HOST, sendbuf, len, 1000 / portTICK_PERIOD_MS);
-        if (ret == ESP_OK) {
+        // the bit may be left over from an earlier drain, clear it and look again before sleeping on it
+        xEventGroupClearBits(spi_tx_event, SPI_TX_DRAINED_BIT);
+        if (!at_spi_tx_pending()) {
             break;
         }
+        xEventGroupWaitBits(spi_tx_event, SPI_TX_DRAINED_BIT, pdFALSE, pdTRUE, (timeout == portMAX_DELAY) ? portMAX_DELAY : (timeout - elapsed));
     }
-    if (wait_time == 0) {
-        ESP_LOGE(TAG, "send error");
-        len = -1;
-    }
-    spi_mutex_unlock();
 
-    free(sendbuf);
-    return len;
+    return true;
 }
 
 int32_t at_spi_get_data_length(void)
 {
-    return notify_len;
+    int32_t len = 0;
+
+    portENTER_CRITICAL(&spi_rx_lock);
+    len = notify_len - recv_offset;
+    portEXIT_CRITICAL(&spi_rx_lock);
+
+    return len;
+}
+
+// a bounce buffer is back, its bytes have been read by the master or dropped
+static void at_spi_tx_release(uint32_t len)
+{
+    bool drained = false;
+
+    portENTER_CRITICAL(&spi_tx_pending_lock);
+    spi_tx_pending_len -= len;
+    drained = (spi_tx_pending_len == 0);
+    portEXIT_CRITICAL(&spi_tx_pending_lock);
+
+    xSemaphoreGive(spi_tx_pool_free);
+    if (drained) {
+        xEventGroupSetBits(spi_tx_event, SPI_TX_DRAINED_BIT);
+    }
+}
+
+// reap the finished transactions, the driver returns them in the order they were queued
+static void at_spi_tx_done_task(void* pvParameters)
+{
+    spi_slave_transaction_t* ret_trans = NULL;
+
+    while (1) {
+        if (at_spi_slave_get_trans_result(AT_SPI_HOST, &ret_trans, portMAX_DELAY) != ESP_OK) {
+            continue;
+        }
+        at_spi_tx_release(ret_trans->length / 8);
+    }
+
+    vTaskDelete(NULL);
+}
+
+// move the stream buffer to the master through the bounce buffers, one of them per queued transaction
+static void at_spi_tx_task(void* pvParameters)
+{
+    esp_err_t ret;
+    uint32_t index = 0;
+    size_t len = 0;
+
+    while (1) {
+        // the bounce buffer to fill next must be back from the driver
+        xSemaphoreTake(spi_tx_pool_free, portMAX_DELAY);
+
+        len = 0;
+        while (len == 0) {
+            len = xStreamBufferReceive(spi_tx_stream_buf, spi_tx_pool[index], SPI_DMA_MAX_LEN, portMAX_DELAY);
+        }
+
+        memset(&spi_tx_trans[index], 0x0, sizeof(spi_slave_transaction_t));
+        spi_tx_trans[index].length = len * 8;
+        spi_tx_trans[index].tx_buffer = spi_tx_pool[index];
+        ret = at_spi_slave_queue_trans(AT_SPI_HOST, &spi_tx_trans[index], portMAX_DELAY);
+        if (ret != ESP_OK) {
+            // the segment is lost, keep the bounce buffer and go on with the next one
+            ESP_LOGE(TAG, "queue trans error: %d, drop %d bytes\r\n", ret, len);
+            at_spi_tx_release(len);
+            continue;
+        }
+        index = (index + 1) % SPI_TX_POOL_NUM;
+    }
+
+    vTaskDelete(NULL);
 }
 
 static void at_spi_slave_task(void* pvParameters)
 {
     esp_err_t ret;
+    uint8_t* recv_buf = NULL;
     uint32_t recv_len = 0;
 
     //Configuration for the SPI bus
@@ -161,15 +305,16 @@ static void at_spi_slave_task(void* pvParameters)
         .sclk_io_num=GPIO_SCLK,
         .intr_flags = ESP_INTR_FLAG_IRAM,
         .quadwp_io_num = -1,
-        .quadhd_io_num = -1
+        .quadhd_io_num = -1,
+        .max_transfer_sz = SPI_DMA_MAX_LEN
     };
 
     //Configuration for the SPI slave interface
     spi_slave_interface_config_t slvcfg={
         .mode=CONFIG_SPI_MODE,
         .spics_io_num=GPIO_CS,
-        .queue_size=3,
-        .flags=0,
+        .queue_size=CONFIG_SPI_RX_SEGMENT_NUM,
+        .flags=SPI_SLAVE_FLAGS,
         .post_setup_cb=pull_high_cb,
         .post_trans_cb=pull_low_cb
     };
@@ -188,48 +333,121 @@ static void at_spi_slave_task(void* pvParameters)
     gpio_set_pull_mode(GPIO_SCLK, GPIO_PULLUP_ONLY);
     gpio_set_pull_mode(GPIO_CS, GPIO_PULLUP_ONLY);
 
-    spi_pxMutex = xSemaphoreCreateMutex();
-    if (!spi_pxMutex) {
-        ESP_LOGE(TAG, "create mutex error\r\n");
-    }
-
     //Initialize SPI slave interface
     ret= at_spi_slave_initialize(AT_SPI_HOST, &buscfg, &slvcfg, 1);
     assert(ret==ESP_OK);
 
+    xTaskCreate(at_spi_tx_task , "at_spi_tx_task" , 4096 , NULL , 10 , NULL);
+    xTaskCreate(at_spi_tx_done_task , "at_spi_tx_done" , 2048 , NULL , 10 , NULL);
+
     at_spi_write_data((uint8_t *)"ready\r\n", strlen("ready\r\n"));
 
     while (1) {
-        ret = at_spi_slave_receive(AT_SPI_HOST, &recv_data, &recv_len, portMAX_DELAY);
+        ret = at_spi_slave_receive(AT_SPI_HOST, &recv_buf, &recv_len, portMAX_DELAY);
         if(ret != ESP_OK) {
             ESP_LOGE(TAG, "Recv error: %d\r\n", ret);
             break;
         }
-        spi_mutex_lock();
+
+        // at_spi_read_data and at_spi_get_data_length see the old buffer or the new one, never a mix
+        portENTER_CRITICAL(&spi_rx_lock);
+        recv_data = recv_buf;
+        recv_offset = 0;
+        notify_len = recv_len;
+        portEXIT_CRITICAL(&spi_rx_lock);
 
         // notify length to AT core
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+        at_transport_recv_data_notify(spi_transport_id, recv_len, portMAX_DELAY);
+#else
         esp_at_port_recv_data_notify(recv_len, portMAX_DELAY);
-        notify_len = recv_len;
+#endif
+
+        // recv_data stays valid until at_spi_read_data has read all of it
+        xSemaphoreTake(spi_rx_consumed, portMAX_DELAY);
     }
-    
+
+    vTaskDelete(NULL);
 }
 
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+static at_tx_coalesce_t spi_tx_coalesce;
+
+static int32_t at_spi_coalesce_write_data(uint8_t* data, int32_t len)
+{
+    return at_tx_coalesce_write(&spi_tx_coalesce, data, len);
+}
+
+static bool at_spi_coalesce_wait_write_complete(int32_t timeout_msec)
+{
+    TickType_t start = xTaskGetTickCount();
+    int32_t elapsed_msec = 0;
+
+    if (!at_tx_coalesce_flush(&spi_tx_coalesce, timeout_msec)) {
+        return false;
+    }
+    if (timeout_msec < 0) {
+        return at_spi_wait_write_complete(timeout_msec);
+    }
+
+    elapsed_msec = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+    return at_spi_wait_write_complete((elapsed_msec < timeout_msec) ? (timeout_msec - elapsed_msec) : 0);
+}
+#endif
+
 void at_interface_init(void)
 {
     esp_at_device_ops_struct esp_at_device_ops = {
         .read_data = at_spi_read_data,
         .write_data = at_spi_write_data,
         .get_data_length = at_spi_get_data_length,
-        .wait_write_complete = NULL
-
+        .wait_write_complete = at_spi_wait_write_complete
     };
-    
+
+    spi_tx_stream_buf = xStreamBufferCreate(AT_WRITE_STREAM_BUFFER_SIZE, 1);
+    spi_tx_write_mutex = xSemaphoreCreateMutex();
+    spi_rx_consumed = xSemaphoreCreateBinary();
+    spi_tx_pool_free = xSemaphoreCreateCounting(SPI_TX_POOL_NUM, SPI_TX_POOL_NUM);
+    spi_tx_event = xEventGroupCreate();
+    if (!spi_tx_stream_buf || !spi_tx_write_mutex || !spi_rx_consumed || !spi_tx_pool_free || !spi_tx_event) {
+        ESP_LOGE(TAG, "create stream buffer or semaphore error\r\n");
+        return;
+    }
+
+    for (int i = 0; i < SPI_TX_POOL_NUM; i++) {
+        spi_tx_pool[i] = heap_caps_malloc(SPI_DMA_MAX_LEN, MALLOC_CAP_DMA);
+        if (!spi_tx_pool[i]) {
+            ESP_LOGE(TAG, "malloc TX bounce buffer error\r\n");
+            return;
+        }
+    }
+
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+    if (at_tx_coalesce_init(&spi_tx_coalesce, "hspi", at_spi_write_data, CONFIG_AT_TX_COALESCE_HIGH_WATER, CONFIG_AT_TX_COALESCE_DEADLINE_US) == ESP_OK) {
+        esp_at_device_ops.write_data = at_spi_coalesce_write_data;
+        esp_at_device_ops.wait_write_complete = at_spi_coalesce_wait_write_complete;
+    }
+#endif
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    spi_transport_id = at_transport_register("hspi", &esp_at_device_ops, NULL, AT_TRANSPORT_RANK_HSPI);
+    at_transport_interface_init();
+#else
     esp_at_device_ops_regist(&esp_at_device_ops);
+#endif
 }
 
 void at_custom_init(void)
 {
     xTaskCreate(at_spi_slave_task , "at_spi_task" , 4096 , NULL , 10 , NULL);
+
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+    at_tx_coalesce_custom_init();
+#endif
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_transport_custom_init();
+#endif
 }
 #endif
 #endif
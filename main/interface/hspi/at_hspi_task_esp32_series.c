@@ -35,10 +35,14 @@
 
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 #ifdef CONFIG_AT_BASE_ON_HSPI
 #include "driver/gpio.h"
 #include "driver/spi_slave_hd.h"
+#include "at_tx_coalesce.h"
+#include "at_transport_mux.h"
 
 static const char* TAG = "HSPI-AT";
 #define SPI_SLAVE_HANDSHARK_GPIO    CONFIG_SPI_HANDSHAKE_PIN
@@ -59,8 +63,22 @@ static const char* TAG = "HSPI-AT";
 
 #define SPI_DMA_MAX_LEN             4092
 #define SPI_WRITE_STREAM_BUFFER     CONFIG_TX_STREAM_BUFFER_SIZE
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+// a flush larger than the stream buffer would be rejected by at_spi_write_data()
+#define SPI_TX_COALESCE_HIGH_WATER  ((CONFIG_AT_TX_COALESCE_HIGH_WATER < SPI_WRITE_STREAM_BUFFER) ? CONFIG_AT_TX_COALESCE_HIGH_WATER : SPI_WRITE_STREAM_BUFFER)
+#endif
 #define SPI_READ_STREAM_BUFFER      CONFIG_RX_STREAM_BUFFER_SIZE
 #define SLAVE_CONFIG_ADDR           4
+#define SPI_RX_SEGMENT_NUM          CONFIG_SPI_RX_SEGMENT_NUM
+#define SPI_TX_SEGMENT_NUM          CONFIG_SPI_TX_SEGMENT_NUM
+
+#ifdef CONFIG_SPI_WINDOW_MODE
+#define SLAVE_WINDOW_ADDR           8
+#define SLAVE_WINDOW_INFO_ADDR      12
+#define SPI_WINDOW_MAGIC            0xC5
+#define SPI_SEGMENT_MAGIC           0xFD
+#define SPI_SEGMENT_HEADER_LEN      sizeof(spi_wr_status_opt_t)
+#endif
 
 typedef enum {
     SPI_NULL = 0,
@@ -84,6 +102,22 @@ typedef struct {
     uint32_t     send_len : 16;
 } spi_wr_status_opt_t;
 
+#ifdef CONFIG_SPI_WINDOW_MODE
+// RX window, kept in a single word so that the master never reads it half updated
+typedef struct {
+    uint32_t     ack_seq    : 8;    // last segment accepted in order
+    uint32_t     nack_count : 8;    // bumped on a missing or corrupt segment, the master resends from ack_seq + 1
+    uint32_t     recv_count : 8;    // segments completed by the driver
+    uint32_t     load_count : 8;    // segments loaded to the driver, the master writes only while it is behind this
+} spi_rx_window_opt_t;
+
+typedef struct {
+    uint32_t     magic    : 8;      // SPI_WINDOW_MAGIC
+    uint32_t     window   : 8;      // SPI_RX_SEGMENT_NUM
+    uint32_t     reserved : 16;
+} spi_rx_window_info_t;
+#endif
+
 static uint8_t spi_slave_send_seq_num = 0;
 static uint8_t spi_slave_recv_seq_num = 0;
 
@@ -92,11 +126,35 @@ static StreamBufferHandle_t spi_slave_tx_ring_buf = NULL;
 static xQueueHandle msg_queue;
 static uint8_t initiative_send_flag = 0;
 static uint32_t notify_len = 0;
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+static int spi_transport_id = -1;
+#endif
 
 static bool send_queue_error_flag = false;
 
 static xSemaphoreHandle pxMutex;
 
+// RX segments stay queued in the driver, the master always writes into a loaded DMA buffer
+static spi_slave_hd_data_t spi_rx_trans[SPI_RX_SEGMENT_NUM];
+#ifdef CONFIG_SPI_WINDOW_MODE
+static spi_rx_window_opt_t spi_rx_window;
+static bool spi_rx_gap = false;             // a gap is reported and the master has not resent the missing segment yet
+static portMUX_TYPE spi_window_lock = portMUX_INITIALIZER_UNLOCKED;
+#else
+static xSemaphoreHandle spi_rx_credit;      // RX segments loaded in the driver and not yet offered to the master
+static xSemaphoreHandle spi_rx_done;        // the master has finished writing one segment
+#endif
+
+// TX segments, the next one is filled while the master reads the current one
+static uint8_t* spi_tx_buf[SPI_TX_SEGMENT_NUM];
+static uint32_t spi_tx_index = 0;
+static uint32_t spi_tx_staged_len = 0;
+
+#ifdef CONFIG_SPI_THROUGHPUT_REPORT
+static uint32_t spi_rx_bytes = 0;
+static uint32_t spi_tx_bytes = 0;
+#endif
+
 void spi_mutex_lock(void)
 {
     while (xSemaphoreTake(pxMutex, portMAX_DELAY) != pdPASS);
@@ -121,6 +179,23 @@ bool cb_master_write_buffer(void* arg, spi_slave_hd_event_t* event, BaseType_t*
     return true;
 }
 
+#ifdef CONFIG_SPI_WINDOW_MODE
+static void at_spi_window_publish(void)
+{
+    spi_slave_hd_write_buffer(SLAVE_HOST, SLAVE_WINDOW_ADDR, (uint8_t*)&spi_rx_window, sizeof(spi_rx_window_opt_t));
+}
+
+// count the segment as soon as the driver completes it, so the master can tell a lost write from a slow delivery
+bool cb_master_write_dma(void* arg, spi_slave_hd_event_t* event, BaseType_t* awoken)
+{
+    portENTER_CRITICAL_ISR(&spi_window_lock);
+    spi_rx_window.recv_count++;
+    at_spi_window_publish();
+    portEXIT_CRITICAL_ISR(&spi_window_lock);
+    return true;
+}
+#endif
+
 inline static void write_transmit_len(spi_mode_t spi_mode, uint16_t transmit_len)
 {
     ESP_EARLY_LOGV(TAG, "write rd status: %d, %d", (uint32_t)spi_mode, transmit_len);
@@ -211,86 +286,201 @@ int32_t at_spi_get_data_length(void)
     return notify_len;
 }
 
+#ifdef CONFIG_SPI_THROUGHPUT_REPORT
+static void at_spi_throughput_report(void* arg)
+{
+    static int64_t last_us = 0;
+    int64_t now_us = esp_timer_get_time();
+    uint32_t rx_bytes = spi_rx_bytes;
+    uint32_t tx_bytes = spi_tx_bytes;
+
+    spi_rx_bytes = 0;
+    spi_tx_bytes = 0;
+
+    if (last_us != 0 && now_us > last_us) {
+        ESP_LOGI(TAG, "master->slave: %.3f MB/s, slave->master: %.3f MB/s",
+            (double)rx_bytes / (now_us - last_us), (double)tx_bytes / (now_us - last_us));
+    }
+    last_us = now_us;
+}
+#endif
+
+#ifdef CONFIG_SPI_WINDOW_MODE
+// check the segment header and sequence number, return the payload length to deliver, 0 to drop the segment
+static int32_t at_spi_segment_check(spi_slave_hd_data_t* trans, uint8_t** data)
+{
+    spi_wr_status_opt_t header;
+    uint8_t expect_seq = spi_rx_window.ack_seq + 1;
+    int32_t len = 0;
+
+    memcpy(&header, trans->data, SPI_SEGMENT_HEADER_LEN);
+    *data = trans->data + SPI_SEGMENT_HEADER_LEN;
+
+    portENTER_CRITICAL(&spi_window_lock);
+    if (trans->trans_len <= SPI_SEGMENT_HEADER_LEN || header.magic != SPI_SEGMENT_MAGIC
+            || header.send_len != trans->trans_len - SPI_SEGMENT_HEADER_LEN) {
+        // a lost WR_END merges two segments, always ask for a resend
+        spi_rx_gap = true;
+        spi_rx_window.nack_count++;
+    } else if (header.send_seq == expect_seq) {
+        spi_rx_gap = false;
+        spi_rx_window.ack_seq = expect_seq;
+        len = header.send_len;
+    } else if ((int8_t)(header.send_seq - expect_seq) > 0 && !spi_rx_gap) {
+        // the segments after a gap are dropped until the master goes back, report the gap only once
+        spi_rx_gap = true;
+        spi_rx_window.nack_count++;
+    }
+    at_spi_window_publish();
+    portEXIT_CRITICAL(&spi_window_lock);
+
+    if (len == 0) {
+        ESP_LOGW(TAG, "Drop segment, len: %d, magic: %x, seq: %d, expect: %d",
+            trans->trans_len, header.magic, header.send_seq, expect_seq);
+    }
+    return len;
+}
+#else
+static int32_t at_spi_segment_check(spi_slave_hd_data_t* trans, uint8_t** data)
+{
+    if (trans->trans_len > SPI_READ_STREAM_BUFFER || trans->trans_len <= 0) {
+        ESP_LOGE(TAG, "Recv error len: %d, %x", trans->trans_len, trans->data[0]);
+        return 0;
+    }
+    *data = trans->data;
+    return trans->trans_len;
+}
+#endif
+
+// deliver the segments written by the master to the AT core, and load the buffers back to the driver
+static void at_spi_rx_task(void* pvParameters)
+{
+    spi_slave_hd_data_t* ret_trans = NULL;
+    uint8_t* data = NULL;
+    int32_t len = 0;
+
+    while (1) {
+        ESP_ERROR_CHECK(spi_slave_hd_get_trans_res(SLAVE_HOST, SPI_SLAVE_CHAN_RX, &ret_trans, portMAX_DELAY));
+#ifndef CONFIG_SPI_WINDOW_MODE
+        // the bus is free again, the next request can be served while this segment is delivered
+        xSemaphoreGive(spi_rx_done);
+#endif
+
+        len = at_spi_segment_check(ret_trans, &data);
+        if (len > 0) {
+            xStreamBufferSend(spi_slave_rx_ring_buf, (void*) data, len, portMAX_DELAY);
+            // notify length to AT core
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+            at_transport_recv_data_notify(spi_transport_id, len, portMAX_DELAY);
+#else
+            esp_at_port_recv_data_notify(len, portMAX_DELAY);
+#endif
+            notify_len = len;
+#ifdef CONFIG_SPI_THROUGHPUT_REPORT
+            spi_rx_bytes += len;
+#endif
+        }
+
+        ret_trans->len = SPI_DMA_MAX_LEN;
+        ESP_ERROR_CHECK(spi_slave_hd_queue_trans(SLAVE_HOST, SPI_SLAVE_CHAN_RX, ret_trans, portMAX_DELAY));
+#ifdef CONFIG_SPI_WINDOW_MODE
+        portENTER_CRITICAL(&spi_window_lock);
+        spi_rx_window.load_count++;
+        at_spi_window_publish();
+        portEXIT_CRITICAL(&spi_window_lock);
+#else
+        xSemaphoreGive(spi_rx_credit);
+#endif
+    }
+
+    vTaskDelete(NULL);
+}
+
+// copy the next TX segment out of the stream buffer, return its length
+static uint32_t at_spi_tx_stage(uint8_t* buf)
+{
+    uint32_t remain_len = xStreamBufferBytesAvailable(spi_slave_tx_ring_buf);
+
+    if (remain_len == 0) {
+        return 0;
+    }
+
+    remain_len = remain_len > SPI_DMA_MAX_LEN ? SPI_DMA_MAX_LEN : remain_len;
+    return xStreamBufferReceive(spi_slave_tx_ring_buf, (void*) buf, remain_len, 0);
+}
+
 static void at_spi_slave_task(void* pvParameters)
 {
     spi_slave_hd_data_t slave_trans;
     spi_slave_hd_data_t* ret_trans;
     spi_msg_t trans_msg = {0};
+    uint8_t* send_buf = NULL;
     uint32_t send_len = 0;
-    uint32_t tmp_send_len = 0;
-    uint32_t remain_len = 0;
-
-    uint8_t* data_buf = (uint8_t*)malloc(SPI_DMA_MAX_LEN * sizeof(uint8_t));
-    if (data_buf == NULL) {
-        ESP_LOGE(TAG, "malloc fail");
-        return;
-    }
 
     while (1) {
-        memset(data_buf, 0x0, SPI_DMA_MAX_LEN);
-        memset(&trans_msg, 0x0, sizeof(spi_msg_t));
-
         xQueueReceive(msg_queue, (void*)&trans_msg, (portTickType)portMAX_DELAY);
         ESP_LOGD(TAG, "Direct: %d", trans_msg.direct);
+#ifndef CONFIG_SPI_WINDOW_MODE
         if (trans_msg.direct == SPI_SLAVE_RD) {    // master -> slave
-
-            // Tell master transmit mode is master send
-            write_transmit_len(SPI_SLAVE_RD, SPI_DMA_MAX_LEN); 
+            // wait until a loaded RX segment is free to be offered
+            xSemaphoreTake(spi_rx_credit, portMAX_DELAY);
 
             gpio_set_level(SPI_SLAVE_HANDSHARK_GPIO, 0);
-            
-            memset(&slave_trans, 0x0, sizeof(spi_slave_hd_data_t));
-            slave_trans.data = data_buf;
-            slave_trans.len = SPI_DMA_MAX_LEN;
-            ESP_ERROR_CHECK(spi_slave_hd_queue_trans(SLAVE_HOST, SPI_SLAVE_CHAN_RX, &slave_trans, portMAX_DELAY));
 
-            gpio_set_level(SPI_SLAVE_HANDSHARK_GPIO, 1); // it means slave has recv done, notify master to do next translation
+            // Tell master transmit mode is master send
+            write_transmit_len(SPI_SLAVE_RD, SPI_DMA_MAX_LEN);
 
-            ESP_ERROR_CHECK(spi_slave_hd_get_trans_res(SLAVE_HOST, SPI_SLAVE_CHAN_RX, &ret_trans, portMAX_DELAY));
-            if (ret_trans->trans_len > SPI_READ_STREAM_BUFFER || ret_trans->trans_len <= 0) {
-                ESP_LOGE(TAG, "Recv error len: %d, %d, %x\n", ret_trans->trans_len, slave_trans.len, data_buf[0]);
-                break;
-            }
+            gpio_set_level(SPI_SLAVE_HANDSHARK_GPIO, 1); // the DMA buffer is already loaded, notify master to send
 
-            xStreamBufferSend(spi_slave_rx_ring_buf, (void*) data_buf, ret_trans->trans_len, portMAX_DELAY);
-            // notify length to AT core
-            esp_at_port_recv_data_notify(ret_trans->trans_len, portMAX_DELAY);
-            notify_len = ret_trans->trans_len;
+            xSemaphoreTake(spi_rx_done, portMAX_DELAY);
 
-        } else if (trans_msg.direct == SPI_SLAVE_WR) {     // slave -> master
-            remain_len = xStreamBufferBytesAvailable(spi_slave_tx_ring_buf);
-            if (remain_len > 0){
-                send_len = remain_len > SPI_DMA_MAX_LEN ? SPI_DMA_MAX_LEN : remain_len;
-                write_transmit_len(SPI_SLAVE_WR, send_len);
+        } else
+#endif
+        if (trans_msg.direct == SPI_SLAVE_WR) {     // slave -> master
+            if (spi_tx_staged_len == 0) {
+                spi_tx_staged_len = at_spi_tx_stage(spi_tx_buf[spi_tx_index]);
+            }
 
-            } else {
+            if (spi_tx_staged_len == 0) {
                 ESP_LOGD(TAG, "Receive send queue but no data");
+                spi_mutex_lock();
                 initiative_send_flag = 0;
+                spi_mutex_unlock();
                 continue;
             }
 
-            gpio_set_level(SPI_SLAVE_HANDSHARK_GPIO, 0);
-            tmp_send_len = xStreamBufferReceive(spi_slave_tx_ring_buf, (void*) data_buf, send_len, 0);
+            send_buf = spi_tx_buf[spi_tx_index];
+            send_len = spi_tx_staged_len;
+            spi_tx_index = (spi_tx_index + 1) % SPI_TX_SEGMENT_NUM;
+            spi_tx_staged_len = 0;
 
-            if (send_len != tmp_send_len) {
-                ESP_LOGE(TAG, "Read len expect %d, but actual read %d", send_len, tmp_send_len);
-                break;
-            }
+            write_transmit_len(SPI_SLAVE_WR, send_len);
+
+            gpio_set_level(SPI_SLAVE_HANDSHARK_GPIO, 0);
             memset(&slave_trans, 0x0, sizeof(spi_slave_hd_data_t));
-            slave_trans.data = (uint8_t*)data_buf;
+            slave_trans.data = send_buf;
             slave_trans.len = send_len;
             ESP_ERROR_CHECK(spi_slave_hd_queue_trans(SLAVE_HOST, SPI_SLAVE_CHAN_TX, &slave_trans, portMAX_DELAY));
             gpio_set_level(SPI_SLAVE_HANDSHARK_GPIO, 1); // it means slave send done and notify master to recv
+
+            // fill the next segment while the master reads this one
+            if (SPI_TX_SEGMENT_NUM > 1) {
+                spi_tx_staged_len = at_spi_tx_stage(spi_tx_buf[spi_tx_index]);
+            }
+
             ESP_ERROR_CHECK(spi_slave_hd_get_trans_res(SLAVE_HOST, SPI_SLAVE_CHAN_TX, &ret_trans, portMAX_DELAY));
+#ifdef CONFIG_SPI_THROUGHPUT_REPORT
+            spi_tx_bytes += send_len;
+#endif
 
             spi_mutex_lock();
-            remain_len = xStreamBufferBytesAvailable(spi_slave_tx_ring_buf);
-            if (remain_len > 0){
+            if (spi_tx_staged_len > 0 || xStreamBufferBytesAvailable(spi_slave_tx_ring_buf) > 0) {
                 spi_msg_t spi_msg = {
                     .direct = SPI_SLAVE_WR,
                 };
                 if (xQueueSend(msg_queue, (void*)&spi_msg, 0) != pdPASS) {
                     ESP_LOGE(TAG, "send WR queue error");
+                    spi_mutex_unlock();
                     break;
                 }
             } else {
@@ -304,10 +494,51 @@ static void at_spi_slave_task(void* pvParameters)
         }
     }
 
-    free(data_buf);
     vTaskDelete(NULL);
 }
 
+static esp_err_t at_spi_segment_init(void)
+{
+    for (int loop = 0; loop < SPI_TX_SEGMENT_NUM; loop++) {
+        spi_tx_buf[loop] = (uint8_t*)heap_caps_malloc(SPI_DMA_MAX_LEN, MALLOC_CAP_DMA);
+        if (spi_tx_buf[loop] == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+#ifndef CONFIG_SPI_WINDOW_MODE
+    spi_rx_credit = xSemaphoreCreateCounting(SPI_RX_SEGMENT_NUM, SPI_RX_SEGMENT_NUM);
+    spi_rx_done = xSemaphoreCreateBinary();
+    if (spi_rx_credit == NULL || spi_rx_done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+    for (int loop = 0; loop < SPI_RX_SEGMENT_NUM; loop++) {
+        spi_rx_trans[loop].data = (uint8_t*)heap_caps_malloc(SPI_DMA_MAX_LEN, MALLOC_CAP_DMA);
+        if (spi_rx_trans[loop].data == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        spi_rx_trans[loop].len = SPI_DMA_MAX_LEN;
+        ESP_ERROR_CHECK(spi_slave_hd_queue_trans(SLAVE_HOST, SPI_SLAVE_CHAN_RX, &spi_rx_trans[loop], portMAX_DELAY));
+    }
+
+#ifdef CONFIG_SPI_WINDOW_MODE
+    spi_rx_window_info_t window_info = {
+        .magic = SPI_WINDOW_MAGIC,
+        .window = SPI_RX_SEGMENT_NUM,
+    };
+    spi_slave_hd_write_buffer(SLAVE_HOST, SLAVE_WINDOW_INFO_ADDR, (uint8_t*)&window_info, sizeof(spi_rx_window_info_t));
+
+    portENTER_CRITICAL(&spi_window_lock);
+    spi_rx_window.load_count += SPI_RX_SEGMENT_NUM;
+    at_spi_window_publish();
+    portEXIT_CRITICAL(&spi_window_lock);
+#endif
+
+    return ESP_OK;
+}
+
 void spi_bus_default_config(spi_bus_config_t* bus_cfg)
 {
     bus_cfg->mosi_io_num = GPIO_MOSI;
@@ -336,12 +567,18 @@ void spi_slot_default_config(spi_slave_hd_slot_config_t* slave_hd_cfg)
     slave_hd_cfg->command_bits = 8;
     slave_hd_cfg->address_bits = 8;
     slave_hd_cfg->dummy_bits = 8;
-    slave_hd_cfg->queue_size = 4;
+    slave_hd_cfg->queue_size = SPI_RX_SEGMENT_NUM > 4 ? SPI_RX_SEGMENT_NUM : 4;
     slave_hd_cfg->dma_chan = SPI_DMA_CH_AUTO;
 
+#ifdef CONFIG_SPI_WINDOW_MODE
+    // the master writes segments on credit, no request through the shared buffer
+    slave_hd_cfg->cb_config.cb_buffer_rx = NULL;
+    slave_hd_cfg->cb_config.cb_recv = cb_master_write_dma;
+#else
     // master writes to shared buffer
     slave_hd_cfg->cb_config.cb_buffer_rx = cb_master_write_buffer;
     slave_hd_cfg->cb_config.cb_recv = NULL;
+#endif
 }
 
 static void init_slave_hd(void)
@@ -355,6 +592,36 @@ static void init_slave_hd(void)
     ESP_ERROR_CHECK(spi_slave_hd_init(SLAVE_HOST, &bus_cfg, &slave_hd_cfg));
 }
 
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+static at_tx_coalesce_t spi_tx_coalesce;
+
+static int32_t at_spi_coalesce_write_data(uint8_t* data, int32_t len)
+{
+    return at_tx_coalesce_write(&spi_tx_coalesce, data, len);
+}
+
+static bool at_spi_coalesce_wait_write_complete(int32_t timeout_msec)
+{
+    TickType_t start = xTaskGetTickCount();
+    int32_t elapsed_msec = 0;
+
+    // the flush blocks until the stream buffer has room, so wait for the room here to keep the timeout
+    while (xStreamBufferSpacesAvailable(spi_slave_tx_ring_buf) < at_tx_coalesce_pending(&spi_tx_coalesce)) {
+        elapsed_msec = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+        if (timeout_msec >= 0 && elapsed_msec >= timeout_msec) {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+
+    if (timeout_msec < 0) {
+        return at_tx_coalesce_flush(&spi_tx_coalesce, timeout_msec);
+    }
+    elapsed_msec = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+    return at_tx_coalesce_flush(&spi_tx_coalesce, (elapsed_msec < timeout_msec) ? (timeout_msec - elapsed_msec) : 0);
+}
+#endif
+
 void at_interface_init(void)
 {
     esp_at_device_ops_struct esp_at_device_ops = {
@@ -365,7 +632,19 @@ void at_interface_init(void)
 
     };
     
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+    if (at_tx_coalesce_init(&spi_tx_coalesce, "hspi", at_spi_write_data, SPI_TX_COALESCE_HIGH_WATER, CONFIG_AT_TX_COALESCE_DEADLINE_US) == ESP_OK) {
+        esp_at_device_ops.write_data = at_spi_coalesce_write_data;
+        esp_at_device_ops.wait_write_complete = at_spi_coalesce_wait_write_complete;
+    }
+#endif
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    spi_transport_id = at_transport_register("hspi", &esp_at_device_ops, NULL, AT_TRANSPORT_RANK_HSPI);
+    at_transport_interface_init();
+#else
     esp_at_device_ops_regist(&esp_at_device_ops);
+#endif
 }
 
 void at_custom_init(void)
@@ -393,12 +672,37 @@ void at_custom_init(void)
     // init slave driver
     init_slave_hd();
 
+    if (at_spi_segment_init() != ESP_OK) {
+        ESP_LOGE(TAG, "malloc fail");
+        return;
+    }
+
     msg_queue = xQueueCreate(10, sizeof(spi_msg_t));
     if (!msg_queue) {
         ESP_LOGE(TAG, "Semaphore create error");
         return;
     }
+    xTaskCreate(at_spi_rx_task , "at_spi_rx_task" , 4096 , NULL , 10 , NULL);
     xTaskCreate(at_spi_slave_task , "at_spi_task" , 4096 , NULL , 10 , NULL);
+
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+    at_tx_coalesce_custom_init();
+#endif
+
+#ifdef CONFIG_SPI_THROUGHPUT_REPORT
+    esp_timer_handle_t report_timer = NULL;
+    esp_timer_create_args_t report_timer_args = {
+        .callback = at_spi_throughput_report,
+        .name = "at_spi_report",
+    };
+    if (esp_timer_create(&report_timer_args, &report_timer) == ESP_OK) {
+        esp_timer_start_periodic(report_timer, CONFIG_SPI_THROUGHPUT_REPORT_INTERVAL * 1000000ULL);
+    }
+#endif
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_transport_custom_init();
+#endif
 }
 #endif
 #endif
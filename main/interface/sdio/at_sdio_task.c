@@ -35,7 +35,11 @@
 
 #include "esp_at.h"
 #include "esp_log.h"
+#include "at_interface.h"
+#include "at_tx_coalesce.h"
+#include "at_transport_mux.h"
 #include "esp_system.h"
+#include "esp_attr.h"
 
 #ifdef CONFIG_AT_BASE_ON_SDIO
 #include "driver/sdio_slave.h"
@@ -51,6 +55,18 @@
 #define ESP_AT_SDIO_BUFFER_NUM       CONFIG_AT_SDIO_BUFFER_NUM
 #define ESP_AT_SDIO_QUEUE_SIZE       CONFIG_AT_SDIO_QUEUE_SIZE
 
+#ifdef CONFIG_AT_SDIO_TRANSMIT_COALESCE_SUPPORT
+#define ESP_AT_SDIO_COALESCE_WINDOW_TICKS   ((CONFIG_AT_SDIO_TRANSMIT_COALESCE_WINDOW_MS + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS)
+#define ESP_AT_SDIO_COALESCE_MAX_LEN        CONFIG_AT_SDIO_TRANSMIT_COALESCE_MAX
+#endif
+
+// shared registers the host reads through function 1 to size its send tokens and CMD53 transfers
+#define ESP_AT_SDIO_REG_BUF_SIZE_L   0
+#define ESP_AT_SDIO_REG_BUF_SIZE_H   1
+#define ESP_AT_SDIO_REG_BUF_NUM      2
+#define ESP_AT_SDIO_REG_MAGIC        3
+#define ESP_AT_SDIO_CONF_MAGIC       0xA5
+
 #define container_of(ptr, type, member) ({      \
     const typeof( ((type *)0)->member ) *__mptr = (ptr);    \
     (type *)( (char *)__mptr - ((size_t) &((type *)0)->member));})
@@ -63,7 +79,8 @@ typedef struct sdio_list {
     uint32_t pos;
 } esp_at_sdio_list_t;
 
-#define ESP32_SDIO_DMA_SIZE 4092
+#define ESP_AT_SDIO_SEND_BUFFER_SIZE CONFIG_AT_SDIO_SEND_BUFFER_SIZE
+#define ESP_AT_SDIO_SEND_BUFFER_NUM  CONFIG_AT_SDIO_SEND_BUFFER_NUM
 
 static const char* TAG = "SDIO-AT";
 
@@ -71,6 +88,50 @@ static esp_at_sdio_list_t WORD_ALIGNED_ATTR sdio_buffer_list[ESP_AT_SDIO_BUFFER_
 static esp_at_sdio_list_t* pHead;
 static esp_at_sdio_list_t* pTail;
 static xSemaphoreHandle semahandle;
+// protects pHead/pTail, shared by the recv task and the AT core
+static portMUX_TYPE sdio_list_lock = portMUX_INITIALIZER_UNLOCKED;
+// receive buffers taken from the SDIO slave and not loaded back yet, and the receive statistics, guarded by sdio_list_lock
+static uint32_t sdio_recv_held;
+// every receive buffer was held at once, so the host ran out of send tokens and waits for TOHOST BIT0
+static bool sdio_recv_dry;
+static at_sdio_recv_stats_t sdio_recv_stats;
+static volatile bool sdio_transmit_mode;
+#ifdef CONFIG_AT_SDIO_TRANSMIT_COALESCE_SUPPORT
+// buffers received in transparent transmission and not notified yet, only used by the recv task
+static esp_at_sdio_list_t* sdio_chain_head;
+static esp_at_sdio_list_t* sdio_chain_tail;
+static uint32_t sdio_chain_len;
+static TickType_t sdio_chain_start;
+#endif
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+static int sdio_transport_id = -1;
+#endif
+
+// send buffers are owned either by the free list below or by the SDIO slave send queue, both guarded by semahandle
+static uint8_t WORD_ALIGNED_ATTR DMA_ATTR sdio_send_pool[ESP_AT_SDIO_SEND_BUFFER_NUM][ESP_AT_SDIO_SEND_BUFFER_SIZE];
+static uint8_t* sdio_send_free_buf[ESP_AT_SDIO_SEND_BUFFER_NUM];
+static uint32_t sdio_send_free_num;
+static at_sdio_send_stats_t sdio_send_stats;
+
+// Take a free send buffer, reclaim the finished ones first, block only when the pool is exhausted
+static uint8_t* at_sdio_send_buf_get(void)
+{
+    uint8_t* sendbuf = NULL;
+
+    while (sdio_slave_send_get_finished((void**)&sendbuf, 0) == ESP_OK) {
+        sdio_send_free_buf[sdio_send_free_num++] = sendbuf;
+    }
+
+    if (sdio_send_free_num == 0) {
+        sdio_send_stats.pool_exhausted++;
+        if (sdio_slave_send_get_finished((void**)&sendbuf, portMAX_DELAY) != ESP_OK) {
+            return NULL;
+        }
+        return sendbuf;
+    }
+
+    return sdio_send_free_buf[--sdio_send_free_num];
+}
 
 // AT response data , send them to SDIO
 static int32_t at_sdio_write_data(uint8_t* data, int32_t len)
@@ -85,37 +146,204 @@ static int32_t at_sdio_write_data(uint8_t* data, int32_t len)
     uint32_t len_remain = len;
     uint8_t* start_ptr = (uint8_t*)data;
 
-    do {
-        int len_to_send = len_remain > ESP32_SDIO_DMA_SIZE ? ESP32_SDIO_DMA_SIZE : len_remain;
-        sendbuf = heap_caps_malloc(len_to_send, MALLOC_CAP_DMA);
+    while (len_remain != 0) {
+        int len_to_send = len_remain > ESP_AT_SDIO_SEND_BUFFER_SIZE ? ESP_AT_SDIO_SEND_BUFFER_SIZE : len_remain;
+        sendbuf = at_sdio_send_buf_get();
         if (sendbuf == NULL) {
-            ESP_LOGE(TAG , "Malloc send buffer fail!");
+            ESP_LOGE(TAG , "Get send buffer fail!");
             xSemaphoreGive(semahandle);
-            return 0;
+            return -1;
         }
 
         memcpy(sendbuf, start_ptr, len_to_send);
 
-        ret = sdio_slave_transmit(sendbuf, len_to_send);
+        // the buffer comes back through sdio_slave_send_get_finished() once the host has read it
+        ret = sdio_slave_send_queue(sendbuf, len_to_send, sendbuf, portMAX_DELAY);
         if (ret != ESP_OK) {
-            ESP_LOGE(TAG , "sdio slave transmit error, return ret : 0x%x\r\n", ret);
-            free(sendbuf);
+            ESP_LOGE(TAG , "sdio slave send queue error, return ret : 0x%x\r\n", ret);
+            sdio_send_free_buf[sdio_send_free_num++] = sendbuf;
             xSemaphoreGive(semahandle);
-            return 0;
+            return -1;
         }
 
-        free(sendbuf);
+        sdio_send_stats.sent_packets++;
         start_ptr += len_to_send;
         len_remain -= len_to_send;
-    } while (len_remain != 0);
+    }
     xSemaphoreGive(semahandle);
 
     return len;
 }
 
+// timeout_msec bounds the whole wait, not each in-flight buffer; negative waits forever
+static bool at_sdio_wait_write_complete(int32_t timeout_msec)
+{
+    uint8_t* sendbuf = NULL;
+    bool ret = true;
+    TickType_t timeout_ticks = (timeout_msec < 0) ? portMAX_DELAY : (TickType_t)(timeout_msec / portTICK_PERIOD_MS);
+    TickType_t start = xTaskGetTickCount();
+    TickType_t wait_ticks = timeout_ticks;
+
+    xSemaphoreTake(semahandle, portMAX_DELAY);
+    while (sdio_send_free_num < ESP_AT_SDIO_SEND_BUFFER_NUM) {
+        if (timeout_ticks != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            wait_ticks = (elapsed < timeout_ticks) ? (timeout_ticks - elapsed) : 0;
+        }
+        if (sdio_slave_send_get_finished((void**)&sendbuf, wait_ticks) != ESP_OK) {
+            ret = false;
+            break;
+        }
+        sdio_send_free_buf[sdio_send_free_num++] = sendbuf;
+    }
+    xSemaphoreGive(semahandle);
+
+    return ret;
+}
+
+void at_sdio_get_send_stats(at_sdio_send_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(semahandle, portMAX_DELAY);
+    stats->sent_packets = sdio_send_stats.sent_packets;
+    stats->pool_exhausted = sdio_send_stats.pool_exhausted;
+    stats->in_flight = ESP_AT_SDIO_SEND_BUFFER_NUM - sdio_send_free_num;
+    xSemaphoreGive(semahandle);
+}
+
+void at_sdio_get_recv_stats(at_sdio_recv_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&sdio_list_lock);
+    *stats = sdio_recv_stats;
+    portEXIT_CRITICAL(&sdio_list_lock);
+}
+
+static uint8_t at_queryCmdSdioStat(uint8_t* cmd_name)
+{
+    at_sdio_send_stats_t send_stats;
+    at_sdio_recv_stats_t recv_stats;
+    uint8_t buffer[128];
+
+    at_sdio_get_send_stats(&send_stats);
+    at_sdio_get_recv_stats(&recv_stats);
+
+    snprintf((char*)buffer, sizeof(buffer) - 1, "%s:%u,%u,%u,%u,%u,%u\r\n", cmd_name, send_stats.sent_packets,
+             send_stats.pool_exhausted, send_stats.in_flight, recv_stats.recv_buffers, recv_stats.recv_bytes,
+             recv_stats.notifies);
+    esp_at_port_write_data(buffer, strlen((char*)buffer));
+
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+// AT+SDIO_STAT=0 clears the counters
+static uint8_t at_setupCmdSdioStat(uint8_t para_num)
+{
+    int32_t value = 0;
+
+    if (para_num != 1) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    if (esp_at_get_para_as_digit(0, &value) != ESP_AT_PARA_PARSE_RESULT_OK) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+    if (value != 0) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    xSemaphoreTake(semahandle, portMAX_DELAY);
+    sdio_send_stats.sent_packets = 0;
+    sdio_send_stats.pool_exhausted = 0;
+    xSemaphoreGive(semahandle);
+
+    portENTER_CRITICAL(&sdio_list_lock);
+    memset(&sdio_recv_stats, 0x0, sizeof(sdio_recv_stats));
+    portEXIT_CRITICAL(&sdio_list_lock);
+
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+static esp_at_cmd_struct at_sdio_cmd[] = {
+    {"+SDIO_STAT", NULL, at_queryCmdSdioStat, at_setupCmdSdioStat, NULL},
+};
+
+int32_t at_sdio_recv_borrow(uint8_t** data)
+{
+    esp_at_sdio_list_t* p_list = NULL;
+
+    if (data == NULL) {
+        return -1;
+    }
+
+    portENTER_CRITICAL(&sdio_list_lock);
+    p_list = pHead;
+    portEXIT_CRITICAL(&sdio_list_lock);
+
+    if (p_list == NULL) {
+        *data = NULL;
+        return 0;
+    }
+
+    *data = p_list->pbuf + p_list->pos;
+    return p_list->left_len;
+}
+
+int32_t at_sdio_recv_return(uint32_t consumed)
+{
+    esp_at_sdio_list_t* p_list = NULL;
+
+    portENTER_CRITICAL(&sdio_list_lock);
+    p_list = pHead;
+    portEXIT_CRITICAL(&sdio_list_lock);
+
+    if (p_list == NULL || consumed > p_list->left_len) {
+        ESP_LOGE(TAG , "Return error, consumed:%d", consumed);
+        return -1;
+    }
+
+    p_list->pos += consumed;
+    p_list->left_len -= consumed;
+
+    if (p_list->left_len == 0) {
+        bool was_dry = false;
+
+        portENTER_CRITICAL(&sdio_list_lock);
+        pHead = p_list->next;
+        p_list->next = NULL;
+        sdio_recv_held--;
+        was_dry = sdio_recv_dry;
+        sdio_recv_dry = false;
+
+        if (!pHead) {
+            pTail = NULL;
+        }
+        portEXIT_CRITICAL(&sdio_list_lock);
+
+        // give the DMA buffer back to the host
+        sdio_slave_recv_load_buf(p_list->handle);
+
+        // the host has a send token again, wake it up instead of letting it poll
+        if (was_dry) {
+            sdio_slave_send_host_int(0);
+        }
+    }
+
+    return consumed;
+}
+
 static int32_t at_sdio_read_data(uint8_t* data, int32_t len)
 {
     uint32_t copy_len = 0;
+    uint8_t* ptr = NULL;
+    int32_t chunk_len = 0;
+
     if (data == NULL || len < 0) {
         ESP_LOGI(TAG , "Cannot get read data address.");
         return -1;
@@ -126,39 +354,19 @@ static int32_t at_sdio_read_data(uint8_t* data, int32_t len)
         return 0;
     }
 
-    if (pHead == NULL) {
-        return 0;
-    }
-
     while (copy_len < len) {
-        if (!pHead) {
+        chunk_len = at_sdio_recv_borrow(&ptr);
+        if (chunk_len <= 0) {
             break;
         }
 
-        esp_at_sdio_list_t* p_list = pHead;
-
-        if (len < p_list->left_len) {
-            memcpy(data + copy_len, p_list->pbuf + p_list->pos, len);
-            p_list->pos += len;
-            p_list->left_len -= len;
-            copy_len += len;
-        } else {
-            memcpy(data + copy_len, p_list->pbuf + p_list->pos, p_list->left_len);
-            p_list->pos += p_list->left_len;
-            copy_len += p_list->left_len;
-            p_list->left_len = 0;
-            xSemaphoreTake(semahandle, portMAX_DELAY);
-            pHead = p_list->next;
-            p_list->next = NULL;
-
-            if (!pHead) {
-                pTail = NULL;
-            }
-
-            xSemaphoreGive(semahandle);
-
-            sdio_slave_recv_load_buf(p_list->handle);
+        if (chunk_len > len - copy_len) {
+            chunk_len = len - copy_len;
         }
+
+        memcpy(data + copy_len, ptr, chunk_len);
+        at_sdio_recv_return(chunk_len);
+        copy_len += chunk_len;
     }
 
     return copy_len;
@@ -174,6 +382,11 @@ static void esp_at_sdio_slave_init()
     sdio_slave_buf_handle_t handle;
 
     semahandle = xSemaphoreCreateMutex();
+
+    for (int loop = 0; loop < ESP_AT_SDIO_SEND_BUFFER_NUM; loop++) {
+        sdio_send_free_buf[loop] = sdio_send_pool[loop];
+    }
+    sdio_send_free_num = ESP_AT_SDIO_SEND_BUFFER_NUM;
     esp_err_t ret = sdio_slave_initialize(&config);
     assert(ret == ESP_OK);
 
@@ -187,51 +400,194 @@ static void esp_at_sdio_slave_init()
 
     sdio_slave_set_host_intena(SDIO_SLAVE_HOSTINT_SEND_NEW_PACKET | SDIO_SLAVE_HOSTINT_BIT0);
 
+    sdio_slave_write_reg(ESP_AT_SDIO_REG_BUF_SIZE_L, ESP_AT_SDIO_BUFFER_SIZE & 0xFF);
+    sdio_slave_write_reg(ESP_AT_SDIO_REG_BUF_SIZE_H, (ESP_AT_SDIO_BUFFER_SIZE >> 8) & 0xFF);
+    sdio_slave_write_reg(ESP_AT_SDIO_REG_BUF_NUM, ESP_AT_SDIO_BUFFER_NUM > 0xFF ? 0xFF : ESP_AT_SDIO_BUFFER_NUM);
+    sdio_slave_write_reg(ESP_AT_SDIO_REG_MAGIC, ESP_AT_SDIO_CONF_MAGIC);
+
     sdio_slave_start();
 
     ESP_LOGI(TAG, "slave ready");
 }
 
+// Append a chain of receive buffers to the list read by the AT core, and notify their length with one call
+static void at_sdio_recv_publish(esp_at_sdio_list_t* head, esp_at_sdio_list_t* tail, uint32_t length)
+{
+    portENTER_CRITICAL(&sdio_list_lock);
+
+    if (!pTail) {
+        pHead = head;
+    } else {
+        pTail->next = head;
+    }
+    pTail = tail;
+    sdio_recv_stats.notifies++;
+
+    portEXIT_CRITICAL(&sdio_list_lock);
+
+    // notify length to AT core
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_transport_recv_data_notify(sdio_transport_id, length, portMAX_DELAY);
+#else
+    esp_at_port_recv_data_notify(length, portMAX_DELAY);
+#endif
+}
+
+#ifdef CONFIG_AT_SDIO_TRANSMIT_COALESCE_SUPPORT
+static void at_sdio_recv_chain_flush(void)
+{
+    if (sdio_chain_head == NULL) {
+        return;
+    }
+
+    at_sdio_recv_publish(sdio_chain_head, sdio_chain_tail, sdio_chain_len);
+    sdio_chain_head = NULL;
+    sdio_chain_tail = NULL;
+    sdio_chain_len = 0;
+}
+
+// Ticks left before the chained buffers must be notified, portMAX_DELAY if nothing is chained
+static TickType_t at_sdio_recv_chain_wait(void)
+{
+    TickType_t elapsed = 0;
+
+    if (sdio_chain_head == NULL) {
+        return portMAX_DELAY;
+    }
+
+    elapsed = xTaskGetTickCount() - sdio_chain_start;
+    return (elapsed < ESP_AT_SDIO_COALESCE_WINDOW_TICKS) ? ESP_AT_SDIO_COALESCE_WINDOW_TICKS - elapsed : 0;
+}
+
+// Chain a buffer received in transparent transmission, return false if it has to be notified on its own
+static bool at_sdio_recv_chain_add(esp_at_sdio_list_t* p_list)
+{
+    bool full = false;
+
+    // "+++" only ends transparent transmission when it comes alone, never merge it with the data before it
+    if (!sdio_transmit_mode || (p_list->left_len == 3 && memcmp(p_list->pbuf, "+++", 3) == 0)) {
+        at_sdio_recv_chain_flush();
+        return false;
+    }
+
+    if (sdio_chain_head == NULL) {
+        sdio_chain_head = p_list;
+        sdio_chain_start = xTaskGetTickCount();
+    } else {
+        sdio_chain_tail->next = p_list;
+    }
+    sdio_chain_tail = p_list;
+    sdio_chain_len += p_list->left_len;
+
+    portENTER_CRITICAL(&sdio_list_lock);
+    full = (sdio_recv_held >= ESP_AT_SDIO_BUFFER_NUM);
+    portEXIT_CRITICAL(&sdio_list_lock);
+
+    // with every receive buffer held, the host can not send more until the AT core reads some
+    if (full || sdio_chain_len >= ESP_AT_SDIO_COALESCE_MAX_LEN) {
+        at_sdio_recv_chain_flush();
+    }
+
+    return true;
+}
+#endif
+
 static void at_sdio_recv_task(void* pvParameters)
 {
     sdio_slave_buf_handle_t handle;
     size_t length = 0;
     uint8_t* ptr = NULL;
+    TickType_t wait = portMAX_DELAY;
 
     at_sdio_write_data((uint8_t *) "\r\nready\r\n" , strlen("\r\nready\r\n"));
 
     for (;;) {
+#ifdef CONFIG_AT_SDIO_TRANSMIT_COALESCE_SUPPORT
+        wait = at_sdio_recv_chain_wait();
+#endif
 
         // receive data from SDIO host
-        esp_err_t ret = sdio_slave_recv(&handle, &ptr, &length, portMAX_DELAY);
+        esp_err_t ret = sdio_slave_recv(&handle, &ptr, &length, wait);
+#ifdef CONFIG_AT_SDIO_TRANSMIT_COALESCE_SUPPORT
+        if (ret == ESP_ERR_TIMEOUT) {
+            // the coalescing window is over
+            at_sdio_recv_chain_flush();
+            continue;
+        }
+#endif
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Recv error,ret:%x", ret);
             continue;
         }
 
-        esp_at_sdio_list_t* p_list = container_of(ptr, esp_at_sdio_list_t, pbuf); // get struct list pointer
+        esp_at_sdio_list_t* p_list = container_of(ptr, esp_at_sdio_list_t, pbuf[0]); // get struct list pointer
 
         p_list->handle = handle;
         p_list->left_len = length;
         p_list->pos = 0;
         p_list->next = NULL;
-        xSemaphoreTake(semahandle, portMAX_DELAY);
-
-        if (!pTail) {
-            pTail = p_list;
-            pHead = pTail;
-        } else {
-            pTail->next = p_list;
-            pTail = p_list;
+
+        portENTER_CRITICAL(&sdio_list_lock);
+        sdio_recv_held++;
+        if (sdio_recv_held >= ESP_AT_SDIO_BUFFER_NUM) {
+            sdio_recv_dry = true;
         }
+        sdio_recv_stats.recv_buffers++;
+        sdio_recv_stats.recv_bytes += length;
+        portEXIT_CRITICAL(&sdio_list_lock);
 
-        xSemaphoreGive(semahandle);
+#ifdef CONFIG_AT_SDIO_TRANSMIT_COALESCE_SUPPORT
+        if (at_sdio_recv_chain_add(p_list)) {
+            continue;
+        }
+#endif
+        at_sdio_recv_publish(p_list, p_list, length);
+    }
+}
 
-        // notify length to AT core
-        esp_at_port_recv_data_notify(length, portMAX_DELAY);
+static void at_sdio_status_callback(esp_at_status_type status)
+{
+    static at_sdio_recv_stats_t transmit_start;
+    at_sdio_recv_stats_t stats;
+
+    at_sdio_get_recv_stats(&stats);
+
+    if (status == ESP_AT_STATUS_TRANSMIT) {
+        transmit_start = stats;
+        sdio_transmit_mode = true;
+    } else if (sdio_transmit_mode) {
+        sdio_transmit_mode = false;
+        ESP_LOGI(TAG, "transparent transmission: %u bytes, %u buffers, %u notifications",
+                 stats.recv_bytes - transmit_start.recv_bytes, stats.recv_buffers - transmit_start.recv_buffers,
+                 stats.notifies - transmit_start.notifies);
     }
 }
 
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+static at_tx_coalesce_t sdio_tx_coalesce;
+
+static int32_t at_sdio_coalesce_write_data(uint8_t* data, int32_t len)
+{
+    return at_tx_coalesce_write(&sdio_tx_coalesce, data, len);
+}
+
+static bool at_sdio_coalesce_wait_write_complete(int32_t timeout_msec)
+{
+    TickType_t start = xTaskGetTickCount();
+    int32_t elapsed_msec = 0;
+
+    if (!at_tx_coalesce_flush(&sdio_tx_coalesce, timeout_msec)) {
+        return false;
+    }
+    if (timeout_msec < 0) {
+        return at_sdio_wait_write_complete(timeout_msec);
+    }
+
+    elapsed_msec = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+    return at_sdio_wait_write_complete((elapsed_msec < timeout_msec) ? (timeout_msec - elapsed_msec) : 0);
+}
+#endif
+
 void at_interface_init(void)
 {
     //If you want to use AT lib, make sure obey this function.
@@ -239,10 +595,26 @@ void at_interface_init(void)
         .read_data = at_sdio_read_data,
         .write_data = at_sdio_write_data,
         .get_data_length = NULL,
-        .wait_write_complete = NULL,
+        .wait_write_complete = at_sdio_wait_write_complete,
+    };
+    esp_at_custom_ops_struct esp_at_custom_ops = {
+        .status_callback = at_sdio_status_callback,
     };
 
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+    if (at_tx_coalesce_init(&sdio_tx_coalesce, "sdio", at_sdio_write_data, CONFIG_AT_TX_COALESCE_HIGH_WATER, CONFIG_AT_TX_COALESCE_DEADLINE_US) == ESP_OK) {
+        esp_at_device_ops.write_data = at_sdio_coalesce_write_data;
+        esp_at_device_ops.wait_write_complete = at_sdio_coalesce_wait_write_complete;
+    }
+#endif
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    sdio_transport_id = at_transport_register("sdio", &esp_at_device_ops, &esp_at_custom_ops, AT_TRANSPORT_RANK_SDIO);
+    at_transport_interface_init();
+#else
     esp_at_device_ops_regist(&esp_at_device_ops);
+    esp_at_custom_ops_regist(&esp_at_custom_ops);
+#endif
 }
 
 void at_custom_init(void)
@@ -251,5 +623,14 @@ void at_custom_init(void)
     esp_at_sdio_slave_init();
 
     xTaskCreate(at_sdio_recv_task , "at_sdio_recv_task" , 4096 , NULL , 2 , NULL);
+    esp_at_custom_cmd_array_regist(at_sdio_cmd, sizeof(at_sdio_cmd) / sizeof(at_sdio_cmd[0]));
+
+#ifdef CONFIG_AT_TX_COALESCE_SUPPORT
+    at_tx_coalesce_custom_init();
+#endif
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_transport_custom_init();
+#endif
 }
 #endif
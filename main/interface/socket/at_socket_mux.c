@@ -0,0 +1,374 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sys/socket.h"
+
+#include "at_socket_mux.h"
+
+#ifdef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
+static const char* s_final_codes[] = {"OK\r\n", "ERROR\r\n", "FAIL\r\n", "SEND OK\r\n", "SEND FAIL\r\n", "SEND CANCELLED\r\n"};
+static const char* s_prompts[] = {">", "OK\r\n>", "OK\r\n\r\n>"};
+
+typedef enum {
+    AT_SOCKET_OUTPUT_DATA,
+    AT_SOCKET_OUTPUT_FINAL,
+    AT_SOCKET_OUTPUT_PROMPT,
+} at_socket_output_type;
+
+static bool at_socket_mux_is(const uint8_t* data, uint32_t len, const char* code)
+{
+    return (len == strlen(code)) && (memcmp(data, code, len) == 0);
+}
+
+/* The AT core writes a result code or a prompt on its own, framed by line breaks only. Anything else,
+ * even if it ends with "OK\r\n", is command output or payload. */
+static at_socket_output_type at_socket_mux_classify(const uint8_t* data, uint32_t len)
+{
+    while (len > 0 && (*data == '\r' || *data == '\n')) {
+        data++;
+        len--;
+    }
+
+    for (int loop = 0; loop < sizeof(s_prompts) / sizeof(s_prompts[0]); loop++) {
+        if (at_socket_mux_is(data, len, s_prompts[loop])) {
+            return AT_SOCKET_OUTPUT_PROMPT;
+        }
+    }
+
+    for (int loop = 0; loop < sizeof(s_final_codes) / sizeof(s_final_codes[0]); loop++) {
+        if (at_socket_mux_is(data, len, s_final_codes[loop])) {
+            return AT_SOCKET_OUTPUT_FINAL;
+        }
+    }
+
+    return AT_SOCKET_OUTPUT_DATA;
+}
+
+// send() may take only part of the data when the socket buffer is short
+static bool at_socket_mux_send_all(int fd, const uint8_t* data, uint32_t len)
+{
+    int ret = 0;
+
+    while (len > 0) {
+        ret = send(fd, data, len, 0);
+        if (ret < 0) {
+            return false;
+        }
+        data += ret;
+        len -= ret;
+    }
+
+    return true;
+}
+
+static uint8_t at_socket_session_peek(at_socket_mux_t* mux, at_socket_session_t* s, uint32_t offset)
+{
+    return s->rx_buf[(s->rx_head + offset) % mux->rx_size];
+}
+
+static uint32_t at_socket_session_read(at_socket_mux_t* mux, at_socket_session_t* s, uint8_t* out, uint32_t len)
+{
+    uint32_t first = 0;
+
+    if (len > s->rx_len) {
+        len = s->rx_len;
+    }
+
+    first = mux->rx_size - s->rx_head;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(out, s->rx_buf + s->rx_head, first);
+    memcpy(out + first, s->rx_buf, len - first);
+
+    s->rx_head = (s->rx_head + len) % mux->rx_size;
+    s->rx_len -= len;
+
+    return len;
+}
+
+// length of the first complete command line, terminator included, 0 if there is none yet
+static uint32_t at_socket_session_line_len(at_socket_mux_t* mux, at_socket_session_t* s)
+{
+    for (uint32_t loop = 0; loop < s->rx_len; loop++) {
+        if (at_socket_session_peek(mux, s, loop) == '\n') {
+            return loop + 1;
+        }
+    }
+
+    // a line that fills up the whole ring can never complete, hand it over as it is
+    if (s->rx_len == mux->rx_size) {
+        return s->rx_len;
+    }
+
+    return 0;
+}
+
+int at_socket_mux_init(at_socket_mux_t* mux, int max_clients, uint32_t rx_size, uint32_t guard_ms)
+{
+    if (mux == NULL || max_clients <= 0 || rx_size == 0) {
+        return -1;
+    }
+
+    memset(mux, 0x0, sizeof(at_socket_mux_t));
+    mux->sessions = (at_socket_session_t*)calloc(max_clients, sizeof(at_socket_session_t));
+    if (mux->sessions == NULL) {
+        return -1;
+    }
+
+    for (int loop = 0; loop < max_clients; loop++) {
+        mux->sessions[loop].fd = -1;
+    }
+
+    mux->max_clients = max_clients;
+    mux->rx_size = rx_size;
+    mux->guard_ms = guard_ms;
+    mux->active = -1;
+
+    return 0;
+}
+
+int at_socket_mux_add(at_socket_mux_t* mux, int fd)
+{
+    for (int loop = 0; loop < mux->max_clients; loop++) {
+        at_socket_session_t* s = &mux->sessions[loop];
+        if (s->fd >= 0) {
+            continue;
+        }
+
+        s->rx_buf = (uint8_t*)malloc(mux->rx_size);
+        if (s->rx_buf == NULL) {
+            return -1;
+        }
+
+        s->fd = fd;
+        s->rx_head = 0;
+        s->rx_len = 0;
+        return loop;
+    }
+
+    return -1;
+}
+
+bool at_socket_mux_remove(at_socket_mux_t* mux, int index)
+{
+    at_socket_session_t* s = &mux->sessions[index];
+    bool was_active = (mux->active == index);
+
+    if (s->fd >= 0) {
+        close(s->fd);
+    }
+    free(s->rx_buf);
+    s->rx_buf = NULL;
+    s->fd = -1;
+    s->rx_len = 0;
+
+    if (was_active) {
+        mux->active = -1;
+        mux->raw = mux->transparent;
+        mux->done = false;
+    }
+
+    return was_active;
+}
+
+int at_socket_mux_fill_fdset(at_socket_mux_t* mux, fd_set* read_set)
+{
+    int max_fd = -1;
+
+    for (int loop = 0; loop < mux->max_clients; loop++) {
+        at_socket_session_t* s = &mux->sessions[loop];
+        // a full ring is not polled, TCP flow control holds the client back
+        if (s->fd >= 0 && s->rx_len < mux->rx_size) {
+            FD_SET(s->fd, read_set);
+            if (s->fd > max_fd) {
+                max_fd = s->fd;
+            }
+        }
+    }
+
+    return max_fd;
+}
+
+int at_socket_mux_recv(at_socket_mux_t* mux, int index)
+{
+    at_socket_session_t* s = &mux->sessions[index];
+    uint32_t tail = (s->rx_head + s->rx_len) % mux->rx_size;
+    uint32_t room = mux->rx_size - s->rx_len;
+    int byte_num = 0;
+
+    // receive into the contiguous free space only, the rest is picked up by the next select()
+    if (tail + room > mux->rx_size) {
+        room = mux->rx_size - tail;
+    }
+
+    byte_num = recv(s->fd, s->rx_buf + tail, room, 0);
+    if (byte_num > 0) {
+        s->rx_len += byte_num;
+    }
+
+    return byte_num;
+}
+
+bool at_socket_mux_take_escape(at_socket_mux_t* mux, int index)
+{
+    at_socket_session_t* s = &mux->sessions[index];
+
+    if (s->rx_len != 3) {
+        return false;
+    }
+
+    for (uint32_t loop = 0; loop < 3; loop++) {
+        if (at_socket_session_peek(mux, s, loop) != '+') {
+            return false;
+        }
+    }
+
+    s->rx_head = (s->rx_head + 3) % mux->rx_size;
+    s->rx_len = 0;
+    return true;
+}
+
+bool at_socket_mux_poll(at_socket_mux_t* mux, uint32_t now_ms)
+{
+    if (mux->active >= 0 && mux->done && (uint32_t)(now_ms - mux->done_ms) >= mux->guard_ms) {
+        mux->active = -1;
+        mux->done = false;
+    }
+
+    if (mux->active >= 0) {
+        return true;
+    }
+
+    for (int loop = 0; loop < mux->max_clients; loop++) {
+        if (mux->sessions[loop].fd >= 0 && mux->sessions[loop].rx_len > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int at_socket_mux_next_command(at_socket_mux_t* mux, uint8_t* out, uint32_t out_size)
+{
+    uint32_t len = 0;
+
+    if (mux->active >= 0) {
+        if (!mux->raw) {
+            return 0;
+        }
+        len = at_socket_session_read(mux, &mux->sessions[mux->active], out, out_size);
+        mux->unread += len;
+        return len;
+    }
+
+    for (int loop = 0; loop < mux->max_clients; loop++) {
+        int index = (mux->next + loop) % mux->max_clients;
+        at_socket_session_t* s = &mux->sessions[index];
+
+        if (s->fd < 0 || s->rx_len == 0) {
+            continue;
+        }
+
+        len = at_socket_session_line_len(mux, s);
+        if (len == 0) {
+            continue;
+        }
+
+        mux->active = index;
+        mux->next = (index + 1) % mux->max_clients;
+        mux->done = false;
+        mux->raw = mux->transparent;
+        len = at_socket_session_read(mux, s, out, len > out_size ? out_size : len);
+        mux->unread += len;
+        return len;
+    }
+
+    return 0;
+}
+
+void at_socket_mux_consumed(at_socket_mux_t* mux, uint32_t len)
+{
+    mux->unread = (len < mux->unread) ? (mux->unread - len) : 0;
+}
+
+int at_socket_mux_send(at_socket_mux_t* mux, const uint8_t* data, uint32_t len, uint32_t now_ms)
+{
+    int sent_num = 0;
+    int client_num = 0;
+
+    if (mux->active >= 0) {
+        client_num++;
+        if (at_socket_mux_send_all(mux->sessions[mux->active].fd, data, len)) {
+            sent_num++;
+        }
+
+        // the AT core answers a command only after it has read all of it
+        if (!mux->transparent && mux->unread == 0) {
+            switch (at_socket_mux_classify(data, len)) {
+            case AT_SOCKET_OUTPUT_PROMPT:
+                // the command waits for data, the same client keeps the AT core
+                mux->raw = true;
+                mux->done = false;
+                break;
+            case AT_SOCKET_OUTPUT_FINAL:
+                mux->raw = false;
+                mux->done = true;
+                mux->done_ms = now_ms;
+                break;
+            default:
+                break;
+            }
+        }
+    } else {
+        for (int loop = 0; loop < mux->max_clients; loop++) {
+            if (mux->sessions[loop].fd < 0) {
+                continue;
+            }
+            client_num++;
+            if (at_socket_mux_send_all(mux->sessions[loop].fd, data, len)) {
+                sent_num++;
+            }
+        }
+    }
+
+    // nobody to talk to is not an error, the same as with a single client
+    return (client_num == 0 || sent_num > 0) ? len : -1;
+}
+
+void at_socket_mux_set_transparent(at_socket_mux_t* mux, bool transparent, uint32_t now_ms)
+{
+    mux->transparent = transparent;
+    mux->raw = transparent;
+
+    if (!transparent && mux->active >= 0) {
+        mux->done = true;
+        mux->done_ms = now_ms;
+    }
+}
+#endif
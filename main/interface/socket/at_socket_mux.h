@@ -0,0 +1,139 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef __AT_SOCKET_MUX_H__
+#define __AT_SOCKET_MUX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/select.h>
+#include "sys/socket.h"
+
+/**
+ * Session multiplexer for AT through socket.
+ *
+ * Several TCP clients share one AT core. Every client has its own RX ring, complete command lines
+ * are handed to the AT core one at a time in round-robin order, and the responses are routed back
+ * to the client that issued the command. Output produced while no command is pending (URCs) is
+ * sent to every client.
+ *
+ * Only the BSD socket API is used here, so this file builds against lwIP as well as a Linux host.
+ * It is not thread safe, the caller serializes the access.
+ */
+
+typedef struct {
+    int fd;                     /**< client socket, -1 if the slot is free */
+    uint8_t* rx_buf;            /**< RX ring storage */
+    uint32_t rx_head;           /**< index of the first unread byte */
+    uint32_t rx_len;            /**< number of unread bytes */
+} at_socket_session_t;
+
+typedef struct {
+    at_socket_session_t* sessions;
+    int max_clients;
+    uint32_t rx_size;
+    int active;                 /**< session owning the AT core, -1 if none */
+    int next;                   /**< round-robin cursor */
+    bool raw;                   /**< active session sends raw data (after '>' or in transparent transmission) */
+    bool transparent;           /**< AT core is in transparent transmission */
+    bool done;                  /**< the command of the active session got its final result code */
+    uint32_t unread;            /**< bytes handed to the AT core for the active session and not read by it yet */
+    uint32_t done_ms;           /**< when the final result code was seen */
+    uint32_t guard_ms;          /**< how long to wait for a '>' prompt after the final result code */
+} at_socket_mux_t;
+
+int at_socket_mux_init(at_socket_mux_t* mux, int max_clients, uint32_t rx_size, uint32_t guard_ms);
+
+/**
+ * @brief Attach an accepted client socket.
+ *
+ * @return session index, or -1 if all the sessions are in use
+ */
+int at_socket_mux_add(at_socket_mux_t* mux, int fd);
+
+/**
+ * @brief Close and detach a client socket.
+ *
+ * @return true if the session was the one owning the AT core
+ */
+bool at_socket_mux_remove(at_socket_mux_t* mux, int index);
+
+/**
+ * @brief Add the sockets that have room in their RX ring to a select() read set.
+ *
+ * @return the largest fd added, -1 if none
+ */
+int at_socket_mux_fill_fdset(at_socket_mux_t* mux, fd_set* read_set);
+
+/**
+ * @brief Receive from a session socket straight into its RX ring.
+ *
+ * @return bytes received, <= 0 if the client is gone
+ */
+int at_socket_mux_recv(at_socket_mux_t* mux, int index);
+
+/**
+ * @brief Drop the RX data of a session if it is exactly "+++", the transparent transmission exit sequence.
+ *
+ * @return true if the exit sequence was found
+ */
+bool at_socket_mux_take_escape(at_socket_mux_t* mux, int index);
+
+/**
+ * @brief Release the AT core once the active command is complete.
+ *
+ * @return true if there may be work for at_socket_mux_next_command() or a pending release, i.e. the caller should poll again soon
+ */
+bool at_socket_mux_poll(at_socket_mux_t* mux, uint32_t now_ms);
+
+/**
+ * @brief Get the next data to hand to the AT core: a whole command line from the next session in
+ *        round-robin order, or raw data from the active session.
+ *
+ * @return bytes copied to out, 0 if nothing can be scheduled now
+ */
+int at_socket_mux_next_command(at_socket_mux_t* mux, uint8_t* out, uint32_t out_size);
+
+/**
+ * @brief Account the bytes the AT core has read. Output is taken as the result of the active command
+ *        only once the AT core has read all of it.
+ */
+void at_socket_mux_consumed(at_socket_mux_t* mux, uint32_t len);
+
+/**
+ * @brief Send AT core output to the session that issued the command, or to all sessions if none.
+ *        A result code or a '>' prompt written on its own ends the command or keeps the session for its data.
+ *
+ * @return len on success or if no client is connected, -1 if it could not be sent to any client
+ */
+int at_socket_mux_send(at_socket_mux_t* mux, const uint8_t* data, uint32_t len, uint32_t now_ms);
+
+/**
+ * @brief Tell the multiplexer that the AT core entered or left transparent transmission.
+ */
+void at_socket_mux_set_transparent(at_socket_mux_t* mux, bool transparent, uint32_t now_ms);
+
+#endif
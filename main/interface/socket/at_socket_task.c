@@ -42,17 +42,90 @@
 #include "nvs_flash.h"
 
 #include "esp_at.h"
+#include "at_socket_mux.h"
+#include "at_transport_mux.h"
 
 #ifdef CONFIG_AT_BASE_ON_SOCKET
-#define ESP_AT_BUFFER_SIZE 200
+#define ESP_AT_BUFFER_SIZE CONFIG_AT_SOCKET_RECV_SIZE
 #define ESP_AT_SOCKET_PORT CONFIG_AT_SOCKET_PORT
 #define ESP_AT_RING_ESP_AT_BUFFER_SIZE 8*1024
 
+/* Every ring buffer item is received into directly, so it is acquired before the received length is known.
+ * The first word of an item holds the valid length of the data following it. */
+#define ESP_AT_RING_ITEM_HEADER_SIZE    sizeof(uint32_t)
+
+#ifndef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
 static int at_client_fd;
+#endif
 static bool at_transparent_transmition = false;
 static RingbufHandle_t at_read_ring_buf;
 static const char* TAG = "esp_at";
 
+// ring buffer item being consumed by the AT core
+static uint8_t* at_read_item;
+static uint32_t at_read_item_len;
+static uint32_t at_read_item_pos;
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+static int at_socket_transport_id = -1;
+#endif
+
+static void at_socket_recv_notify(int32_t len)
+{
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_transport_recv_data_notify(at_socket_transport_id, len, portMAX_DELAY);
+#else
+    esp_at_port_recv_data_notify(len, portMAX_DELAY);
+#endif
+}
+
+#ifndef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
+/* Size of the next ring buffer item. Reserving ESP_AT_BUFFER_SIZE for every recv() would let only a few
+ * short commands be queued in the ring, so reserve what the socket holds when lwIP can tell. */
+static int at_socket_recv_len(int fd)
+{
+    int avail = 0;
+
+    if (ioctlsocket(fd, FIONREAD, &avail) < 0 || avail > ESP_AT_BUFFER_SIZE) {
+        return ESP_AT_BUFFER_SIZE;
+    }
+
+    // readable with nothing buffered: the peer has closed, and recv() returns 0 anyway
+    return (avail > 0) ? avail : 1;
+}
+#endif
+
+#ifdef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
+#define ESP_AT_SOCKET_MAX_CLIENT_NUM    CONFIG_AT_SOCKET_MAX_CLIENT_NUM
+#define ESP_AT_SOCKET_CLIENT_RX_SIZE    CONFIG_AT_SOCKET_CLIENT_RX_BUFFER_SIZE
+#define ESP_AT_SOCKET_MUX_POLL_MS       10
+// time to wait for a '>' prompt after a final result code before serving the next client
+#define ESP_AT_SOCKET_MUX_GUARD_MS      20
+
+static at_socket_mux_t at_socket_mux;
+static xSemaphoreHandle at_socket_mux_lock;
+
+static uint32_t at_socket_now_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static bool at_socket_ring_push(const uint8_t* data, uint32_t len)
+{
+    uint8_t* item = NULL;
+
+    if (xRingbufferSendAcquire(at_read_ring_buf, (void**)&item, ESP_AT_RING_ITEM_HEADER_SIZE + len, portMAX_DELAY) == pdFALSE) {
+        return false;
+    }
+
+    *(uint32_t*)item = len;
+    memcpy(item + ESP_AT_RING_ITEM_HEADER_SIZE, data, len);
+    xRingbufferSendComplete(at_read_ring_buf, item);
+
+    return true;
+}
+#endif
+
 /*Called when socket recieve a normal AT command, make sure you have added \r\n in your socket data*/
 static int32_t at_socket_read_data(uint8_t* data, int32_t len)
 {
@@ -66,17 +139,47 @@ static int32_t at_socket_read_data(uint8_t* data, int32_t len)
         return 0;
     }
 
-    size_t ring_len = len;
-    uint8_t* recv_data = (uint8_t*) xRingbufferReceive(at_read_ring_buf, &ring_len, (portTickType) 0);
+    int32_t copy_len = 0;
+    uint32_t chunk_len = 0;
+    size_t item_size = 0;
+
+    while (copy_len < len) {
+        if (at_read_item == NULL) {
+            at_read_item = (uint8_t*) xRingbufferReceive(at_read_ring_buf, &item_size, (portTickType) 0);
+            if (at_read_item == NULL) {
+                break;
+            }
+            at_read_item_len = *(uint32_t*)at_read_item;
+            at_read_item_pos = 0;
+        }
+
+        chunk_len = at_read_item_len - at_read_item_pos;
+        if (chunk_len > len - copy_len) {
+            chunk_len = len - copy_len;
+        }
+
+        memcpy(data + copy_len, at_read_item + ESP_AT_RING_ITEM_HEADER_SIZE + at_read_item_pos, chunk_len);
+        at_read_item_pos += chunk_len;
+        copy_len += chunk_len;
 
-    if (recv_data == NULL) {
+        if (at_read_item_pos == at_read_item_len) {
+            vRingbufferReturnItem(at_read_ring_buf, at_read_item);
+            at_read_item = NULL;
+        }
+    }
+
+    if (copy_len == 0) {
         ESP_LOGE(TAG, "Cannot recieve socket data from ringbuf.");
         return -1;
-    } else {
-        memcpy(data, recv_data, len);
     }
 
-    return len;
+#ifdef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
+    xSemaphoreTake(at_socket_mux_lock, portMAX_DELAY);
+    at_socket_mux_consumed(&at_socket_mux, copy_len);
+    xSemaphoreGive(at_socket_mux_lock);
+#endif
+
+    return copy_len;
 }
 
 /*Result of AT command, auto call when read_data get data*/
@@ -92,12 +195,22 @@ static int32_t at_socket_write_data(uint8_t* buf, int32_t len)
         return 0;
     }
 
+#ifdef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
+    xSemaphoreTake(at_socket_mux_lock, portMAX_DELAY);
+    len = at_socket_mux_send(&at_socket_mux, buf, len, at_socket_now_ms());
+    xSemaphoreGive(at_socket_mux_lock);
+
+    if (len < 0) {
+        ESP_LOGE(TAG, "Cannot send message.");
+    }
+#else
     if (at_client_fd >= 0 && len > 0) {
         if (send(at_client_fd, buf, len, 0) < 0) {
             ESP_LOGE(TAG, "Cannot send message.");
             return -1;
         }
     }
+#endif
 
     return len;
 }
@@ -114,6 +227,7 @@ static bool at_port_wait_write_complete(int32_t timeout_msec)
     return true;
 }
 
+#ifndef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
 static void socket_task(void* pvParameters)
 {
     struct sockaddr_in server_addr;
@@ -150,8 +264,6 @@ static void socket_task(void* pvParameters)
             break;
         }
 
-        uint8_t* recv_msg = (uint8_t*) malloc(ESP_AT_BUFFER_SIZE * sizeof(uint8_t));
-
         for (;;) {
 
             //Firstly, we do some preparatory work for AT command
@@ -162,24 +274,34 @@ static void socket_task(void* pvParameters)
 
                 //There are something happened in socket
                 if (FD_ISSET(at_client_fd, &server_fd_set)) {
-                    int byte_num = recv(at_client_fd, recv_msg, ESP_AT_BUFFER_SIZE, 0);
+                    uint8_t* item = NULL;
+                    int recv_len = at_socket_recv_len(at_client_fd);
+
+                    // receive straight into the ring buffer, no intermediate copy
+                    if (xRingbufferSendAcquire(at_read_ring_buf, (void**)&item, ESP_AT_RING_ITEM_HEADER_SIZE + recv_len, portMAX_DELAY) == pdFALSE) {
+                        ESP_LOGE(TAG, "Cannot acquire ringbuf");
+                        continue;
+                    }
+
+                    int byte_num = recv(at_client_fd, item + ESP_AT_RING_ITEM_HEADER_SIZE, recv_len, 0);
 
                     /* If using custom commands and want to exit transparent transmition, make sure
                     the program know first*/
-                    if (at_transparent_transmition && (byte_num == 3) && (memcmp(recv_msg, "+++", 3) == 0)) {
+                    if (at_transparent_transmition && (byte_num == 3) && (memcmp(item + ESP_AT_RING_ITEM_HEADER_SIZE, "+++", 3) == 0)) {
+                        *(uint32_t*)item = 0;
+                        xRingbufferSendComplete(at_read_ring_buf, item);
                         ESP_LOGI(TAG, "Exit transparent transmition mode");
                         esp_at_transmit_terminal();
                         continue;
                     }
 
-                    if (byte_num > 0) {
-                        if (xRingbufferSend(at_read_ring_buf, recv_msg, byte_num, portMAX_DELAY) == pdFALSE) {        // a buffer is better
-                            ESP_LOGE(TAG, "Cannot send data to ringbuf");
-                            continue;
-                        }
+                    // an acquired item can not be cancelled, an empty one is skipped by the reader
+                    *(uint32_t*)item = (byte_num > 0) ? byte_num : 0;
+                    xRingbufferSendComplete(at_read_ring_buf, item);
 
+                    if (byte_num > 0) {
                         //Call AT lib to handle commands
-                        esp_at_port_recv_data_notify(byte_num, portMAX_DELAY);
+                        at_socket_recv_notify(byte_num);
                     } else {  //have not recieve data or error data
                         at_client_fd = -1;
                         ESP_LOGE(TAG, "Time out or client exit,try to reconnect");
@@ -191,9 +313,132 @@ static void socket_task(void* pvParameters)
                 continue;
             }
         }
+    }
+
+    //There is something wrong happened when we try to use socket.
+Exit0:
 
-        free(recv_msg);
-        recv_msg = NULL;
+    if (server_sock_fd >= 0) {
+        close(server_sock_fd);
+    }
+
+    vTaskDelete(NULL);
+}
+#else
+static void socket_mux_task(void* pvParameters)
+{
+    struct sockaddr_in server_addr;
+    fd_set read_set;
+    struct sockaddr_in client_address;
+    socklen_t address_len;
+    struct timeval poll_timeout;
+    int max_fd = -1;
+    int client_fd = -1;
+    int byte_num = 0;
+    bool busy = false;
+    uint8_t* recv_msg = NULL;
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(ESP_AT_SOCKET_PORT);
+    server_addr.sin_addr.s_addr = 0;
+
+    int server_sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (server_sock_fd == -1) {
+        ESP_LOGE(TAG, "Cannot create socket.");
+        goto Exit0;
+    }
+
+    if (bind(server_sock_fd, (struct sockaddr*) &server_addr, sizeof(server_addr)) == -1) {
+        ESP_LOGE(TAG, "Cannot bind socket");
+        goto Exit0;
+    }
+
+    if (listen(server_sock_fd, ESP_AT_SOCKET_MAX_CLIENT_NUM) == -1) {
+        ESP_LOGE(TAG, "Cannot listen socket.");
+        goto Exit0;
+    }
+
+    recv_msg = (uint8_t*) malloc(ESP_AT_BUFFER_SIZE * sizeof(uint8_t));
+    if (recv_msg == NULL) {
+        ESP_LOGE(TAG, "Cannot malloc recv buffer.");
+        goto Exit0;
+    }
+
+    for (;;) {
+        FD_ZERO(&read_set);
+        FD_SET(server_sock_fd, &read_set);
+
+        xSemaphoreTake(at_socket_mux_lock, portMAX_DELAY);
+        max_fd = at_socket_mux_fill_fdset(&at_socket_mux, &read_set);
+        busy = at_socket_mux_poll(&at_socket_mux, at_socket_now_ms());
+        xSemaphoreGive(at_socket_mux_lock);
+
+        if (server_sock_fd > max_fd) {
+            max_fd = server_sock_fd;
+        }
+
+        // a pending command may be released by the AT core output, so do not sleep forever then
+        poll_timeout.tv_sec = 0;
+        poll_timeout.tv_usec = ESP_AT_SOCKET_MUX_POLL_MS * 1000;
+        if (select(max_fd + 1, &read_set, NULL, NULL, busy ? &poll_timeout : NULL) < 0) {
+            ESP_LOGE(TAG, "Cannot select socket.");
+            continue;
+        }
+
+        if (FD_ISSET(server_sock_fd, &read_set)) {
+            address_len = sizeof(client_address);
+            client_fd = accept(server_sock_fd, (struct sockaddr*) &client_address, &address_len);
+            if (client_fd >= 0) {
+                xSemaphoreTake(at_socket_mux_lock, portMAX_DELAY);
+                if (at_socket_mux_add(&at_socket_mux, client_fd) < 0) {
+                    ESP_LOGW(TAG, "Too many clients, reject %d", client_fd);
+                    close(client_fd);
+                }
+                xSemaphoreGive(at_socket_mux_lock);
+            }
+        }
+
+        xSemaphoreTake(at_socket_mux_lock, portMAX_DELAY);
+        for (int loop = 0; loop < ESP_AT_SOCKET_MAX_CLIENT_NUM; loop++) {
+            client_fd = at_socket_mux.sessions[loop].fd;
+            if (client_fd < 0 || !FD_ISSET(client_fd, &read_set)) {
+                continue;
+            }
+
+            if (at_socket_mux_recv(&at_socket_mux, loop) <= 0) {
+                ESP_LOGI(TAG, "Client %d exit", client_fd);
+                if (at_socket_mux_remove(&at_socket_mux, loop) && at_transparent_transmition) {
+                    esp_at_transmit_terminal();
+                }
+                continue;
+            }
+
+            /* If using custom commands and want to exit transparent transmition, make sure
+            the program know first*/
+            if (at_transparent_transmition && (loop == at_socket_mux.active) && at_socket_mux_take_escape(&at_socket_mux, loop)) {
+                ESP_LOGI(TAG, "Exit transparent transmition mode");
+                esp_at_transmit_terminal();
+            }
+        }
+
+        at_socket_mux_poll(&at_socket_mux, at_socket_now_ms());
+        while ((byte_num = at_socket_mux_next_command(&at_socket_mux, recv_msg, ESP_AT_BUFFER_SIZE)) > 0) {
+            xSemaphoreGive(at_socket_mux_lock);
+
+            if (!at_socket_ring_push(recv_msg, byte_num)) {
+                ESP_LOGE(TAG, "Cannot send data to ringbuf");
+                xSemaphoreTake(at_socket_mux_lock, portMAX_DELAY);
+                // the AT core will never read it
+                at_socket_mux_consumed(&at_socket_mux, byte_num);
+            } else {
+                //Call AT lib to handle commands
+                at_socket_recv_notify(byte_num);
+                xSemaphoreTake(at_socket_mux_lock, portMAX_DELAY);
+            }
+        }
+        xSemaphoreGive(at_socket_mux_lock);
     }
 
     //There is something wrong happened when we try to use socket.
@@ -203,8 +448,10 @@ Exit0:
         close(server_sock_fd);
     }
 
+    free(recv_msg);
     vTaskDelete(NULL);
 }
+#endif
 
 /*This function let you handle some operation when using custom cmd and AT status change*/
 static void at_status_callback(esp_at_status_type status)
@@ -218,10 +465,24 @@ static void at_status_callback(esp_at_status_type status)
             at_transparent_transmition = true;
             break;
     }
+
+#ifdef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
+    xSemaphoreTake(at_socket_mux_lock, portMAX_DELAY);
+    at_socket_mux_set_transparent(&at_socket_mux, at_transparent_transmition, at_socket_now_ms());
+    xSemaphoreGive(at_socket_mux_lock);
+#endif
 }
 
 void at_interface_init (void)
 {
+#ifdef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
+    at_socket_mux_lock = xSemaphoreCreateMutex();
+    if (at_socket_mux_lock == NULL || at_socket_mux_init(&at_socket_mux, ESP_AT_SOCKET_MAX_CLIENT_NUM, ESP_AT_SOCKET_CLIENT_RX_SIZE, ESP_AT_SOCKET_MUX_GUARD_MS) != 0) {
+        ESP_LOGE(TAG, "Cannot init socket multiplexer");
+        return;
+    }
+#endif
+
     uint8_t* version = (uint8_t*)malloc(192);
 
     if (version == NULL) {
@@ -241,14 +502,19 @@ void at_interface_init (void)
         .status_callback = at_status_callback,
     };
 
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_socket_transport_id = at_transport_register("socket", &esp_at_device_ops, &esp_at_custom_ops, AT_TRANSPORT_RANK_SOCKET);
+    at_transport_interface_init();
+#else
     esp_at_device_ops_regist(&esp_at_device_ops);
     esp_at_custom_ops_regist(&esp_at_custom_ops);
+#endif
 }
 
 void at_custom_init(void)
 {
     wifi_mode_t mode;
-    at_read_ring_buf = xRingbufferCreate(ESP_AT_RING_ESP_AT_BUFFER_SIZE, RINGBUF_TYPE_ALLOWSPLIT);
+    at_read_ring_buf = xRingbufferCreate(ESP_AT_RING_ESP_AT_BUFFER_SIZE, RINGBUF_TYPE_NOSPLIT);
 
     if (at_read_ring_buf == NULL) {
         ESP_LOGE(TAG, "Cannot create ringbuf");
@@ -270,7 +536,15 @@ void at_custom_init(void)
     /*This IP is a socket server,you can connect it and use AT command to control esp32*/
     ESP_LOGI(TAG, "IP address of Soft AP is:"IPSTR, IP2STR(&ip.ip));
 
+#ifdef CONFIG_AT_SOCKET_MULTI_CLIENT_SUPPORT
+    xTaskCreate(&socket_mux_task, "socket_task", 4096, NULL, 5, NULL);
+#else
     xTaskCreate(&socket_task, "socket_task", 4096, NULL, 5, NULL);
+#endif
+
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_transport_custom_init();
+#endif
 
     esp_at_port_write_data((uint8_t*) "\r\nready\r\n", strlen("\r\nready\r\n"));
 }
@@ -32,11 +32,13 @@
 #include "nvs.h"
 #include "nvs_flash.h"
 
-#ifdef CONFIG_AT_BASE_ON_UART
+#if defined(CONFIG_AT_BASE_ON_UART) || defined(CONFIG_AT_TRANSPORT_MUX_SUPPORT)
 #include "esp_system.h"
+#include "esp_log.h"
 #include "driver/gpio.h"
 #include "driver/uart.h"
 #include "at_interface.h"
+#include "at_transport_mux.h"
 
 #ifdef CONFIG_IDF_TARGET_ESP32
 #include "esp32/rom/uart.h"
@@ -88,11 +90,84 @@ static const uint8_t esp_at_uart_parity_table[] = {UART_PARITY_DISABLE, UART_PAR
 
 #define AT_UART_PATTERN_TIMEOUT_MS                  20
 
+#define AT_UART_RX_BUFFER_SIZE_MIN                  2048
+#define AT_UART_RX_BUFFER_SIZE_MAX                  CONFIG_AT_UART_RX_BUFFER_SIZE_MAX
+#define AT_UART_DISCARD_BUFFER_SIZE                 64
+
+#ifdef CONFIG_AT_UART_ADAPTIVE_RX
+#define AT_UART_NOTIFY_THRESH_MIN                   128
+#define AT_UART_NOTIFY_BURST_LEN                    512     // a batch this long means events are queuing up
+#define AT_UART_NOTIFY_WAIT_TICKS                   1
+#endif
+
+typedef struct {
+    uint32_t data_events;
+    uint32_t notify_count;
+    uint32_t fifo_overflow;
+    uint32_t buffer_full;
+    uint32_t pattern_det;
+} at_uart_rx_stats_t;
+
 static uart_port_t esp_at_uart_port = CONFIG_AT_UART_PORT;
+static int32_t s_at_uart_rx_buffer_size = AT_UART_RX_BUFFER_SIZE_MIN;
+static uart_intr_config_t s_at_uart_intr_config;
+static at_uart_rx_stats_t s_at_uart_rx_stats;
+static uint32_t s_at_uart_notify_thresh = 0;
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+static const char* TAG = "UART-AT";
+static int s_at_uart_transport_id = -1;
+static bool s_at_uart_flow_ctrl_allowed = true;     // false once CTS/RTS were taken off the pins of the transport
+
+// pins of the transport next to UART, -1 ends the list
+static const int32_t s_at_transport_pins[] = {
+#if defined(CONFIG_AT_BASE_ON_SDIO)
+    14, 15, 2, 4, 12, 13,       // CLK, CMD, DAT0~3
+#elif defined(CONFIG_AT_BASE_ON_HSPI)
+    CONFIG_SPI_SCLK_PIN, CONFIG_SPI_MOSI_PIN, CONFIG_SPI_MISO_PIN, CONFIG_SPI_CS_PIN, CONFIG_SPI_HANDSHAKE_PIN,
+#ifdef CONFIG_SPI_QUAD_MODE
+    CONFIG_SPI_WP_PIN, CONFIG_SPI_HD_PIN,
+#endif
+#endif
+    -1
+};
+#endif
 
 static bool at_nvm_uart_config_set (at_nvm_uart_config_struct *uart_config);
 static bool at_nvm_uart_config_get (at_nvm_uart_config_struct *uart_config);
 
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+static bool at_uart_pin_on_transport(int32_t pin)
+{
+    for (int i = 0; pin >= 0 && s_at_transport_pins[i] >= 0; i++) {
+        if (s_at_transport_pins[i] == pin) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// CTS or RTS on a pin of the transport would load or drive its bus, run UART without flow control then
+static void at_uart_drop_transport_pins(int32_t* cts_pin, int32_t* rts_pin, uart_hw_flowcontrol_t* flow_ctrl)
+{
+    if (at_uart_pin_on_transport(*cts_pin)) {
+        ESP_LOGW(TAG, "CTS pin %d is used by the transport, UART flow control disabled", *cts_pin);
+        *cts_pin = -1;
+        s_at_uart_flow_ctrl_allowed = false;
+    }
+
+    if (at_uart_pin_on_transport(*rts_pin)) {
+        ESP_LOGW(TAG, "RTS pin %d is used by the transport, UART flow control disabled", *rts_pin);
+        *rts_pin = -1;
+        s_at_uart_flow_ctrl_allowed = false;
+    }
+
+    if (!s_at_uart_flow_ctrl_allowed) {
+        *flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    }
+}
+#endif
+
 
 static int32_t at_port_write_data(uint8_t*data,int32_t len)
 {
@@ -102,10 +177,32 @@ static int32_t at_port_write_data(uint8_t*data,int32_t len)
     return length;
 }
 
+// discard the data in the rx buffer through a static scratch buffer, so draining never allocates
+static int32_t at_port_discard_data(int32_t len, TickType_t ticks_to_wait)
+{
+    static uint8_t discard_buf[AT_UART_DISCARD_BUFFER_SIZE];
+    int32_t discard_len = 0;
+    int32_t read_len = 0;
+
+    while (discard_len < len) {
+        read_len = len - discard_len;
+        if (read_len > sizeof(discard_buf)) {
+            read_len = sizeof(discard_buf);
+        }
+
+        read_len = uart_read_bytes(esp_at_uart_port, discard_buf, read_len, ticks_to_wait);
+        if (read_len <= 0) {
+            break;
+        }
+        discard_len += read_len;
+    }
+
+    return discard_len;
+}
+
 static int32_t at_port_read_data(uint8_t*buf,int32_t len)
 {
     TickType_t ticks_to_wait = portTICK_RATE_MS;
-    uint8_t *data = NULL;
     size_t size = 0;
 
     if (len == 0) {
@@ -124,14 +221,7 @@ static int32_t at_port_read_data(uint8_t*buf,int32_t len)
             return 0;
         }
 
-        data = (uint8_t *)malloc(len);
-        if (data) {
-            len = uart_read_bytes(esp_at_uart_port,data,len,ticks_to_wait);
-            free(data);
-            return len;
-        } else {
-            return -1;
-        }
+        return at_port_discard_data(len, ticks_to_wait);
     } else {
         return uart_read_bytes(esp_at_uart_port,buf,len,ticks_to_wait);
     }
@@ -153,6 +243,68 @@ static int32_t at_port_get_data_length (void)
     }
 }
 
+// the rx ring holds about CONFIG_AT_UART_RX_BUFFER_MS of data at the given baud rate
+static int32_t at_uart_rx_buffer_size_get(uint32_t baudrate)
+{
+    int32_t size = (int32_t)((uint64_t)baudrate * CONFIG_AT_UART_RX_BUFFER_MS / 10 / 1000);
+
+    if (size < AT_UART_RX_BUFFER_SIZE_MIN) {
+        size = AT_UART_RX_BUFFER_SIZE_MIN;
+    } else if (size > AT_UART_RX_BUFFER_SIZE_MAX) {
+        size = AT_UART_RX_BUFFER_SIZE_MAX;
+    }
+
+    return size;
+}
+
+// the rx fifo is 128 bytes, leave more room to the interrupt latency as the baud rate goes up
+static void at_uart_rx_intr_tune(uint32_t baudrate)
+{
+    s_at_uart_intr_config.intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M
+        | UART_RXFIFO_TOUT_INT_ENA_M
+        | UART_RXFIFO_OVF_INT_ENA_M;
+    s_at_uart_intr_config.rxfifo_full_thresh = 100;
+    s_at_uart_intr_config.rx_timeout_thresh = 10;
+    s_at_uart_intr_config.txfifo_empty_intr_thresh = 10;
+
+#ifdef CONFIG_AT_UART_ADAPTIVE_RX
+    if (baudrate >= 2000000) {
+        s_at_uart_intr_config.rxfifo_full_thresh = 64;
+        s_at_uart_intr_config.rx_timeout_thresh = 20;
+    } else if (baudrate >= 921600) {
+        s_at_uart_intr_config.rxfifo_full_thresh = 80;
+        s_at_uart_intr_config.rx_timeout_thresh = 15;
+    }
+#endif
+
+    uart_intr_config(esp_at_uart_port, &s_at_uart_intr_config);
+}
+
+static void at_uart_rx_notify(uint32_t len)
+{
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_transport_recv_data_notify(s_at_uart_transport_id, len, portMAX_DELAY);
+#else
+    esp_at_port_recv_data_notify(len, portMAX_DELAY);
+#endif
+    s_at_uart_rx_stats.notify_count++;
+
+#ifdef CONFIG_AT_UART_ADAPTIVE_RX
+    // batch more data per notification under load, go back to per-event notification once the load drops
+    if (len >= AT_UART_NOTIFY_BURST_LEN && len >= s_at_uart_notify_thresh) {
+        s_at_uart_notify_thresh = (s_at_uart_notify_thresh < AT_UART_NOTIFY_THRESH_MIN) ? AT_UART_NOTIFY_THRESH_MIN : s_at_uart_notify_thresh * 2;
+        if (s_at_uart_notify_thresh > s_at_uart_rx_buffer_size / 4) {
+            s_at_uart_notify_thresh = s_at_uart_rx_buffer_size / 4;
+        }
+    } else if (len < s_at_uart_notify_thresh) {
+        s_at_uart_notify_thresh /= 2;
+        if (s_at_uart_notify_thresh < AT_UART_NOTIFY_THRESH_MIN) {
+            s_at_uart_notify_thresh = 0;
+        }
+    }
+#endif
+}
+
 static bool at_port_wait_write_complete (int32_t timeout_msec)
 {
     if (ESP_OK == uart_wait_tx_done(esp_at_uart_port, timeout_msec / portTICK_PERIOD_MS)) {
@@ -168,7 +320,7 @@ static void uart_task(void *pvParameters)
     uint32_t data_len = 0;
     BaseType_t retry_flag = pdFALSE;
     int pattern_pos = -1;
-    uint8_t *data = NULL;
+    TickType_t wait_ticks = 0;
 
     for (;;) {
         //Waiting for UART event.
@@ -178,22 +330,38 @@ retry:
             //Event of UART receving data
             case UART_DATA:
             case UART_BUFFER_FULL:
+                s_at_uart_rx_stats.data_events++;
+                if (event.type == UART_BUFFER_FULL) {
+                    s_at_uart_rx_stats.buffer_full++;
+                }
                 data_len += event.size;
                 // we can put all data together to process
                 retry_flag = pdFALSE;
-                while (xQueueReceive(esp_at_uart_queue, (void * )&event, (portTickType)0) == pdTRUE) {
+                wait_ticks = 0;
+#ifdef CONFIG_AT_UART_ADAPTIVE_RX
+                if (event.type == UART_DATA && data_len < s_at_uart_notify_thresh) {
+                    wait_ticks = AT_UART_NOTIFY_WAIT_TICKS;
+                }
+#endif
+                while (xQueueReceive(esp_at_uart_queue, (void * )&event, wait_ticks) == pdTRUE) {
                     if (event.type == UART_DATA) {
+                        s_at_uart_rx_stats.data_events++;
                         data_len += event.size;
                     } else if (event.type == UART_BUFFER_FULL) {
-                        esp_at_port_recv_data_notify(data_len, portMAX_DELAY);
+                        s_at_uart_rx_stats.data_events++;
+                        s_at_uart_rx_stats.buffer_full++;
+                        at_uart_rx_notify(data_len);
                         data_len = event.size;
                         break;
                     } else {
                         retry_flag = pdTRUE;
                         break;
                     }
+#ifdef CONFIG_AT_UART_ADAPTIVE_RX
+                    wait_ticks = (data_len < s_at_uart_notify_thresh) ? AT_UART_NOTIFY_WAIT_TICKS : 0;
+#endif
                 }
-                esp_at_port_recv_data_notify (data_len, portMAX_DELAY);
+                at_uart_rx_notify(data_len);
                 data_len = 0;
 
                 if (retry_flag == pdTRUE) {
@@ -201,12 +369,10 @@ retry:
                 }
                 break;
             case UART_PATTERN_DET:
+                s_at_uart_rx_stats.pattern_det++;
                 pattern_pos = uart_pattern_pop_pos(esp_at_uart_port);
                 if (pattern_pos >= 0) {
-                    data = (uint8_t *)malloc(pattern_pos + 3);
-                    uart_read_bytes(esp_at_uart_port,data,pattern_pos + 3,0);
-                    free(data);
-                    data = NULL;
+                    at_port_discard_data(pattern_pos + 3, 0);
                 } else {
                     uart_flush_input(esp_at_uart_port);
                     xQueueReset(esp_at_uart_queue);
@@ -214,16 +380,22 @@ retry:
                 esp_at_transmit_terminal();
                 break;
             case UART_FIFO_OVF:
+                s_at_uart_rx_stats.fifo_overflow++;
                 retry_flag = pdFALSE;
                 while (xQueueReceive(esp_at_uart_queue, (void *)&event, (portTickType)0) == pdTRUE) {
                     if ((event.type == UART_DATA) || (event.type == UART_BUFFER_FULL) || (event.type == UART_FIFO_OVF)) {
                         // Put all data together to process
+                        if (event.type == UART_FIFO_OVF) {
+                            s_at_uart_rx_stats.fifo_overflow++;
+                        } else if (event.type == UART_BUFFER_FULL) {
+                            s_at_uart_rx_stats.buffer_full++;
+                        }
                     } else {
                         retry_flag = pdTRUE;
                         break;
                     }
                 }
-                esp_at_port_recv_data_notify(at_port_get_data_length(), portMAX_DELAY);
+                at_uart_rx_notify(at_port_get_data_length());
                 data_len = 0;
                 if (retry_flag == pdTRUE) {
                     goto retry;
@@ -250,15 +422,6 @@ static void at_uart_init(void)
         .rx_flow_ctrl_thresh = 122,
     };
 
-    uart_intr_config_t intr_config = {
-        .intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M
-            | UART_RXFIFO_TOUT_INT_ENA_M
-            | UART_RXFIFO_OVF_INT_ENA_M,
-        .rxfifo_full_thresh = 100,
-        .rx_timeout_thresh = 10,
-        .txfifo_empty_intr_thresh = 10
-    };
-
     int32_t tx_pin = CONFIG_AT_UART_PORT_TX_PIN_DEFAULT;	
     int32_t rx_pin = CONFIG_AT_UART_PORT_RX_PIN_DEFAULT;
     int32_t cts_pin = CONFIG_AT_UART_PORT_CTS_PIN_DEFAULT;
@@ -356,13 +519,17 @@ static void at_uart_init(void)
         free(data);
         data = NULL;
     }
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    at_uart_drop_transport_pins(&cts_pin, &rts_pin, &uart_config.flow_ctrl);
+#endif
     //Set UART parameters
     uart_param_config(esp_at_uart_port, &uart_config);
     //Set UART pins,(-1: default pin, no change.)
     uart_set_pin(esp_at_uart_port, tx_pin, rx_pin, rts_pin, cts_pin);
     //Install UART driver, and get the queue.
-    uart_driver_install(esp_at_uart_port, 2048, 8192, 30,&esp_at_uart_queue,0);
-    uart_intr_config(esp_at_uart_port, &intr_config);
+    s_at_uart_rx_buffer_size = at_uart_rx_buffer_size_get(uart_config.baud_rate);
+    uart_driver_install(esp_at_uart_port, s_at_uart_rx_buffer_size, 8192, 30,&esp_at_uart_queue,0);
+    at_uart_rx_intr_tune(uart_config.baud_rate);
 
     // set actual uart pins
     s_at_uart_port_pin.tx = tx_pin;
@@ -370,7 +537,7 @@ static void at_uart_init(void)
     s_at_uart_port_pin.cts = cts_pin;
     s_at_uart_port_pin.rts = rts_pin;
 
-    xTaskCreate(uart_task, "uTask", 1024, (void*)esp_at_uart_port, 1, NULL);
+    xTaskCreate(uart_task, "uTask", CONFIG_AT_UART_TASK_STACK_SIZE, (void*)esp_at_uart_port, CONFIG_AT_UART_TASK_PRIORITY, NULL);
 }
 
 static bool at_nvm_uart_config_set (at_nvm_uart_config_struct *uart_config)
@@ -495,6 +662,12 @@ static uint8_t at_setupCmdUart(uint8_t para_num)
     if ((value < 0) || (value > 3)) {
         return ESP_AT_RESULT_CODE_ERROR;
     }
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    // CTS/RTS have no pins, they collide with the transport
+    if ((value != UART_HW_FLOWCTRL_DISABLE) && !s_at_uart_flow_ctrl_allowed) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+#endif
     uart_config.flow_control = value;
 
     if (at_default_flag) {
@@ -506,6 +679,7 @@ static uint8_t at_setupCmdUart(uint8_t para_num)
 
     uart_wait_tx_done(esp_at_uart_port,portMAX_DELAY);
     uart_set_baudrate(esp_at_uart_port,uart_config.baudrate);
+    at_uart_rx_intr_tune(uart_config.baudrate);
     uart_set_word_length(esp_at_uart_port,uart_config.data_bits);
     uart_set_stop_bits(esp_at_uart_port,uart_config.stop_bits);
     uart_set_parity(esp_at_uart_port,uart_config.parity);
@@ -581,10 +755,44 @@ static uint8_t at_queryCmdUartDef (uint8_t *cmd_name)
     return ESP_AT_RESULT_CODE_OK;
 }
 
+static uint8_t at_queryCmdUartStat (uint8_t *cmd_name)
+{
+    uint8_t buffer[128];
+
+    snprintf((char*)buffer,sizeof(buffer) - 1,"%s:%d,%d,%d,%u,%u,%u,%u,%u,%u\r\n",cmd_name,s_at_uart_rx_buffer_size,
+        s_at_uart_intr_config.rxfifo_full_thresh,s_at_uart_intr_config.rx_timeout_thresh,s_at_uart_notify_thresh,
+        s_at_uart_rx_stats.data_events,s_at_uart_rx_stats.notify_count,s_at_uart_rx_stats.fifo_overflow,
+        s_at_uart_rx_stats.buffer_full,s_at_uart_rx_stats.pattern_det);
+
+    esp_at_port_write_data(buffer,strlen((char*)buffer));
+    return ESP_AT_RESULT_CODE_OK;
+}
+
+// AT+UART_STAT=0 clears the counters
+static uint8_t at_setupCmdUartStat (uint8_t para_num)
+{
+    int32_t value = 0;
+
+    if (para_num != 1) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    if (esp_at_get_para_as_digit (0,&value) != ESP_AT_PARA_PARSE_RESULT_OK) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+    if (value != 0) {
+        return ESP_AT_RESULT_CODE_ERROR;
+    }
+
+    memset(&s_at_uart_rx_stats,0x0,sizeof(s_at_uart_rx_stats));
+    return ESP_AT_RESULT_CODE_OK;
+}
+
 static esp_at_cmd_struct at_custom_cmd[] = {
     {"+UART", NULL, at_queryCmdUart, at_setupCmdUartDef, NULL},
     {"+UART_CUR", NULL, at_queryCmdUart, at_setupCmdUart, NULL},
     {"+UART_DEF", NULL, at_queryCmdUartDef, at_setupCmdUartDef, NULL},
+    {"+UART_STAT", NULL, at_queryCmdUartStat, at_setupCmdUartStat, NULL},
 };
 
 void at_status_callback (esp_at_status_type status)
@@ -648,7 +856,11 @@ void at_pre_restart_callback (void)
     esp_at_port_wait_write_complete(ESP_AT_PORT_TX_WAIT_MS_MAX);
 }
 
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+void at_uart_transport_init (void)
+#else
 void at_interface_init (void)
+#endif
 {
     esp_at_device_ops_struct esp_at_device_ops = {
         .read_data = at_port_read_data,
@@ -665,14 +877,27 @@ void at_interface_init (void)
 
     at_uart_init();
 
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+    s_at_uart_transport_id = at_transport_register("uart", &esp_at_device_ops, &esp_at_custom_ops, AT_TRANSPORT_RANK_UART);
+#else
     esp_at_device_ops_regist (&esp_at_device_ops);
     esp_at_custom_ops_regist(&esp_at_custom_ops);
+#endif
 }
 
 
+#ifdef CONFIG_AT_TRANSPORT_MUX_SUPPORT
+void at_uart_transport_custom_init(void)
+{
+    esp_at_custom_cmd_array_regist (at_custom_cmd, sizeof(at_custom_cmd)/sizeof(at_custom_cmd[0]));
+    // the AT output goes to the primary transport until UART sends a command
+    at_port_write_data((uint8_t *)"\r\nready\r\n",strlen("\r\nready\r\n"));
+}
+#else
 void at_custom_init(void)
 {
     esp_at_custom_cmd_array_regist (at_custom_cmd, sizeof(at_custom_cmd)/sizeof(at_custom_cmd[0]));
     esp_at_port_write_data((uint8_t *)"\r\nready\r\n",strlen("\r\nready\r\n"));
 }
 #endif
+#endif
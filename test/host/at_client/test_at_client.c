@@ -0,0 +1,613 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host test and fuzz harness of the AT client library, examples/at_client/at_client.c.
+//
+// A fake transport replays a recorded ESP-AT session: each command the client writes releases its
+// recorded response, which is fed back to the client in random splits. The fuzz part feeds random
+// responses built from AT tokens while submitting, polling and aborting at random.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "at_client.h"
+#include "test_common.h"
+
+#define PENDING_MAX         4096
+#define LINK_MAX            2
+#define SESSION_ROUNDS      2000
+#define FUZZ_ROUNDS         20000
+#define FUZZ_INPUT_MAX      512
+
+/******************* fake transport *********************/
+
+typedef struct {
+    const char* cmd;
+    const char* data;               // written on the prompt, NULL if none
+    const char* rsp;                // released by the command
+    const char* rsp_data;           // released by the data
+    at_client_result_t result;
+    uint32_t lines;                 // lines passed to on_line
+} session_step_t;
+
+static const session_step_t s_session[] = {
+    { "ATE0", NULL, "ATE0\r\r\n\r\nOK\r\n", NULL, AT_RESULT_OK, 1 },
+    { "AT+CWMODE=1", NULL, "\r\nOK\r\n", NULL, AT_RESULT_OK, 0 },
+    { "AT+CWJAP=\"ssid\",\"password\"", NULL, "WIFI DISCONNECT\r\nWIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n", NULL, AT_RESULT_OK, 0 },
+    { "AT+CWJAP?", NULL, "+CWJAP:\"ssid\",\"aa:bb:cc:dd:ee:ff\",6,-50\r\n\r\nOK\r\n", NULL, AT_RESULT_OK, 1 },
+    { "AT+CIPMUX=1", NULL, "\r\nOK\r\n", NULL, AT_RESULT_OK, 0 },
+    { "AT+CIPDINFO=1", NULL, "\r\nOK\r\n", NULL, AT_RESULT_OK, 0 },
+    { "AT+CIPSTART=0,\"TCP\",\"192.168.1.2\",8080", NULL, "0,CONNECT\r\n\r\nOK\r\n", NULL, AT_RESULT_OK, 0 },
+    { "AT+CIPSEND=0,5", "hello", "\r\nOK\r\n\r\n>", "\r\nRecv 5 bytes\r\n\r\nSEND OK\r\n", AT_RESULT_OK, 1 },
+    { "AT+CIPSEND=0,4", "ping", "\r\nOK\r\n\r\n>", "\r\nRecv 4 bytes\r\n\r\n+IPD,0,4,\"192.168.1.2\",8080:pong\r\nSEND OK\r\n", AT_RESULT_OK, 1 },
+    { "AT+CIPSTART=1,\"TCP\",\"fe80::1\",80", NULL, "1,CONNECT\r\n\r\nOK\r\n\r\n+IPD,1,11,\"fe80::1\",80:hello\r\nipv6", NULL, AT_RESULT_OK, 0 },
+    { "AT+CIPSEND=1,3", "abc", "\r\nERROR\r\n", NULL, AT_RESULT_ERROR, 0 },
+    { "AT+CIPSEND=1,3", "xyz", "\r\nOK\r\n\r\n>", "\r\nRecv 3 bytes\r\n\r\nSEND FAIL\r\n", AT_RESULT_SEND_FAIL, 1 },
+    { "AT+CIPRECVMODE=1", NULL, "\r\nOK\r\n\r\n+IPD,0,100\r\n", NULL, AT_RESULT_OK, 0 },
+    { "AT+CIPRECVMODE=0", NULL, "\r\nOK\r\n\r\n+IPD,0,3,\"192.168.1.2\",8080:+++", NULL, AT_RESULT_OK, 0 },
+    { "AT+CIPCLOSE=0", NULL, "0,CLOSED\r\n\r\nOK\r\n", NULL, AT_RESULT_OK, 0 },
+    { "AT+BOGUS", NULL, "\r\nERROR\r\n", NULL, AT_RESULT_ERROR, 0 },
+    { "AT+CWJAP=\"x\",\"y\"", NULL, "WIFI DISCONNECT\r\n+CWJAP:1\r\n\r\nFAIL\r\n", NULL, AT_RESULT_FAIL, 1 },
+};
+
+#define SESSION_STEPS   (sizeof(s_session) / sizeof(s_session[0]))
+
+static const char* s_link_data[LINK_MAX] = { "pong+++", "hello\r\nipv6" };
+
+typedef struct {
+    uint32_t step;                  // next command expected
+    bool wait_data;                 // the command of step - 1 waits for its data
+    bool write_fail;
+    bool bad_write;
+    uint8_t pending[PENDING_MAX];   // bytes released and not fed to the client yet
+    size_t pending_len;
+    size_t pending_pos;
+    uint32_t now_ms;
+} fake_transport_t;
+
+static fake_transport_t s_fake;
+
+static void fake_release(const char* rsp)
+{
+    size_t len = strlen(rsp);
+
+    CHECK(s_fake.pending_len + len <= sizeof(s_fake.pending));
+    memcpy(s_fake.pending + s_fake.pending_len, rsp, len);
+    s_fake.pending_len += len;
+}
+
+static int fake_write(void* ctx, const uint8_t* data, size_t len)
+{
+    const session_step_t* step = NULL;
+    char line[AT_CLIENT_CMD_MAX];
+
+    if (s_fake.write_fail) {
+        return -1;
+    }
+
+    if (s_fake.wait_data) {
+        step = &s_session[s_fake.step - 1];
+        s_fake.wait_data = false;
+        if (len != strlen(step->data) || memcmp(data, step->data, len) != 0) {
+            s_fake.bad_write = true;
+            return -1;
+        }
+        fake_release(step->rsp_data);
+        return 0;
+    }
+
+    if (s_fake.step >= SESSION_STEPS) {
+        s_fake.bad_write = true;
+        return -1;
+    }
+
+    step = &s_session[s_fake.step++];
+    snprintf(line, sizeof(line), "%s\r\n", step->cmd);
+    if (len != strlen(line) || memcmp(data, line, len) != 0) {
+        s_fake.bad_write = true;
+        return -1;
+    }
+    s_fake.wait_data = step->data && step->rsp_data;
+    fake_release(step->rsp);
+    return 0;
+}
+
+static uint32_t fake_now_ms(void* ctx)
+{
+    return s_fake.now_ms;
+}
+
+static const at_client_transport_t s_transport = { fake_write, fake_now_ms, NULL };
+
+/******************* callbacks *********************/
+
+typedef struct {
+    uint32_t lines;
+    uint32_t done;
+    at_client_result_t result;
+} cmd_record_t;
+
+static cmd_record_t s_records[SESSION_STEPS];
+static uint8_t s_link_rx[LINK_MAX][64];
+static size_t s_link_rx_len[LINK_MAX];
+static uint32_t s_passive_num;
+static uint32_t s_wifi_urc;
+static uint32_t s_conn_urc;
+static uint32_t s_unsolicited;
+
+// the input chunk being fed, +IPD slices must point into it
+static const uint8_t* s_chunk;
+static size_t s_chunk_len;
+
+static uint32_t s_rand = 1;
+
+static uint32_t test_rand(uint32_t n)
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return ((s_rand >> 8) & 0xFFFFFF) % n;
+}
+
+static void check_line(const char* line, size_t len)
+{
+    CHECK(len > 0 && len < AT_CLIENT_LINE_MAX);
+    CHECK(line[len] == '\0');
+}
+
+static void on_line(void* arg, const char* line, size_t len)
+{
+    check_line(line, len);
+    ((cmd_record_t*)arg)->lines++;
+}
+
+static void on_done(void* arg, at_client_result_t result)
+{
+    cmd_record_t* record = (cmd_record_t*)arg;
+
+    record->done++;
+    record->result = result;
+}
+
+static void on_wifi(void* arg, const char* line, size_t len)
+{
+    check_line(line, len);
+    s_wifi_urc++;
+}
+
+static void on_conn(void* arg, const char* line, size_t len)
+{
+    check_line(line, len);
+    CHECK(line[0] == '0' || line[0] == '1');
+    s_conn_urc++;
+}
+
+static void on_unsolicited(void* arg, const char* line, size_t len)
+{
+    check_line(line, len);
+    s_unsolicited++;
+}
+
+static void on_ipd(void* arg, const at_client_ipd_t* ipd, size_t offset, const uint8_t* data, size_t len)
+{
+    if (data == NULL) {
+        CHECK(len == 0 && offset == 0);
+        CHECK(ipd->link_id == 0 && ipd->length == 100 && ipd->remote_ip[0] == '\0');
+        s_passive_num++;
+        return;
+    }
+
+    CHECK(ipd->link_id >= 0 && ipd->link_id < LINK_MAX);
+    CHECK(data >= s_chunk && data + len <= s_chunk + s_chunk_len);
+    CHECK(offset + len <= ipd->length);
+    CHECK(s_link_rx_len[ipd->link_id] + len <= sizeof(s_link_rx[0]));
+    if (ipd->link_id == 0) {
+        CHECK(strcmp(ipd->remote_ip, "192.168.1.2") == 0 && ipd->remote_port == 8080);
+    } else {
+        CHECK(strcmp(ipd->remote_ip, "fe80::1") == 0 && ipd->remote_port == 80);
+    }
+
+    memcpy(s_link_rx[ipd->link_id] + s_link_rx_len[ipd->link_id], data, len);
+    s_link_rx_len[ipd->link_id] += len;
+}
+
+static at_client_err_t submit(at_client_t* client, const char* cmd, const uint8_t* data, size_t data_len, void* record)
+{
+    at_client_cmd_t entry = { cmd, data, data_len, 0, on_line, on_done, record };
+
+    return at_client_submit(client, &entry);
+}
+
+static void client_setup(at_client_t* client)
+{
+    memset(&s_fake, 0x0, sizeof(s_fake));
+    memset(s_records, 0x0, sizeof(s_records));
+    memset(s_link_rx_len, 0x0, sizeof(s_link_rx_len));
+    s_passive_num = 0;
+    s_wifi_urc = 0;
+    s_conn_urc = 0;
+    s_unsolicited = 0;
+
+    CHECK(at_client_init(client, &s_transport) == AT_CLIENT_OK);
+    CHECK(at_client_register_urc(client, "WIFI ", on_wifi, NULL) == AT_CLIENT_OK);
+    CHECK(at_client_register_urc(client, "*,CONNECT", on_conn, NULL) == AT_CLIENT_OK);
+    CHECK(at_client_register_urc(client, "*,CLOSED", on_conn, NULL) == AT_CLIENT_OK);
+    at_client_set_unsolicited_cb(client, on_unsolicited, NULL);
+    at_client_set_ipd_cb(client, on_ipd, NULL);
+}
+
+// feed the released bytes in chunks of 1 to max_chunk, copied so that a slice outside the chunk shows up
+static void feed_pending(at_client_t* client, uint32_t max_chunk)
+{
+    uint8_t chunk[PENDING_MAX];
+
+    while (s_fake.pending_pos < s_fake.pending_len) {
+        size_t len = 1 + test_rand(max_chunk);
+
+        if (len > s_fake.pending_len - s_fake.pending_pos) {
+            len = s_fake.pending_len - s_fake.pending_pos;
+        }
+        memcpy(chunk, s_fake.pending + s_fake.pending_pos, len);
+        s_fake.pending_pos += len;
+        s_chunk = chunk;
+        s_chunk_len = len;
+        at_client_input(client, chunk, len);
+    }
+}
+
+/******************* session replay *********************/
+
+static void run_session(uint32_t max_chunk)
+{
+    at_client_t client;
+    uint32_t submitted = 0;
+
+    client_setup(&client);
+
+    while (submitted < SESSION_STEPS || !at_client_idle(&client)) {
+        // keep a random number of commands queued, the client writes them one after another
+        uint32_t want = 1 + test_rand(AT_CLIENT_QUEUE_LEN);
+
+        while (submitted < SESSION_STEPS && want-- > 0) {
+            const session_step_t* step = &s_session[submitted];
+            size_t data_len = step->data ? strlen(step->data) : 0;
+            at_client_err_t err = submit(&client, step->cmd, (const uint8_t*)step->data, data_len, &s_records[submitted]);
+
+            if (err == AT_CLIENT_ERR_QUEUE_FULL) {
+                break;
+            }
+            CHECK(err == AT_CLIENT_OK);
+            submitted++;
+        }
+
+        CHECK(s_fake.pending_pos < s_fake.pending_len);
+        feed_pending(&client, max_chunk);
+        CHECK(!s_fake.bad_write);
+    }
+
+    CHECK(s_fake.step == SESSION_STEPS);
+    for (uint32_t i = 0; i < SESSION_STEPS; i++) {
+        CHECK(s_records[i].done == 1);
+        CHECK(s_records[i].result == s_session[i].result);
+        CHECK(s_records[i].lines == s_session[i].lines);
+    }
+    for (uint32_t i = 0; i < LINK_MAX; i++) {
+        CHECK(s_link_rx_len[i] == strlen(s_link_data[i]));
+        CHECK(memcmp(s_link_rx[i], s_link_data[i], s_link_rx_len[i]) == 0);
+    }
+    CHECK(s_passive_num == 1);
+    CHECK(s_wifi_urc == 4);
+    CHECK(s_conn_urc == 3);
+    CHECK(s_unsolicited == 0);
+}
+
+static void test_session_whole(void)
+{
+    run_session(PENDING_MAX);
+}
+
+static void test_session_bytewise(void)
+{
+    run_session(1);
+}
+
+static void test_session_random_splits(void)
+{
+    for (int round = 0; round < SESSION_ROUNDS; round++) {
+        run_session(1 + test_rand(32));
+    }
+}
+
+/******************* single features *********************/
+
+static void test_invalid_args(void)
+{
+    at_client_t client;
+    at_client_transport_t no_write = { NULL, NULL, NULL };
+    char long_cmd[AT_CLIENT_CMD_MAX];
+
+    CHECK(at_client_init(&client, &no_write) == AT_CLIENT_ERR_INVALID_ARG);
+    CHECK(at_client_init(&client, NULL) == AT_CLIENT_ERR_INVALID_ARG);
+    client_setup(&client);
+
+    CHECK(at_client_submit(&client, NULL) == AT_CLIENT_ERR_INVALID_ARG);
+    CHECK(submit(&client, NULL, NULL, 0, NULL) == AT_CLIENT_ERR_INVALID_ARG);
+    CHECK(at_client_register_urc(&client, NULL, on_wifi, NULL) == AT_CLIENT_ERR_INVALID_ARG);
+
+    // the client adds "\r\n" to the command
+    memset(long_cmd, 'A', sizeof(long_cmd));
+    long_cmd[sizeof(long_cmd) - 1] = '\0';
+    CHECK(submit(&client, long_cmd, NULL, 0, NULL) == AT_CLIENT_ERR_TOO_LONG);
+
+    for (uint32_t i = 3; i < AT_CLIENT_URC_MAX; i++) {
+        CHECK(at_client_register_urc(&client, "X", on_wifi, NULL) == AT_CLIENT_OK);
+    }
+    CHECK(at_client_register_urc(&client, "X", on_wifi, NULL) == AT_CLIENT_ERR_QUEUE_FULL);
+    CHECK(at_client_idle(&client));
+    CHECK(s_fake.step == 0);
+}
+
+static void test_queue_full_and_abort(void)
+{
+    at_client_t client;
+
+    client_setup(&client);
+    for (uint32_t i = 0; i < AT_CLIENT_QUEUE_LEN; i++) {
+        CHECK(submit(&client, s_session[i].cmd, NULL, 0, &s_records[i]) == AT_CLIENT_OK);
+    }
+    CHECK(submit(&client, "AT", NULL, 0, NULL) == AT_CLIENT_ERR_QUEUE_FULL);
+
+    // only the first command is written until it finishes
+    CHECK(s_fake.step == 1);
+    at_client_abort(&client);
+    CHECK(at_client_idle(&client));
+    CHECK(s_fake.step == 1);
+    for (uint32_t i = 0; i < AT_CLIENT_QUEUE_LEN; i++) {
+        CHECK(s_records[i].done == 1 && s_records[i].result == AT_RESULT_ABORTED);
+    }
+
+    // the response of the aborted command is unsolicited now
+    feed_pending(&client, 3);
+    CHECK(s_unsolicited == 2);
+}
+
+static void test_timeout(void)
+{
+    at_client_t client;
+    at_client_cmd_t cmd = { s_session[0].cmd, NULL, 0, 100, on_line, on_done, &s_records[0] };
+
+    client_setup(&client);
+    CHECK(at_client_submit(&client, &cmd) == AT_CLIENT_OK);
+    CHECK(submit(&client, s_session[1].cmd, NULL, 0, &s_records[1]) == AT_CLIENT_OK);
+
+    s_fake.now_ms = 99;
+    at_client_poll(&client);
+    CHECK(s_records[0].done == 0);
+
+    // the timeout passes, the next command is written at once
+    s_fake.now_ms = 100;
+    at_client_poll(&client);
+    CHECK(s_records[0].done == 1 && s_records[0].result == AT_RESULT_TIMEOUT);
+    CHECK(s_fake.step == 2);
+
+    s_fake.now_ms = 100 + AT_CLIENT_DEFAULT_TIMEOUT_MS - 1;
+    at_client_poll(&client);
+    CHECK(s_records[1].done == 0);
+    s_fake.now_ms = 100 + AT_CLIENT_DEFAULT_TIMEOUT_MS;
+    at_client_poll(&client);
+    CHECK(s_records[1].done == 1 && s_records[1].result == AT_RESULT_TIMEOUT);
+    CHECK(at_client_idle(&client));
+}
+
+static void test_io_error(void)
+{
+    at_client_t client;
+    const session_step_t* send = &s_session[7];
+
+    client_setup(&client);
+    s_fake.write_fail = true;
+    CHECK(submit(&client, s_session[0].cmd, NULL, 0, &s_records[0]) == AT_CLIENT_OK);
+    CHECK(s_records[0].done == 1 && s_records[0].result == AT_RESULT_IO_ERROR);
+    CHECK(at_client_idle(&client));
+
+    // the data write fails on the prompt
+    s_fake.write_fail = false;
+    s_fake.step = 7;
+    CHECK(submit(&client, send->cmd, (const uint8_t*)send->data, strlen(send->data), &s_records[7]) == AT_CLIENT_OK);
+    s_fake.write_fail = true;
+    feed_pending(&client, 4);
+    CHECK(s_records[7].done == 1 && s_records[7].result == AT_RESULT_IO_ERROR);
+    CHECK(at_client_idle(&client));
+}
+
+static at_client_ipd_t s_last_ipd;
+static uint8_t s_last_data[16];
+static size_t s_last_len;
+
+static void on_ipd_record(void* arg, const at_client_ipd_t* ipd, size_t offset, const uint8_t* data, size_t len)
+{
+    s_last_ipd = *ipd;
+    CHECK(offset + len <= sizeof(s_last_data));
+    memcpy(s_last_data + offset, data, len);
+    s_last_len = offset + len;
+}
+
+static void test_ipd_headers(void)
+{
+    static const char* const invalid[] = {
+        "+IPD,0,0:", "+IPD,:", "+IPD,0,-1:", "+IPD,0,2,\"1.2.3.4\":", "+IPD,0,2,\"1.2.3.4\",70000:",
+        "+IPD,0,2,\"1.2.3.4,80:", "+IPD,256,2:", "+IPD,0,2,1,2,3:", "+IPD,0,2,\"zz\",80:",
+        "+IPD,0,9999999999:",
+    };
+    at_client_t client;
+
+    client_setup(&client);
+    at_client_set_ipd_cb(&client, on_ipd_record, NULL);
+    for (uint32_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        // an invalid header is an ordinary line, the bytes after the colon stay in it
+        fake_release(invalid[i]);
+        fake_release("zz\r\n");
+        feed_pending(&client, 5);
+        CHECK(s_unsolicited == i + 1);
+    }
+    CHECK(s_last_len == 0);
+
+    // single connection mode, no link ID, the data is followed by an empty line
+    fake_release("+IPD,3:abc\r\n");
+    feed_pending(&client, 2);
+    CHECK(s_last_ipd.link_id == -1 && s_last_ipd.length == 3 && s_last_ipd.remote_ip[0] == '\0');
+    CHECK(s_last_len == 3 && memcmp(s_last_data, "abc", 3) == 0);
+
+    // AT+CIPDINFO=1 in single connection mode, unquoted address
+    fake_release("+IPD,2,10.0.0.1,1234:xy");
+    feed_pending(&client, 7);
+    CHECK(s_last_ipd.link_id == -1 && s_last_ipd.length == 2 && s_last_ipd.remote_port == 1234);
+    CHECK(strcmp(s_last_ipd.remote_ip, "10.0.0.1") == 0);
+    CHECK(s_last_len == 2 && memcmp(s_last_data, "xy", 2) == 0);
+    CHECK(s_unsolicited == sizeof(invalid) / sizeof(invalid[0]));
+}
+
+/******************* fuzz *********************/
+
+static const char* const s_fuzz_tokens[] = {
+    "\r\n", "\r\n", "OK", "ERROR", "FAIL", "SEND OK", "SEND FAIL", ">", "+IPD,", "0,", "1,", "5", "3:", ":",
+    "\"192.168.1.2\",", "\"fe80::1\",", "80", "WIFI GOT IP", "0,CLOSED", "\"", ",", "busy p...", "Recv 5 bytes",
+};
+
+static cmd_record_t s_fuzz_records[AT_CLIENT_QUEUE_LEN * 2];
+static uint32_t s_fuzz_submitted;
+static uint32_t s_fuzz_done;
+
+static int fuzz_write(void* ctx, const uint8_t* data, size_t len)
+{
+    CHECK(data != NULL || len == 0);
+    return test_rand(16) == 0 ? -1 : 0;
+}
+
+static void fuzz_on_done(void* arg, at_client_result_t result)
+{
+    cmd_record_t* record = (cmd_record_t*)arg;
+
+    CHECK(record->done == 0);
+    CHECK(result >= AT_RESULT_OK && result <= AT_RESULT_ABORTED);
+    record->done = 1;
+    s_fuzz_done++;
+}
+
+static void fuzz_on_ipd(void* arg, const at_client_ipd_t* ipd, size_t offset, const uint8_t* data, size_t len)
+{
+    CHECK(ipd->link_id >= -1 && ipd->link_id <= 0xff);
+    CHECK(ipd->length > 0);
+    CHECK(memchr(ipd->remote_ip, '\0', sizeof(ipd->remote_ip)) != NULL);
+    if (data) {
+        CHECK(data >= s_chunk && data + len <= s_chunk + s_chunk_len);
+        CHECK(len > 0 && offset + len <= ipd->length);
+    }
+}
+
+static void fuzz_on_line(void* arg, const char* line, size_t len)
+{
+    check_line(line, len);
+}
+
+static void test_fuzz(void)
+{
+    static const uint8_t data[] = "0123456789";
+    at_client_t client;
+    at_client_transport_t transport = { fuzz_write, fake_now_ms, NULL };
+    uint8_t input[FUZZ_INPUT_MAX];
+
+    s_fake.now_ms = 0;
+    CHECK(at_client_init(&client, &transport) == AT_CLIENT_OK);
+    CHECK(at_client_register_urc(&client, "WIFI ", fuzz_on_line, NULL) == AT_CLIENT_OK);
+    CHECK(at_client_register_urc(&client, "*,CLOSED", fuzz_on_line, NULL) == AT_CLIENT_OK);
+    at_client_set_unsolicited_cb(&client, fuzz_on_line, NULL);
+    at_client_set_ipd_cb(&client, fuzz_on_ipd, NULL);
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        size_t len = 0;
+        uint32_t action = test_rand(8);
+
+        if (action == 0) {
+            cmd_record_t* record = &s_fuzz_records[s_fuzz_submitted % (sizeof(s_fuzz_records) / sizeof(s_fuzz_records[0]))];
+            at_client_cmd_t cmd = { "AT+CIPSEND=0,5", test_rand(2) ? data : NULL, 5, 1 + test_rand(50), fuzz_on_line, fuzz_on_done, record };
+
+            // a record is reused only after its command finished
+            if (record->done || s_fuzz_submitted == s_fuzz_done) {
+                memset(record, 0x0, sizeof(cmd_record_t));
+                if (at_client_submit(&client, &cmd) == AT_CLIENT_OK) {
+                    s_fuzz_submitted++;
+                }
+            }
+        } else if (action == 1) {
+            s_fake.now_ms += test_rand(40);
+            at_client_poll(&client);
+        } else if (action == 2 && test_rand(16) == 0) {
+            at_client_abort(&client);
+            CHECK(at_client_idle(&client));
+        }
+
+        // random input built from AT tokens and random bytes
+        while (len < sizeof(input) - 32 && test_rand(8) != 0) {
+            if (test_rand(4) == 0) {
+                input[len++] = test_rand(256);
+            } else {
+                const char* token = s_fuzz_tokens[test_rand(sizeof(s_fuzz_tokens) / sizeof(s_fuzz_tokens[0]))];
+                memcpy(input + len, token, strlen(token));
+                len += strlen(token);
+            }
+        }
+        for (size_t pos = 0; pos < len;) {
+            size_t chunk = 1 + test_rand(len - pos);
+
+            s_chunk = input + pos;
+            s_chunk_len = chunk;
+            at_client_input(&client, input + pos, chunk);
+            pos += chunk;
+        }
+
+        CHECK(s_fuzz_submitted - s_fuzz_done <= AT_CLIENT_QUEUE_LEN);
+        CHECK(at_client_idle(&client) == (s_fuzz_submitted == s_fuzz_done));
+    }
+
+    at_client_abort(&client);
+    CHECK(s_fuzz_submitted == s_fuzz_done);
+    CHECK(s_fuzz_submitted > FUZZ_ROUNDS / 16);
+}
+
+int main(void)
+{
+    printf("at_client\n");
+
+    RUN_TEST(test_invalid_args);
+    RUN_TEST(test_session_whole);
+    RUN_TEST(test_session_bytewise);
+    RUN_TEST(test_session_random_splits);
+    RUN_TEST(test_queue_full_and_abort);
+    RUN_TEST(test_timeout);
+    RUN_TEST(test_io_error);
+    RUN_TEST(test_ipd_headers);
+    RUN_TEST(test_fuzz);
+
+    printf("at_client: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,481 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// The FreeRTOS calls of the AT transports on top of pthreads, enough to run a transport
+// task and its AT core side in one Linux process. Tasks are detached threads, a tick is 1 ms.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
+
+struct shim_task {
+    pthread_t thread;
+    TaskFunction_t func;
+    void* arg;
+    UBaseType_t prio;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+};
+
+struct shim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t len;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t* items;
+};
+
+struct shim_ringbuf {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t size;
+    size_t used;            // bytes of the items in the ring, headers included
+    uint8_t* mem;
+    struct shim_ring_item* first;
+    struct shim_ring_item* last;
+};
+
+struct shim_ring_item {
+    struct shim_ring_item* next;
+    size_t size;
+    size_t charge;          // what the item counts against the ring size
+    bool complete;
+    bool taken;
+    uint8_t data[];
+};
+
+static pthread_mutex_t s_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread struct shim_task* s_current;
+
+void shim_critical_enter(void)
+{
+    pthread_mutex_lock(&s_critical);
+}
+
+void shim_critical_exit(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+static void shim_cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static struct timespec shim_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+// wait on cond until it is signalled or the deadline passes, false on timeout
+static bool shim_wait(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t ticks, const struct timespec* deadline)
+{
+    if (ticks == 0) {
+        return false;
+    }
+    if (ticks == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+// the test's main thread becomes a task the first time it needs to be one
+static struct shim_task* shim_self(void)
+{
+    if (s_current == NULL) {
+        s_current = (struct shim_task*)calloc(1, sizeof(struct shim_task));
+        s_current->thread = pthread_self();
+        s_current->prio = 1;
+        pthread_mutex_init(&s_current->lock, NULL);
+        shim_cond_init(&s_current->cond);
+    }
+    return s_current;
+}
+
+static void* shim_task_entry(void* arg)
+{
+    struct shim_task* task = (struct shim_task*)arg;
+
+    s_current = task;
+    task->func(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char* name, uint32_t stack, void* arg, UBaseType_t prio, TaskHandle_t* handle)
+{
+    struct shim_task* task = (struct shim_task*)calloc(1, sizeof(struct shim_task));
+
+    (void)name;
+    (void)stack;
+    if (task == NULL) {
+        return pdFAIL;
+    }
+
+    task->func = func;
+    task->arg = arg;
+    task->prio = prio;
+    pthread_mutex_init(&task->lock, NULL);
+    shim_cond_init(&task->cond);
+    if (handle) {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, shim_task_entry, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle == NULL || handle == s_current) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(handle->thread);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { ticks / 1000, (long)(ticks % 1000) * 1000000L };
+
+    nanosleep(&ts, NULL);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000L);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return shim_self();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t handle)
+{
+    if (handle == NULL) {
+        handle = s_current;
+    }
+    return handle ? handle->prio : 1;
+}
+
+void xTaskNotifyGive(TaskHandle_t handle)
+{
+    pthread_mutex_lock(&handle->lock);
+    handle->notify++;
+    pthread_cond_signal(&handle->cond);
+    pthread_mutex_unlock(&handle->lock);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct shim_task* task = shim_self();
+    struct timespec deadline = shim_deadline(ticks);
+    uint32_t value = 0;
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && shim_wait(&task->cond, &task->lock, ticks, &deadline)) {
+    }
+    value = task->notify;
+    if (value) {
+        task->notify = clear ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    struct shim_queue* queue = (struct shim_queue*)calloc(1, sizeof(struct shim_queue));
+
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->len = len;
+    queue->item_size = item_size;
+    queue->items = (uint8_t*)calloc(len ? len : 1, item_size ? item_size : 1);
+    pthread_mutex_init(&queue->lock, NULL);
+    shim_cond_init(&queue->cond);
+
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    struct timespec deadline = shim_deadline(ticks);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->len) {
+        if (!shim_wait(&queue->cond, &queue->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->item_size) {
+        memcpy(queue->items + ((queue->head + queue->count) % queue->len) * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks)
+{
+    struct timespec deadline = shim_deadline(ticks);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (!shim_wait(&queue->cond, &queue->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->item_size) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->len;
+    queue->count--;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue == NULL) {
+        return;
+    }
+    free(queue->items);
+    free(queue);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max, 0);
+
+    if (sem) {
+        sem->count = initial;
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return xQueueReceive(sem, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, NULL, 0);
+}
+
+// An item is charged with an 8 byte header and rounded up to 4 bytes, as in the ESP-IDF ring buffer
+static size_t shim_ring_charge(size_t size)
+{
+    return 8 + ((size + 3) & ~(size_t)3);
+}
+
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type)
+{
+    struct shim_ringbuf* ring = (struct shim_ringbuf*)calloc(1, sizeof(struct shim_ringbuf));
+
+    (void)type;
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->size = size;
+    pthread_mutex_init(&ring->lock, NULL);
+    shim_cond_init(&ring->cond);
+
+    return ring;
+}
+
+BaseType_t xRingbufferSendAcquire(RingbufHandle_t ring, void** item, size_t size, TickType_t ticks)
+{
+    struct timespec deadline = shim_deadline(ticks);
+    struct shim_ring_item* entry = NULL;
+    size_t charge = shim_ring_charge(size);
+
+    if (charge > ring->size) {
+        return pdFALSE;
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->used + charge > ring->size) {
+        if (!shim_wait(&ring->cond, &ring->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&ring->lock);
+            return pdFALSE;
+        }
+    }
+    entry = (struct shim_ring_item*)calloc(1, sizeof(struct shim_ring_item) + size);
+    entry->size = size;
+    entry->charge = charge;
+    if (ring->last) {
+        ring->last->next = entry;
+    } else {
+        ring->first = entry;
+    }
+    ring->last = entry;
+    ring->used += charge;
+    pthread_mutex_unlock(&ring->lock);
+
+    *item = entry->data;
+    return pdTRUE;
+}
+
+BaseType_t xRingbufferSendComplete(RingbufHandle_t ring, void* item)
+{
+    struct shim_ring_item* entry = (struct shim_ring_item*)((uint8_t*)item - offsetof(struct shim_ring_item, data));
+
+    pthread_mutex_lock(&ring->lock);
+    entry->complete = true;
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+
+    return pdTRUE;
+}
+
+BaseType_t xRingbufferSend(RingbufHandle_t ring, const void* data, size_t size, TickType_t ticks)
+{
+    void* item = NULL;
+
+    if (xRingbufferSendAcquire(ring, &item, size, ticks) != pdTRUE) {
+        return pdFALSE;
+    }
+    memcpy(item, data, size);
+    return xRingbufferSendComplete(ring, item);
+}
+
+void* xRingbufferReceive(RingbufHandle_t ring, size_t* size, TickType_t ticks)
+{
+    struct timespec deadline = shim_deadline(ticks);
+    struct shim_ring_item* entry = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+    for (;;) {
+        for (entry = ring->first; entry && entry->taken; entry = entry->next) {
+        }
+        if (entry && entry->complete) {
+            break;
+        }
+        if (!shim_wait(&ring->cond, &ring->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&ring->lock);
+            return NULL;
+        }
+    }
+    entry->taken = true;
+    pthread_mutex_unlock(&ring->lock);
+
+    *size = entry->size;
+    return entry->data;
+}
+
+void vRingbufferReturnItem(RingbufHandle_t ring, void* item)
+{
+    struct shim_ring_item* entry = (struct shim_ring_item*)((uint8_t*)item - offsetof(struct shim_ring_item, data));
+    struct shim_ring_item** link = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+    for (link = &ring->first; *link != entry; link = &(*link)->next) {
+    }
+    *link = entry->next;
+    if (ring->last == entry) {
+        ring->last = NULL;
+        for (entry = ring->first; entry && entry->next; entry = entry->next) {
+        }
+        ring->last = entry;
+        entry = (struct shim_ring_item*)((uint8_t*)item - offsetof(struct shim_ring_item, data));
+    }
+    ring->used -= entry->charge;
+    free(entry);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void vRingbufferDelete(RingbufHandle_t ring)
+{
+    struct shim_ring_item* entry = ring->first;
+
+    while (entry) {
+        struct shim_ring_item* next = entry->next;
+        free(entry);
+        entry = next;
+    }
+    free(ring);
+}
@@ -0,0 +1,60 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// The ESP-IDF SDIO slave driver calls used by at_sdio_task.c. The tests provide the implementation.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef void* sdio_slave_buf_handle_t;
+
+typedef enum {
+    SDIO_SLAVE_SEND_STREAM = 0,
+    SDIO_SLAVE_SEND_PACKET = 1,
+} sdio_slave_sending_mode_t;
+
+typedef enum {
+    SDIO_SLAVE_HOSTINT_BIT0 = 1 << 0,
+    SDIO_SLAVE_HOSTINT_BIT1 = 1 << 1,
+    SDIO_SLAVE_HOSTINT_SEND_NEW_PACKET = 1 << 23,
+} sdio_slave_hostint_t;
+
+typedef struct {
+    sdio_slave_sending_mode_t sending_mode;
+    int send_queue_size;
+    size_t recv_buffer_size;
+} sdio_slave_config_t;
+
+esp_err_t sdio_slave_initialize(sdio_slave_config_t* config);
+esp_err_t sdio_slave_start(void);
+sdio_slave_buf_handle_t sdio_slave_recv_register_buf(uint8_t* start);
+esp_err_t sdio_slave_recv_load_buf(sdio_slave_buf_handle_t handle);
+esp_err_t sdio_slave_recv(sdio_slave_buf_handle_t* handle_ret, uint8_t** out_addr, size_t* out_len, TickType_t wait);
+esp_err_t sdio_slave_send_queue(uint8_t* addr, size_t len, void* arg, TickType_t wait);
+esp_err_t sdio_slave_send_get_finished(void** out_arg, TickType_t wait);
+esp_err_t sdio_slave_send_host_int(uint8_t pos);
+void sdio_slave_set_host_intena(sdio_slave_hostint_t mask);
+esp_err_t sdio_slave_write_reg(int pos, uint8_t reg);
@@ -0,0 +1,93 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// FreeRTOS API used by the AT transports, implemented on pthreads by freertos_shim.c.
+// One tick is one millisecond. Critical sections take one global recursive lock.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef TickType_t portTickType;
+
+typedef struct shim_task* TaskHandle_t;
+typedef TaskHandle_t xTaskHandle;
+typedef void (*TaskFunction_t)(void*);
+typedef struct shim_queue* QueueHandle_t;
+typedef QueueHandle_t xQueueHandle;
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef SemaphoreHandle_t xSemaphoreHandle;
+typedef struct shim_ringbuf* RingbufHandle_t;
+typedef struct shim_stream* StreamBufferHandle_t;
+typedef int portMUX_TYPE;
+
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define pdPASS                          1
+#define pdFAIL                          0
+#define portMAX_DELAY                   ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ              1000
+#define portTICK_PERIOD_MS              1
+#define portTICK_RATE_MS                portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(ms))
+#define portMUX_INITIALIZER_UNLOCKED    0
+
+void shim_critical_enter(void);
+void shim_critical_exit(void);
+#define portENTER_CRITICAL(mux)         ((void)(mux), shim_critical_enter())
+#define portEXIT_CRITICAL(mux)          ((void)(mux), shim_critical_exit())
+#define portENTER_CRITICAL_ISR(mux)     portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)      portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR()
+
+// tasks
+BaseType_t xTaskCreate(TaskFunction_t func, const char* name, uint32_t stack, void* arg, UBaseType_t prio, TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t handle);
+void xTaskNotifyGive(TaskHandle_t handle);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+// queues, a semaphore is a queue of zero sized items
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+#define xQueueSendToBack(q, item, ticks)    xQueueSend(q, item, ticks)
+#define xQueueSendFromISR(q, item, woken)   xQueueSend(q, item, 0)
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+#define xSemaphoreCreateMutex()             xSemaphoreCreateCounting(1, 1)
+#define xSemaphoreCreateBinary()            xSemaphoreCreateCounting(1, 0)
+#define vSemaphoreDelete(sem)               vQueueDelete(sem)
+#define xSemaphoreGiveFromISR(sem, woken)   xSemaphoreGive(sem)
@@ -0,0 +1,46 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Stand-in for the AT core: keeps the registered ops and counts the data notifications.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_at.h"
+
+extern esp_at_device_ops_struct mock_esp_at_device_ops;
+extern esp_at_custom_ops_struct mock_esp_at_custom_ops;
+
+/**
+ * @brief Wait for the next esp_at_port_recv_data_notify() call.
+ *
+ * @param timeout_msec how long to wait
+ *
+ * @return the length notified, or -1 on timeout
+ */
+int32_t mock_esp_at_wait_notify(uint32_t timeout_msec);
+
+/**
+ * @brief Number of esp_at_port_recv_data_notify() calls so far.
+ */
+uint32_t mock_esp_at_notify_count(void);
@@ -0,0 +1,85 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mock_esp_at.h"
+
+esp_at_device_ops_struct mock_esp_at_device_ops;
+esp_at_custom_ops_struct mock_esp_at_custom_ops;
+
+static QueueHandle_t s_notify_queue;
+static uint32_t s_notify_count;
+
+static QueueHandle_t mock_esp_at_queue(void)
+{
+    portENTER_CRITICAL(NULL);
+    if (s_notify_queue == NULL) {
+        s_notify_queue = xQueueCreate(64, sizeof(int32_t));
+    }
+    portEXIT_CRITICAL(NULL);
+
+    return s_notify_queue;
+}
+
+void esp_at_device_ops_regist(esp_at_device_ops_struct* ops)
+{
+    mock_esp_at_device_ops = *ops;
+}
+
+void esp_at_custom_ops_regist(esp_at_custom_ops_struct* ops)
+{
+    mock_esp_at_custom_ops = *ops;
+}
+
+bool esp_at_port_recv_data_notify(int32_t len, uint32_t msec)
+{
+    portENTER_CRITICAL(NULL);
+    s_notify_count++;
+    portEXIT_CRITICAL(NULL);
+
+    return xQueueSend(mock_esp_at_queue(), &len, msec == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(msec)) == pdTRUE;
+}
+
+int32_t mock_esp_at_wait_notify(uint32_t timeout_msec)
+{
+    int32_t len = -1;
+
+    if (xQueueReceive(mock_esp_at_queue(), &len, pdMS_TO_TICKS(timeout_msec)) != pdTRUE) {
+        return -1;
+    }
+    return len;
+}
+
+uint32_t mock_esp_at_notify_count(void)
+{
+    uint32_t count = 0;
+
+    portENTER_CRITICAL(NULL);
+    count = s_notify_count;
+    portEXIT_CRITICAL(NULL);
+
+    return count;
+}
@@ -0,0 +1,418 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host test of the incremental HTTP response parser of the OTA, components/at/src/at_http_parser.c.
+// Every capture is fed whole, split at every position, byte by byte and in random segments, and must
+// give the same result each time.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "at_http_parser.h"
+#include "test_common.h"
+
+#define BODY_MAX            1024
+#define RANDOM_ROUNDS       200
+
+typedef struct {
+    const char* name;
+    const char* capture;
+    const char* extra;              // bytes after the response on a keep-alive connection, NULL if none
+    bool head_request;
+    bool closed;                    // the server closes the connection after the capture
+    int result;                     // 0 done, -1 parse error, 1 incomplete
+    int status_code;
+    int64_t content_length;
+    bool chunked;
+    bool keep_alive;
+    const char* body;
+    uint32_t headers;
+} http_capture_t;
+
+static const http_capture_t s_captures[] = {
+    {
+        "version query, keep-alive",
+        "HTTP/1.1 200 OK\r\nServer: nginx\r\nDate: Mon, 18 Oct 2021 08:00:00 GMT\r\n"
+        "Content-Type: application/json\r\nContent-Length: 52\r\nConnection: keep-alive\r\n\r\n"
+        "{\"latest\":\"v2.2.0.0\",\"versions\":[\"v2.1.0.0\",\"v2.2\"]}",
+        "HTTP/1.1 200 OK\r\n", false, false,
+        0, 200, 52, false, true, "{\"latest\":\"v2.2.0.0\",\"versions\":[\"v2.1.0.0\",\"v2.2\"]}", 5,
+    },
+    {
+        "chunked with extensions and trailer",
+        "HTTP/1.1 200 OK\r\ntransfer-encoding: gzip, CHUNKED\r\n\r\n"
+        "5;name=value\r\nhello\r\n1\r\n \r\n6\r\nworld!\r\n0\r\nX-Checksum: 1234\r\n\r\n",
+        NULL, false, false,
+        0, 200, -1, true, true, "hello world!", 1,
+    },
+    {
+        "interim 100 Continue",
+        "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 3\r\nConnection: close\r\n\r\nabc",
+        NULL, false, false,
+        0, 200, 3, false, false, "abc", 2,
+    },
+    {
+        "bare LF and HTTP/1.0 body to EOF",
+        "\nHTTP/1.0 200 OK\nServer: test\n\nfirmware\r\nbytes\n",
+        NULL, false, true,
+        0, 200, -1, false, false, "firmware\r\nbytes\n", 1,
+    },
+    {
+        "body to EOF, connection not closed yet",
+        "HTTP/1.1 200 OK\r\n\r\nsome",
+        NULL, false, false,
+        1, 200, -1, false, false, "some", 0,
+    },
+    {
+        "204 has no body",
+        "HTTP/1.1 204 No Content\r\nContent-Length: 10\r\n\r\n",
+        "HTTP", false, false,
+        0, 204, 10, false, true, "", 1,
+    },
+    {
+        "304 has no body",
+        "HTTP/1.1 304 Not Modified\r\nETag: \"x\"\r\n\r\n",
+        NULL, false, false,
+        0, 304, -1, false, true, "", 1,
+    },
+    {
+        "HEAD response",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1048576\r\n\r\n",
+        NULL, true, false,
+        0, 200, 1048576, false, true, "", 1,
+    },
+    {
+        "404 with a body, header name case and padding",
+        "HTTP/1.1 404 Not Found\r\nCONTENT-length:   9  \r\nconnection: Upgrade, Close\r\n\r\nnot found",
+        NULL, false, false,
+        0, 404, 9, false, false, "not found", 2,
+    },
+    {
+        "empty Content-Length body",
+        "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n",
+        "HTTP/1.1", false, false,
+        0, 200, 0, false, true, "", 1,
+    },
+    {
+        "status line without reason",
+        "HTTP/1.1 200\r\nContent-Length: 2\r\n\r\nok",
+        NULL, false, false,
+        0, 200, 2, false, true, "ok", 1,
+    },
+    {
+        "truncated Content-Length body",
+        "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\nshort",
+        NULL, false, true,
+        1, 200, 100, false, true, "short", 1,
+    },
+    { "not HTTP", "SSH-2.0-OpenSSH_8.2\r\n", NULL, false, false, -1, 0, -1, false, false, "", 0 },
+    { "bad status code", "HTTP/1.1 2x0 OK\r\n", NULL, false, false, -1, 0, -1, false, false, "", 0 },
+    {
+        "conflicting Content-Length",
+        "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\nhello!",
+        NULL, false, false,
+        -1, 200, 5, false, true, "", 1,
+    },
+    {
+        "Content-Length with junk",
+        "HTTP/1.1 200 OK\r\nContent-Length: 5x\r\n\r\nhello",
+        NULL, false, false,
+        -1, 200, -1, false, true, "", 0,
+    },
+    {
+        "invalid chunk size",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+        NULL, false, false,
+        -1, 200, -1, true, true, "", 1,
+    },
+    {
+        "chunk data longer than its size",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcd\r\n0\r\n\r\n",
+        NULL, false, false,
+        -1, 200, -1, true, true, "abc", 1,
+    },
+    {
+        "chunk size overflow",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nffffffffffffffffff\r\n",
+        NULL, false, false,
+        -1, 200, -1, true, true, "", 1,
+    },
+};
+
+#define CAPTURE_NUM     (sizeof(s_captures) / sizeof(s_captures[0]))
+
+typedef struct {
+    int result;
+    int consumed;                   // bytes of the capture and extra taken by the parser
+    int status_code;
+    int64_t content_length;
+    bool chunked;
+    bool keep_alive;
+    uint8_t body[BODY_MAX];
+    size_t body_len;
+    uint32_t headers;
+    uint32_t headers_complete;
+} parse_result_t;
+
+// the segment being fed, body slices must point into it
+static const uint8_t* s_segment;
+static size_t s_segment_len;
+static int s_fail_body_at = -1;
+static uint32_t s_rand = 1;
+
+static uint32_t test_rand(uint32_t n)
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return ((s_rand >> 8) & 0xFFFFFF) % n;
+}
+
+static int on_header(at_http_parser_t* parser, const char* name, const char* value)
+{
+    parse_result_t* result = (parse_result_t*)parser->arg;
+
+    CHECK(name[0] != '\0' && strchr(name, ':') == NULL);
+    CHECK(value[0] != ' ' && (value[0] == '\0' || value[strlen(value) - 1] != ' '));
+    result->headers++;
+    return 0;
+}
+
+static int on_headers_complete(at_http_parser_t* parser)
+{
+    parse_result_t* result = (parse_result_t*)parser->arg;
+
+    result->headers_complete++;
+    return 0;
+}
+
+static int on_body(at_http_parser_t* parser, const uint8_t* data, size_t len)
+{
+    parse_result_t* result = (parse_result_t*)parser->arg;
+
+    CHECK(len > 0);
+    CHECK(data >= s_segment && data + len <= s_segment + s_segment_len);
+    CHECK(result->body_len + len <= sizeof(result->body));
+    CHECK(result->headers_complete == 1);
+
+    if (s_fail_body_at >= 0 && result->body_len + len > (size_t)s_fail_body_at) {
+        return -1;
+    }
+    memcpy(result->body + result->body_len, data, len);
+    result->body_len += len;
+    return 0;
+}
+
+static const at_http_parser_callbacks_t s_callbacks = { on_header, on_headers_complete, on_body };
+
+// feed the capture, and the extra bytes after it, cut at the given positions
+static void parse_segmented(const http_capture_t* capture, const size_t* cuts, uint32_t cut_num, parse_result_t* result)
+{
+    at_http_parser_t parser;
+    uint8_t stream[2048];
+    uint8_t segment[2048];
+    size_t len = strlen(capture->capture);
+    size_t pos = 0;
+
+    memset(result, 0x0, sizeof(parse_result_t));
+    memcpy(stream, capture->capture, len);
+    if (capture->extra) {
+        memcpy(stream + len, capture->extra, strlen(capture->extra));
+        len += strlen(capture->extra);
+    }
+
+    at_http_parser_init(&parser, &s_callbacks, capture->head_request, result);
+    result->result = 1;
+
+    for (uint32_t i = 0; i <= cut_num && result->result == 1; i++) {
+        size_t end = (i < cut_num) ? cuts[i] : len;
+        int ret = 0;
+
+        CHECK(end >= pos && end <= len);
+        // copied so that a body slice outside the segment shows up
+        memcpy(segment, stream + pos, end - pos);
+        s_segment = segment;
+        s_segment_len = end - pos;
+        ret = at_http_parser_execute(&parser, segment, end - pos);
+
+        if (ret < 0) {
+            CHECK(parser.state == AT_HTTP_STATE_ERROR);
+            CHECK(at_http_parser_execute(&parser, segment, 1) == -1);
+            result->result = -1;
+            break;
+        }
+        CHECK((size_t)ret <= end - pos);
+        result->consumed += ret;
+        if ((size_t)ret < end - pos) {
+            // only a complete response leaves bytes behind
+            CHECK(at_http_parser_is_done(&parser));
+        }
+        if (at_http_parser_is_done(&parser)) {
+            result->result = 0;
+        }
+        pos = end;
+    }
+
+    if (result->result == 1 && capture->closed) {
+        result->result = at_http_parser_finish(&parser) == 0 ? 0 : 1;
+    }
+    if (result->result == 0) {
+        CHECK(parser.body_len == (int64_t)result->body_len);
+    }
+
+    result->status_code = parser.status_code;
+    result->content_length = parser.content_length;
+    result->chunked = parser.chunked;
+    result->keep_alive = parser.keep_alive;
+}
+
+static void check_result(const http_capture_t* capture, const parse_result_t* result)
+{
+    if (result->result != capture->result) {
+        fprintf(stderr, "%s: result %d\n", capture->name, result->result);
+
+    }
+    CHECK(result->result == capture->result);
+    CHECK(result->status_code == capture->status_code);
+    CHECK(result->content_length == capture->content_length);
+    CHECK(result->chunked == capture->chunked);
+    CHECK(result->keep_alive == capture->keep_alive);
+    CHECK(result->body_len == strlen(capture->body));
+    CHECK(memcmp(result->body, capture->body, result->body_len) == 0);
+    CHECK(result->headers == capture->headers);
+    if (capture->result == 0) {
+        // a complete response stops before the next one on the connection
+        CHECK(result->consumed == (int)strlen(capture->capture));
+    }
+}
+
+static void test_whole(void)
+{
+    parse_result_t result;
+
+    for (uint32_t i = 0; i < CAPTURE_NUM; i++) {
+        parse_segmented(&s_captures[i], NULL, 0, &result);
+        check_result(&s_captures[i], &result);
+    }
+}
+
+static void test_every_split(void)
+{
+    parse_result_t result;
+
+    for (uint32_t i = 0; i < CAPTURE_NUM; i++) {
+        size_t len = strlen(s_captures[i].capture);
+
+        for (size_t cut = 0; cut <= len; cut++) {
+            parse_segmented(&s_captures[i], &cut, 1, &result);
+            check_result(&s_captures[i], &result);
+        }
+    }
+}
+
+static void test_bytewise(void)
+{
+    static size_t cuts[2048];
+    parse_result_t result;
+
+    for (uint32_t i = 0; i < CAPTURE_NUM; i++) {
+        size_t len = strlen(s_captures[i].capture);
+
+        for (size_t cut = 0; cut < len; cut++) {
+            cuts[cut] = cut + 1;
+        }
+        parse_segmented(&s_captures[i], cuts, len, &result);
+        check_result(&s_captures[i], &result);
+    }
+}
+
+static void test_random_segments(void)
+{
+    size_t cuts[64];
+    parse_result_t result;
+
+    for (uint32_t i = 0; i < CAPTURE_NUM; i++) {
+        size_t len = strlen(s_captures[i].capture);
+
+        for (int round = 0; round < RANDOM_ROUNDS; round++) {
+            uint32_t cut_num = test_rand(sizeof(cuts) / sizeof(cuts[0]));
+
+            for (uint32_t j = 0; j < cut_num; j++) {
+                cuts[j] = test_rand(len + 1);
+            }
+            // sorted cuts, equal ones feed empty segments
+            for (uint32_t j = 1; j < cut_num; j++) {
+                for (uint32_t k = j; k > 0 && cuts[k - 1] > cuts[k]; k--) {
+                    size_t tmp = cuts[k];
+                    cuts[k] = cuts[k - 1];
+                    cuts[k - 1] = tmp;
+                }
+            }
+            parse_segmented(&s_captures[i], cuts, cut_num, &result);
+            check_result(&s_captures[i], &result);
+        }
+    }
+}
+
+static void test_body_callback_error(void)
+{
+    parse_result_t result;
+
+    // the OTA write failing in the middle of the body stops the parser
+    s_fail_body_at = 7;
+    parse_segmented(&s_captures[1], NULL, 0, &result);
+    CHECK(result.result == -1);
+    CHECK(result.body_len == 6);
+    s_fail_body_at = -1;
+}
+
+static void test_long_header_line(void)
+{
+    static char capture[1024];
+    http_capture_t long_header = s_captures[10];
+    parse_result_t result;
+
+    // a header line longer than AT_HTTP_LINE_MAX is truncated and does not overflow
+    strcpy(capture, "HTTP/1.1 200\r\nX-Long: ");
+    memset(capture + strlen(capture), 'a', 600);
+    strcat(capture, "\r\nContent-Length: 2\r\n\r\nok");
+    long_header.capture = capture;
+    long_header.headers = 2;
+
+    parse_segmented(&long_header, NULL, 0, &result);
+    check_result(&long_header, &result);
+}
+
+int main(void)
+{
+    printf("http_parser\n");
+
+    RUN_TEST(test_whole);
+    RUN_TEST(test_every_split);
+    RUN_TEST(test_bytewise);
+    RUN_TEST(test_random_segments);
+    RUN_TEST(test_body_callback_error);
+    RUN_TEST(test_long_header_line);
+
+    printf("http_parser: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// The slave side of CMD53 writes to an ESP AT SDIO slave. A packet is announced by the address of its
+// first write, END_ADDR - length, and every following write has to continue at the address where the
+// previous one stopped. Every write but the last of a packet carries a multiple of 4 bytes from a word
+// aligned buffer, and the last one is padded to 4 bytes at most. The slave takes a packet only into free
+// receive buffers, and loads them back when the host waits for tokens.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "platform_os.h"
+#include "sdio_host_reg.h"
+#include "sdio_driver_port.h"
+#include "sim_sdio_slave.h"
+
+#define SIM_CMD53_BYTE_MAX      512
+
+static uint8_t s_func0[0x400];
+static uint32_t s_block_size = ESP_SDIO_DEFAULT_BUF_SIZE;
+static uint32_t s_token_total;          // receive buffers loaded since reset, what the token register counts
+static uint32_t s_held;                 // receive buffers filled and not loaded back
+static uint32_t s_reload_delay;
+static uint32_t s_pending_waits;
+
+static uint32_t s_packet_len;           // length of the packet being received, 0 if none
+static uint32_t s_packet_remain;
+static uint8_t s_packet[SIM_BUF_SIZE * SIM_BUF_NUM];
+
+static uint8_t s_stream[SIM_STREAM_SIZE];
+static size_t s_stream_len;
+static const uint8_t* s_source;
+static size_t s_source_len;
+static sim_sdio_stats_t s_stats;
+
+static void sim_fail(const char* rule)
+{
+    if (s_stats.error == NULL) {
+        s_stats.error = rule;
+    }
+}
+
+void sim_sdio_reset(void)
+{
+    s_token_total = SIM_BUF_NUM;
+    s_held = 0;
+    s_packet_len = 0;
+    s_pending_waits = 0;
+    s_reload_delay = 0;
+    sim_sdio_clear();
+}
+
+void sim_sdio_clear(void)
+{
+    s_stream_len = 0;
+    memset(&s_stats, 0x0, sizeof(s_stats));
+}
+
+void sim_sdio_set_source(const void* start, size_t len)
+{
+    s_source = (const uint8_t*)start;
+    s_source_len = len;
+}
+
+void sim_sdio_set_reload_delay(uint32_t waits)
+{
+    s_reload_delay = waits;
+}
+
+const uint8_t* sim_sdio_stream(size_t* len)
+{
+    *len = s_stream_len;
+    return s_stream;
+}
+
+void sim_sdio_get_stats(sim_sdio_stats_t* stats)
+{
+    *stats = s_stats;
+}
+
+// the host is waiting for tokens, the slave's AT core reads the held buffers and loads them back
+static void sim_sdio_host_wait(void)
+{
+    s_stats.waits++;
+    if (s_pending_waits++ < s_reload_delay) {
+        return;
+    }
+    s_token_total += s_held;
+    s_held = 0;
+    s_pending_waits = 0;
+}
+
+static sdio_err_t sim_sdio_write(uint32_t addr, const uint8_t* buffer, uint32_t len, bool blocks)
+{
+    uint32_t remain = ESP_SLAVE_CMD53_END_ADDR - addr;
+    uint32_t data_len = 0;
+
+    if (buffer >= s_source && buffer < s_source + s_source_len) {
+        if (buffer + len > s_source + s_source_len + 3) {
+            sim_fail("in place write runs past the caller's data");
+        }
+    } else {
+        s_stats.copied++;
+    }
+
+    if (((uintptr_t)buffer & 3) != 0) {
+        sim_fail("CMD53 buffer not word aligned");
+    }
+
+    if (blocks) {
+        s_stats.cmd53_blocks++;
+        if (len % s_block_size != 0 || len / s_block_size > SDIO_CMD53_MAX_BLOCKS) {
+            sim_fail("block mode CMD53 is not a whole number of blocks");
+        }
+    } else {
+        s_stats.cmd53_bytes++;
+        if (len > SIM_CMD53_BYTE_MAX || (len & 3) != 0) {
+            sim_fail("byte mode CMD53 is not a multiple of 4 within 512 bytes");
+        }
+    }
+
+    if (s_packet_len == 0) {
+        // the first write of a packet gives its length
+        if (remain == 0 || remain > sizeof(s_packet)) {
+            sim_fail("packet longer than all the slave receive buffers");
+            return FAILURE;
+        }
+        if ((remain + SIM_BUF_SIZE - 1) / SIM_BUF_SIZE > SIM_BUF_NUM - s_held) {
+            sim_fail("packet sent without enough send tokens");
+            return FAILURE;
+        }
+        s_packet_len = remain;
+        s_packet_remain = remain;
+    } else if (remain != s_packet_remain) {
+        sim_fail("CMD53 address does not continue the packet");
+        return FAILURE;
+    }
+
+    data_len = (len < remain) ? len : remain;
+    if (data_len < len && len - data_len > 3) {
+        sim_fail("more than 3 bytes of padding");
+    }
+    if (data_len < remain && (data_len & 3) != 0) {
+        sim_fail("a CMD53 before the last one of a packet is not a multiple of 4");
+    }
+
+    memcpy(s_packet + (s_packet_len - s_packet_remain), buffer, data_len);
+    s_packet_remain -= data_len;
+
+    if (s_packet_remain == 0) {
+        if (s_stream_len + s_packet_len <= sizeof(s_stream)) {
+            memcpy(s_stream + s_stream_len, s_packet, s_packet_len);
+            s_stream_len += s_packet_len;
+        }
+        s_held += (s_packet_len + SIM_BUF_SIZE - 1) / SIM_BUF_SIZE;
+        s_stats.packets++;
+        if (s_packet_len > s_stats.max_packet) {
+            s_stats.max_packet = s_packet_len;
+        }
+        s_packet_len = 0;
+    }
+
+    return SIM_OK;
+}
+
+sdio_err_t sdio_driver_init(void)
+{
+    return SIM_OK;
+}
+
+sdio_err_t sdio_driver_set_block_size(uint32_t block_size)
+{
+    s_block_size = block_size;
+    return SIM_OK;
+}
+
+void sdio_driver_get_bus(uint32_t* bus_width, uint32_t* clock_khz)
+{
+    *bus_width = 4;
+    *clock_khz = 40000;
+}
+
+sdio_err_t sdio_driver_write_blocks(uint32_t function, uint32_t addr, void* buffer, uint32_t len)
+{
+    return sim_sdio_write(addr, (const uint8_t*)buffer, len, true);
+}
+
+sdio_err_t sdio_driver_write_bytes(uint32_t function, uint32_t addr, void* buffer, uint32_t len)
+{
+    return sim_sdio_write(addr, (const uint8_t*)buffer, len, false);
+}
+
+sdio_err_t sdio_driver_read_blocks(uint32_t function, uint32_t addr, void* buffer, uint32_t len)
+{
+    return FAILURE;
+}
+
+sdio_err_t sdio_driver_read_bytes(uint32_t function, uint32_t addr, void* buffer, uint32_t len)
+{
+    uint8_t* out = (uint8_t*)buffer;
+    uint32_t token = (s_token_total % TX_BUFFER_MAX) << ESP_SDIO_SEND_OFFSET;
+
+    memset(buffer, 0x0, len);
+    if (addr == (ESP_SDIO_TOKEN_RDATA) && len == 4) {
+        memcpy(buffer, &token, 4);
+    } else if (addr == (ESP_SDIO_SLAVE_CONF_W0) && len == 4) {
+        out[0] = SIM_BUF_SIZE & 0xFF;
+        out[1] = (SIM_BUF_SIZE >> 8) & 0xFF;
+        out[2] = SIM_BUF_NUM;
+        out[3] = ESP_SDIO_SLAVE_CONF_MAGIC;
+    }
+
+    return SIM_OK;
+}
+
+sdio_err_t sdio_driver_read_byte(uint32_t function, uint32_t reg, uint8_t* out_byte)
+{
+    *out_byte = (function == 0 && reg < sizeof(s_func0)) ? s_func0[reg] : 0;
+    return SIM_OK;
+}
+
+sdio_err_t sdio_driver_write_byte(uint32_t function, uint32_t reg, uint8_t in_byte, uint8_t* out_byte)
+{
+    if (function == 0 && reg < sizeof(s_func0)) {
+        s_func0[reg] = in_byte;
+    }
+    if (out_byte) {
+        *out_byte = in_byte;
+    }
+    return SIM_OK;
+}
+
+sdio_err_t sdio_driver_wait_int(uint32_t timeout)
+{
+    return ERR_TIMEOUT;
+}
+
+// single threaded: a delay or a semaphore wait of the host is where the slave makes progress
+void platform_os_delay(uint32_t milliseconds)
+{
+    sim_sdio_host_wait();
+}
+
+uint32_t platform_os_get_time_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+#ifdef SIM_PLATFORM_OS_SEM
+platform_os_sem_t platform_os_sem_create(void)
+{
+    return (platform_os_sem_t)s_func0;
+}
+
+bool platform_os_sem_take(platform_os_sem_t sem, uint32_t milliseconds)
+{
+    sim_sdio_host_wait();
+    return false;
+}
+
+void platform_os_sem_give(platform_os_sem_t sem)
+{
+}
+
+bool platform_os_task_create(void (*task_func)(void*), const char* name, uint32_t stack_size, void* arg, uint32_t priority)
+{
+    return true;
+}
+#endif
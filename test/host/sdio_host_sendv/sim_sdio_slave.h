@@ -0,0 +1,72 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// An AT SDIO slave behind the sdio_driver_* port of the SDIO host example, checking every CMD53 it gets.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdio_host_error.h"
+
+#define SIM_OK              ((sdio_err_t)0)
+#define SIM_BUF_SIZE        512     // receive buffer size the slave publishes
+#define SIM_BUF_NUM         4       // receive buffers the slave publishes
+#define SIM_STREAM_SIZE     (256 * 1024)
+
+typedef struct {
+    uint32_t cmd53_bytes;       // byte mode CMD53 writes
+    uint32_t cmd53_blocks;      // block mode CMD53 writes
+    uint32_t copied;            // CMD53 writes whose buffer is not inside the caller's data
+    uint32_t packets;           // packets completed by the slave
+    uint32_t max_packet;        // longest packet
+    uint32_t waits;             // times the host waited for receive buffers
+    const char* error;          // first rule the host broke, NULL if none
+} sim_sdio_stats_t;
+
+/**
+ * @brief Power up the slave: every receive buffer loaded, nothing received.
+ */
+void sim_sdio_reset(void);
+
+/**
+ * @brief Forget the received stream and the statistics, the receive buffers and the token count stay as they are.
+ */
+void sim_sdio_clear(void);
+
+/**
+ * @brief The caller's data, a CMD53 from inside it is sent in place.
+ */
+void sim_sdio_set_source(const void* start, size_t len);
+
+/**
+ * @brief Keep the received buffers held until the host has waited this many times, 0 to reload them at the first wait.
+ */
+void sim_sdio_set_reload_delay(uint32_t waits);
+
+/**
+ * @brief The byte stream the slave received, in order.
+ */
+const uint8_t* sim_sdio_stream(size_t* len);
+
+void sim_sdio_get_stats(sim_sdio_stats_t* stats);
@@ -0,0 +1,217 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host test of sdio_host_send_packetv() of the SDIO host examples, examples/at_sdio_host/*/sdio_host_transport.c,
+// against a simulated slave which checks the CMD53 rules of an ESP AT SDIO slave. The Makefile builds it once
+// with the ESP32 host and once with the STM32 host.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdio_host_reg.h"
+#include "sdio_host_transport.h"
+#include "sim_sdio_slave.h"
+#include "test_common.h"
+
+#define DATA_SIZE           (16 * 1024)
+#define PACKET_MAX          (SIM_BUF_SIZE * SIM_BUF_NUM)
+#define RANDOM_ROUNDS       2000
+#define RANDOM_SEG_MAX      8
+#define RANDOM_SEG_LEN      700
+
+int sdio_debugLevel = 0;
+
+static uint8_t s_data[DATA_SIZE] __attribute__((aligned(4)));
+static uint8_t s_expect[SIM_STREAM_SIZE];
+static uint32_t s_rand = 1;
+
+static uint32_t test_rand(uint32_t n)
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return ((s_rand >> 8) & 0xFFFFFF) % n;
+}
+
+// send the segments and check the slave received their concatenation by the rules
+static void send_and_check(const sdio_host_iovec_t* iov, int iovcnt, sim_sdio_stats_t* stats)
+{
+    size_t expect_len = 0;
+    size_t stream_len = 0;
+    const uint8_t* stream = NULL;
+
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].len) {
+            memcpy(s_expect + expect_len, iov[i].base, iov[i].len);
+            expect_len += iov[i].len;
+        }
+    }
+
+    sim_sdio_clear();
+    CHECK(sdio_host_send_packetv(iov, iovcnt) == SIM_OK);
+    sim_sdio_get_stats(stats);
+
+    if (stats->error) {
+        fprintf(stderr, "slave: %s\n", stats->error);
+    }
+    CHECK(stats->error == NULL);
+
+    stream = sim_sdio_stream(&stream_len);
+    CHECK(stream_len == expect_len);
+    CHECK(memcmp(stream, s_expect, expect_len) == 0);
+    CHECK(stats->max_packet <= PACKET_MAX);
+}
+
+static void test_invalid_args(void)
+{
+    sdio_host_iovec_t iov[2] = { { s_data, 4 }, { NULL, 1 } };
+    sim_sdio_stats_t stats;
+
+    sim_sdio_clear();
+    CHECK(sdio_host_send_packetv(NULL, 1) == ERR_INVALID_ARG);
+    CHECK(sdio_host_send_packetv(iov, -1) == ERR_INVALID_ARG);
+    CHECK(sdio_host_send_packetv(iov, 2) == ERR_INVALID_ARG);
+
+    // an empty segment may have no base, and an empty list sends nothing
+    iov[1].len = 0;
+    CHECK(sdio_host_send_packetv(iov, 0) == SIM_OK);
+    CHECK(sdio_host_send_packetv(iov, 2) == SIM_OK);
+    CHECK(sdio_host_send_packet(s_data, 0) == SIM_OK);
+
+    sim_sdio_get_stats(&stats);
+    CHECK(stats.error == NULL);
+    CHECK(stats.packets == 1);
+}
+
+static void test_single_lengths(void)
+{
+    sim_sdio_stats_t stats;
+
+    for (size_t len = 1; len <= PACKET_MAX + 600; len++) {
+        sdio_host_iovec_t iov = { s_data, len };
+
+        send_and_check(&iov, 1, &stats);
+        CHECK(stats.packets == (len + PACKET_MAX - 1) / PACKET_MAX);
+        // one aligned segment always goes in place, its tail is padded rather than copied
+        CHECK(stats.copied == 0);
+    }
+}
+
+static void test_aligned_in_place(void)
+{
+    sdio_host_iovec_t iov[3] = { { s_data, 1024 }, { s_data + 2048, 100 }, { s_data + 4096, 36 } };
+    sim_sdio_stats_t stats;
+
+    send_and_check(iov, 3, &stats);
+    CHECK(stats.copied == 0);
+    CHECK(stats.cmd53_blocks == 1);
+    CHECK(stats.packets == 1);
+}
+
+static void test_misaligned_gathered(void)
+{
+    // the 3 byte tail of one segment and the byte before the next word boundary make a word, only those
+    // go through the bounce buffer
+    sdio_host_iovec_t iov[3] = { { s_data, 515 }, { s_data + 1023, 5 }, { s_data + 2048, 512 } };
+    sim_sdio_stats_t stats;
+
+    send_and_check(iov, 3, &stats);
+    CHECK(stats.copied == 1);
+    CHECK(stats.packets == 1);
+
+    // a misaligned segment is copied whole
+    iov[0].base = s_data + 1;
+    iov[0].len = 700;
+    send_and_check(iov, 1, &stats);
+    CHECK(stats.copied > 0);
+}
+
+static void test_split_and_wait(void)
+{
+    sdio_host_iovec_t iov[2] = { { s_data + 3, 5000 }, { s_data + 8192, 3000 } };
+    sim_sdio_stats_t stats;
+
+    // the slave hands the buffers back only after the host waited a few times
+    sim_sdio_set_reload_delay(3);
+    send_and_check(iov, 2, &stats);
+    sim_sdio_set_reload_delay(0);
+
+    CHECK(stats.packets == (8000 + PACKET_MAX - 1) / PACKET_MAX);
+    CHECK(stats.max_packet == PACKET_MAX);
+    CHECK(stats.waits >= 3);
+}
+
+// random layouts, the loaded buffers count runs past TX_BUFFER_MAX so the token register wraps
+static void test_random_iov(void)
+{
+    sdio_host_iovec_t iov[RANDOM_SEG_MAX];
+    sim_sdio_stats_t stats;
+    uint32_t buffers = 0;
+
+    for (int round = 0; round < RANDOM_ROUNDS; round++) {
+        int iovcnt = 1 + test_rand(RANDOM_SEG_MAX);
+        size_t total = 0;
+
+        for (int i = 0; i < iovcnt; i++) {
+            size_t len = test_rand(4) == 0 ? test_rand(4) : test_rand(RANDOM_SEG_LEN);
+            size_t offset = test_rand(DATA_SIZE - len);
+
+            iov[i].base = (len == 0 && test_rand(2)) ? NULL : s_data + offset;
+            iov[i].len = len;
+            total += len;
+        }
+
+        send_and_check(iov, iovcnt, &stats);
+        buffers += (total + SIM_BUF_SIZE - 1) / SIM_BUF_SIZE;
+    }
+
+    CHECK(buffers > TX_BUFFER_MAX);
+}
+
+int main(void)
+{
+    sdio_host_link_info_t info;
+
+    printf("sdio_host_sendv %s\n", SIM_HOST_NAME);
+
+    for (size_t i = 0; i < sizeof(s_data); i++) {
+        s_data[i] = test_rand(256);
+    }
+    sim_sdio_set_source(s_data, sizeof(s_data));
+
+    sim_sdio_reset();
+    CHECK(SDIO_HOST_INIT() == SIM_OK);
+    sdio_host_get_link_info(&info);
+    CHECK(info.block_size == 512);
+    CHECK(info.slave_buf_size == SIM_BUF_SIZE);
+    CHECK(info.slave_buf_num == SIM_BUF_NUM);
+
+    RUN_TEST(test_invalid_args);
+    RUN_TEST(test_single_lengths);
+    RUN_TEST(test_aligned_in_place);
+    RUN_TEST(test_misaligned_gathered);
+    RUN_TEST(test_split_and_wait);
+    RUN_TEST(test_random_iov);
+
+    printf("sdio_host_sendv %s: all tests passed\n", SIM_HOST_NAME);
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// The SDIO slave driver as at_sdio_task.c sees it: receive buffers loaded in order,
+// filled by mock_sdio_host_send(), and sends that complete at once.
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/sdio_slave.h"
+#include "mock_sdio_slave.h"
+
+#define MOCK_SDIO_MAX_BUF       64
+#define MOCK_SDIO_HOST_SIZE     4096
+
+typedef struct {
+    uint8_t* start;
+    bool loaded;
+    uint32_t load_seq;
+} mock_sdio_buf_t;
+
+typedef struct {
+    mock_sdio_buf_t* buf;
+    size_t len;
+} mock_sdio_packet_t;
+
+static mock_sdio_buf_t s_bufs[MOCK_SDIO_MAX_BUF];
+static uint32_t s_buf_num;
+static size_t s_buf_size;
+static uint32_t s_load_seq;
+static uint32_t s_load_calls;
+static uint32_t s_host_int;
+static uint8_t s_regs[64];
+static QueueHandle_t s_recv_queue;
+static QueueHandle_t s_finished_queue;
+static uint8_t s_host_data[MOCK_SDIO_HOST_SIZE];
+static size_t s_host_len;
+
+esp_err_t sdio_slave_initialize(sdio_slave_config_t* config)
+{
+    s_buf_size = config->recv_buffer_size;
+    s_recv_queue = xQueueCreate(MOCK_SDIO_MAX_BUF, sizeof(mock_sdio_packet_t));
+    s_finished_queue = xQueueCreate(config->send_queue_size, sizeof(void*));
+
+    return ESP_OK;
+}
+
+esp_err_t sdio_slave_start(void)
+{
+    return ESP_OK;
+}
+
+sdio_slave_buf_handle_t sdio_slave_recv_register_buf(uint8_t* start)
+{
+    if (s_buf_num == MOCK_SDIO_MAX_BUF) {
+        return NULL;
+    }
+    s_bufs[s_buf_num].start = start;
+    return &s_bufs[s_buf_num++];
+}
+
+esp_err_t sdio_slave_recv_load_buf(sdio_slave_buf_handle_t handle)
+{
+    mock_sdio_buf_t* buf = (mock_sdio_buf_t*)handle;
+
+    portENTER_CRITICAL(NULL);
+    s_load_calls++;
+    if (buf->loaded) {
+        portEXIT_CRITICAL(NULL);
+        return ESP_ERR_INVALID_STATE;
+    }
+    buf->loaded = true;
+    buf->load_seq = s_load_seq++;
+    portEXIT_CRITICAL(NULL);
+
+    return ESP_OK;
+}
+
+esp_err_t sdio_slave_recv(sdio_slave_buf_handle_t* handle_ret, uint8_t** out_addr, size_t* out_len, TickType_t wait)
+{
+    mock_sdio_packet_t packet;
+
+    if (xQueueReceive(s_recv_queue, &packet, wait) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    *handle_ret = packet.buf;
+    *out_addr = packet.buf->start;
+    *out_len = packet.len;
+
+    return ESP_OK;
+}
+
+esp_err_t sdio_slave_send_queue(uint8_t* addr, size_t len, void* arg, TickType_t wait)
+{
+    portENTER_CRITICAL(NULL);
+    if (s_host_len + len <= sizeof(s_host_data)) {
+        memcpy(s_host_data + s_host_len, addr, len);
+        s_host_len += len;
+    }
+    portEXIT_CRITICAL(NULL);
+
+    return xQueueSend(s_finished_queue, &arg, wait) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t sdio_slave_send_get_finished(void** out_arg, TickType_t wait)
+{
+    return xQueueReceive(s_finished_queue, out_arg, wait) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t sdio_slave_send_host_int(uint8_t pos)
+{
+    if (pos == 0) {
+        portENTER_CRITICAL(NULL);
+        s_host_int++;
+        portEXIT_CRITICAL(NULL);
+    }
+    return ESP_OK;
+}
+
+void sdio_slave_set_host_intena(sdio_slave_hostint_t mask)
+{
+    (void)mask;
+}
+
+esp_err_t sdio_slave_write_reg(int pos, uint8_t reg)
+{
+    s_regs[pos] = reg;
+    return ESP_OK;
+}
+
+bool mock_sdio_host_send(const void* data, size_t len)
+{
+    mock_sdio_buf_t* next = NULL;
+    mock_sdio_packet_t packet;
+
+    if (len > s_buf_size) {
+        return false;
+    }
+
+    // the slave fills its receive buffers in the order they were loaded
+    portENTER_CRITICAL(NULL);
+    for (uint32_t i = 0; i < s_buf_num; i++) {
+        if (s_bufs[i].loaded && (next == NULL || s_bufs[i].load_seq < next->load_seq)) {
+            next = &s_bufs[i];
+        }
+    }
+    if (next) {
+        next->loaded = false;
+    }
+    portEXIT_CRITICAL(NULL);
+
+    if (next == NULL) {
+        return false;
+    }
+
+    memcpy(next->start, data, len);
+    packet.buf = next;
+    packet.len = len;
+    xQueueSend(s_recv_queue, &packet, portMAX_DELAY);
+
+    return true;
+}
+
+bool mock_sdio_is_recv_buf(const uint8_t* addr)
+{
+    for (uint32_t i = 0; i < s_buf_num; i++) {
+        if (addr >= s_bufs[i].start && addr < s_bufs[i].start + s_buf_size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t mock_sdio_loaded_count(void)
+{
+    uint32_t count = 0;
+
+    portENTER_CRITICAL(NULL);
+    for (uint32_t i = 0; i < s_buf_num; i++) {
+        count += s_bufs[i].loaded;
+    }
+    portEXIT_CRITICAL(NULL);
+
+    return count;
+}
+
+uint32_t mock_sdio_load_calls(void)
+{
+    uint32_t count = 0;
+
+    portENTER_CRITICAL(NULL);
+    count = s_load_calls;
+    portEXIT_CRITICAL(NULL);
+
+    return count;
+}
+
+uint32_t mock_sdio_host_int_count(void)
+{
+    uint32_t count = 0;
+
+    portENTER_CRITICAL(NULL);
+    count = s_host_int;
+    portEXIT_CRITICAL(NULL);
+
+    return count;
+}
+
+uint8_t mock_sdio_reg(int pos)
+{
+    return s_regs[pos];
+}
+
+size_t mock_sdio_host_take(uint8_t* out, size_t size)
+{
+    size_t len = 0;
+
+    portENTER_CRITICAL(NULL);
+    len = (s_host_len < size) ? s_host_len : size;
+    memcpy(out, s_host_data, len);
+    memmove(s_host_data, s_host_data + len, s_host_len - len);
+    s_host_len -= len;
+    portEXIT_CRITICAL(NULL);
+
+    return len;
+}
@@ -0,0 +1,53 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host side of the mocked SDIO slave driver.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Send a packet from the host into the next loaded receive buffer, as a CMD53 write would.
+ *
+ * @return false if no receive buffer is loaded, that is the host has no send token
+ */
+bool mock_sdio_host_send(const void* data, size_t len);
+
+/**
+ * @brief Whether the address falls inside a registered receive buffer.
+ */
+bool mock_sdio_is_recv_buf(const uint8_t* addr);
+
+uint32_t mock_sdio_loaded_count(void);      // receive buffers currently loaded
+uint32_t mock_sdio_load_calls(void);        // sdio_slave_recv_load_buf() calls so far
+uint32_t mock_sdio_host_int_count(void);    // sdio_slave_send_host_int(0) calls so far
+uint8_t mock_sdio_reg(int pos);             // last value written to a shared register
+
+/**
+ * @brief Copy out what the slave sent to the host so far and forget it.
+ *
+ * @return the number of bytes copied
+ */
+size_t mock_sdio_host_take(uint8_t* out, size_t size);
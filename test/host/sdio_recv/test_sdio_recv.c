@@ -0,0 +1,250 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host test of the SDIO receive list of main/interface/sdio/at_sdio_task.c: zero-copy borrow/return,
+// the reload of fully consumed DMA buffers, read_data across buffers, the BIT0 wake up once
+// the host ran out of send tokens, and the AT+SDIO_STAT counters.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "at_interface.h"
+#include "mock_esp_at.h"
+#include "mock_sdio_slave.h"
+#include "test_common.h"
+
+#define NOTIFY_TIMEOUT_MS   1000
+
+void at_interface_init(void);
+void at_custom_init(void);
+
+static const esp_at_cmd_struct* s_cmd;
+static int32_t s_para;
+static char s_response[128];
+
+// the AT core side of AT+SDIO_STAT: the registered command, its parameter and its response line
+bool esp_at_custom_cmd_array_regist(const esp_at_cmd_struct* custom_at_cmd_array, uint32_t cmd_num)
+{
+    s_cmd = custom_at_cmd_array;
+    return cmd_num == 1;
+}
+
+esp_at_para_parse_result_type esp_at_get_para_as_digit(int32_t para_index, int32_t* value)
+{
+    *value = s_para;
+    return ESP_AT_PARA_PARSE_RESULT_OK;
+}
+
+int32_t esp_at_port_write_data(uint8_t* data, int32_t len)
+{
+    snprintf(s_response, sizeof(s_response), "%.*s", (int)len, (char*)data);
+    return len;
+}
+
+static void host_send(const char* data)
+{
+    CHECK(mock_sdio_host_send(data, strlen(data)));
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == (int32_t)strlen(data));
+}
+
+static void test_slave_ready(void)
+{
+    uint8_t out[32];
+    size_t len = 0;
+    TickType_t start = xTaskGetTickCount();
+
+    CHECK(mock_sdio_reg(0) == (CONFIG_AT_SDIO_BLOCK_SIZE & 0xFF));
+    CHECK(mock_sdio_reg(1) == ((CONFIG_AT_SDIO_BLOCK_SIZE >> 8) & 0xFF));
+    CHECK(mock_sdio_reg(2) == CONFIG_AT_SDIO_BUFFER_NUM);
+    CHECK(mock_sdio_reg(3) == 0xA5);
+    CHECK(mock_sdio_loaded_count() == CONFIG_AT_SDIO_BUFFER_NUM);
+
+    // the recv task greets the host before it waits for data
+    while (len < strlen("\r\nready\r\n") && xTaskGetTickCount() - start < NOTIFY_TIMEOUT_MS) {
+        len += mock_sdio_host_take(out + len, sizeof(out) - len);
+        vTaskDelay(1);
+    }
+    CHECK(len == strlen("\r\nready\r\n"));
+    CHECK(memcmp(out, "\r\nready\r\n", len) == 0);
+}
+
+static void test_borrow_return(void)
+{
+    uint8_t* data = NULL;
+    uint8_t* first = NULL;
+    uint32_t loads = mock_sdio_load_calls();
+
+    host_send("AT+GMR\r\n");
+
+    // the data is handed out in place, inside the DMA buffer the host wrote
+    CHECK(at_sdio_recv_borrow(&data) == 8);
+    CHECK(mock_sdio_is_recv_buf(data));
+    CHECK(memcmp(data, "AT+GMR\r\n", 8) == 0);
+    first = data;
+
+    // borrowing again without returning gives the same bytes
+    CHECK(at_sdio_recv_borrow(&data) == 8);
+    CHECK(data == first);
+
+    CHECK(at_sdio_recv_return(3) == 3);
+    CHECK(mock_sdio_load_calls() == loads);
+    CHECK(at_sdio_recv_borrow(&data) == 5);
+    CHECK(data == first + 3);
+    CHECK(memcmp(data, "GMR\r\n", 5) == 0);
+
+    // the buffer goes back to the slave only once it is fully consumed
+    CHECK(at_sdio_recv_return(5) == 5);
+    CHECK(mock_sdio_load_calls() == loads + 1);
+    CHECK(mock_sdio_loaded_count() == CONFIG_AT_SDIO_BUFFER_NUM);
+
+    CHECK(at_sdio_recv_borrow(&data) == 0);
+    CHECK(data == NULL);
+}
+
+static void test_read_data(void)
+{
+    uint8_t buf[CONFIG_AT_SDIO_BLOCK_SIZE * 2];
+
+    host_send("hello");
+    host_send("world");
+    host_send("!");
+
+    CHECK(mock_esp_at_device_ops.read_data(buf, 0) == 0);
+
+    // a partial read leaves the rest of the buffer in place
+    CHECK(mock_esp_at_device_ops.read_data(buf, 3) == 3);
+    CHECK(memcmp(buf, "hel", 3) == 0);
+
+    // one read spans buffers, in the order the host sent them
+    CHECK(mock_esp_at_device_ops.read_data(buf, 7) == 7);
+    CHECK(memcmp(buf, "loworld", 7) == 0);
+
+    CHECK(mock_esp_at_device_ops.read_data(buf, sizeof(buf)) == 1);
+    CHECK(buf[0] == '!');
+    CHECK(mock_esp_at_device_ops.read_data(buf, sizeof(buf)) == 0);
+    CHECK(mock_sdio_loaded_count() == CONFIG_AT_SDIO_BUFFER_NUM);
+}
+
+static void test_errors(void)
+{
+    uint8_t* data = NULL;
+    uint8_t buf[8];
+
+    CHECK(at_sdio_recv_borrow(NULL) == -1);
+    CHECK(at_sdio_recv_return(1) == -1);
+    CHECK(mock_esp_at_device_ops.read_data(NULL, 4) == -1);
+    CHECK(mock_esp_at_device_ops.read_data(buf, -1) == -1);
+
+    // returning more than was borrowed is refused and leaves the buffer untouched
+    host_send("abc");
+    CHECK(at_sdio_recv_return(4) == -1);
+    CHECK(at_sdio_recv_borrow(&data) == 3);
+    CHECK(at_sdio_recv_return(3) == 3);
+}
+
+static void test_dry_pool_wakes_host(void)
+{
+    at_sdio_recv_stats_t before;
+    at_sdio_recv_stats_t after;
+    uint8_t buf[16];
+    uint32_t ints = mock_sdio_host_int_count();
+
+    at_sdio_get_recv_stats(&before);
+
+    // fill every receive buffer, the host has no send token left
+    for (int i = 0; i < CONFIG_AT_SDIO_BUFFER_NUM; i++) {
+        host_send("0123");
+    }
+    CHECK(mock_sdio_loaded_count() == 0);
+    CHECK(!mock_sdio_host_send("x", 1));
+
+    // the first reload raises BIT0 so the host does not have to poll for its token
+    CHECK(mock_esp_at_device_ops.read_data(buf, 2) == 2);
+    CHECK(mock_sdio_host_int_count() == ints);
+    CHECK(mock_esp_at_device_ops.read_data(buf, 2) == 2);
+    CHECK(mock_sdio_host_int_count() == ints + 1);
+    CHECK(mock_sdio_loaded_count() == 1);
+
+    // the following reloads do not
+    CHECK(mock_esp_at_device_ops.read_data(buf, sizeof(buf)) == 4 * (CONFIG_AT_SDIO_BUFFER_NUM - 1));
+    CHECK(mock_sdio_host_int_count() == ints + 1);
+    CHECK(mock_sdio_loaded_count() == CONFIG_AT_SDIO_BUFFER_NUM);
+
+    at_sdio_get_recv_stats(&after);
+    CHECK(after.recv_buffers - before.recv_buffers == CONFIG_AT_SDIO_BUFFER_NUM);
+    CHECK(after.recv_bytes - before.recv_bytes == 4 * CONFIG_AT_SDIO_BUFFER_NUM);
+    CHECK(after.notifies - before.notifies == CONFIG_AT_SDIO_BUFFER_NUM);
+
+    // a pool that never ran dry does not wake the host
+    host_send("ok");
+    CHECK(mock_esp_at_device_ops.read_data(buf, sizeof(buf)) == 2);
+    CHECK(mock_sdio_host_int_count() == ints + 1);
+}
+
+static void test_sdio_stat(void)
+{
+    uint8_t data[CONFIG_AT_SDIO_SEND_BUFFER_SIZE + 1] = {0};
+    uint8_t out[sizeof(data)];
+    uint8_t buf[16];
+
+    CHECK(s_cmd != NULL && strcmp(s_cmd->at_cmdName, "+SDIO_STAT") == 0);
+    CHECK(s_cmd->at_setupCmd(2) == ESP_AT_RESULT_CODE_ERROR);
+    s_para = 1;
+    CHECK(s_cmd->at_setupCmd(1) == ESP_AT_RESULT_CODE_ERROR);
+    s_para = 0;
+    CHECK(s_cmd->at_setupCmd(1) == ESP_AT_RESULT_CODE_OK);
+
+    // one write larger than a send buffer takes two packets
+    CHECK(mock_esp_at_device_ops.write_data(data, sizeof(data)) == sizeof(data));
+    CHECK(mock_esp_at_device_ops.wait_write_complete(1000));
+    CHECK(mock_sdio_host_take(out, sizeof(out)) == sizeof(data));
+    host_send("abc");
+    CHECK(mock_esp_at_device_ops.read_data(buf, sizeof(buf)) == 3);
+
+    CHECK(s_cmd->at_queryCmd((uint8_t*)"+SDIO_STAT") == ESP_AT_RESULT_CODE_OK);
+    CHECK(strcmp(s_response, "+SDIO_STAT:2,0,0,1,3,1\r\n") == 0);
+
+    CHECK(s_cmd->at_setupCmd(1) == ESP_AT_RESULT_CODE_OK);
+    CHECK(s_cmd->at_queryCmd((uint8_t*)"+SDIO_STAT") == ESP_AT_RESULT_CODE_OK);
+    CHECK(strcmp(s_response, "+SDIO_STAT:0,0,0,0,0,0\r\n") == 0);
+}
+
+int main(void)
+{
+    printf("sdio_recv\n");
+
+    at_interface_init();
+    at_custom_init();
+
+    RUN_TEST(test_slave_ready);
+    RUN_TEST(test_borrow_return);
+    RUN_TEST(test_read_data);
+    RUN_TEST(test_errors);
+    RUN_TEST(test_dry_pool_wakes_host);
+    RUN_TEST(test_sdio_stat);
+
+    printf("sdio_recv: all tests passed\n");
+    return 0;
+}
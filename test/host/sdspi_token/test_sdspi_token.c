@@ -0,0 +1,231 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host test of the SD SPI token and CRC helpers of the STM32 SDSPI host example,
+// examples/at_spi_master/sdspi/STM32/Src/sdspi_token.c.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sdspi_token.h"
+#include "test_common.h"
+
+#define POLL_CHUNK      16      // token poll chunk of the host read path
+
+static uint32_t s_rand = 1;
+
+static uint8_t test_rand_byte(void)
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return (s_rand >> 16) & 0xFF;
+}
+
+// bit-serial CRC7, x^7 + x^3 + 1, as in the SD specification
+static uint8_t ref_crc7(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < len * 8; i++) {
+        uint8_t in = (data[i / 8] >> (7 - i % 8)) & 1;
+        uint8_t fb = ((crc >> 6) & 1) ^ in;
+
+        crc = (crc << 1) & 0x7f;
+        if (fb) {
+            crc ^= 0x09;
+        }
+    }
+
+    return crc;
+}
+
+// bit-serial CRC16, x^16 + x^12 + x^5 + 1
+static uint16_t ref_crc16(const uint8_t* data, size_t len)
+{
+    uint16_t crc = 0;
+
+    for (size_t i = 0; i < len * 8; i++) {
+        uint16_t in = (data[i / 8] >> (7 - i % 8)) & 1;
+        uint16_t fb = ((crc >> 15) & 1) ^ in;
+
+        crc = (uint16_t)(crc << 1);
+        if (fb) {
+            crc ^= 0x1021;
+        }
+    }
+
+    return crc;
+}
+
+static void test_find_r1(void)
+{
+    const uint8_t rsp[] = { 0xff, 0xff, 0xff, 0x01, 0x00 };
+    const uint8_t idle[] = { 0xff, 0xff, 0xff, 0xff };
+
+    CHECK(sdspi_token_find_r1(rsp, sizeof(rsp)) == 3);
+    CHECK(sdspi_token_find_r1(rsp + 3, 2) == 0);
+    CHECK(sdspi_token_find_r1(idle, sizeof(idle)) == -1);
+    CHECK(sdspi_token_find_r1(idle, 0) == -1);
+}
+
+static void test_find_start(void)
+{
+    // the rest of an R5 response comes before the token
+    const uint8_t buf[] = { 0xff, 0x00, 0x10, 0xff, 0xfe, 0x12, 0xfe };
+
+    CHECK(sdspi_token_find_start(buf, sizeof(buf)) == 4);
+    CHECK(sdspi_token_find_start(buf, 4) == -1);
+    CHECK(sdspi_token_find_start(buf + 5, 2) == 1);
+}
+
+static void test_poll_start(void)
+{
+    const uint8_t idle[] = { 0xff, 0x00, 0xff, 0xff };
+    const uint8_t token[] = { 0xff, 0xff, 0xfe, 0x08 };
+    const uint8_t error[] = { 0xff, 0x08, 0xfe };
+    size_t pos = 99;
+
+    CHECK(sdspi_token_poll_start(idle, sizeof(idle), &pos) == SDSPI_TOKEN_NOT_FOUND);
+    CHECK(pos == 99);
+    CHECK(sdspi_token_poll_start(idle, 0, &pos) == SDSPI_TOKEN_NOT_FOUND);
+    CHECK(sdspi_token_poll_start(token, sizeof(token), &pos) == SDSPI_TOKEN_FOUND);
+    CHECK(pos == 2);
+    CHECK(sdspi_token_poll_start(error, sizeof(error), &pos) == SDSPI_TOKEN_ERROR);
+    CHECK(pos == 1);
+}
+
+// poll a stream in chunks as the host does, the token is found wherever the chunks are cut
+static void test_poll_start_chunked(void)
+{
+    uint8_t stream[4 * POLL_CHUNK];
+
+    for (size_t token_at = 0; token_at < sizeof(stream); token_at++) {
+        for (size_t chunk = 1; chunk <= POLL_CHUNK; chunk++) {
+            size_t offset = 0;
+            size_t pos = 0;
+            sdspi_token_result_t ret = SDSPI_TOKEN_NOT_FOUND;
+
+            memset(stream, 0xff, sizeof(stream));
+            stream[token_at] = TOKEN_BLOCK_START;
+
+            while (offset < sizeof(stream)) {
+                size_t len = sizeof(stream) - offset < chunk ? sizeof(stream) - offset : chunk;
+
+                ret = sdspi_token_poll_start(stream + offset, len, &pos);
+                if (ret != SDSPI_TOKEN_NOT_FOUND) {
+                    break;
+                }
+                offset += len;
+            }
+
+            CHECK(ret == SDSPI_TOKEN_FOUND);
+            CHECK(offset + pos == token_at);
+        }
+    }
+}
+
+static void test_find_not_busy(void)
+{
+    const uint8_t busy[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    const uint8_t ready[] = { 0x00, 0x00, 0x00, 0xff, 0xff };
+
+    CHECK(sdspi_token_find_not_busy(busy, sizeof(busy)) == -1);
+    CHECK(sdspi_token_find_not_busy(ready, sizeof(ready)) == 3);
+    CHECK(sdspi_token_find_not_busy(ready + 3, 2) == 0);
+}
+
+static void test_parse_data_rsp(void)
+{
+    const uint8_t ok[] = { 0xff, 0xe5, 0x00 };
+    const uint8_t crc_err[] = { 0xff, 0xff, 0x0b };
+    const uint8_t write_err[] = { 0x0d };
+    const uint8_t undefined[] = { 0xff, 0x03, 0x00, 0xff };
+    const uint8_t undefined_then_ok[] = { 0x03, 0x05 };
+
+    CHECK(sdspi_token_parse_data_rsp(ok, sizeof(ok)) == SDSPI_DATA_RSP_OK);
+    CHECK(sdspi_token_parse_data_rsp(crc_err, sizeof(crc_err)) == SDSPI_DATA_RSP_CRC_ERR);
+    CHECK(sdspi_token_parse_data_rsp(write_err, sizeof(write_err)) == SDSPI_DATA_RSP_WRITE_ERR);
+    CHECK(sdspi_token_parse_data_rsp(undefined, sizeof(undefined)) == SDSPI_DATA_RSP_NONE);
+    CHECK(sdspi_token_parse_data_rsp(undefined_then_ok, sizeof(undefined_then_ok)) == SDSPI_DATA_RSP_OK);
+    CHECK(sdspi_token_parse_data_rsp(ok, 0) == SDSPI_DATA_RSP_NONE);
+}
+
+static void test_crc7(void)
+{
+    const uint8_t cmd0[] = { 0x40, 0x00, 0x00, 0x00, 0x00 };
+    const uint8_t cmd8[] = { 0x48, 0x00, 0x00, 0x01, 0xaa };
+    const uint8_t cmd17[] = { 0x51, 0x00, 0x00, 0x00, 0x00 };
+    uint8_t cmd[5];
+
+    // the CRC bytes 0x95, 0x87 and 0x55 of the SD specification examples
+    CHECK(sdspi_crc7(cmd0, sizeof(cmd0)) == 0x4a);
+    CHECK(sdspi_crc7(cmd8, sizeof(cmd8)) == 0x43);
+    CHECK(sdspi_crc7(cmd17, sizeof(cmd17)) == 0x2a);
+
+    for (int i = 0; i < 10000; i++) {
+        for (size_t j = 0; j < sizeof(cmd); j++) {
+            cmd[j] = test_rand_byte();
+        }
+        CHECK(sdspi_crc7(cmd, sizeof(cmd)) == ref_crc7(cmd, sizeof(cmd)));
+    }
+}
+
+static void test_crc16(void)
+{
+    uint8_t block[512];
+
+    // the CRC of a block of 0xFF in the SD specification
+    memset(block, 0xff, sizeof(block));
+    CHECK(sdspi_crc16(0, block, sizeof(block)) == 0x7fa1);
+    CHECK(sdspi_crc16(0, block, 0) == 0);
+
+    for (int i = 0; i < 2000; i++) {
+        size_t len = test_rand_byte() + test_rand_byte() + 1;
+        size_t split = test_rand_byte() % len;
+
+        for (size_t j = 0; j < len; j++) {
+            block[j] = test_rand_byte();
+        }
+
+        uint16_t crc = sdspi_crc16(0, block, len);
+        CHECK(crc == ref_crc16(block, len));
+        // a block received in parts gives the same CRC
+        CHECK(sdspi_crc16(sdspi_crc16(0, block, split), block + split, len - split) == crc);
+    }
+}
+
+int main(void)
+{
+    printf("sdspi_token\n");
+
+    RUN_TEST(test_find_r1);
+    RUN_TEST(test_find_start);
+    RUN_TEST(test_poll_start);
+    RUN_TEST(test_poll_start_chunked);
+    RUN_TEST(test_find_not_busy);
+    RUN_TEST(test_parse_data_rsp);
+    RUN_TEST(test_crc7);
+    RUN_TEST(test_crc16);
+
+    printf("sdspi_token: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host test of the session multiplexer of AT through socket, main/interface/socket/at_socket_mux.c,
+// with Linux socket pairs as the clients.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "at_socket_mux.h"
+#include "test_common.h"
+
+#define MAX_CLIENTS     3
+#define RX_SIZE         64
+#define GUARD_MS        20
+#define SEND_CHUNK      7
+
+// at most SEND_CHUNK bytes per send() as a short socket buffer would, at_socket_mux_send_all() has to loop
+static uint32_t s_send_calls;
+
+ssize_t send(int fd, const void* data, size_t len, int flags)
+{
+    s_send_calls++;
+    return sendto(fd, data, len > SEND_CHUNK ? SEND_CHUNK : len, flags, NULL, 0);
+}
+
+static at_socket_mux_t s_mux;
+static int s_peer[MAX_CLIENTS];
+
+static void mux_open(void)
+{
+    int fds[2];
+
+    CHECK(at_socket_mux_init(&s_mux, MAX_CLIENTS, RX_SIZE, GUARD_MS) == 0);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        CHECK(at_socket_mux_add(&s_mux, fds[0]) == i);
+        s_peer[i] = fds[1];
+        // the client side is read with nothing pending in some checks
+        fcntl(s_peer[i], F_SETFL, O_NONBLOCK);
+    }
+}
+
+static void mux_close(void)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (s_mux.sessions[i].fd >= 0) {
+            at_socket_mux_remove(&s_mux, i);
+        }
+        close(s_peer[i]);
+    }
+    free(s_mux.sessions);
+}
+
+static void client_send(int index, const char* data)
+{
+    int received = 0;
+    int ret = 0;
+
+    CHECK(write(s_peer[index], data, strlen(data)) == (ssize_t)strlen(data));
+
+    // the ring takes its contiguous free space per call, the task calls again on the next select()
+    while (received < (int)strlen(data)) {
+        ret = at_socket_mux_recv(&s_mux, index);
+        CHECK(ret > 0);
+        received += ret;
+    }
+}
+
+// what a client received, "" if nothing
+static const char* client_take(int index)
+{
+    static char buf[1024];
+    ssize_t len = read(s_peer[index], buf, sizeof(buf) - 1);
+
+    buf[len > 0 ? len : 0] = '\0';
+    return buf;
+}
+
+static void core_write(const char* data, uint32_t now_ms)
+{
+    CHECK(at_socket_mux_send(&s_mux, (const uint8_t*)data, strlen(data), now_ms) == (int)strlen(data));
+}
+
+// the AT core reads a whole command
+static int core_read(char* out, uint32_t size)
+{
+    int len = at_socket_mux_next_command(&s_mux, (uint8_t*)out, size - 1);
+
+    out[len] = '\0';
+    at_socket_mux_consumed(&s_mux, len);
+    return len;
+}
+
+static void test_add_remove(void)
+{
+    int fds[2];
+
+    mux_open();
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CHECK(at_socket_mux_add(&s_mux, fds[0]) == -1);
+    close(fds[0]);
+    close(fds[1]);
+
+    // a freed slot is reused
+    CHECK(!at_socket_mux_remove(&s_mux, 1));
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CHECK(at_socket_mux_add(&s_mux, fds[0]) == 1);
+    close(s_peer[1]);
+    s_peer[1] = fds[1];
+    mux_close();
+}
+
+static void test_round_robin(void)
+{
+    char cmd[RX_SIZE];
+
+    mux_open();
+    client_send(2, "AT+C\r\n");
+    client_send(0, "AT+A\r\n");
+    client_send(1, "AT+B\r\n");
+
+    CHECK(core_read(cmd, sizeof(cmd)) == 6);
+    CHECK(strcmp(cmd, "AT+A\r\n") == 0);
+    CHECK(s_mux.active == 0);
+
+    // one command at a time
+    CHECK(core_read(cmd, sizeof(cmd)) == 0);
+
+    core_write("OK\r\n", 100);
+    CHECK(strcmp(client_take(0), "OK\r\n") == 0);
+    CHECK(strcmp(client_take(1), "") == 0);
+
+    // the session is kept for the guard time, a '>' prompt may still follow
+    CHECK(at_socket_mux_poll(&s_mux, 100 + GUARD_MS - 1));
+    CHECK(s_mux.active == 0);
+    CHECK(at_socket_mux_poll(&s_mux, 100 + GUARD_MS));
+    CHECK(s_mux.active == -1);
+
+    CHECK(core_read(cmd, sizeof(cmd)) == 6);
+    CHECK(strcmp(cmd, "AT+B\r\n") == 0);
+    core_write("ERROR\r\n", 200);
+    at_socket_mux_poll(&s_mux, 200 + GUARD_MS);
+
+    CHECK(core_read(cmd, sizeof(cmd)) == 6);
+    CHECK(strcmp(cmd, "AT+C\r\n") == 0);
+    core_write("\r\nOK\r\n", 300);
+    CHECK(strcmp(client_take(2), "\r\nOK\r\n") == 0);
+    CHECK(!at_socket_mux_poll(&s_mux, 300 + GUARD_MS));
+    mux_close();
+}
+
+static void test_routing(void)
+{
+    char cmd[RX_SIZE];
+
+    mux_open();
+
+    // output with no command pending is a URC, every client gets it
+    core_write("WIFI GOT IP\r\n", 0);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        CHECK(strcmp(client_take(i), "WIFI GOT IP\r\n") == 0);
+    }
+
+    client_send(1, "AT+GMR\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 8);
+    core_write("AT version:2.1.0.0\r\n", 10);
+    CHECK(strcmp(client_take(1), "AT version:2.1.0.0\r\n") == 0);
+    CHECK(strcmp(client_take(0), "") == 0);
+    CHECK(strcmp(client_take(2), "") == 0);
+
+    // a client that goes away releases the AT core at once
+    CHECK(at_socket_mux_remove(&s_mux, 1));
+    CHECK(s_mux.active == -1);
+    mux_close();
+}
+
+static void test_payload_ending_with_ok(void)
+{
+    char cmd[RX_SIZE];
+
+    mux_open();
+    client_send(0, "AT+CIPRECVDATA=8\r\n");
+    client_send(1, "AT\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 18);
+
+    // received data that happens to end with a result code does not end the command
+    core_write("+CIPRECVDATA:8,abcdOK\r\n", 10);
+    CHECK(!s_mux.done);
+    core_write("\r\nOK\r\n", 11);
+    CHECK(s_mux.done);
+    CHECK(strcmp(client_take(0), "+CIPRECVDATA:8,abcdOK\r\n\r\nOK\r\n") == 0);
+    CHECK(strcmp(client_take(1), "") == 0);
+    mux_close();
+}
+
+static void test_unread_holds_result(void)
+{
+    char cmd[RX_SIZE];
+    int len = 0;
+
+    mux_open();
+    client_send(0, "AT+CWJAP=\"ssid\",\"pwd\"\r\n");
+    len = at_socket_mux_next_command(&s_mux, (uint8_t*)cmd, sizeof(cmd));
+    CHECK(len == 23);
+
+    // an "OK" before the AT core read all of the command can not be its result
+    at_socket_mux_consumed(&s_mux, 10);
+    CHECK(s_mux.unread == 13);
+    core_write("OK\r\n", 10);
+    CHECK(!s_mux.done);
+
+    at_socket_mux_consumed(&s_mux, 13);
+    CHECK(s_mux.unread == 0);
+    core_write("OK\r\n", 20);
+    CHECK(s_mux.done);
+
+    // more than handed over can not make unread wrap
+    at_socket_mux_consumed(&s_mux, 5);
+    CHECK(s_mux.unread == 0);
+    mux_close();
+}
+
+static void test_prompt(void)
+{
+    char cmd[RX_SIZE];
+
+    mux_open();
+    client_send(0, "AT+CIPSEND=5\r\n");
+    client_send(1, "AT\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 14);
+
+    // after the prompt the same client sends raw data, no line ending needed
+    core_write("OK\r\n\r\n>", 10);
+    CHECK(s_mux.raw);
+    CHECK(!s_mux.done);
+    CHECK(at_socket_mux_poll(&s_mux, 10 + GUARD_MS * 2));
+    CHECK(s_mux.active == 0);
+
+    client_send(0, "ab");
+    CHECK(core_read(cmd, sizeof(cmd)) == 2);
+    CHECK(strcmp(cmd, "ab") == 0);
+    client_send(0, "c\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 3);
+
+    core_write("\r\nRecv 5 bytes\r\n", 20);
+    core_write("\r\nSEND OK\r\n", 21);
+    CHECK(s_mux.done);
+    CHECK(!s_mux.raw);
+    at_socket_mux_poll(&s_mux, 21 + GUARD_MS);
+
+    CHECK(core_read(cmd, sizeof(cmd)) == 4);
+    CHECK(strcmp(cmd, "AT\r\n") == 0);
+    CHECK(s_mux.active == 1);
+    mux_close();
+}
+
+static void test_lines(void)
+{
+    char cmd[RX_SIZE + 1];
+    char fill[RX_SIZE + 1];
+
+    mux_open();
+
+    // a line is scheduled only once it is complete
+    client_send(0, "AT+RS");
+    CHECK(core_read(cmd, sizeof(cmd)) == 0);
+    client_send(0, "T\r\nAT\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 8);
+    CHECK(strcmp(cmd, "AT+RST\r\n") == 0);
+    core_write("OK\r\n", 0);
+    at_socket_mux_poll(&s_mux, GUARD_MS);
+
+    // the next line of the same client waits for its turn
+    client_send(1, "AT+B\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 6);
+    CHECK(strcmp(cmd, "AT+B\r\n") == 0);
+    core_write("OK\r\n", 0);
+    at_socket_mux_poll(&s_mux, GUARD_MS);
+    CHECK(core_read(cmd, sizeof(cmd)) == 4);
+    core_write("OK\r\n", 0);
+    at_socket_mux_poll(&s_mux, GUARD_MS);
+
+    // a line that fills the whole ring is handed over as it is
+    memset(fill, 'A', RX_SIZE);
+    fill[RX_SIZE] = '\0';
+    client_send(2, fill);
+    CHECK(core_read(cmd, sizeof(cmd)) == RX_SIZE);
+    mux_close();
+}
+
+static void test_ring_wrap(void)
+{
+    char cmd[RX_SIZE];
+    fd_set read_set;
+
+    mux_open();
+    for (int i = 0; i < 10; i++) {
+        client_send(0, "AT+ABCDEFGHIJ\r\n");
+        CHECK(core_read(cmd, sizeof(cmd)) == 15);
+        CHECK(strcmp(cmd, "AT+ABCDEFGHIJ\r\n") == 0);
+        core_write("OK\r\n", 0);
+        at_socket_mux_poll(&s_mux, GUARD_MS);
+    }
+
+    // a full ring is left out of select()
+    FD_ZERO(&read_set);
+    CHECK(at_socket_mux_fill_fdset(&s_mux, &read_set) >= 0);
+    CHECK(FD_ISSET(s_mux.sessions[0].fd, &read_set));
+    s_mux.sessions[0].rx_len = RX_SIZE;
+    FD_ZERO(&read_set);
+    at_socket_mux_fill_fdset(&s_mux, &read_set);
+    CHECK(!FD_ISSET(s_mux.sessions[0].fd, &read_set));
+    s_mux.sessions[0].rx_len = 0;
+    mux_close();
+}
+
+static void test_transparent(void)
+{
+    char cmd[RX_SIZE];
+
+    mux_open();
+    client_send(0, "AT+CIPSEND\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 12);
+    core_write("\r\nOK\r\n\r\n>", 0);
+    at_socket_mux_set_transparent(&s_mux, true, 0);
+
+    // in transparent transmission no output ends the session
+    client_send(0, "OK\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 4);
+    core_write("OK\r\n", 1);
+    CHECK(!s_mux.done);
+
+    client_send(0, "+++");
+    CHECK(at_socket_mux_take_escape(&s_mux, 0));
+    CHECK(s_mux.sessions[0].rx_len == 0);
+    at_socket_mux_set_transparent(&s_mux, false, 2);
+    CHECK(s_mux.done);
+    CHECK(!s_mux.raw);
+    at_socket_mux_poll(&s_mux, 2 + GUARD_MS);
+    CHECK(s_mux.active == -1);
+
+    // "+++" inside other data is data
+    client_send(1, "+++\r\n");
+    CHECK(!at_socket_mux_take_escape(&s_mux, 1));
+    mux_close();
+}
+
+static void test_send_all(void)
+{
+    char cmd[RX_SIZE];
+    char data[200];
+    uint32_t calls = 0;
+
+    mux_open();
+    for (int i = 0; i < sizeof(data) - 1; i++) {
+        data[i] = 'a' + i % 26;
+    }
+    data[sizeof(data) - 1] = '\0';
+
+    // URCs go out whole to every client
+    calls = s_send_calls;
+    core_write(data, 0);
+    CHECK(s_send_calls - calls == MAX_CLIENTS * ((sizeof(data) - 1 + SEND_CHUNK - 1) / SEND_CHUNK));
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        CHECK(strcmp(client_take(i), data) == 0);
+    }
+
+    // and so does the output of a command
+    client_send(2, "AT+CWLAP\r\n");
+    CHECK(core_read(cmd, sizeof(cmd)) == 10);
+    core_write(data, 1);
+    CHECK(strcmp(client_take(2), data) == 0);
+
+    // a client that can not be written to is an error only if nobody got the data
+    close(s_peer[2]);
+    s_peer[2] = -1;
+    signal(SIGPIPE, SIG_IGN);
+    CHECK(at_socket_mux_send(&s_mux, (const uint8_t*)"x", 1, 2) == -1);
+    at_socket_mux_remove(&s_mux, 2);
+    core_write("y", 3);
+    CHECK(strcmp(client_take(0), "y") == 0);
+    mux_close();
+}
+
+int main(void)
+{
+    printf("socket_mux\n");
+
+    RUN_TEST(test_add_remove);
+    RUN_TEST(test_round_robin);
+    RUN_TEST(test_routing);
+    RUN_TEST(test_payload_ending_with_ok);
+    RUN_TEST(test_unread_holds_result);
+    RUN_TEST(test_prompt);
+    RUN_TEST(test_lines);
+    RUN_TEST(test_ring_wrap);
+    RUN_TEST(test_transparent);
+    RUN_TEST(test_send_all);
+
+    printf("socket_mux: all tests passed\n");
+    return 0;
+}
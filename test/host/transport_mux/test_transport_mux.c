@@ -0,0 +1,378 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host test of the AT transport multiplexer, main/interface/at_transport_mux.c and the glue of
+// main/interface/at_transport_task.c, with fake transports in place of UART, SDIO and socket.
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "at_transport_mux.h"
+#include "mock_esp_at.h"
+#include "test_common.h"
+
+#define FAKE_BUF_SIZE       256
+#define NOTIFY_TIMEOUT_MS   100
+
+typedef struct {
+    const char* name;
+    uint32_t rank;
+    int index;
+    uint8_t rx[FAKE_BUF_SIZE];
+    uint32_t rx_len;
+    char tx[FAKE_BUF_SIZE];
+    uint32_t tx_len;
+    esp_at_status_type status;
+    uint32_t status_calls;
+} fake_transport_t;
+
+static fake_transport_t s_uart = {.name = "uart", .rank = AT_TRANSPORT_RANK_UART, .index = -1};
+static fake_transport_t s_sdio = {.name = "sdio", .rank = AT_TRANSPORT_RANK_SDIO, .index = -1};
+static fake_transport_t s_socket = {.name = "socket", .rank = AT_TRANSPORT_RANK_SOCKET, .index = -1};
+
+static int32_t fake_read(fake_transport_t* t, uint8_t* buf, int32_t len)
+{
+    if (len > t->rx_len) {
+        len = t->rx_len;
+    }
+    memcpy(buf, t->rx, len);
+    memmove(t->rx, t->rx + len, t->rx_len - len);
+    t->rx_len -= len;
+    return len;
+}
+
+static int32_t fake_write(fake_transport_t* t, uint8_t* buf, int32_t len)
+{
+    memcpy(t->tx + t->tx_len, buf, len);
+    t->tx_len += len;
+    t->tx[t->tx_len] = '\0';
+    return len;
+}
+
+static void fake_status(fake_transport_t* t, esp_at_status_type status)
+{
+    t->status = status;
+    t->status_calls++;
+}
+
+#define FAKE_OPS(t)                                                                         \
+    static int32_t t##_read(uint8_t* buf, int32_t len) { return fake_read(&s_##t, buf, len); }   \
+    static int32_t t##_write(uint8_t* buf, int32_t len) { return fake_write(&s_##t, buf, len); } \
+    static void t##_status(esp_at_status_type status) { fake_status(&s_##t, status); }
+
+FAKE_OPS(uart)
+FAKE_OPS(sdio)
+FAKE_OPS(socket)
+
+static int fake_register(fake_transport_t* t, int32_t (*read)(uint8_t*, int32_t), int32_t (*write)(uint8_t*, int32_t),
+                         void (*status)(esp_at_status_type))
+{
+    esp_at_device_ops_struct device_ops = {
+        .read_data = read,
+        .write_data = write,
+    };
+    esp_at_custom_ops_struct custom_ops = {
+        .status_callback = status,
+    };
+
+    t->index = at_transport_register(t->name, &device_ops, &custom_ops, t->rank);
+    return t->index;
+}
+
+// a transport receives data and tells the multiplexer, as its recv task would
+static bool fake_receive(fake_transport_t* t, const char* data)
+{
+    memcpy(t->rx + t->rx_len, data, strlen(data));
+    t->rx_len += strlen(data);
+    return at_transport_recv_data_notify(t->index, strlen(data), 0);
+}
+
+static void fake_clear_tx(void)
+{
+    s_uart.tx_len = s_sdio.tx_len = s_socket.tx_len = 0;
+    s_uart.tx[0] = s_sdio.tx[0] = s_socket.tx[0] = '\0';
+}
+
+// AT core side
+static int32_t core_read(char* buf, int32_t len)
+{
+    int32_t ret = mock_esp_at_device_ops.read_data((uint8_t*)buf, len - 1);
+
+    buf[ret > 0 ? ret : 0] = '\0';
+    return ret;
+}
+
+static void core_write(const char* data)
+{
+    CHECK(mock_esp_at_device_ops.write_data((uint8_t*)data, strlen(data)) == (int32_t)strlen(data));
+}
+
+// the parts of the AT core at_transport_task.c calls for AT+TRANSPORT
+static const esp_at_cmd_struct* s_cmds;
+static const char* s_para_str;
+static char s_core_out[FAKE_BUF_SIZE];
+
+bool esp_at_custom_cmd_array_regist(const esp_at_cmd_struct* custom_at_cmd_array, uint32_t cmd_num)
+{
+    s_cmds = custom_at_cmd_array;
+    return true;
+}
+
+esp_at_para_parse_result_type esp_at_get_para_as_str(int32_t para_index, uint8_t** result)
+{
+    if (s_para_str == NULL) {
+        return ESP_AT_PARA_PARSE_RESULT_FAIL;
+    }
+    *result = (uint8_t*)s_para_str;
+    return ESP_AT_PARA_PARSE_RESULT_OK;
+}
+
+int32_t esp_at_port_write_data(uint8_t* data, int32_t len)
+{
+    strncat(s_core_out, (char*)data, len);
+    return len;
+}
+
+// UART registers itself from at_transport_interface_init(), after the selected transport
+void at_uart_transport_init(void)
+{
+    fake_register(&s_uart, uart_read, uart_write, uart_status);
+}
+
+void at_uart_transport_custom_init(void)
+{
+}
+
+static void test_select_unit(void)
+{
+    at_transport_mux_t mux;
+    esp_at_device_ops_struct ops = {
+        .read_data = uart_read,
+        .write_data = uart_write,
+    };
+    esp_at_device_ops_struct no_read = {
+        .write_data = uart_write,
+    };
+
+    at_transport_mux_init(&mux);
+    CHECK(at_transport_mux_select_output(&mux) == -1);
+    CHECK(at_transport_mux_select_input(&mux) == -1);
+
+    CHECK(at_transport_mux_add(&mux, "a", &ops, NULL, 1) == 0);
+    CHECK(at_transport_mux_add(&mux, "b", &ops, NULL, 3) == 1);
+    CHECK(at_transport_mux_add(&mux, "c", &ops, NULL, 2) == 2);
+    CHECK(at_transport_mux_add(&mux, "b", &ops, NULL, 2) == -1);
+    CHECK(at_transport_mux_add(&mux, "d", &no_read, NULL, 2) == -1);
+    CHECK(at_transport_mux_add(&mux, NULL, &ops, NULL, 2) == -1);
+    CHECK(at_transport_mux_add(&mux, "d", &ops, NULL, 0) == 3);
+    CHECK(at_transport_mux_add(&mux, "e", &ops, NULL, 9) == -1);
+    CHECK(mux.primary == 1);
+    CHECK(at_transport_mux_find(&mux, "c") == 2);
+    CHECK(at_transport_mux_find(&mux, "x") == -1);
+
+    // with nothing received the output goes to the primary transport
+    CHECK(at_transport_mux_select_output(&mux) == 1);
+
+    // the input picks the active transport, the output follows it
+    CHECK(at_transport_mux_notify(&mux, 2, 5));
+    CHECK(!at_transport_mux_notify(&mux, 2, 0));
+    CHECK(!at_transport_mux_notify(&mux, 7, 5));
+    CHECK(at_transport_mux_select_input(&mux) == 2);
+    CHECK(at_transport_mux_select_output(&mux) == 2);
+    CHECK(mux.switches == 1);
+
+    // a transport is drained before the next one is read, commands are not interleaved
+    CHECK(at_transport_mux_notify(&mux, 0, 3));
+    at_transport_mux_consume(&mux, 2, 2);
+    CHECK(mux.transports[2].pending == 3);
+    CHECK(at_transport_mux_select_input(&mux) == 2);
+    at_transport_mux_consume(&mux, 2, 3);
+    CHECK(at_transport_mux_select_input(&mux) == 0);
+    CHECK(mux.switches == 2);
+
+    // a failed read clears what was pending
+    at_transport_mux_consume(&mux, 0, -1);
+    CHECK(mux.transports[0].pending == 0);
+    CHECK(mux.transports[0].rx_bytes == 0);
+    CHECK(mux.transports[2].rx_bytes == 5);
+    CHECK(at_transport_mux_select_input(&mux) == -1);
+    CHECK(at_transport_mux_select_output(&mux) == 0);
+
+    // transparent transmission moves to the primary transport, changing it moves the transmission along
+    at_transport_mux_set_transmit(&mux, true);
+    CHECK(at_transport_mux_select_output(&mux) == 1);
+    CHECK(!at_transport_mux_notify(&mux, 0, 4));
+    CHECK(at_transport_mux_select_input(&mux) == -1);
+    CHECK(at_transport_mux_set_primary(&mux, 0));
+    CHECK(!at_transport_mux_set_primary(&mux, 4));
+    CHECK(at_transport_mux_select_input(&mux) == 0);
+    CHECK(at_transport_mux_select_output(&mux) == 0);
+    at_transport_mux_set_transmit(&mux, false);
+    CHECK(at_transport_mux_select_output(&mux) == 0);
+}
+
+static void test_register(void)
+{
+    // SDIO and socket register from their at_interface_init(), then the multiplexer takes over
+    CHECK(fake_register(&s_sdio, sdio_read, sdio_write, sdio_status) == 0);
+    CHECK(fake_register(&s_socket, socket_read, socket_write, socket_status) == 1);
+    at_transport_interface_init();
+    CHECK(s_uart.index == 2);
+    CHECK(mock_esp_at_device_ops.read_data != NULL);
+    at_transport_custom_init();
+    CHECK(s_cmds != NULL);
+    CHECK(strcmp(s_cmds[0].at_cmdName, "+TRANSPORT") == 0);
+
+    // the output before any input goes to the primary transport
+    core_write("\r\nready\r\n");
+    CHECK(strcmp(s_sdio.tx, "\r\nready\r\n") == 0);
+    CHECK(s_uart.tx_len == 0);
+    fake_clear_tx();
+}
+
+static void test_answer_where_asked(void)
+{
+    char buf[64];
+
+    CHECK(fake_receive(&s_uart, "AT+GMR\r\n"));
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 8);
+    CHECK(mock_esp_at_device_ops.get_data_length() == 8);
+    CHECK(core_read(buf, sizeof(buf)) == 8);
+    CHECK(strcmp(buf, "AT+GMR\r\n") == 0);
+    core_write("OK\r\n");
+    CHECK(strcmp(s_uart.tx, "OK\r\n") == 0);
+    CHECK(s_sdio.tx_len == 0);
+
+    // a command is read to its end before another transport gets the AT core, then the next one in turn
+    CHECK(fake_receive(&s_socket, "AT+CWMODE?\r\n"));
+    CHECK(fake_receive(&s_sdio, "AT\r\n"));
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 12);
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 4);
+    CHECK(core_read(buf, 3) == 2);
+    CHECK(strcmp(buf, "AT") == 0);
+    CHECK(core_read(buf, sizeof(buf)) == 2);
+    CHECK(strcmp(buf, "\r\n") == 0);
+    core_write("OK\r\n");
+    CHECK(strcmp(s_sdio.tx, "OK\r\n") == 0);
+    CHECK(core_read(buf, 4) == 3);
+    CHECK(strcmp(buf, "AT+") == 0);
+    CHECK(core_read(buf, sizeof(buf)) == 9);
+    CHECK(strcmp(buf, "CWMODE?\r\n") == 0);
+    core_write("+CWMODE:1\r\n");
+    CHECK(strcmp(s_socket.tx, "+CWMODE:1\r\n") == 0);
+    CHECK(strcmp(s_sdio.tx, "OK\r\n") == 0);
+    CHECK(core_read(buf, sizeof(buf)) == 0);
+    fake_clear_tx();
+}
+
+static void test_transmit(void)
+{
+    char buf[64];
+    uint32_t notified = 0;
+
+    // a command from UART starts transparent transmission, the primary transport carries it
+    CHECK(fake_receive(&s_uart, "AT+CIPSEND\r\n"));
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 12);
+    CHECK(core_read(buf, sizeof(buf)) == 12);
+    mock_esp_at_custom_ops.status_callback(ESP_AT_STATUS_TRANSMIT);
+
+    // only the transport carrying the transmission enters it
+    CHECK(s_sdio.status == ESP_AT_STATUS_TRANSMIT);
+    CHECK(s_uart.status == ESP_AT_STATUS_NORMAL);
+    CHECK(s_socket.status == ESP_AT_STATUS_NORMAL);
+
+    // the input of the other transports is held back
+    notified = mock_esp_at_notify_count();
+    CHECK(!fake_receive(&s_uart, "+++"));
+    CHECK(!fake_receive(&s_socket, "AT\r\n"));
+    CHECK(mock_esp_at_notify_count() == notified);
+    CHECK(fake_receive(&s_sdio, "payload"));
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 7);
+    CHECK(mock_esp_at_device_ops.get_data_length() == 7);
+    CHECK(core_read(buf, sizeof(buf)) == 7);
+    CHECK(strcmp(buf, "payload") == 0);
+    CHECK(core_read(buf, sizeof(buf)) == 0);
+    core_write("data");
+    CHECK(strcmp(s_sdio.tx, "data") == 0);
+    CHECK(s_uart.tx_len == 0);
+
+    // back in normal mode the held input is notified and read
+    mock_esp_at_custom_ops.status_callback(ESP_AT_STATUS_NORMAL);
+    CHECK(s_sdio.status == ESP_AT_STATUS_NORMAL);
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 4);
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 3);
+    CHECK(mock_esp_at_wait_notify(0) == -1);
+    CHECK(core_read(buf, sizeof(buf)) == 4);
+    CHECK(strcmp(buf, "AT\r\n") == 0);
+    CHECK(core_read(buf, sizeof(buf)) == 3);
+    CHECK(strcmp(buf, "+++") == 0);
+    fake_clear_tx();
+}
+
+static void test_transport_cmd(void)
+{
+    char buf[64];
+
+    // AT+TRANSPORT="uart" makes UART the primary transport
+    s_para_str = "uart";
+    CHECK(s_cmds[0].at_setupCmd(1) == ESP_AT_RESULT_CODE_OK);
+    s_para_str = "spi";
+    CHECK(s_cmds[0].at_setupCmd(1) == ESP_AT_RESULT_CODE_ERROR);
+    CHECK(s_cmds[0].at_setupCmd(2) == ESP_AT_RESULT_CODE_ERROR);
+
+    mock_esp_at_custom_ops.status_callback(ESP_AT_STATUS_TRANSMIT);
+    CHECK(s_uart.status == ESP_AT_STATUS_TRANSMIT);
+    CHECK(s_sdio.status == ESP_AT_STATUS_NORMAL);
+    CHECK(!fake_receive(&s_sdio, "x"));
+    CHECK(fake_receive(&s_uart, "y"));
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 1);
+    CHECK(core_read(buf, sizeof(buf)) == 1);
+    CHECK(strcmp(buf, "y") == 0);
+    mock_esp_at_custom_ops.status_callback(ESP_AT_STATUS_NORMAL);
+    CHECK(mock_esp_at_wait_notify(NOTIFY_TIMEOUT_MS) == 1);
+    CHECK(core_read(buf, sizeof(buf)) == 1);
+    CHECK(strcmp(buf, "x") == 0);
+    core_write("OK\r\n");
+    CHECK(strcmp(s_sdio.tx, "OK\r\n") == 0);
+
+    // AT+TRANSPORT? lists every transport with its byte counts
+    s_core_out[0] = '\0';
+    CHECK(s_cmds[0].at_queryCmd((uint8_t*)"+TRANSPORT") == ESP_AT_RESULT_CODE_OK);
+    CHECK(strstr(s_core_out, "+TRANSPORT:\"sdio\",0,1,12,21\r\n") != NULL);
+    CHECK(strstr(s_core_out, "+TRANSPORT:\"socket\",0,0,16,11\r\n") != NULL);
+    CHECK(strstr(s_core_out, "+TRANSPORT:\"uart\",1,0,24,4\r\n") != NULL);
+}
+
+int main(void)
+{
+    printf("transport_mux\n");
+
+    RUN_TEST(test_select_unit);
+    RUN_TEST(test_register);
+    RUN_TEST(test_answer_where_asked);
+    RUN_TEST(test_transmit);
+    RUN_TEST(test_transport_cmd);
+
+    printf("transport_mux: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// The UART driver as at_uart_task.c sees it: an RX ring filled by the test and an event queue,
+// with the GPIO, NVS and AT core calls of the file reduced to stubs.
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
+#include "driver/gpio.h"
+#include "nvs.h"
+#include "esp_partition.h"
+#include "esp_at.h"
+#include "mock_uart.h"
+
+#define MOCK_UART_RX_SIZE   4096
+
+static uint8_t s_rx_buf[MOCK_UART_RX_SIZE];
+static size_t s_rx_len;
+static int s_pattern_pos = -1;
+static uint32_t s_read_calls;
+static uint32_t s_read_max;
+static uint32_t s_terminal;
+static QueueHandle_t s_event_queue;
+static uint32_t s_baudrate;
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t* uart_queue, int intr_alloc_flags)
+{
+    s_event_queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+    *uart_queue = s_event_queue;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t* uart_config)
+{
+    s_baudrate = uart_config->baud_rate;
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void* buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    size_t len = 0;
+
+    portENTER_CRITICAL(NULL);
+    s_read_calls++;
+    if (length > s_read_max) {
+        s_read_max = length;
+    }
+    len = (length < s_rx_len) ? length : s_rx_len;
+    memcpy(buf, s_rx_buf, len);
+    memmove(s_rx_buf, s_rx_buf + len, s_rx_len - len);
+    s_rx_len -= len;
+    portEXIT_CRITICAL(NULL);
+
+    return len;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size)
+{
+    portENTER_CRITICAL(NULL);
+    *size = s_rx_len;
+    portEXIT_CRITICAL(NULL);
+
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num)
+{
+    portENTER_CRITICAL(NULL);
+    s_rx_len = 0;
+    portEXIT_CRITICAL(NULL);
+
+    return ESP_OK;
+}
+
+int uart_pattern_pop_pos(uart_port_t uart_num)
+{
+    int pos = 0;
+
+    portENTER_CRITICAL(NULL);
+    pos = s_pattern_pos;
+    s_pattern_pos = -1;
+    portEXIT_CRITICAL(NULL);
+
+    return pos;
+}
+
+int uart_pattern_get_pos(uart_port_t uart_num)
+{
+    return s_pattern_pos;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void* src, size_t size)
+{
+    return size;
+}
+
+esp_err_t uart_get_baudrate(uart_port_t uart_num, uint32_t* baudrate)
+{
+    *baudrate = s_baudrate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate)
+{
+    s_baudrate = baudrate;
+    return ESP_OK;
+}
+
+// the calls at_uart_task.c makes to configure the port, nothing to check on them here
+esp_err_t uart_intr_config(uart_port_t uart_num, const uart_intr_config_t* intr_conf) { return ESP_OK; }
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num) { return ESP_OK; }
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait) { return ESP_OK; }
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t uart_num, char pattern_chr, uint8_t chr_num, int chr_tout, int post_idle, int pre_idle) { return ESP_OK; }
+esp_err_t uart_disable_pattern_det_intr(uart_port_t uart_num) { return ESP_OK; }
+esp_err_t uart_disable_rx_intr(uart_port_t uart_num) { return ESP_OK; }
+esp_err_t uart_set_word_length(uart_port_t uart_num, uart_word_length_t data_bit) { return ESP_OK; }
+esp_err_t uart_get_word_length(uart_port_t uart_num, uart_word_length_t* data_bit) { *data_bit = UART_DATA_8_BITS; return ESP_OK; }
+esp_err_t uart_set_stop_bits(uart_port_t uart_num, uart_stop_bits_t stop_bits) { return ESP_OK; }
+esp_err_t uart_get_stop_bits(uart_port_t uart_num, uart_stop_bits_t* stop_bits) { *stop_bits = UART_STOP_BITS_1; return ESP_OK; }
+esp_err_t uart_set_parity(uart_port_t uart_num, uart_parity_t parity_mode) { return ESP_OK; }
+esp_err_t uart_get_parity(uart_port_t uart_num, uart_parity_t* parity_mode) { *parity_mode = UART_PARITY_DISABLE; return ESP_OK; }
+esp_err_t uart_set_hw_flow_ctrl(uart_port_t uart_num, uart_hw_flowcontrol_t flow_ctrl, uint8_t rx_thresh) { return ESP_OK; }
+esp_err_t uart_get_hw_flow_ctrl(uart_port_t uart_num, uart_hw_flowcontrol_t* flow_ctrl) { *flow_ctrl = UART_HW_FLOWCTRL_DISABLE; return ESP_OK; }
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) { return ESP_OK; }
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) { return ESP_OK; }
+
+// no stored UART configuration, the defaults of the Makefile apply
+esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle* out_handle) { return ESP_FAIL; }
+void nvs_close(nvs_handle handle) { }
+esp_err_t nvs_set_i8(nvs_handle handle, const char* key, int8_t value) { return ESP_FAIL; }
+esp_err_t nvs_get_i8(nvs_handle handle, const char* key, int8_t* out_value) { return ESP_FAIL; }
+esp_err_t nvs_set_i32(nvs_handle handle, const char* key, int32_t value) { return ESP_FAIL; }
+esp_err_t nvs_get_i32(nvs_handle handle, const char* key, int32_t* out_value) { return ESP_FAIL; }
+
+// no factory parameter partition either
+const esp_partition_t* esp_at_custom_partition_find(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) { return NULL; }
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size) { return ESP_FAIL; }
+
+esp_at_para_parse_result_type esp_at_get_para_as_digit(int32_t para_index, int32_t* value) { return ESP_AT_PARA_PARSE_RESULT_FAIL; }
+bool esp_at_custom_cmd_array_regist(const esp_at_cmd_struct* custom_at_cmd_array, uint32_t cmd_num) { return true; }
+void esp_at_response_result(uint8_t result_code) { }
+int32_t esp_at_port_write_data(uint8_t* data, int32_t len) { return len; }
+bool esp_at_port_wait_write_complete(int32_t timeout_msec) { return true; }
+
+void esp_at_transmit_terminal(void)
+{
+    portENTER_CRITICAL(NULL);
+    s_terminal++;
+    portEXIT_CRITICAL(NULL);
+}
+
+void mock_uart_rx_push(const void* data, size_t len)
+{
+    portENTER_CRITICAL(NULL);
+    if (s_rx_len + len <= sizeof(s_rx_buf)) {
+        memcpy(s_rx_buf + s_rx_len, data, len);
+        s_rx_len += len;
+    }
+    portEXIT_CRITICAL(NULL);
+}
+
+void mock_uart_post_event(uart_event_type_t type, size_t size)
+{
+    uart_event_t event = {
+        .type = type,
+        .size = size,
+    };
+
+    xQueueSend(s_event_queue, &event, portMAX_DELAY);
+}
+
+void mock_uart_set_pattern_pos(int pos)
+{
+    portENTER_CRITICAL(NULL);
+    s_pattern_pos = pos;
+    portEXIT_CRITICAL(NULL);
+}
+
+size_t mock_uart_rx_len(void)
+{
+    size_t len = 0;
+
+    uart_get_buffered_data_len(UART_NUM_1, &len);
+    return len;
+}
+
+uint32_t mock_uart_read_calls(void)
+{
+    uint32_t count = 0;
+
+    portENTER_CRITICAL(NULL);
+    count = s_read_calls;
+    portEXIT_CRITICAL(NULL);
+
+    return count;
+}
+
+uint32_t mock_uart_read_max(void)
+{
+    uint32_t len = 0;
+
+    portENTER_CRITICAL(NULL);
+    len = s_read_max;
+    portEXIT_CRITICAL(NULL);
+
+    return len;
+}
+
+uint32_t mock_uart_terminal_count(void)
+{
+    uint32_t count = 0;
+
+    portENTER_CRITICAL(NULL);
+    count = s_terminal;
+    portEXIT_CRITICAL(NULL);
+
+    return count;
+}
@@ -0,0 +1,45 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host side of the mocked UART driver.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/uart.h"
+
+/**
+ * @brief Put received bytes into the driver's RX ring.
+ */
+void mock_uart_rx_push(const void* data, size_t len);
+
+/**
+ * @brief Post an event to the queue created by uart_driver_install().
+ */
+void mock_uart_post_event(uart_event_type_t type, size_t size);
+
+void mock_uart_set_pattern_pos(int pos);    // position uart_pattern_pop_pos() returns next, -1 for none
+size_t mock_uart_rx_len(void);              // bytes left in the RX ring
+uint32_t mock_uart_read_calls(void);        // uart_read_bytes() calls so far
+uint32_t mock_uart_read_max(void);          // the largest length asked from uart_read_bytes()
+uint32_t mock_uart_terminal_count(void);    // esp_at_transmit_terminal() calls so far
@@ -0,0 +1,209 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Host test of the UART discard path of main/interface/uart/at_uart_task.c: at_port_read_data()
+// with a NULL buffer, and the "+++" drop of the uart task, must drain the RX ring without touching the heap.
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mock_esp_at.h"
+#include "mock_uart.h"
+#include "test_common.h"
+
+#define DISCARD_CHUNK       64      // AT_UART_DISCARD_BUFFER_SIZE
+#define EVENT_TIMEOUT_MS    1000
+
+void at_interface_init(void);
+
+// While armed, every heap call is counted and fails, as it would on a device out of memory
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+static volatile bool s_heap_armed;
+static volatile uint32_t s_heap_calls;
+
+void* malloc(size_t size)
+{
+    if (s_heap_armed) {
+        s_heap_calls++;
+        return NULL;
+    }
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size)
+{
+    if (s_heap_armed) {
+        s_heap_calls++;
+        return NULL;
+    }
+    return __libc_calloc(num, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if (s_heap_armed) {
+        s_heap_calls++;
+        return NULL;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    if (s_heap_armed && ptr) {
+        s_heap_calls++;
+    }
+    __libc_free(ptr);
+}
+
+static void heap_arm(void)
+{
+    s_heap_calls = 0;
+    s_heap_armed = true;
+}
+
+static uint32_t heap_disarm(void)
+{
+    s_heap_armed = false;
+    return s_heap_calls;
+}
+
+static void rx_fill(size_t len)
+{
+    uint8_t data[256];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)i;
+    }
+    while (len > 0) {
+        size_t chunk = len > sizeof(data) ? sizeof(data) : len;
+        mock_uart_rx_push(data, chunk);
+        len -= chunk;
+    }
+}
+
+static void test_discard_len(void)
+{
+    uint32_t calls = mock_uart_read_calls();
+    int32_t ret = 0;
+
+    rx_fill(1000);
+    heap_arm();
+    ret = mock_esp_at_device_ops.read_data(NULL, 1000);
+    CHECK(heap_disarm() == 0);
+
+    CHECK(ret == 1000);
+    CHECK(mock_uart_rx_len() == 0);
+    CHECK(mock_uart_read_calls() - calls == (1000 + DISCARD_CHUNK - 1) / DISCARD_CHUNK);
+    CHECK(mock_uart_read_max() <= DISCARD_CHUNK);
+}
+
+static void test_discard_all(void)
+{
+    int32_t ret = 0;
+
+    rx_fill(3000);
+    heap_arm();
+    ret = mock_esp_at_device_ops.read_data(NULL, -1);
+    CHECK(heap_disarm() == 0);
+
+    CHECK(ret == 3000);
+    CHECK(mock_uart_rx_len() == 0);
+
+    // nothing buffered, nothing read
+    heap_arm();
+    ret = mock_esp_at_device_ops.read_data(NULL, -1);
+    CHECK(heap_disarm() == 0);
+    CHECK(ret == 0);
+}
+
+static void test_discard_short(void)
+{
+    int32_t ret = 0;
+
+    // the ring runs out before the length asked for, the discard stops there
+    rx_fill(100);
+    heap_arm();
+    ret = mock_esp_at_device_ops.read_data(NULL, 500);
+    CHECK(heap_disarm() == 0);
+
+    CHECK(ret == 100);
+    CHECK(mock_uart_rx_len() == 0);
+    CHECK(mock_esp_at_device_ops.read_data(NULL, 0) == 0);
+}
+
+static void test_discard_keeps_order(void)
+{
+    uint8_t buf[16];
+
+    mock_uart_rx_push("skip-me:AT\r\n", 12);
+    CHECK(mock_esp_at_device_ops.read_data(NULL, 8) == 8);
+    CHECK(mock_esp_at_device_ops.read_data(buf, sizeof(buf)) == 4);
+    CHECK(memcmp(buf, "AT\r\n", 4) == 0);
+}
+
+static void test_pattern_drop(void)
+{
+    uint8_t buf[16];
+    uint32_t terminal = mock_uart_terminal_count();
+    TickType_t start = 0;
+
+    // transparent transmission data, then the "+++" exit sequence the driver detected
+    mock_uart_rx_push("abc+++", 6);
+    mock_uart_set_pattern_pos(3);
+
+    heap_arm();
+    mock_uart_post_event(UART_PATTERN_DET, 0);
+    start = xTaskGetTickCount();
+    while (mock_uart_terminal_count() == terminal && xTaskGetTickCount() - start < EVENT_TIMEOUT_MS) {
+        vTaskDelay(1);
+    }
+    CHECK(heap_disarm() == 0);
+
+    CHECK(mock_uart_terminal_count() == terminal + 1);
+    CHECK(mock_uart_rx_len() == 0);
+    CHECK(mock_esp_at_device_ops.read_data(buf, sizeof(buf)) == 0);
+}
+
+int main(void)
+{
+    printf("uart_discard\n");
+
+    at_interface_init();
+    CHECK(mock_esp_at_device_ops.read_data != NULL);
+
+    RUN_TEST(test_discard_len);
+    RUN_TEST(test_discard_all);
+    RUN_TEST(test_discard_short);
+    RUN_TEST(test_discard_keeps_order);
+    RUN_TEST(test_pattern_drop);
+
+    printf("uart_discard: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,327 @@
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS ESP32 only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#
+
+# Drive AT+BENCH on an AT port and report throughput, round-trip latency and errors.
+#
+# The AT port is reached either over TCP (the socket interface, main/interface/socket)
+# or through a tty/pty path (UART adapter, pty bridged to an emulator). Run it first against
+# the socket interface of a device built with CONFIG_AT_BASE_ON_SOCKET, e.g.
+#
+#     python tools/at_bench.py --host 192.168.4.1 --port 8080
+#
+# --loopback answers from ATBenchEmulator, a Python copy of at_bench_cmd.c on a socketpair. It only
+# checks the framing, pattern and statistics code of this script against itself: neither the socket
+# interface nor the AT core is involved, so a loopback run says nothing about the firmware.
+
+import os
+import re
+import sys
+import time
+import socket
+import argparse
+import threading
+
+BENCH_BUFFER_SIZE = 4096
+BENCH_MODE_SOURCE = 0
+BENCH_MODE_SINK = 1
+
+
+def bench_pattern(offset, length):
+    return bytes(((n + (n >> 8)) & 0xff) for n in range(offset, offset + length))
+
+
+def bench_pattern_errors(data, offset):
+    expect = bench_pattern(offset, len(data))
+    return sum(1 for a, b in zip(data, expect) if a != b)
+
+
+class ATPortError(Exception):
+    pass
+
+
+class ATPort(object):
+    def __init__(self, timeout):
+        self.timeout = timeout
+        self.rx = b''
+
+    def send(self, data):
+        raise NotImplementedError
+
+    def recv_some(self, timeout):
+        raise NotImplementedError
+
+    def close(self):
+        pass
+
+    def _fill(self, deadline):
+        remain = deadline - time.time()
+        if remain <= 0:
+            raise ATPortError('timeout, received %r' % self.rx[-64:])
+        data = self.recv_some(remain)
+        if data is None:
+            raise ATPortError('connection closed')
+        self.rx += data
+
+    def read_until(self, pattern):
+        deadline = time.time() + self.timeout
+        while True:
+            m = pattern.search(self.rx)
+            if m:
+                self.rx = self.rx[m.end():]
+                return m
+            self._fill(deadline)
+
+    def read_exact(self, length):
+        deadline = time.time() + self.timeout
+        while len(self.rx) < length:
+            self._fill(deadline)
+        data, self.rx = self.rx[:length], self.rx[length:]
+        return data
+
+    def command(self, cmd):
+        self.send(cmd.encode() + b'\r\n')
+        m = self.read_until(re.compile(br'\r\n(OK|ERROR)\r\n'))
+        if m.group(1) != b'OK':
+            raise ATPortError('%s returned ERROR' % cmd)
+
+
+class ATSocketPort(ATPort):
+    def __init__(self, sock, timeout):
+        super(ATSocketPort, self).__init__(timeout)
+        self.sock = sock
+        if sock.family != socket.AF_UNIX:
+            self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def send(self, data):
+        self.sock.sendall(data)
+
+    def recv_some(self, timeout):
+        self.sock.settimeout(timeout)
+        try:
+            data = self.sock.recv(65536)
+        except socket.timeout:
+            return b''
+        return data if data else None
+
+    def close(self):
+        self.sock.close()
+
+
+class ATTtyPort(ATPort):
+    def __init__(self, path, timeout):
+        import termios
+        import tty
+        super(ATTtyPort, self).__init__(timeout)
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd, termios.TCSANOW)
+
+    def send(self, data):
+        while data:
+            data = data[os.write(self.fd, data):]
+
+    def recv_some(self, timeout):
+        import select
+        r, _, _ = select.select([self.fd], [], [], timeout)
+        if not r:
+            return b''
+        data = os.read(self.fd, 65536)
+        return data if data else None
+
+    def close(self):
+        os.close(self.fd)
+
+
+class ATBenchEmulator(threading.Thread):
+    """Minimal AT+BENCH responder on one end of a socketpair, following at_bench_cmd.c."""
+
+    def __init__(self, sock):
+        super(ATBenchEmulator, self).__init__()
+        self.daemon = True
+        self.sock = sock
+        self.rx = b''
+        self.result = None
+
+    def recv_exact(self, length):
+        while len(self.rx) < length:
+            data = self.sock.recv(65536)
+            if not data:
+                raise EOFError
+            self.rx += data
+        data, self.rx = self.rx[:length], self.rx[length:]
+        return data
+
+    def result_output(self):
+        return ('\r\n+BENCH:%d,%d,%d,%d\r\n' % self.result).encode()
+
+    def handle(self, line):
+        m = re.match(r'AT\+BENCH=(\d+),(\d+)(?:,(\d+))?(?:,(\d+))?$', line)
+        if line in ('AT', 'AT+BENCH'):
+            return b'\r\nOK\r\n'
+        if line == 'AT+BENCH?':
+            return self.result_output() + b'\r\nOK\r\n' if self.result else b'\r\nERROR\r\n'
+        if not m:
+            return b'\r\nERROR\r\n'
+        mode, length = int(m.group(1)), int(m.group(2))
+        chunk = int(m.group(3) or BENCH_BUFFER_SIZE)
+        start = time.time()
+        if mode == BENCH_MODE_SOURCE:
+            self.sock.sendall(('+BENCH:%d,' % length).encode())
+            for offset in range(0, length, chunk):
+                self.sock.sendall(bench_pattern(offset, min(chunk, length - offset)))
+            errors = 0
+        elif mode == BENCH_MODE_SINK:
+            self.sock.sendall(b'\r\nOK\r\n\r\n>')
+            errors = bench_pattern_errors(self.recv_exact(length), 0)
+        else:
+            return b'\r\nERROR\r\n'
+        self.result = (mode, length, int((time.time() - start) * 1000000), errors)
+        return self.result_output() + b'\r\nOK\r\n'
+
+    def run(self):
+        try:
+            while True:
+                while b'\r\n' not in self.rx:
+                    data = self.sock.recv(65536)
+                    if not data:
+                        return
+                    self.rx += data
+                line, self.rx = self.rx.split(b'\r\n', 1)
+                self.sock.sendall(self.handle(line.decode(errors='replace')))
+        except (EOFError, OSError):
+            return
+
+
+def parse_bench_result(m):
+    return tuple(int(v) for v in m.groups())
+
+
+BENCH_RESULT = re.compile(br'\r\n\+BENCH:(\d+),(\d+),(-?\d+),(\d+)\r\n\r\nOK\r\n')
+
+
+def bench_source(port, length, chunk, interval_ms):
+    cmd = 'AT+BENCH=%d,%d,%d,%d' % (BENCH_MODE_SOURCE, length, chunk, interval_ms)
+    start = time.time()
+    port.send(cmd.encode() + b'\r\n')
+    m = port.read_until(re.compile(br'\+BENCH:(\d+),|\r\nERROR\r\n'))
+    if m.group(1) is None or int(m.group(1)) != length:
+        raise ATPortError('%s failed' % cmd)
+    errors = 0
+    offset = 0
+    while offset < length:
+        data = port.read_exact(min(BENCH_BUFFER_SIZE, length - offset))
+        errors += bench_pattern_errors(data, offset)
+        offset += len(data)
+    host_us = int((time.time() - start) * 1000000)
+    _, _, device_us, device_errors = parse_bench_result(port.read_until(BENCH_RESULT))
+    return host_us, device_us, errors + device_errors
+
+
+def bench_sink(port, length):
+    cmd = 'AT+BENCH=%d,%d' % (BENCH_MODE_SINK, length)
+    port.send(cmd.encode() + b'\r\n')
+    m = port.read_until(re.compile(br'OK\r\n(?:\r\n)?>|\r\nERROR\r\n'))
+    if m.group(0).endswith(b'ERROR\r\n'):
+        raise ATPortError('%s failed' % cmd)
+    start = time.time()
+    for offset in range(0, length, BENCH_BUFFER_SIZE):
+        port.send(bench_pattern(offset, min(BENCH_BUFFER_SIZE, length - offset)))
+    _, received, device_us, errors = parse_bench_result(port.read_until(BENCH_RESULT))
+    host_us = int((time.time() - start) * 1000000)
+    return host_us, device_us, errors + (length - received)
+
+
+def percentile(samples, p):
+    samples = sorted(samples)
+    index = min(len(samples) - 1, max(0, int(round(p / 100.0 * len(samples) + 0.5)) - 1))
+    return samples[index]
+
+
+def bench_latency(port, count):
+    samples = []
+    for _ in range(count):
+        start = time.time()
+        port.command('AT+BENCH')
+        samples.append((time.time() - start) * 1000.0)
+    return samples
+
+
+def throughput_kbps(length, us):
+    return length * 8 / 1000.0 / (us / 1000000.0) if us > 0 else 0.0
+
+
+def open_port(args):
+    if args.loopback:
+        host_sock, device_sock = socket.socketpair()
+        ATBenchEmulator(device_sock).start()
+        return ATSocketPort(host_sock, args.timeout)
+    if args.tty:
+        return ATTtyPort(args.tty, args.timeout)
+    sock = socket.create_connection((args.host, args.port), args.timeout)
+    return ATSocketPort(sock, args.timeout)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='AT port throughput and latency benchmark based on AT+BENCH')
+    parser.add_argument("--host", default="192.168.4.1", help="AT socket interface address")
+    parser.add_argument("--port", type=int, default=8080, help="AT socket interface port (CONFIG_AT_SOCKET_PORT)")
+    parser.add_argument("--tty", default=None, help="tty or pty path of the AT port, used instead of --host")
+    parser.add_argument("--loopback", action="store_true",
+                        help="self-test of this script against a Python AT+BENCH emulator, no device or firmware involved")
+    parser.add_argument("--length", type=int, default=256 * 1024, help="bytes per throughput run")
+    parser.add_argument("--chunk", type=int, default=BENCH_BUFFER_SIZE, help="device write size of the source run")
+    parser.add_argument("--interval", type=int, default=0, help="device delay in ms between source chunks")
+    parser.add_argument("--rounds", type=int, default=3, help="throughput runs per direction")
+    parser.add_argument("--latency_count", type=int, default=100, help="AT+BENCH round trips for the latency test")
+    parser.add_argument("--timeout", type=float, default=15.0, help="seconds to wait for the device")
+    args = parser.parse_args()
+
+    port = open_port(args)
+    total_errors = 0
+    try:
+        port.command('AT')
+
+        samples = bench_latency(port, args.latency_count)
+        print("latency: %d round trips, p50 %.3f ms, p99 %.3f ms, max %.3f ms"
+              % (len(samples), percentile(samples, 50), percentile(samples, 99), max(samples)))
+
+        for name, run in (("source", lambda: bench_source(port, args.length, args.chunk, args.interval)),
+                          ("sink", lambda: bench_sink(port, args.length))):
+            for loop in range(args.rounds):
+                host_us, device_us, errors = run()
+                total_errors += errors
+                print("%s #%d: %d bytes, host %.1f kbps, device %.1f kbps, errors %d"
+                      % (name, loop, args.length, throughput_kbps(args.length, host_us),
+                         throughput_kbps(args.length, device_us), errors))
+    except ATPortError as e:
+        print("benchmark failed: %s" % e)
+        total_errors += 1
+    finally:
+        port.close()
+
+    print("total errors: %d" % total_errors)
+    sys.exit(1 if total_errors else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,160 @@
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS ESP32 only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+# heatshrink LZSS compression, the bitstream decoded by components/at/src/at_heatshrink.c.
+#
+# Bits are written MSB first. A literal is a 1 bit and the byte, a back-reference is a 0 bit,
+# window_sz2 bits of (distance - 1) and lookahead_sz2 bits of (length - 1). The last byte is padded
+# with 0 bits, the decoder ignores them since the container tells the decompressed size.
+
+WINDOW_SZ2_DEFAULT = 12
+LOOKAHEAD_SZ2_DEFAULT = 8
+CHAIN_MAX = 16              # candidates tried for each position
+
+
+class BitWriter(object):
+    def __init__(self):
+        self.out = bytearray()
+        self.bits = 0
+        self.nbits = 0
+
+    def put(self, value, count):
+        self.bits = (self.bits << count) | value
+        self.nbits += count
+        while self.nbits >= 8:
+            self.nbits -= 8
+            self.out.append((self.bits >> self.nbits) & 0xFF)
+        self.bits &= (1 << self.nbits) - 1
+
+    def finish(self):
+        if self.nbits:
+            self.out.append((self.bits << (8 - self.nbits)) & 0xFF)
+            self.bits = 0
+            self.nbits = 0
+        return bytes(self.out)
+
+
+def check_params(window_sz2, lookahead_sz2):
+    if not 4 <= window_sz2 <= 14 or not 3 <= lookahead_sz2 < window_sz2:
+        raise ValueError("window_sz2 must be 4 to 14, lookahead_sz2 3 to window_sz2 - 1")
+
+
+def _match_len(data, src, dst, limit):
+    """Length of the common prefix of data[src:] and data[dst:], at most limit."""
+    if data[src] != data[dst]:
+        return 0
+    lo, hi = 1, limit
+    while lo < hi:
+        mid = (lo + hi + 1) // 2
+        if data[src:src + mid] == data[dst:dst + mid]:
+            lo = mid
+        else:
+            hi = mid - 1
+    return lo
+
+
+def compress(data, window_sz2=WINDOW_SZ2_DEFAULT, lookahead_sz2=LOOKAHEAD_SZ2_DEFAULT):
+    check_params(window_sz2, lookahead_sz2)
+    data = bytes(data)
+    window = 1 << window_sz2
+    lookahead = 1 << lookahead_sz2
+    # a back-reference has to be shorter than the literals it replaces
+    min_len = (1 + window_sz2 + lookahead_sz2) // 9 + 1
+    chains = {}
+    writer = BitWriter()
+    size = len(data)
+    pos = 0
+
+    while pos < size:
+        best_len = 0
+        best_distance = 0
+        limit = min(lookahead, size - pos)
+        if limit >= min_len:
+            for src in reversed(chains.get(data[pos:pos + 3], ())):
+                if pos - src > window:
+                    break
+                if best_len and data[src + best_len - 1] != data[pos + best_len - 1]:
+                    continue
+                length = _match_len(data, src, pos, limit)
+                if length > best_len:
+                    best_len, best_distance = length, pos - src
+                    if length == limit:
+                        break
+
+        if best_len >= min_len:
+            writer.put(0, 1)
+            writer.put(best_distance - 1, window_sz2)
+            writer.put(best_len - 1, lookahead_sz2)
+            step = best_len
+        else:
+            writer.put(1, 1)
+            writer.put(data[pos], 8)
+            step = 1
+
+        for i in range(pos, min(pos + step, size - 2)):
+            chain = chains.setdefault(data[i:i + 3], [])
+            chain.append(i)
+            if len(chain) > 2 * CHAIN_MAX:
+                del chain[:CHAIN_MAX]
+        pos += step
+
+    return writer.finish()
+
+
+def decompress(data, size=None, window_sz2=WINDOW_SZ2_DEFAULT, lookahead_sz2=LOOKAHEAD_SZ2_DEFAULT):
+    """Decompress the first size bytes of a stream, or all of it if size is None.
+
+    The padding of the last byte is too short for a back-reference, so the end of the input ends the data.
+    """
+    check_params(window_sz2, lookahead_sz2)
+    out = bytearray()
+    bits = 0
+    nbits = 0
+    it = iter(bytearray(data))
+
+    def get(count):
+        nonlocal bits, nbits
+        while nbits < count:
+            bits = (bits << 8) | next(it)
+            nbits += 8
+        nbits -= count
+        value = (bits >> nbits) & ((1 << count) - 1)
+        bits &= (1 << nbits) - 1
+        return value
+
+    try:
+        while size is None or len(out) < size:
+            if get(1):
+                out.append(get(8))
+            else:
+                distance = get(window_sz2) + 1
+                length = get(lookahead_sz2) + 1
+                if distance > len(out):
+                    raise ValueError("back-reference before the start of the data")
+                for _ in range(length):
+                    out.append(out[-distance])
+    except StopIteration:
+        if size is not None:
+            raise ValueError("compressed data is truncated")
+
+    return bytes(out if size is None else out[:size])
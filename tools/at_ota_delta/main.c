@@ -0,0 +1,238 @@
+/*
+ * ESPRESSIF MIT License
+ *
+ * Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+ *
+ * Permission is hereby granted for use on ESPRESSIF SYSTEMS only, in which case,
+ * it is free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+// Apply a delta patch on Linux with the code the device runs (components/at/src/at_ota_delta.c),
+// to check a patch, or the applier, against two image files:
+//
+//   at_ota_delta_apply old.bin esp-at.patch out.bin && cmp out.bin new.bin
+//
+// The patch is fed in pieces of a TCP segment, as AT+CIUPDATE receives it, and the SHA-256 of the
+// source and of the result are checked against the patch header, as the device does.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "at_ota_delta.h"
+
+#define AT_OTA_DELTA_APPLY_CHUNK_SIZE       1460
+
+typedef struct {
+    uint8_t* source;
+    size_t source_len;
+    FILE* target;
+    uint32_t h[8];                          // SHA-256 of the target
+    uint8_t block[64];
+    uint64_t len;
+} at_ota_delta_apply_t;
+
+static const uint32_t s_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t h[8], const uint8_t* p)
+{
+    uint32_t w[64], a, b, c, d, e, f, g, k, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) | ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+    }
+    for (i = 16; i < 64; i++) {
+        w[i] = w[i - 16] + (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 7]
+               + (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+    }
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4]; f = h[5]; g = h[6]; k = h[7];
+    for (i = 0; i < 64; i++) {
+        t1 = k + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + s_sha256_k[i] + w[i];
+        t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+static void sha256_init(at_ota_delta_apply_t* apply)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(apply->h, init, sizeof(init));
+    apply->len = 0;
+}
+
+static void sha256_update(at_ota_delta_apply_t* apply, const uint8_t* data, size_t len)
+{
+    while (len > 0) {
+        apply->block[apply->len % 64] = *data++;
+        apply->len++;
+        len--;
+        if (apply->len % 64 == 0) {
+            sha256_block(apply->h, apply->block);
+        }
+    }
+}
+
+static void sha256_finish(at_ota_delta_apply_t* apply, uint8_t digest[32])
+{
+    uint64_t bits = apply->len * 8;
+    uint8_t pad = 0x80;
+    int i;
+
+    sha256_update(apply, &pad, 1);
+    pad = 0;
+    while (apply->len % 64 != 56) {
+        sha256_update(apply, &pad, 1);
+    }
+    for (i = 7; i >= 0; i--) {
+        pad = (uint8_t)(bits >> (8 * i));
+        sha256_update(apply, &pad, 1);
+    }
+    for (i = 0; i < 32; i++) {
+        digest[i] = (uint8_t)(apply->h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static int on_header(at_ota_delta_t* delta, const at_ota_delta_header_t* header)
+{
+    at_ota_delta_apply_t* apply = (at_ota_delta_apply_t*)delta->arg;
+    uint8_t digest[32];
+
+    printf("source %u bytes, target %u bytes, window %u, lookahead %u\n",
+           header->source_size, header->target_size, header->window_sz2, header->lookahead_sz2);
+    if (header->source_size > apply->source_len) {
+        printf("the source image is shorter than the patch expects\n");
+        return -1;
+    }
+    sha256_init(apply);
+    sha256_update(apply, apply->source, header->source_size);
+    sha256_finish(apply, digest);
+    if (memcmp(digest, header->source_sha256, sizeof(digest)) != 0) {
+        printf("the patch is for another image\n");
+        return -1;
+    }
+    sha256_init(apply);
+    return 0;
+}
+
+static int read_source(at_ota_delta_t* delta, uint32_t offset, uint8_t* data, size_t len)
+{
+    at_ota_delta_apply_t* apply = (at_ota_delta_apply_t*)delta->arg;
+
+    memcpy(data, apply->source + offset, len);
+    return 0;
+}
+
+static int on_target(at_ota_delta_t* delta, const uint8_t* data, size_t len)
+{
+    at_ota_delta_apply_t* apply = (at_ota_delta_apply_t*)delta->arg;
+
+    sha256_update(apply, data, len);
+    return (fwrite(data, 1, len, apply->target) == len) ? 0 : -1;
+}
+
+static const at_ota_delta_callbacks_t s_callbacks = {
+    .on_header = on_header,
+    .read_source = read_source,
+    .on_target = on_target,
+};
+
+static uint8_t* read_file(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    uint8_t* data = NULL;
+    long size = 0;
+
+    if (f == NULL) {
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+        data = (uint8_t*)malloc(size ? size : 1);
+        if (data && fread(data, 1, size, f) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return data;
+}
+
+int main(int argc, char** argv)
+{
+    at_ota_delta_apply_t apply;
+    at_ota_delta_t delta;
+    uint8_t* patch = NULL;
+    size_t patch_len = 0;
+    size_t pos = 0;
+    size_t size = 0;
+    uint8_t digest[32];
+    int ret = -1;
+
+    if (argc != 4) {
+        printf("usage: %s <old image> <patch> <new image to write>\n", argv[0]);
+        return 2;
+    }
+
+    memset(&apply, 0x0, sizeof(apply));
+    apply.source = read_file(argv[1], &apply.source_len);
+    patch = read_file(argv[2], &patch_len);
+    apply.target = fopen(argv[3], "wb");
+    if (apply.source == NULL || patch == NULL || apply.target == NULL) {
+        printf("cannot open the files\n");
+        return 1;
+    }
+
+    at_ota_delta_init(&delta, &s_callbacks, &apply);
+    for (pos = 0; pos < patch_len; pos += size) {
+        size = (patch_len - pos < AT_OTA_DELTA_APPLY_CHUNK_SIZE) ? patch_len - pos : AT_OTA_DELTA_APPLY_CHUNK_SIZE;
+        if (at_ota_delta_execute(&delta, patch + pos, size) != 0) {
+            break;
+        }
+    }
+
+    if (at_ota_delta_finish(&delta) != 0) {
+        printf("patch failed at %u bytes of the target\n", delta.target_len);
+    } else {
+        sha256_finish(&apply, digest);
+        if (memcmp(digest, delta.header.target_sha256, sizeof(digest)) != 0) {
+            printf("SHA-256 of the result does not match the patch\n");
+        } else {
+            printf("wrote %u bytes to %s\n", delta.target_len, argv[3]);
+            ret = 0;
+        }
+    }
+
+    fclose(apply.target);
+    free(apply.source);
+    free(patch);
+    return (ret == 0) ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS ESP32 only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+# Serve a firmware over HTTP for AT+CIUPDATE and AT+USEROTA, and drop the connection in the
+# middle of the download, to check that the device goes on from where it stopped
+# (CONFIG_AT_OTA_RESUME_SUPPORT).
+#
+# Range requests ("Range: bytes=<offset>-") are answered with 206 and Content-Range, unless the
+# If-Range ETag does not match the firmware. The version query of AT+CIUPDATE is answered with
+# --version, so CONFIG_AT_OTA_SERVER_IP and CONFIG_AT_OTA_SERVER_PORT can point to this server.
+#
+# With --patch and --patch_base, a download whose X-ESP-AT-App-SHA256 header matches the firmware
+# of --patch_base is answered with the patch instead (CONFIG_AT_OTA_DELTA_SUPPORT).
+
+import os
+import re
+import sys
+import json
+import socket
+import random
+import hashlib
+import argparse
+import threading
+
+try:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+    from socketserver import ThreadingMixIn
+except ImportError:
+    print("python 3 is required")
+    sys.exit(1)
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import esp_at_ota_delta
+
+
+class OTAServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+    def __init__(self, address, args):
+        HTTPServer.__init__(self, address, OTARequestHandler)
+        with open(args.file, 'rb') as f:
+            self.firmware = f.read()
+        self.sha256 = hashlib.sha256(self.firmware).hexdigest()
+        self.etag = '"%s"' % self.sha256[:16]
+        self.patch = None
+        self.patch_base = None
+        if args.patch:
+            with open(args.patch, 'rb') as f:
+                self.patch = f.read()
+            with open(args.patch_base, 'rb') as f:
+                self.patch_base = esp_at_ota_delta.app_elf_sha256(f.read())
+            if self.patch_base is None:
+                raise ValueError("%s is not an app image" % args.patch_base)
+            self.patch_base = self.patch_base.hex()
+        self.args = args
+        self.lock = threading.Lock()
+        self.drops = 0
+
+    def drop_at(self, length):
+        """Body bytes to send before dropping the connection, None to send them all."""
+        args = self.args
+        with self.lock:
+            if args.drops >= 0 and self.drops >= args.drops:
+                return None
+            if args.drop_after is not None and args.drop_after < length:
+                at = args.drop_after
+            elif random.random() < args.drop_rate:
+                at = random.randrange(length) if length else 0
+            else:
+                return None
+            self.drops += 1
+            return at
+
+
+class OTARequestHandler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, fmt, *args):
+        sys.stdout.write("%s %s\n" % (self.address_string(), fmt % args))
+
+    def do_GET(self):
+        if 'is_format_simple=true' in self.path:
+            self.send_version()
+        else:
+            self.send_firmware()
+
+    def send_version(self):
+        body = json.dumps({'rom_version': self.server.args.version, 'status': 200}).encode()
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(body)))
+        self.send_header('Connection', 'close')
+        self.end_headers()
+        self.wfile.write(body)
+        self.close_connection = True
+
+    def send_firmware(self):
+        server = self.server
+        firmware = server.firmware
+        start = 0
+
+        if server.patch and self.headers.get('X-ESP-AT-App-SHA256', '').strip().lower() == server.patch_base:
+            self.send_patch()
+            return
+
+        match = re.match(r'bytes=(\d+)-$', self.headers.get('Range', '').strip())
+        if_range = self.headers.get('If-Range')
+        if match and not server.args.ignore_range and (if_range is None or if_range == server.etag):
+            start = int(match.group(1))
+            if start >= len(firmware):
+                self.send_response(416)
+                self.send_header('Content-Range', 'bytes */%d' % len(firmware))
+                self.send_header('Content-Length', '0')
+                self.end_headers()
+                return
+            self.send_response(206)
+            self.send_header('Content-Range', 'bytes %d-%d/%d' % (start, len(firmware) - 1, len(firmware)))
+        else:
+            self.send_response(200)
+
+        body = firmware[start:]
+        self.send_header('Content-Type', 'application/octet-stream')
+        self.send_header('Content-Length', str(len(body)))
+        self.send_header('ETag', server.etag)
+        self.send_header('Accept-Ranges', 'bytes')
+        self.send_header('Connection', 'close')
+        self.end_headers()
+        self.close_connection = True
+        self.send_body(body, start, len(firmware))
+
+    def send_patch(self):
+        # a patch is applied from its start, Range requests are not answered with a part of it
+        body = self.server.patch
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/octet-stream')
+        self.send_header('Content-Length', str(len(body)))
+        self.send_header('Connection', 'close')
+        self.end_headers()
+        self.close_connection = True
+        print("patch for app %s" % self.server.patch_base)
+        self.send_body(body, 0, len(body))
+
+    def send_body(self, body, start, length):
+        server = self.server
+        drop = server.drop_at(len(body))
+        if drop is None:
+            self.wfile.write(body)
+            print("sent %d-%d of %d" % (start, length, length))
+            return
+
+        self.wfile.write(body[:drop])
+        self.wfile.flush()
+        print("dropped at %d of %d" % (start + drop, length))
+        try:
+            self.connection.shutdown(socket.SHUT_RDWR)
+        except socket.error:
+            pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description='HTTP OTA server that drops connections, for resumed OTA downloads')
+    parser.add_argument("file", help="firmware served for every download request")
+    parser.add_argument("--host", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--port", type=int, default=8070, help="port to listen on")
+    parser.add_argument("--version", default="v2.2.0.0", help="version answered to the AT+CIUPDATE version query")
+    parser.add_argument("--drop_after", type=int, default=None, help="drop each download after this many bytes of its body")
+    parser.add_argument("--drop_rate", type=float, default=0.0, help="probability to drop a download at a random point")
+    parser.add_argument("--drops", type=int, default=-1, help="stop dropping after this many drops, -1 for no limit")
+    parser.add_argument("--ignore_range", action="store_true", help="answer Range requests with the whole firmware")
+    parser.add_argument("--patch", default=None, help="patch made by esp_at_ota_delta.py, served to the devices running --patch_base")
+    parser.add_argument("--patch_base", default=None, help="the old firmware the patch is made from")
+    args = parser.parse_args()
+    if (args.patch is None) != (args.patch_base is None):
+        parser.error("--patch and --patch_base go together")
+
+    server = OTAServer((args.host, args.port), args)
+    print("serving %s, %d bytes, sha256 %s, ETag %s on port %d"
+          % (os.path.basename(args.file), len(server.firmware), server.sha256, server.etag, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+
+
+if __name__ == '__main__':
+    main()
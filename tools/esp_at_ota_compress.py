@@ -0,0 +1,105 @@
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS ESP32 only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+# Compress an AT firmware image for AT+USEROTA and the OTA of AT+WEBSERVER
+# (CONFIG_AT_OTA_COMPRESS_SUPPORT). The device tells a compressed image from a plain one by its first
+# bytes and decompresses it while it is downloaded, see components/at/src/at_ota_image.c.
+#
+#   python esp_at_ota_compress.py build/esp-at.bin esp-at-compressed.bin
+#   python esp_at_ota_compress.py --decompress esp-at-compressed.bin esp-at.bin
+#
+# Compressed image format, little endian: the 12-byte header
+#   magic "ATCZ", version 1, window_sz2, lookahead_sz2, 0, image size
+# then the heatshrink compressed image (at_heatshrink.py).
+
+import os
+import sys
+import struct
+import hashlib
+import argparse
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import at_heatshrink
+
+IMAGE_MAGIC = b'ATCZ'
+IMAGE_VERSION = 1
+HEADER_FORMAT = '<4sBBBBI'
+HEADER_LEN = struct.calcsize(HEADER_FORMAT)
+DEVICE_WINDOW_SZ2_MAX = 12      # default of CONFIG_AT_OTA_COMPRESS_WINDOW_SZ2_MAX
+
+
+def compress(image, window_sz2=at_heatshrink.WINDOW_SZ2_DEFAULT, lookahead_sz2=at_heatshrink.LOOKAHEAD_SZ2_DEFAULT):
+    if not image:
+        raise ValueError("the image is empty")
+    header = struct.pack(HEADER_FORMAT, IMAGE_MAGIC, IMAGE_VERSION, window_sz2, lookahead_sz2, 0, len(image))
+    return header + at_heatshrink.compress(bytes(image), window_sz2, lookahead_sz2)
+
+
+def decompress(data):
+    if len(data) < HEADER_LEN:
+        raise ValueError("the image is too short")
+    magic, version, window_sz2, lookahead_sz2, _, size = struct.unpack(HEADER_FORMAT, data[:HEADER_LEN])
+    if magic != IMAGE_MAGIC or version != IMAGE_VERSION:
+        raise ValueError("not a version %d compressed image" % IMAGE_VERSION)
+    image = at_heatshrink.decompress(data[HEADER_LEN:], None, window_sz2, lookahead_sz2)
+    if len(image) != size:
+        raise ValueError("the image is %d bytes, the header tells %d" % (len(image), size))
+    return image
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compress an AT firmware image for the OTA')
+    parser.add_argument("input", help="the image to compress, or to decompress with --decompress")
+    parser.add_argument("output", help="the file to write")
+    parser.add_argument("--decompress", action="store_true", help="decompress a compressed image, to check it")
+    parser.add_argument("--window", type=int, default=at_heatshrink.WINDOW_SZ2_DEFAULT,
+                        help="heatshrink window size, log2, the device allocates 2^window bytes")
+    parser.add_argument("--lookahead", type=int, default=at_heatshrink.LOOKAHEAD_SZ2_DEFAULT,
+                        help="heatshrink lookahead size, log2")
+    args = parser.parse_args()
+
+    with open(args.input, 'rb') as f:
+        data = f.read()
+
+    if args.decompress:
+        output = decompress(data)
+    else:
+        output = compress(data, args.window, args.lookahead)
+        if decompress(output) != data:
+            print("the compressed image does not decompress to %s" % args.input)
+            sys.exit(1)
+        if args.window > DEVICE_WINDOW_SZ2_MAX:
+            print("warning: a window of 2^%d needs CONFIG_AT_OTA_COMPRESS_WINDOW_SZ2_MAX %d on the device"
+                  % (args.window, args.window))
+
+    with open(args.output, 'wb') as f:
+        f.write(output)
+    if args.decompress:
+        print("Create %s finished, sha256 %s" % (args.output, hashlib.sha256(output).hexdigest()))
+    else:
+        print("Create %s finished: %d bytes for %d, %.1f%%"
+              % (args.output, len(output), len(data), len(output) * 100.0 / len(data)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,289 @@
+#
+# ESPRESSIF MIT License
+#
+# Copyright (c) 2021 <ESPRESSIF SYSTEMS (SHANGHAI) PTE LTD>
+#
+# Permission is hereby granted for use on ESPRESSIF SYSTEMS ESP32 only, in which case,
+# it is free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the Software is furnished
+# to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+# FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+# IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+
+# Create and apply delta patches between two AT firmware images, for AT+CIUPDATE
+# (CONFIG_AT_OTA_DELTA_SUPPORT). The device applies the patch to the firmware it runs and writes the
+# result to the next OTA partition while the patch is downloaded, see components/at/src/at_ota_delta.c.
+#
+#   python esp_at_ota_delta.py create old/esp-at.bin new/esp-at.bin esp-at.patch
+#   python esp_at_ota_delta.py apply old/esp-at.bin esp-at.patch esp-at.bin
+#   python esp_at_ota_delta.py info esp-at.patch
+#
+# Patch format, little endian: the 80-byte header
+#   magic "ATDP", version 1, window_sz2, lookahead_sz2, 0, source size, target size,
+#   source SHA-256, target SHA-256
+# then the heatshrink compressed records (at_heatshrink.py). A record is diff_len, extra_len and seek
+# (signed), then diff_len bytes added to the source bytes at the source cursor, and extra_len bytes
+# copied as they are. The source cursor moves diff_len, then seek.
+
+import os
+import sys
+import struct
+import hashlib
+import binascii
+import argparse
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import at_heatshrink
+
+PATCH_MAGIC = b'ATDP'
+PATCH_VERSION = 1
+HEADER_FORMAT = '<4sBBBBII32s32s'
+HEADER_LEN = struct.calcsize(HEADER_FORMAT)
+RECORD_FORMAT = '<IIi'
+RECORD_LEN = struct.calcsize(RECORD_FORMAT)
+SEED_LEN = 8                    # bytes hashed to find matches in the old image
+SEED_STEP = 4                   # positions of the old image that are indexed
+SEED_MIN = 16                   # shortest exact match a diff region starts from
+APP_ELF_SHA256_OFFSET = 176     # image header, first segment header, esp_app_desc_t up to app_elf_sha256
+
+
+def app_elf_sha256(image):
+    """SHA-256 of the ELF the app image is built from, as esp_ota_get_app_description() tells it."""
+    if len(image) < APP_ELF_SHA256_OFFSET + 32 or bytearray(image[:1])[0] != 0xE9:
+        return None
+    return bytes(image[APP_ELF_SHA256_OFFSET:APP_ELF_SHA256_OFFSET + 32])
+
+
+def _common_len(old, old_pos, new, new_pos):
+    lo, hi = 0, min(len(old) - old_pos, len(new) - new_pos)
+    while lo < hi:
+        mid = (lo + hi + 1) // 2
+        if old[old_pos:old_pos + mid] == new[new_pos:new_pos + mid]:
+            lo = mid
+        else:
+            hi = mid - 1
+    return lo
+
+
+def find_seeds(old, new):
+    """Exact matches (new_pos, old_pos, length) of SEED_MIN bytes at least, in the order of new."""
+    index = {}
+    for pos in range(0, len(old) - SEED_LEN + 1, SEED_STEP):
+        candidates = index.setdefault(old[pos:pos + SEED_LEN], [])
+        if len(candidates) < 4:
+            candidates.append(pos)
+
+    seeds = []
+    last_end = 0
+    offset = None
+    new_pos = 0
+    while new_pos <= len(new) - SEED_LEN:
+        candidates = index.get(new[new_pos:new_pos + SEED_LEN])
+        if not candidates:
+            new_pos += 1
+            continue
+        best_len, best_old = 0, 0
+        for old_pos in candidates:
+            length = _common_len(old, old_pos, new, new_pos)
+            # on a tie the current alignment wins, it goes on without a seek
+            if length > best_len or (length == best_len and old_pos - new_pos == offset):
+                best_len, best_old = length, old_pos
+        back = 0
+        while new_pos - back > last_end and best_old - back > 0 and new[new_pos - back - 1] == old[best_old - back - 1]:
+            back += 1
+        if best_len + back < SEED_MIN:
+            new_pos += 1
+            continue
+        seeds.append((new_pos - back, best_old - back, best_len + back))
+        offset = best_old - new_pos
+        new_pos += best_len
+        last_end = new_pos
+    return seeds
+
+
+def _extend(old, new, new_pos, old_pos, limit, step):
+    """Length of the approximate extension of a match, forward (step 1) or backward (step -1).
+
+    It maximizes 2 * matching bytes - length, so it goes on through regions where most bytes still
+    match, such as code whose addresses moved.
+    """
+    score = best_score = best_len = 0
+    for i in range(limit):
+        n = new_pos + i if step > 0 else new_pos - 1 - i
+        o = old_pos + i if step > 0 else old_pos - 1 - i
+        if o < 0 or o >= len(old):
+            break
+        if old[o] == new[n]:
+            score += 1
+        if 2 * score - (i + 1) > 2 * best_score - best_len:
+            best_score, best_len = score, i + 1
+    return best_len
+
+
+def make_regions(old, new):
+    """Diff regions (start, end, old start) of new, in order, the bytes between them are extra bytes."""
+    regions = []
+    seeds = find_seeds(old, new)
+    prev_seed_end = 0
+    for k, (new_pos, old_pos, length) in enumerate(seeds):
+        offset = old_pos - new_pos
+        start = new_pos - _extend(old, new, new_pos, old_pos, new_pos - prev_seed_end, -1)
+
+        if regions and start < regions[-1][1]:
+            # the previous region reaches into this one, split the overlap where the most bytes match
+            prev_start, prev_end, prev_old = regions[-1]
+            prev_offset = prev_old - prev_start
+            split = start
+            score = best_score = 0
+            for n in range(start, prev_end):
+                score += (old[n + prev_offset] == new[n]) - (old[n + offset] == new[n])
+                if score > best_score:
+                    best_score, split = score, n + 1
+            regions[-1] = (prev_start, split, prev_old)
+            start = split
+
+        end = new_pos + length
+        next_start = seeds[k + 1][0] if k + 1 < len(seeds) else len(new)
+        end += _extend(old, new, end, end + offset, next_start - end, 1)
+        regions.append((start, end, start + offset))
+        prev_seed_end = new_pos + length
+    return regions
+
+
+def create(old, new, window_sz2=at_heatshrink.WINDOW_SZ2_DEFAULT, lookahead_sz2=at_heatshrink.LOOKAHEAD_SZ2_DEFAULT):
+    regions = make_regions(old, new)
+    body = bytearray()
+    old_pos = 0
+
+    # a record starts with its diff bytes, the extra bytes before the first region get an empty one
+    first_start = regions[0][0] if regions else len(new)
+    if first_start > 0:
+        first_old = regions[0][2] if regions else 0
+        body += struct.pack(RECORD_FORMAT, 0, first_start, first_old)
+        body += new[:first_start]
+        old_pos = first_old
+
+    for k, (start, end, old_start) in enumerate(regions):
+        next_start = regions[k + 1][0] if k + 1 < len(regions) else len(new)
+        old_pos = old_start + end - start
+        next_old = regions[k + 1][2] if k + 1 < len(regions) else old_pos
+        body += struct.pack(RECORD_FORMAT, end - start, next_start - end, next_old - old_pos)
+        body += bytearray((new[start + i] - old[old_start + i]) & 0xFF for i in range(end - start))
+        body += new[end:next_start]
+
+    header = struct.pack(HEADER_FORMAT, PATCH_MAGIC, PATCH_VERSION, window_sz2, lookahead_sz2, 0, len(old), len(new),
+                         hashlib.sha256(old).digest(), hashlib.sha256(new).digest())
+    return header + at_heatshrink.compress(bytes(body), window_sz2, lookahead_sz2), len(regions)
+
+
+def parse_header(patch):
+    if len(patch) < HEADER_LEN:
+        raise ValueError("the patch is too short")
+    fields = struct.unpack(HEADER_FORMAT, patch[:HEADER_LEN])
+    if fields[0] != PATCH_MAGIC or fields[1] != PATCH_VERSION:
+        raise ValueError("not a version %d patch" % PATCH_VERSION)
+    keys = ('window_sz2', 'lookahead_sz2', 'reserved', 'source_size', 'target_size', 'source_sha256', 'target_sha256')
+    return dict(zip(keys, fields[2:]))
+
+
+def apply(old, patch):
+    header = parse_header(patch)
+    source_size, target_size = header['source_size'], header['target_size']
+    if len(old) < source_size or hashlib.sha256(old[:source_size]).digest() != header['source_sha256']:
+        raise ValueError("the patch is for another image")
+
+    body = at_heatshrink.decompress(patch[HEADER_LEN:], None, header['window_sz2'], header['lookahead_sz2'])
+    new = bytearray()
+    pos = 0
+    old_pos = 0
+    while len(new) < target_size:
+        if pos + RECORD_LEN > len(body):
+            raise ValueError("the patch is truncated")
+        diff_len, extra_len, seek = struct.unpack(RECORD_FORMAT, body[pos:pos + RECORD_LEN])
+        pos += RECORD_LEN
+        if old_pos + diff_len > source_size or len(new) + diff_len + extra_len > target_size \
+           or pos + diff_len + extra_len > len(body):
+            raise ValueError("the patch is corrupted")
+        new += bytearray((body[pos + i] + old[old_pos + i]) & 0xFF for i in range(diff_len))
+        pos += diff_len
+        new += body[pos:pos + extra_len]
+        pos += extra_len
+        old_pos += diff_len + seek
+        if not 0 <= old_pos <= source_size:
+            raise ValueError("the patch is corrupted")
+
+    if hashlib.sha256(new).digest() != header['target_sha256']:
+        raise ValueError("SHA-256 of the result does not match the patch")
+    return bytes(new)
+
+
+def read_file(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Delta patches between two AT firmware images')
+    subparsers = parser.add_subparsers(dest='command')
+
+    create_parser = subparsers.add_parser('create', help='create a patch from the old image to the new one')
+    create_parser.add_argument("old", help="the image the devices run")
+    create_parser.add_argument("new", help="the image to upgrade to")
+    create_parser.add_argument("patch", help="the patch to write")
+    create_parser.add_argument("--window", type=int, default=at_heatshrink.WINDOW_SZ2_DEFAULT,
+                               help="heatshrink window size, log2, the device allocates 2^window bytes")
+    create_parser.add_argument("--lookahead", type=int, default=at_heatshrink.LOOKAHEAD_SZ2_DEFAULT,
+                               help="heatshrink lookahead size, log2")
+
+    apply_parser = subparsers.add_parser('apply', help='apply a patch as the device does, to check it')
+    apply_parser.add_argument("old", help="the image the patch was created from")
+    apply_parser.add_argument("patch", help="the patch")
+    apply_parser.add_argument("new", help="the image to write")
+
+    info_parser = subparsers.add_parser('info', help='print the header of a patch')
+    info_parser.add_argument("patch", help="the patch")
+
+    args = parser.parse_args()
+
+    if args.command == 'create':
+        old = read_file(args.old)
+        new = read_file(args.new)
+        patch, regions = create(old, new, args.window, args.lookahead)
+        if apply(old, patch) != new:
+            print("the patch does not reproduce %s" % args.new)
+            sys.exit(1)
+        with open(args.patch, 'wb') as f:
+            f.write(patch)
+        print("Create %s finished: %d bytes for %d, %.1f%%, %d diff regions"
+              % (args.patch, len(patch), len(new), len(patch) * 100.0 / len(new), regions))
+        sha256 = app_elf_sha256(old)
+        if sha256:
+            print("base app_elf_sha256 %s" % binascii.hexlify(sha256).decode())
+    elif args.command == 'apply':
+        new = apply(read_file(args.old), read_file(args.patch))
+        with open(args.new, 'wb') as f:
+            f.write(new)
+        print("Create %s finished, sha256 %s" % (args.new, hashlib.sha256(new).hexdigest()))
+    elif args.command == 'info':
+        header = parse_header(read_file(args.patch))
+        for key in ('window_sz2', 'lookahead_sz2', 'source_size', 'target_size'):
+            print("%s: %d" % (key, header[key]))
+        for key in ('source_sha256', 'target_sha256'):
+            print("%s: %s" % (key, binascii.hexlify(header[key]).decode()))
+    else:
+        parser.print_help()
+
+
+if __name__ == '__main__':
+    main()